@@ -1174,6 +1174,19 @@ core.register_chatcommand("shutdown", {
 	end,
 })
 
+core.register_chatcommand("dump_trace", {
+	description = S("Write the recent timeline of the server into the world directory"),
+	privs = {server=true},
+	func = function(name, param)
+		local path = core.dump_trace()
+		if not path then
+			return false, S("Writing the timeline failed. Is profiler_tracing enabled?")
+		end
+		core.log("action", name .. " dumped the server timeline to " .. path)
+		return true, S("Timeline written to @1.", path)
+	end,
+})
+
 core.register_chatcommand("ban", {
 	params = S("[<name>]"),
 	description = S("Ban the IP of a player or show the ban list"),
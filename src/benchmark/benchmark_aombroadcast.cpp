@@ -0,0 +1,141 @@
+/*
+Minetest
+Copyright (C) 2024 Minetest Authors
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "benchmark_setup.h"
+#include "server/aombroadcast.h"
+#include "util/serialize.h"
+#include <algorithm>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+typedef std::vector<std::set<u16>> KnownObjects;
+
+// Every object sends a reliable and an unreliable (position) message per step
+static std::vector<ActiveObjectMessage> makeMessages(u16 object_count)
+{
+	std::vector<ActiveObjectMessage> ret;
+	ret.reserve(object_count * 2);
+	for (u16 id = 1; id <= object_count; id++) {
+		std::string anim(24, '\0');
+		anim[0] = AO_CMD_SET_ANIMATION;
+		ret.emplace_back(id, true, anim);
+		std::string pos(40, '\0');
+		pos[0] = AO_CMD_UPDATE_POSITION;
+		ret.emplace_back(id, false, pos);
+	}
+	return ret;
+}
+
+// `groups` clusters of clients, each knowing an overlapping range of objects.
+// The first object a client knows stands for its own player, which does not
+// get its position updates sent.
+static KnownObjects makeKnownObjects(u16 client_count, u16 object_count, u16 groups)
+{
+	KnownObjects ret(client_count);
+	const u16 range = object_count / groups;
+	for (u16 i = 0; i < client_count; i++) {
+		u16 first = (i % groups) * range;
+		u16 last = std::min<u32>(object_count, first + range * 2);
+		for (u16 id = first + 1; id <= last; id++)
+			ret[i].insert(id);
+	}
+	return ret;
+}
+
+// Mirrors the former per-client routing in Server::AsyncRunStep
+static size_t routePerClient(const std::vector<ActiveObjectMessage> &messages,
+	const KnownObjects &known)
+{
+	std::unordered_map<u16, std::vector<const ActiveObjectMessage *>> buffered;
+	for (const auto &aom : messages)
+		buffered[aom.id].push_back(&aom);
+
+	size_t total = 0;
+	std::string reliable_data, unreliable_data;
+	for (const auto &known_objects : known) {
+		reliable_data.clear();
+		unreliable_data.clear();
+		const u16 own_id = known_objects.empty() ? 0 : *known_objects.begin();
+		for (const auto &it : buffered) {
+			if (known_objects.find(it.first) == known_objects.end())
+				continue;
+			for (const ActiveObjectMessage *aom : it.second) {
+				if (aom->id == own_id && !aom->datastring.empty() &&
+						aom->datastring[0] == AO_CMD_UPDATE_POSITION)
+					continue;
+				std::string &buffer = aom->reliable ? reliable_data : unreliable_data;
+				char idbuf[2];
+				writeU16((u8*) idbuf, aom->id);
+				buffer.append(idbuf, sizeof(idbuf));
+				buffer.append(serializeString16(aom->datastring));
+			}
+		}
+		// Each client gets its own packet
+		total += std::string(reliable_data).size() + std::string(unreliable_data).size();
+	}
+	return total;
+}
+
+static size_t routeBroadcast(const std::vector<ActiveObjectMessage> &messages,
+	const KnownObjects &known)
+{
+	server::AOMessageBroadcast broadcast;
+	for (const auto &aom : messages)
+		broadcast.push(aom);
+	broadcast.encode();
+
+	size_t total = 0;
+	std::set<const std::string *> packets;
+	for (const auto &known_objects : known) {
+		const u16 own_id = known_objects.empty() ? 0 : *known_objects.begin();
+		auto payload = broadcast.build([&] (size_t i,
+				const server::AOMessageBroadcast::Batch &batch) {
+			if (known_objects.find(batch.id) == known_objects.end())
+				return server::AOMessageBroadcast::SELECT_NONE;
+			if (batch.id == own_id && batch.has_position)
+				return server::AOMessageBroadcast::SELECT_NO_POSITION;
+			return server::AOMessageBroadcast::SELECT_ALL;
+		});
+		// Only distinct payloads turn into packets
+		for (const auto &data : payload.data) {
+			if (data && packets.insert(data.get()).second)
+				total += std::string(*data).size();
+		}
+	}
+	return total;
+}
+
+#define BENCH(_clients, _objects, _groups) \
+	BENCHMARK_ADVANCED("per_client_" #_clients "c_" #_objects "o_" #_groups "g")(Catch::Benchmark::Chronometer meter) { \
+		auto messages = makeMessages(_objects); \
+		auto known = makeKnownObjects(_clients, _objects, _groups); \
+		meter.measure([&] { return routePerClient(messages, known); }); \
+	}; \
+	BENCHMARK_ADVANCED("broadcast_" #_clients "c_" #_objects "o_" #_groups "g")(Catch::Benchmark::Chronometer meter) { \
+		auto messages = makeMessages(_objects); \
+		auto known = makeKnownObjects(_clients, _objects, _groups); \
+		meter.measure([&] { return routeBroadcast(messages, known); }); \
+	};
+
+TEST_CASE("benchmark_aombroadcast") {
+	BENCH(100, 2000, 1)
+	BENCH(100, 2000, 8)
+	BENCH(100, 2000, 100)
+}
@@ -18,7 +18,11 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 */
 
 #include "benchmark_setup.h"
+#include "dummygamedef.h"
 #include "mapblock.h"
+#include "nodedef.h"
+#include "serialization.h"
+#include <sstream>
 #include <vector>
 
 typedef std::vector<MapBlock*> MBContainer;
@@ -180,7 +184,63 @@ static u32 workOnBoth(const MBContainer &vec)
 		freeAll(vec); \
 	};
 
+// A block of terrain with some variety, as saved to disk
+static std::string makeSerializedBlock(IGameDef *gamedef, content_t c_stone,
+	content_t c_dirt)
+{
+	MapBlock block({0, 0, 0}, gamedef);
+	v3s16 p;
+	for (p.Z = 0; p.Z < MAP_BLOCKSIZE; p.Z++)
+	for (p.Y = 0; p.Y < MAP_BLOCKSIZE; p.Y++)
+	for (p.X = 0; p.X < MAP_BLOCKSIZE; p.X++) {
+		const s16 height = 6 + (p.X * 3 + p.Z * 5) % 5;
+		MapNode n(CONTENT_AIR, 0xf0);
+		if (p.Y < height - 2)
+			n = MapNode(c_stone);
+		else if (p.Y < height)
+			n = MapNode(c_dirt, 0, (p.X + p.Z) & 3);
+		block.setNodeNoCheck(p, n);
+	}
+
+	std::ostringstream os(std::ios_base::binary);
+	block.serialize(os, SER_FMT_VER_HIGHEST_WRITE, true, -1);
+	return os.str();
+}
+
+static void benchDeserialize()
+{
+	DummyGameDef gamedef;
+	NodeDefManager *ndef = gamedef.getWritableNodeDefManager();
+	ContentFeatures f;
+	f.name = "stone";
+	const content_t c_stone = ndef->set(f.name, f);
+	f.name = "dirt";
+	const content_t c_dirt = ndef->set(f.name, f);
+
+	const std::string data = makeSerializedBlock(&gamedef, c_stone, c_dirt);
+	const u8 version = SER_FMT_VER_HIGHEST_WRITE;
+	MapBlock block({0, 0, 0}, &gamedef);
+
+	BENCHMARK_ADVANCED("deserialize_stream")(Catch::Benchmark::Chronometer meter) {
+		meter.measure([&] {
+			std::istringstream is(data, std::ios_base::binary);
+			block.deSerialize(is, version, true);
+			return block.getNodeNoCheck(0, 0, 0).getContent();
+		});
+	};
+
+	BENCHMARK_ADVANCED("deserialize_buffer")(Catch::Benchmark::Chronometer meter) {
+		meter.measure([&] {
+			block.deSerialize(reinterpret_cast<const u8 *>(data.data()), data.size(),
+				version, true);
+			return block.getNodeNoCheck(0, 0, 0).getContent();
+		});
+	};
+}
+
 TEST_CASE("benchmark_mapblock") {
+	benchDeserialize();
+
 	BENCH1(900)
 	BENCH1(2200)
 	BENCH1(7500) // <- default client_mapblock_limit
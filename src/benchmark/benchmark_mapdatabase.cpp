@@ -0,0 +1,116 @@
+/*
+Minetest
+Copyright (C) 2024 Minetest Authors
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "benchmark_setup.h"
+#include "database/database.h"
+#include "filesys.h"
+#include "map.h"
+#include "porting.h"
+#include "settings.h"
+#include <memory>
+#include <vector>
+
+// The area around a player, as loaded when joining
+static std::vector<v3s16> makePositions(s16 offset)
+{
+	std::vector<v3s16> pos;
+	v3s16 p;
+	for (p.Z = -4; p.Z < 4; p.Z++)
+	for (p.Y = -4; p.Y < 4; p.Y++)
+	for (p.X = -4; p.X < 4; p.X++)
+		pos.push_back(p + v3s16(offset, 0, 0));
+	return pos;
+}
+
+// Sized like compressed blocks, half of it repetitive
+static std::string makeBlockData(u32 seed)
+{
+	std::string data(1024 + seed % 2048, '\0');
+	u32 x = seed * 2654435761U + 1;
+	for (size_t i = 0; i < data.size(); i++) {
+		x = x * 1103515245U + 12345U;
+		data[i] = i % 2 ? (char)(x >> 24) : 'a';
+	}
+	return data;
+}
+
+static void benchDatabase(const std::string &backend, const std::string &world_path)
+{
+	Settings conf;
+	std::unique_ptr<MapDatabase> db(ServerMap::createDatabase(backend, world_path, conf));
+
+	const std::vector<v3s16> pos = makePositions(0);
+	const std::vector<v3s16> missing = makePositions(1000);
+	std::vector<std::string> data;
+	for (size_t i = 0; i < pos.size(); i++)
+		data.push_back(makeBlockData(i));
+
+	BENCHMARK_ADVANCED("save_" + backend)(Catch::Benchmark::Chronometer meter) {
+		meter.measure([&] {
+			db->beginSave();
+			for (size_t i = 0; i < pos.size(); i++)
+				db->saveBlock(pos[i], data[i]);
+			db->endSave();
+		});
+	};
+
+	BENCHMARK_ADVANCED("load_" + backend)(Catch::Benchmark::Chronometer meter) {
+		std::string block;
+		meter.measure([&] {
+			size_t total = 0;
+			for (const v3s16 &p : pos) {
+				db->loadBlock(p, &block);
+				total += block.size();
+			}
+			return total;
+		});
+	};
+
+	BENCHMARK_ADVANCED("load_batch_" + backend)(Catch::Benchmark::Chronometer meter) {
+		std::vector<std::string> blocks;
+		meter.measure([&] {
+			db->loadBlocks(pos, blocks);
+			return blocks.size();
+		});
+	};
+
+	BENCHMARK_ADVANCED("load_missing_" + backend)(Catch::Benchmark::Chronometer meter) {
+		std::string block;
+		meter.measure([&] {
+			size_t total = 0;
+			for (const v3s16 &p : missing) {
+				db->loadBlock(p, &block);
+				total += block.size();
+			}
+			return total;
+		});
+	};
+}
+
+TEST_CASE("benchmark_mapdatabase")
+{
+	const std::string world_path = fs::TempPath() + DIR_DELIM "mt_bench_mapdatabase_"
+		+ std::to_string(porting::getTimeMs());
+	REQUIRE(fs::CreateAllDirs(world_path));
+
+	benchDatabase("sqlite3", world_path);
+	benchDatabase("regions", world_path);
+
+	fs::RecursiveDelete(world_path);
+}
@@ -0,0 +1,415 @@
+/*
+Minetest
+Copyright (C) 2024 Minetest Authors
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "benchmark_server.h"
+#include "emerge.h"
+#include "filesys.h"
+#include "log.h"
+#include "map.h"
+#include "mapgen/mapgen.h"
+#include "mapgen/mg_ore.h"
+#include "porting.h"
+#include "server.h"
+#include "serverenvironment.h"
+#include <iomanip>
+#include <sstream>
+
+/*
+	Times Mapgen::makeChunk() of the individual mapgens on a fixed set of
+	chunks. The chunks are never written back to the map, so every run
+	generates them from scratch.
+*/
+
+// A small game with the kind of content most games register
+static const char *fixture_mod_lua = R"(
+local function liquid(name)
+	core.register_node("bench_mapgen:" .. name .. "_source", {
+		drawtype = "liquid",
+		walkable = false,
+		liquidtype = "source",
+		liquid_alternative_source = "bench_mapgen:" .. name .. "_source",
+		liquid_alternative_flowing = "bench_mapgen:" .. name .. "_flowing",
+	})
+	core.register_node("bench_mapgen:" .. name .. "_flowing", {
+		drawtype = "flowingliquid",
+		walkable = false,
+		paramtype2 = "flowingliquid",
+		liquidtype = "flowing",
+		liquid_alternative_source = "bench_mapgen:" .. name .. "_source",
+		liquid_alternative_flowing = "bench_mapgen:" .. name .. "_flowing",
+	})
+end
+
+for _, name in ipairs({"stone", "cobble", "mossycobble", "dirt", "dirt_with_grass",
+		"dirt_with_snow", "sand", "desert_sand", "gravel", "snow", "ice",
+		"stone_with_coal", "stone_with_iron", "tree", "leaves"}) do
+	core.register_node("bench_mapgen:" .. name, {})
+end
+core.register_node("bench_mapgen:grass", {drawtype = "plantlike", walkable = false})
+liquid("water")
+liquid("river_water")
+liquid("lava")
+
+core.register_alias("mapgen_stone", "bench_mapgen:stone")
+core.register_alias("mapgen_water_source", "bench_mapgen:water_source")
+core.register_alias("mapgen_river_water_source", "bench_mapgen:river_water_source")
+core.register_alias("mapgen_lava_source", "bench_mapgen:lava_source")
+core.register_alias("mapgen_cobble", "bench_mapgen:cobble")
+
+core.register_biome({
+	name = "grassland",
+	node_top = "bench_mapgen:dirt_with_grass", depth_top = 1,
+	node_filler = "bench_mapgen:dirt", depth_filler = 3,
+	node_riverbed = "bench_mapgen:sand", depth_riverbed = 2,
+	node_dungeon = "bench_mapgen:cobble",
+	node_dungeon_alt = "bench_mapgen:mossycobble",
+	y_max = 31000, y_min = 4,
+	heat_point = 50, humidity_point = 50,
+})
+core.register_biome({
+	name = "desert",
+	node_top = "bench_mapgen:desert_sand", depth_top = 1,
+	node_filler = "bench_mapgen:desert_sand", depth_filler = 2,
+	y_max = 31000, y_min = 4,
+	heat_point = 90, humidity_point = 10,
+})
+core.register_biome({
+	name = "taiga",
+	node_dust = "bench_mapgen:snow",
+	node_top = "bench_mapgen:dirt_with_snow", depth_top = 1,
+	node_filler = "bench_mapgen:dirt", depth_filler = 3,
+	node_water_top = "bench_mapgen:ice", depth_water_top = 2,
+	y_max = 31000, y_min = 4,
+	heat_point = 10, humidity_point = 60,
+})
+core.register_biome({
+	name = "ocean",
+	node_top = "bench_mapgen:sand", depth_top = 1,
+	node_filler = "bench_mapgen:sand", depth_filler = 3,
+	y_max = 3, y_min = -31000,
+	heat_point = 50, humidity_point = 50,
+})
+
+core.register_ore({
+	ore_type = "scatter",
+	ore = "bench_mapgen:stone_with_coal",
+	wherein = "bench_mapgen:stone",
+	clust_scarcity = 8 * 8 * 8, clust_num_ores = 9, clust_size = 3,
+	y_max = 31000, y_min = -31000,
+})
+core.register_ore({
+	ore_type = "blob",
+	ore = "bench_mapgen:gravel",
+	wherein = "bench_mapgen:stone",
+	clust_scarcity = 16 * 16 * 16, clust_size = 5,
+	y_max = 31000, y_min = -31000,
+	noise_threshold = 0.0,
+	noise_params = {offset = 0.5, scale = 0.2, spread = {x = 5, y = 5, z = 5},
+		seed = 766, octaves = 1, persist = 0.0},
+})
+core.register_ore({
+	ore_type = "sheet",
+	ore = "bench_mapgen:dirt",
+	wherein = "bench_mapgen:stone",
+	column_height_min = 2, column_height_max = 4,
+	y_max = 31000, y_min = -31000,
+	noise_threshold = 0.6,
+	noise_params = {offset = 0, scale = 1, spread = {x = 100, y = 100, z = 100},
+		seed = 17676, octaves = 2, persist = 0.6},
+})
+core.register_ore({
+	ore_type = "vein",
+	ore = "bench_mapgen:stone_with_iron",
+	wherein = "bench_mapgen:stone",
+	y_max = 31000, y_min = -31000,
+	random_factor = 0,
+	noise_threshold = 0.9,
+	noise_params = {offset = 0, scale = 1, spread = {x = 100, y = 100, z = 100},
+		seed = 25391, octaves = 2, persist = 0.5},
+})
+
+-- Games commonly have dozens of ores
+for i = 1, 12 do
+	local y_max = 64 - i * 200
+	core.register_ore({
+		ore_type = "scatter",
+		ore = "bench_mapgen:stone_with_coal",
+		wherein = "bench_mapgen:stone",
+		clust_scarcity = 12 * 12 * 12, clust_num_ores = 8, clust_size = 3,
+		y_max = y_max, y_min = -31000,
+	})
+	core.register_ore({
+		ore_type = "blob",
+		ore = "bench_mapgen:gravel",
+		wherein = {"bench_mapgen:stone", "bench_mapgen:dirt"},
+		clust_scarcity = 24 * 24 * 24, clust_size = 4,
+		y_max = y_max, y_min = -31000,
+		noise_threshold = 0.0,
+		noise_params = {offset = 0.5, scale = 0.2, spread = {x = 5, y = 5, z = 5},
+			seed = 766 + i, octaves = 1, persist = 0.0},
+	})
+	core.register_ore({
+		ore_type = "sheet",
+		ore = "bench_mapgen:gravel",
+		wherein = "bench_mapgen:stone",
+		column_height_min = 1, column_height_max = 3,
+		y_max = y_max, y_min = -31000,
+		noise_threshold = 0.8,
+		noise_params = {offset = 0, scale = 1, spread = {x = 80, y = 80, z = 80},
+			seed = 1000 + i, octaves = 2, persist = 0.6},
+	})
+	core.register_ore({
+		ore_type = "vein",
+		ore = "bench_mapgen:stone_with_iron",
+		wherein = "bench_mapgen:stone",
+		y_max = y_max, y_min = -31000,
+		random_factor = 0.2,
+		noise_threshold = 0.95,
+		noise_params = {offset = 0, scale = 1, spread = {x = 60, y = 60, z = 60},
+			seed = 2000 + i, octaves = 2, persist = 0.5},
+	})
+end
+
+core.register_decoration({
+	deco_type = "simple",
+	place_on = {"bench_mapgen:dirt_with_grass"},
+	decoration = "bench_mapgen:grass",
+	fill_ratio = 0.1,
+	y_max = 31000, y_min = 1,
+})
+
+local tree = {size = {x = 3, y = 5, z = 3}, data = {}}
+for z = 0, 2 do
+for y = 0, 4 do
+for x = 0, 2 do
+	local node = {name = "air", prob = 0}
+	if x == 1 and z == 1 and y < 4 then
+		node = {name = "bench_mapgen:tree", force_place = true}
+	elseif y >= 2 then
+		node = {name = "bench_mapgen:leaves", prob = 200}
+	end
+	tree.data[#tree.data + 1] = node
+end
+end
+end
+core.register_decoration({
+	deco_type = "schematic",
+	place_on = {"bench_mapgen:dirt_with_grass", "bench_mapgen:dirt_with_snow"},
+	schematic = tree,
+	noise_params = {offset = 0.01, scale = 0.02, spread = {x = 250, y = 250, z = 250},
+		seed = 2, octaves = 3, persist = 0.66},
+	flags = "place_center_x, place_center_z",
+	rotation = "random",
+	y_max = 31000, y_min = 1,
+})
+)";
+
+static const char *mapgen_names[] = {
+	"v5", "v7", "valleys", "carpathian", "fractal", "flat",
+};
+
+// Chunks around the surface and below it, where caves and ores are
+static const v3s16 chunk_positions[] = {
+	{0, 0, 0}, {5, 0, 0}, {0, 0, 5}, {-5, 0, -5},
+	{0, -5, 0}, {5, -5, 0}, {0, -5, 5}, {-5, -5, -5},
+};
+
+class MapgenBenchmark
+{
+public:
+	// The chunks are generated over and over again, so by default they skip
+	// the column cache, which would always have their 2D noise.
+	MapgenBenchmark(const std::string &world_path, const std::string &mg_name,
+		u32 column_cache_size = 0)
+	{
+		makeBenchmarkWorld(world_path, "bench_mapgen", fixture_mod_lua,
+			"mg_name = " + mg_name + "\nseed = 1\n[end_of_params]\n");
+		{
+			SettingsOverride settings;
+			settings.set("mapgen_column_cache_size", std::to_string(column_cache_size));
+			m_server = std::make_unique<BenchmarkServer>(world_path);
+		}
+		m_mapgen = m_server->getMapgen();
+
+		for (v3s16 p : chunk_positions)
+			addChunk(p);
+	}
+
+	// Creates the (empty) blocks the voxel manipulator of the chunk containing
+	// the block 'p' is filled from, returns the index for prepareChunk()
+	size_t addChunk(v3s16 p)
+	{
+		BlockMakeData data;
+		REQUIRE(m_server->get()->getEnv().getServerMap().initBlockMake(p, &data));
+		m_chunks.emplace_back(data.blockpos_min, data.blockpos_max);
+		return m_chunks.size() - 1;
+	}
+
+	// Returns the data for generating the i-th chunk from scratch
+	std::unique_ptr<BlockMakeData> prepareChunk(size_t i)
+	{
+		const auto &chunk = m_chunks[i % m_chunks.size()];
+		auto data = std::make_unique<BlockMakeData>();
+		data->blockpos_min = chunk.first;
+		data->blockpos_max = chunk.second;
+		data->nodedef = m_server->get()->getNodeDefManager();
+		data->vmanip = new MMVManip(&m_server->get()->getEnv().getServerMap());
+		data->vmanip->initialEmerge(chunk.first - v3s16(1, 1, 1),
+			chunk.second + v3s16(1, 1, 1), false);
+		return data;
+	}
+
+	// Like prepareChunk(), with the mapchunk filled with one node
+	std::unique_ptr<BlockMakeData> prepareFilledChunk(size_t i, content_t c)
+	{
+		auto data = prepareChunk(i);
+		MMVManip *vm = data->vmanip;
+		const v3s16 nmin = data->blockpos_min * MAP_BLOCKSIZE;
+		const v3s16 nmax = (data->blockpos_max + 1) * MAP_BLOCKSIZE - v3s16(1, 1, 1);
+		for (s16 z = nmin.Z; z <= nmax.Z; z++)
+		for (s16 y = nmin.Y; y <= nmax.Y; y++) {
+			u32 vi = vm->m_area.index(nmin.X, y, z);
+			for (s16 x = nmin.X; x <= nmax.X; x++, vi++)
+				vm->m_data[vi] = MapNode(c);
+		}
+		return data;
+	}
+
+	Mapgen *getMapgen() { return m_mapgen; }
+	const NodeDefManager *getNodeDefManager() { return m_server->get()->getNodeDefManager(); }
+
+private:
+	std::unique_ptr<BenchmarkServer> m_server;
+	Mapgen *m_mapgen = nullptr;
+	std::vector<std::pair<v3s16, v3s16>> m_chunks;
+};
+
+static void reportPhases(const std::string &mg_name, const MapgenPhaseTimes &times)
+{
+	const u64 total_us = times.getTotalUs();
+	if (times.chunks == 0 || total_us == 0)
+		return;
+
+	std::ostringstream os;
+	os << std::fixed << std::setprecision(2);
+	os << "mapgen " << mg_name << ": " << times.chunks << " chunks, "
+		<< times.chunks * 1000000.0 / total_us << " chunks/s per core" << std::endl;
+	for (int i = 0; i < MGPHASE_COUNT; i++) {
+		os << "  " << std::left << std::setw(12)
+			<< Mapgen::getPhaseName((MapgenPhase)i) << std::right
+			<< std::setw(9) << times.time_us[i] / 1000.0 / times.chunks << " ms/chunk"
+			<< std::setw(7) << times.time_us[i] * 100.0 / total_us << " %" << std::endl;
+	}
+	rawstream << os.str();
+}
+
+TEST_CASE("benchmark_mapgen")
+{
+	const std::string root_path = fs::TempPath() + DIR_DELIM "mt_bench_mapgen_"
+		+ std::to_string(porting::getTimeMs());
+
+	for (const char *mg_name : mapgen_names) {
+		MapgenBenchmark bench(root_path + DIR_DELIM + mg_name, mg_name);
+		Mapgen *mapgen = bench.getMapgen();
+
+		// Generate every chunk once so that the caches are warm
+		for (size_t i = 0; i < ARRLEN(chunk_positions); i++)
+			mapgen->makeChunk(bench.prepareChunk(i).get());
+		mapgen->phase_times = MapgenPhaseTimes();
+
+		BENCHMARK_ADVANCED(std::string("makeChunk_") + mg_name)(
+				Catch::Benchmark::Chronometer meter) {
+			std::vector<std::unique_ptr<BlockMakeData>> data(meter.runs());
+			for (size_t i = 0; i < data.size(); i++)
+				data[i] = bench.prepareChunk(i);
+			meter.measure([&] (int i) { mapgen->makeChunk(data[i].get()); });
+		};
+
+		reportPhases(mg_name, mapgen->phase_times);
+	}
+
+	fs::RecursiveDelete(root_path);
+}
+
+static void benchPlaceAllOres(MapgenBenchmark &bench, const std::string &name,
+	content_t c_fill)
+{
+	Mapgen *mapgen = bench.getMapgen();
+	OreManager *oremgr = mapgen->m_emerge->oremgr;
+
+	BENCHMARK_ADVANCED(name)(Catch::Benchmark::Chronometer meter) {
+		std::vector<std::unique_ptr<BlockMakeData>> data(meter.runs());
+		for (size_t i = 0; i < data.size(); i++)
+			data[i] = bench.prepareFilledChunk(i, c_fill);
+		meter.measure([&] (int i) {
+			BlockMakeData *d = data[i].get();
+			mapgen->vm = d->vmanip;
+			oremgr->placeAllOres(mapgen, i, d->blockpos_min * MAP_BLOCKSIZE,
+				(d->blockpos_max + 1) * MAP_BLOCKSIZE - v3s16(1, 1, 1));
+		});
+	};
+}
+
+TEST_CASE("benchmark_mapgen_ores")
+{
+	const std::string world_path = fs::TempPath() + DIR_DELIM "mt_bench_ores_"
+		+ std::to_string(porting::getTimeMs());
+	{
+		MapgenBenchmark bench(world_path, "v7");
+		// Fills the biomemap
+		bench.getMapgen()->makeChunk(bench.prepareChunk(0).get());
+
+		const NodeDefManager *ndef = bench.getNodeDefManager();
+		benchPlaceAllOres(bench, "placeAllOres_stone", ndef->getId("bench_mapgen:stone"));
+		benchPlaceAllOres(bench, "placeAllOres_air", CONTENT_AIR);
+	}
+	fs::RecursiveDelete(world_path);
+}
+
+TEST_CASE("benchmark_mapgen_column")
+{
+	const std::string root_path = fs::TempPath() + DIR_DELIM "mt_bench_mapgen_column_"
+		+ std::to_string(porting::getTimeMs());
+
+	for (u32 cache_size : {0, 128}) {
+		const std::string name = cache_size ? "cached" : "uncached";
+		MapgenBenchmark bench(root_path + DIR_DELIM + name, "v7", cache_size);
+		Mapgen *mapgen = bench.getMapgen();
+		s16 column = 0;
+
+		// Each run generates a new stack of four mapchunks, top to bottom
+		BENCHMARK_ADVANCED("makeChunk_v7_stack_" + name)(
+				Catch::Benchmark::Chronometer meter) {
+			std::vector<std::vector<std::unique_ptr<BlockMakeData>>> data(meter.runs());
+			for (auto &stack : data) {
+				column++;
+				for (s16 y = 1; y >= -2; y--) {
+					size_t i = bench.addChunk(v3s16(column * 5, y * 5, 0));
+					stack.push_back(bench.prepareChunk(i));
+				}
+			}
+			meter.measure([&] (int i) {
+				for (auto &d : data[i])
+					mapgen->makeChunk(d.get());
+			});
+		};
+	}
+
+	fs::RecursiveDelete(root_path);
+}
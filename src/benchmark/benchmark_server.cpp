@@ -0,0 +1,67 @@
+/*
+Minetest
+Copyright (C) 2024 Minetest Authors
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "benchmark_server.h"
+#include "emerge.h"
+#include "filesys.h"
+#include "settings.h"
+
+void makeBenchmarkWorld(const std::string &world_path, const std::string &mod_name,
+	const std::string &mod_lua, const std::string &map_meta)
+{
+	const std::string game_path = world_path + DIR_DELIM "game";
+	const std::string mod_path = world_path + DIR_DELIM "worldmods" DIR_DELIM + mod_name;
+	REQUIRE(fs::CreateAllDirs(game_path));
+	REQUIRE(fs::CreateAllDirs(mod_path));
+	REQUIRE(fs::safeWriteToFile(game_path + DIR_DELIM "game.conf", "title = Benchmark\n"));
+	REQUIRE(fs::safeWriteToFile(world_path + DIR_DELIM "map_meta.txt", map_meta));
+	REQUIRE(fs::safeWriteToFile(mod_path + DIR_DELIM "init.lua", mod_lua));
+}
+
+void SettingsOverride::set(const std::string &name, const std::string &value)
+{
+	m_old.emplace_back(name, g_settings->get(name));
+	g_settings->set(name, value);
+}
+
+SettingsOverride::~SettingsOverride()
+{
+	for (auto it = m_old.rbegin(); it != m_old.rend(); ++it)
+		g_settings->set(it->first, it->second);
+}
+
+BenchmarkServer::BenchmarkServer(const std::string &world_path) :
+	m_server(std::make_unique<Server>(world_path,
+		SubgameSpec("benchmark", world_path + DIR_DELIM "game"),
+		false, Address(), true))
+{
+	m_server->init();
+}
+
+ClientInterface &BenchmarkServer::getClients()
+{
+	return m_server->m_clients;
+}
+
+Mapgen *BenchmarkServer::getMapgen()
+{
+	EmergeManager *emerge = m_server->getEmergeManager();
+	REQUIRE(!emerge->m_mapgens.empty());
+	return emerge->m_mapgens[0];
+}
@@ -0,0 +1,68 @@
+/*
+Minetest
+Copyright (C) 2024 Minetest Authors
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#pragma once
+
+#include "benchmark_setup.h"
+#include "server.h"
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+class Mapgen;
+
+/*
+	Shared setup of the benchmarks that run a real Server without network
+	on a temporary world.
+*/
+
+// Creates a world whose game consists of the single world mod 'mod_name'.
+// 'map_meta' is the contents of map_meta.txt.
+void makeBenchmarkWorld(const std::string &world_path, const std::string &mod_name,
+	const std::string &mod_lua, const std::string &map_meta);
+
+// Restores the overridden settings when going out of scope
+class SettingsOverride
+{
+public:
+	void set(const std::string &name, const std::string &value);
+	~SettingsOverride();
+
+private:
+	std::vector<std::pair<std::string, std::string>> m_old;
+};
+
+// A Server without network on a world made by makeBenchmarkWorld()
+class BenchmarkServer
+{
+public:
+	BenchmarkServer(const std::string &world_path);
+
+	Server *get() { return m_server.get(); }
+	Server *operator->() { return m_server.get(); }
+
+	// Internals the benchmarks drive directly
+	ClientInterface &getClients();
+	// The mapgen of the first emerge thread
+	Mapgen *getMapgen();
+
+private:
+	std::unique_ptr<Server> m_server;
+};
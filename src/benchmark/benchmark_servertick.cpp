@@ -0,0 +1,254 @@
+/*
+Minetest
+Copyright (C) 2024 Minetest Authors
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "benchmark_server.h"
+#include "emerge.h"
+#include "filesys.h"
+#include "log.h"
+#include "network/networkprotocol.h"
+#include "porting.h"
+#include "profiler.h"
+#include "serialization.h"
+#include "server.h"
+#include "server/player_sao.h"
+#include "util/string.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+/*
+	Runs a real Server without network: simulated players are registered with
+	the ClientInterface like after a handshake and walk along fixed paths,
+	the packets sent to them are dropped by the unbound connection.
+*/
+
+// Same as dedicated_server_step
+static constexpr float BENCH_DTIME = 0.09f;
+
+static const char *fixture_map_meta =
+	"mg_name = flat\n"
+	"seed = 1\n"
+	"water_level = 1\n"
+	"mg_flags = nocaves, nodungeons, light, nodecorations, biomes, ores\n"
+	"mgflat_spflags = nolakes, nohills, nocaverns\n"
+	"[end_of_params]\n";
+
+// Something for SendBlocks, ABMs and SAO stepping to do
+static const char *fixture_mod_lua = R"(
+core.register_node("bench_tick:stone", {})
+core.register_node("bench_tick:water", {})
+core.register_node("bench_tick:flower", {drawtype = "plantlike", walkable = false})
+core.register_alias("mapgen_stone", "bench_tick:stone")
+core.register_alias("mapgen_water_source", "bench_tick:water")
+core.register_alias("mapgen_river_water_source", "bench_tick:water")
+
+core.register_abm({
+	nodenames = {"bench_tick:stone"},
+	neighbors = {"air"},
+	interval = 1,
+	chance = 200,
+	action = function(pos)
+		pos.y = pos.y + 1
+		if core.get_node(pos).name == "air" then
+			core.set_node(pos, {name = "bench_tick:flower"})
+		end
+	end,
+})
+
+core.register_abm({
+	nodenames = {"bench_tick:flower"},
+	interval = 1,
+	chance = 20,
+	action = function(pos)
+		core.remove_node(pos)
+	end,
+})
+
+core.register_entity("bench_tick:mob", {
+	initial_properties = {
+		physical = true,
+		collisionbox = {-0.3, 0, -0.3, 0.3, 1, 0.3},
+		visual = "cube",
+	},
+	on_step = function(self, dtime)
+		self._t = (self._t or math.random() * 6) + dtime
+		self.object:set_velocity({x = math.cos(self._t) * 2, y = -5, z = math.sin(self._t) * 2})
+	end,
+})
+
+core.register_on_joinplayer(function(player)
+	local pos = player:get_pos()
+	for i = 1, 5 do
+		core.add_entity(vector.offset(pos, i * 2 - 6, 1, 3), "bench_tick:mob")
+	end
+end)
+)";
+
+class ServerTickBenchmark
+{
+public:
+	ServerTickBenchmark(const std::string &world_path, u16 player_count) :
+		m_server(world_path),
+		m_player_count(player_count)
+	{
+		for (u16 i = 0; i < player_count; i++)
+			addPlayer(i);
+	}
+
+	// Generates or loads everything the players can see on their paths
+	void prepareArea(s16 radius)
+	{
+		std::atomic<u32> remaining(0);
+		auto callback = [] (v3s16, EmergeAction, void *param) {
+			(*(std::atomic<u32> *)param)--;
+		};
+
+		v3s16 p;
+		for (p.X = -radius; p.X <= radius; p.X++)
+		for (p.Y = -radius / 2; p.Y <= radius / 2; p.Y++)
+		for (p.Z = -radius; p.Z <= radius; p.Z++) {
+			remaining++;
+			if (!m_server->getEmergeManager()->enqueueBlockEmergeEx(p, PEER_ID_INEXISTENT,
+					BLOCK_EMERGE_ALLOW_GEN | BLOCK_EMERGE_FORCE_QUEUE,
+					callback, &remaining))
+				remaining--;
+		}
+
+		m_server->getEmergeManager()->startThreads();
+		while (remaining > 0)
+			sleep_ms(10);
+	}
+
+	// Moves the players along their paths and runs one server step
+	void step()
+	{
+		m_time += BENCH_DTIME;
+		{
+			MutexAutoLock envlock(m_server->m_env_mutex);
+			for (u16 i = 0; i < m_player_count; i++) {
+				PlayerSAO *sao = m_server->getPlayerSAO(getPeerId(i));
+				if (sao)
+					sao->setBasePosition(getPathPosition(i, m_time));
+			}
+		}
+
+		const u64 t0 = porting::getTimeUs();
+		m_server->AsyncRunStep(BENCH_DTIME);
+		m_step_times_us.push_back(porting::getTimeUs() - t0);
+	}
+
+	void report(std::ostream &os)
+	{
+		if (m_step_times_us.empty())
+			return;
+		std::sort(m_step_times_us.begin(), m_step_times_us.end());
+		auto percentile = [&] (float p) {
+			return m_step_times_us[(size_t)((m_step_times_us.size() - 1) * p)] / 1000.0f;
+		};
+		os << m_player_count << " players, " << m_step_times_us.size()
+			<< " steps: p50 " << percentile(0.5f) << " ms, p99 "
+			<< percentile(0.99f) << " ms, max " << percentile(1.0f) << " ms"
+			<< std::endl;
+	}
+
+private:
+	static session_t getPeerId(u16 i) { return PEER_ID_SERVER + 1 + i; }
+
+	// Players walk in circles of different sizes around the origin
+	v3f getPathPosition(u16 i, float time) const
+	{
+		const float radius = 16.0f + (i % 4) * 8.0f;
+		const float speed = 4.0f; // nodes per second
+		const float angle = 2.0f * M_PI * i / m_player_count + time * speed / radius;
+		// The flat mapgen's ground level is 8
+		return v3f(std::cos(angle) * radius, 9.0f, std::sin(angle) * radius) * BS;
+	}
+
+	// Does the same as the handshake in the packet handlers
+	void addPlayer(u16 i)
+	{
+		const session_t peer_id = getPeerId(i);
+		ClientInterface &clients = m_server.getClients();
+
+		clients.CreateClient(peer_id);
+		{
+			ClientInterface::AutoLock clientlock(clients);
+			RemoteClient *client = clients.lockedGetClientNoEx(peer_id, CS_Created);
+			REQUIRE(client);
+			client->setName("bench" + itos(i));
+			client->net_proto_version = LATEST_PROTOCOL_VERSION;
+			client->setPendingSerializationVersion(SER_FMT_VER_HIGHEST_WRITE);
+		}
+		clients.event(peer_id, CSE_Hello);
+		clients.event(peer_id, CSE_AuthAccept);
+		clients.event(peer_id, CSE_GotInit2);
+		clients.event(peer_id, CSE_SetDefinitionsSent);
+		{
+			MutexAutoLock envlock(m_server->m_env_mutex);
+			PlayerSAO *sao = m_server->StageTwoClientInit(peer_id);
+			REQUIRE(sao);
+			sao->setBasePosition(getPathPosition(i, 0.0f));
+		}
+		clients.event(peer_id, CSE_SetClientReady);
+	}
+
+	BenchmarkServer m_server;
+	const u16 m_player_count;
+	float m_time = 0.0f;
+	std::vector<u64> m_step_times_us;
+};
+
+static void benchServerTick(const std::string &world_path, u16 player_count)
+{
+	ServerTickBenchmark bench(world_path, player_count);
+	// Path radius + send distance
+	bench.prepareArea(3 + 6 + 1);
+
+	// Let the players join, load the active blocks and spawn the entities
+	for (int i = 0; i < 50; i++)
+		bench.step();
+
+	g_profiler->clear();
+	BENCHMARK_ADVANCED("server_step_" + std::to_string(player_count) + "p")(
+			Catch::Benchmark::Chronometer meter) {
+		meter.measure([&] { bench.step(); });
+	};
+
+	rawstream << "Per-phase timings (" << player_count << " players):" << std::endl;
+	g_profiler->print(rawstream);
+	bench.report(rawstream);
+}
+
+TEST_CASE("benchmark_servertick")
+{
+	const std::string world_path = fs::TempPath() + DIR_DELIM "mt_bench_servertick_"
+		+ std::to_string(porting::getTimeMs());
+	makeBenchmarkWorld(world_path, "bench_tick", fixture_mod_lua, fixture_map_meta);
+
+	// Keep the area that has to be prepared small
+	SettingsOverride settings;
+	settings.set("max_block_send_distance", "6");
+	settings.set("max_block_generate_distance", "6");
+
+	// The first run generates the map, the second one loads it from the database
+	benchServerTick(world_path, 10);
+	benchServerTick(world_path, 50);
+
+	fs::RecursiveDelete(world_path);
+}
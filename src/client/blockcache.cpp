@@ -0,0 +1,294 @@
+/*
+Minetest
+Copyright (C) 2024 Minetest Authors
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "blockcache.h"
+#include <algorithm>
+#include "database/database-sqlite3.h"
+#include "filesys.h"
+#include "log.h"
+#include "serialization.h"
+#include "util/numeric.h"
+#include "util/serialize.h"
+
+/*
+	Format of a cache entry:
+	u64 hash (see hashSerializedBlock())
+	u8[...] block data as received from the server
+*/
+#define BLOCK_CACHE_HEADER_SIZE 8
+
+/*
+	Format of the index file, so that the hashes are known without reading
+	the cached blocks:
+	u8 version (BLOCK_CACHE_INDEX_VERSION)
+	for each block, most recently used first:
+		v3s16 pos
+		u64 hash
+	Blocks of the database that are missing in it are read once when
+	their hash is needed.
+*/
+#define BLOCK_CACHE_INDEX_VERSION 1
+#define BLOCK_CACHE_INDEX_RECORD_SIZE (6 + 8)
+
+#define UNANNOUNCED_AREA_SIZE 8
+
+ClientBlockCache::ClientBlockCache(const std::string &savedir, size_t max_blocks) :
+	m_db(std::make_unique<MapDatabaseSQLite3>(savedir)),
+	m_index_path(savedir + DIR_DELIM + "index.bin"),
+	m_max_blocks(max_blocks)
+{
+	std::vector<v3s16> positions;
+	m_db->listAllLoadableBlocks(positions);
+	// Blocks not in the index go to the end of the LRU list
+	for (v3s16 pos : positions) {
+		touch(pos);
+		setUnannounced(pos, true);
+	}
+	loadIndex();
+
+	m_db->beginSave();
+	// The cache may have been made with a larger limit
+	evict();
+}
+
+ClientBlockCache::~ClientBlockCache()
+{
+	m_db->endSave();
+	saveIndex();
+}
+
+void ClientBlockCache::store(v3s16 pos, const std::string &data, u8 ser_ver)
+{
+	std::string entry;
+	entry.reserve(BLOCK_CACHE_HEADER_SIZE + data.size());
+	entry.resize(BLOCK_CACHE_HEADER_SIZE);
+	const u64 hash = hashSerializedBlock(data, ser_ver);
+	writeU64((u8 *)&entry[0], hash);
+	entry.append(data);
+	m_db->saveBlock(pos, entry);
+
+	// It may be unloaded and requested again later
+	Entry &e = touch(pos);
+	e.hash = hash;
+	e.hash_known = true;
+	setUnannounced(pos, true);
+	evict();
+}
+
+bool ClientBlockCache::load(v3s16 pos, u64 hash, std::string *data)
+{
+	auto it = m_entries.find(pos);
+	if (it == m_entries.end() ||
+			(it->second.hash_known && it->second.hash != hash))
+		return false;
+
+	std::string entry;
+	m_db->loadBlock(pos, &entry);
+	if (entry.size() < BLOCK_CACHE_HEADER_SIZE)
+		return false;
+	if (!it->second.hash_known) {
+		it->second.hash = readU64((const u8 *)entry.data());
+		it->second.hash_known = true;
+		m_index_dirty = true;
+	}
+	if (it->second.hash != hash)
+		return false;
+
+	data->assign(entry, BLOCK_CACHE_HEADER_SIZE, std::string::npos);
+	touch(pos);
+	return true;
+}
+
+void ClientBlockCache::collectUnannounced(v3s16 center, s16 radius,
+		size_t max, const std::function<bool(v3s16)> &skip,
+		std::vector<std::pair<v3s16, u64>> &dst)
+{
+	const v3s16 area_min = getContainerPos(center - radius, UNANNOUNCED_AREA_SIZE);
+	const v3s16 area_max = getContainerPos(center + radius, UNANNOUNCED_AREA_SIZE);
+
+	std::vector<std::pair<u32, v3s16>> candidates;
+	auto add_area = [&] (const std::unordered_set<v3s16> &area) {
+		for (v3s16 pos : area) {
+			v3s16 d = pos - center;
+			s16 dist = std::max(std::max(std::abs(d.X), std::abs(d.Y)), std::abs(d.Z));
+			if (dist > radius || skip(pos))
+				continue;
+			candidates.emplace_back(d.X * d.X + d.Y * d.Y + d.Z * d.Z, pos);
+		}
+	};
+
+	const v3s32 extent = v3s32(area_max.X, area_max.Y, area_max.Z) -
+			v3s32(area_min.X, area_min.Y, area_min.Z) + 1;
+	if ((size_t)extent.X * extent.Y * extent.Z <= m_unannounced.size()) {
+		v3s16 a;
+		for (a.Z = area_min.Z; a.Z <= area_max.Z; a.Z++)
+		for (a.Y = area_min.Y; a.Y <= area_max.Y; a.Y++)
+		for (a.X = area_min.X; a.X <= area_max.X; a.X++) {
+			auto it = m_unannounced.find(a);
+			if (it != m_unannounced.end())
+				add_area(it->second);
+		}
+	} else {
+		// Fewer areas have unannounced blocks than there are in the range
+		for (const auto &area : m_unannounced) {
+			const v3s16 a = area.first;
+			if (a.X >= area_min.X && a.Y >= area_min.Y && a.Z >= area_min.Z &&
+					a.X <= area_max.X && a.Y <= area_max.Y && a.Z <= area_max.Z)
+				add_area(area.second);
+		}
+	}
+
+	if (candidates.size() > max) {
+		std::nth_element(candidates.begin(), candidates.begin() + max,
+			candidates.end());
+		candidates.resize(max);
+	}
+	std::sort(candidates.begin(), candidates.end());
+
+	std::string entry;
+	for (const auto &candidate : candidates) {
+		const v3s16 pos = candidate.second;
+		setUnannounced(pos, false);
+
+		auto it = m_entries.find(pos);
+		if (it == m_entries.end())
+			continue;
+		Entry &e = it->second;
+		if (!e.hash_known) {
+			m_db->loadBlock(pos, &entry);
+			if (entry.size() < BLOCK_CACHE_HEADER_SIZE) {
+				remove(pos);
+				continue;
+			}
+			e.hash = readU64((const u8 *)entry.data());
+			e.hash_known = true;
+			m_index_dirty = true;
+		}
+		dst.emplace_back(pos, e.hash);
+	}
+}
+
+ClientBlockCache::Entry &ClientBlockCache::touch(v3s16 pos)
+{
+	m_index_dirty = true;
+	auto it = m_entries.find(pos);
+	if (it != m_entries.end()) {
+		m_lru.splice(m_lru.begin(), m_lru, it->second.lru);
+		return it->second;
+	}
+	m_lru.push_front(pos);
+	Entry &e = m_entries[pos];
+	e.lru = m_lru.begin();
+	return e;
+}
+
+void ClientBlockCache::remove(v3s16 pos)
+{
+	auto it = m_entries.find(pos);
+	if (it != m_entries.end()) {
+		m_lru.erase(it->second.lru);
+		m_entries.erase(it);
+		m_index_dirty = true;
+	}
+	setUnannounced(pos, false);
+	m_db->deleteBlock(pos);
+}
+
+void ClientBlockCache::evict()
+{
+	while (m_lru.size() > m_max_blocks)
+		remove(m_lru.back());
+}
+
+void ClientBlockCache::setUnannounced(v3s16 pos, bool unannounced)
+{
+	const v3s16 area = getContainerPos(pos, UNANNOUNCED_AREA_SIZE);
+	if (unannounced) {
+		m_unannounced[area].insert(pos);
+		return;
+	}
+
+	auto it = m_unannounced.find(area);
+	if (it == m_unannounced.end())
+		return;
+	it->second.erase(pos);
+	if (it->second.empty())
+		m_unannounced.erase(it);
+}
+
+void ClientBlockCache::loadIndex()
+{
+	std::string index;
+	if (!fs::ReadFile(m_index_path, index) || index.empty())
+		return;
+	if ((u8)index[0] != BLOCK_CACHE_INDEX_VERSION) {
+		warningstream << "ClientBlockCache: Ignoring index of unknown version "
+				<< (int)(u8)index[0] << std::endl;
+		return;
+	}
+
+	// Least recently used first, so that the most recent one ends up in front
+	const size_t count = (index.size() - 1) / BLOCK_CACHE_INDEX_RECORD_SIZE;
+	for (size_t i = count; i-- > 0;) {
+		const u8 *record = (const u8 *)index.data() + 1 +
+				i * BLOCK_CACHE_INDEX_RECORD_SIZE;
+		const v3s16 pos = readV3S16(record);
+		// Skip the blocks that did not make it into the database
+		if (m_entries.find(pos) == m_entries.end())
+			continue;
+		Entry &e = touch(pos);
+		e.hash = readU64(record + 6);
+		e.hash_known = true;
+	}
+	m_index_dirty = false;
+}
+
+void ClientBlockCache::saveIndex()
+{
+	if (!m_index_dirty)
+		return;
+
+	std::string index;
+	index.reserve(1 + m_lru.size() * BLOCK_CACHE_INDEX_RECORD_SIZE);
+	index.push_back((char)BLOCK_CACHE_INDEX_VERSION);
+	u8 record[BLOCK_CACHE_INDEX_RECORD_SIZE];
+	for (v3s16 pos : m_lru) {
+		const Entry &e = m_entries.at(pos);
+		if (!e.hash_known)
+			continue;
+		writeV3S16(record, pos);
+		writeU64(record + 6, e.hash);
+		index.append((const char *)record, sizeof(record));
+	}
+
+	if (!fs::safeWriteToFile(m_index_path, index)) {
+		errorstream << "ClientBlockCache: Failed to write " << m_index_path
+				<< std::endl;
+		return;
+	}
+	m_index_dirty = false;
+}
+
+void ClientBlockCache::flush()
+{
+	m_db->endSave();
+	m_db->beginSave();
+	// After the blocks, so that the index never has hashes of unsaved data
+	saveIndex();
+}
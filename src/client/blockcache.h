@@ -0,0 +1,96 @@
+/*
+Minetest
+Copyright (C) 2024 Minetest Authors
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#pragma once
+
+#include "irr_v3d.h"
+#include <functional>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+class MapDatabaseSQLite3;
+
+/*
+	On-disk cache of the mapblocks received from one server.
+
+	Blocks are stored exactly as received with TOCLIENT_BLOCKDATA, together
+	with hashSerializedBlock() of the data. The hashes are announced to the
+	server, which then answers with TOCLIENT_BLOCKDATA_CACHED instead of the
+	block data if the block did not change.
+	The hashes are also kept in memory and in an index file next to the
+	database, so announcing the blocks does not read them.
+	At most `max_blocks` blocks are kept, the least recently used ones are
+	deleted first.
+*/
+class ClientBlockCache
+{
+public:
+	ClientBlockCache(const std::string &savedir, size_t max_blocks);
+	~ClientBlockCache();
+
+	// Stores a block as received from the server
+	void store(v3s16 pos, const std::string &data, u8 ser_ver);
+	// Returns false if there is no cached data with the given hash
+	bool load(v3s16 pos, u64 hash, std::string *data);
+
+	/*
+		Appends up to `max` cached blocks within `radius` of `center` that
+		were not announced yet to `dst`, nearest first.
+		Blocks for which `skip` returns true are left for later.
+	*/
+	void collectUnannounced(v3s16 center, s16 radius, size_t max,
+			const std::function<bool(v3s16)> &skip,
+			std::vector<std::pair<v3s16, u64>> &dst);
+
+	// Writes the pending changes to disk
+	void flush();
+
+private:
+	struct Entry {
+		std::list<v3s16>::iterator lru;
+		// Hash of the cached data, read from the database if not known
+		u64 hash = 0;
+		bool hash_known = false;
+	};
+
+	// Marks a cached block as most recently used
+	Entry &touch(v3s16 pos);
+	void remove(v3s16 pos);
+	// Deletes the least recently used blocks above the limit
+	void evict();
+	void setUnannounced(v3s16 pos, bool unannounced);
+	void loadIndex();
+	void saveIndex();
+
+	std::unique_ptr<MapDatabaseSQLite3> m_db;
+	const std::string m_index_path;
+	bool m_index_dirty = false;
+	const size_t m_max_blocks;
+	// All cached blocks, most recently used first
+	std::list<v3s16> m_lru;
+	std::unordered_map<v3s16, Entry> m_entries;
+	// Cached blocks that may be announced to the server, by area of
+	// UNANNOUNCED_AREA_SIZE^3 blocks so that the ones far away are not visited
+	std::unordered_map<v3s16, std::unordered_set<v3s16>> m_unannounced;
+};
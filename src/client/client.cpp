@@ -36,6 +36,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "client/mesh_generator_thread.h"
 #include "client/particles.h"
 #include "client/localplayer.h"
+#include "client/blockcache.h"
 #include "util/auth.h"
 #include "util/directiontables.h"
 #include "util/pointedthing.h"
@@ -384,6 +385,7 @@ Client::~Client()
 void Client::connect(Address address, bool is_local_server)
 {
 	initLocalMapSaving(address, m_address_name, is_local_server);
+	initBlockCache(address, m_address_name, is_local_server);
 
 	// Since we use TryReceive() a timeout here would be ineffective anyway
 	m_con->SetTimeoutMs(0);
@@ -761,6 +763,29 @@ void Client::step(float dtime)
 		m_localdb->endSave();
 		m_localdb->beginSave();
 	}
+
+	/*
+		Tell the server which blocks around us we have cached
+	*/
+	if (m_block_cache && m_state == LC_Ready &&
+			m_block_cache_announce_interval.step(dtime, 0.2f)) {
+		v3s16 center = getNodeBlockPos(
+				floatToInt(m_env.getLocalPlayer()->getPosition(), BS));
+		s16 radius = g_settings->getS16("viewing_range") / MAP_BLOCKSIZE + 1;
+		Map &map = m_env.getMap();
+		auto is_loaded = [&map] (v3s16 p) {
+			return map.getBlockNoCreateNoEx(p) != nullptr;
+		};
+
+		std::vector<std::pair<v3s16, u64>> blocks;
+		m_block_cache->collectUnannounced(center, radius, 255, is_loaded, blocks);
+		if (!blocks.empty())
+			sendHaveBlocks(blocks);
+	}
+	if (m_block_cache && m_block_cache_save_interval.step(dtime,
+			m_cache_save_interval)) {
+		m_block_cache->flush();
+	}
 }
 
 bool Client::loadMedia(const std::string &data, const std::string &filename,
@@ -930,6 +955,24 @@ void Client::initLocalMapSaving(const Address &address,
 	actionstream << "Local map saving started, map will be saved at '" << world_path << "'" << std::endl;
 }
 
+void Client::initBlockCache(const Address &address,
+		const std::string &hostname,
+		bool is_local_server)
+{
+	if (!g_settings->getBool("enable_client_block_cache") || is_local_server)
+		return;
+
+	std::string hostname_escaped = hostname;
+	str_replace(hostname_escaped, ':', '_');
+	std::string cache_path = porting::path_cache + DIR_DELIM + "blocks"
+		+ DIR_DELIM + hostname_escaped + "_" + std::to_string(address.getPort());
+	fs::CreateAllDirs(cache_path);
+
+	m_block_cache = std::make_unique<ClientBlockCache>(cache_path,
+			g_settings->getU32("client_block_cache_size"));
+	infostream << "Client: Using block cache at '" << cache_path << "'" << std::endl;
+}
+
 void Client::ReceiveAll()
 {
 	NetworkPacket pkt;
@@ -1216,6 +1259,21 @@ void Client::sendGotBlocks(const std::vector<v3s16> &blocks)
 	Send(&pkt);
 }
 
+void Client::sendHaveBlocks(const std::vector<std::pair<v3s16, u64>> &blocks)
+{
+	// Older servers do not know this packet
+	if (m_proto_ver < BLOCK_CACHE_PROTOCOL_VERSION_MIN)
+		return;
+
+	assert(blocks.size() <= 255);
+	NetworkPacket pkt(TOSERVER_HAVE_BLOCKS, 1 + (6 + 8) * blocks.size());
+	pkt << (u8) blocks.size();
+	for (const auto &block : blocks)
+		pkt << block.first << block.second;
+
+	Send(&pkt);
+}
+
 void Client::sendRemovedSounds(const std::vector<s32> &soundList)
 {
 	size_t server_ids = soundList.size();
@@ -1521,6 +1579,21 @@ void Client::addNode(v3s16 p, MapNode n, bool remove_metadata)
 	}
 }
 
+void Client::addNodes(const NodeChangeBatch &batch)
+{
+	std::map<v3s16, MapBlock*> modified_blocks;
+
+	try {
+		m_env.getMap().addNodesAndUpdate(batch, modified_blocks);
+	}
+	catch(InvalidPositionException &e) {
+	}
+
+	for (const auto &modified_block : modified_blocks) {
+		addUpdateMeshTaskWithEdge(modified_block.first, false, true);
+	}
+}
+
 void Client::setPlayerControl(PlayerControl &control)
 {
 	LocalPlayer *player = m_env.getLocalPlayer();
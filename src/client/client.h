@@ -67,6 +67,8 @@ class ParticleManager;
 class Camera;
 struct PlayerControl;
 class NetworkPacket;
+class NodeChangeBatch;
+class ClientBlockCache;
 namespace con {
 class Connection;
 }
@@ -234,6 +236,8 @@ class Client : public con::PeerHandler, public InventoryManager, public IGameDef
 	void handleCommand_MediaPush(NetworkPacket *pkt);
 	void handleCommand_MinimapModes(NetworkPacket *pkt);
 	void handleCommand_SetLighting(NetworkPacket *pkt);
+	void handleCommand_NodeBatch(NetworkPacket *pkt);
+	void handleCommand_BlockDataCached(NetworkPacket *pkt);
 
 	void ProcessData(NetworkPacket *pkt);
 
@@ -274,6 +278,7 @@ class Client : public con::PeerHandler, public InventoryManager, public IGameDef
 	v3s16 CSMClampPos(v3s16 pos);
 
 	void addNode(v3s16 p, MapNode n, bool remove_metadata = true);
+	void addNodes(const NodeChangeBatch &batch);
 
 	void setPlayerControl(PlayerControl &control);
 
@@ -456,6 +461,12 @@ class Client : public con::PeerHandler, public InventoryManager, public IGameDef
 	void initLocalMapSaving(const Address &address,
 			const std::string &hostname,
 			bool is_local_server);
+	void initBlockCache(const Address &address,
+			const std::string &hostname,
+			bool is_local_server);
+
+	// Applies a block received with BLOCKDATA or from the block cache
+	void deSerializeBlock(v3s16 p, const std::string &datastring);
 
 	void ReceiveAll();
 
@@ -469,6 +480,7 @@ class Client : public con::PeerHandler, public InventoryManager, public IGameDef
 	void startAuth(AuthMechanism chosen_auth_mechanism);
 	void sendDeletedBlocks(std::vector<v3s16> &blocks);
 	void sendGotBlocks(const std::vector<v3s16> &blocks);
+	void sendHaveBlocks(const std::vector<std::pair<v3s16, u64>> &blocks);
 	void sendRemovedSounds(const std::vector<s32> &soundList);
 
 	bool canSendChatMessage() const;
@@ -592,6 +604,11 @@ class Client : public con::PeerHandler, public InventoryManager, public IGameDef
 	IntervalLimiter m_localdb_save_interval;
 	u16 m_cache_save_interval;
 
+	// Blocks received from this server in earlier sessions
+	std::unique_ptr<ClientBlockCache> m_block_cache;
+	IntervalLimiter m_block_cache_announce_interval;
+	IntervalLimiter m_block_cache_save_interval;
+
 	// Client modding
 	ClientScripting *m_script = nullptr;
 	ModStorageDatabase *m_mod_storage_database = nullptr;
@@ -273,7 +273,8 @@ class MapBlockFlags
 
 void ClientMap::updateDrawList()
 {
-	ScopeProfiler sp(g_profiler, "CM::updateDrawList()", SPT_AVG);
+	static const auto sp_id = ScopeProfiler::intern("CM::updateDrawList()");
+	ScopeProfiler sp(g_profiler, sp_id, SPT_AVG);
 
 	m_needs_update_drawlist = false;
 
@@ -643,7 +644,8 @@ void ClientMap::touchMapBlocks()
 	if (m_control.range_all || m_loops_occlusion_culler)
 		return;
 
-	ScopeProfiler sp(g_profiler, "CM::touchMapBlocks()", SPT_AVG);
+	static const auto sp_id = ScopeProfiler::intern("CM::touchMapBlocks()");
+	ScopeProfiler sp(g_profiler, sp_id, SPT_AVG);
 
 	v3s16 cam_pos_nodes = floatToInt(m_camera_position, BS);
 
@@ -985,7 +987,8 @@ static bool getVisibleBrightness(Map *map, const v3f &p0, v3f dir, float step,
 int ClientMap::getBackgroundBrightness(float max_d, u32 daylight_factor,
 		int oldvalue, bool *sunlight_seen_result)
 {
-	ScopeProfiler sp(g_profiler, "CM::getBackgroundBrightness", SPT_AVG);
+	static const auto sp_id = ScopeProfiler::intern("CM::getBackgroundBrightness");
+	ScopeProfiler sp(g_profiler, sp_id, SPT_AVG);
 	static v3f z_directions[50] = {
 		v3f(-100, 0, 0)
 	};
@@ -1255,7 +1258,8 @@ void ClientMap::renderMapShadows(video::IVideoDriver *driver,
 */
 void ClientMap::updateDrawListShadow(v3f shadow_light_pos, v3f shadow_light_dir, float radius, float length)
 {
-	ScopeProfiler sp(g_profiler, "CM::updateDrawListShadow()", SPT_AVG);
+	static const auto sp_id = ScopeProfiler::intern("CM::updateDrawListShadow()");
+	ScopeProfiler sp(g_profiler, sp_id, SPT_AVG);
 
 	v3s16 cam_pos_nodes = floatToInt(shadow_light_pos, BS);
 	v3s16 p_blocks_min;
@@ -1321,7 +1325,8 @@ void ClientMap::reportMetrics(u64 save_time_us, u32 saved_blocks, u32 all_blocks
 
 void ClientMap::updateTransparentMeshBuffers()
 {
-	ScopeProfiler sp(g_profiler, "CM::updateTransparentMeshBuffers", SPT_AVG);
+	static const auto sp_id = ScopeProfiler::intern("CM::updateTransparentMeshBuffers");
+	ScopeProfiler sp(g_profiler, sp_id, SPT_AVG);
 	u32 sorted_blocks = 0;
 	u32 unsorted_blocks = 0;
 	f32 sorting_distance_sq = pow(m_cache_transparency_sorting_distance * BS, 2.0f);
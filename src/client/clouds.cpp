@@ -104,7 +104,8 @@ void Clouds::render()
 	//if(SceneManager->getSceneNodeRenderPass() != scene::ESNRP_SOLID)
 		return;
 
-	ScopeProfiler sp(g_profiler, "Clouds::render()", SPT_AVG);
+	static const auto sp_id = ScopeProfiler::intern("Clouds::render()");
+	ScopeProfiler sp(g_profiler, sp_id, SPT_AVG);
 
 	video::SMaterial& m_material = m_meshbuffer->getMaterial();
 
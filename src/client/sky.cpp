@@ -149,7 +149,8 @@ void Sky::render()
 	if (!camera || !driver)
 		return;
 
-	ScopeProfiler sp(g_profiler, "Sky::render()", SPT_AVG);
+	static const auto sp_id = ScopeProfiler::intern("Sky::render()");
+	ScopeProfiler sp(g_profiler, sp_id, SPT_AVG);
 
 	// Draw perspective skybox
 
@@ -54,7 +54,14 @@ std::string ClientInterface::state2Name(ClientState state)
 }
 
 RemoteClient::RemoteClient() :
+	m_blocks_sent(g_settings->getS16("max_block_send_distance")),
+	m_blocks_occ(g_settings->getS16("max_block_send_distance")),
 	m_max_simul_sends(g_settings->getU16("max_simultaneous_block_sends_per_client")),
+	m_adaptive_block_send(g_settings->getBool("adaptive_block_send")),
+	m_send_budget(m_max_simul_sends,
+		std::min<u16>(m_max_simul_sends, ADAPTIVE_BLOCK_SENDS_MIN),
+		std::max(m_max_simul_sends,
+			g_settings->getU16("max_adaptive_block_sends_per_client"))),
 	m_min_time_from_building(
 		g_settings->getFloat("full_block_send_enable_min_time_from_building")),
 	m_max_send_distance(g_settings->getS16("max_block_send_distance")),
@@ -73,6 +80,30 @@ void RemoteClient::ResendBlockIfOnWire(v3s16 p)
 	}
 }
 
+void RemoteClient::addCachedBlock(v3s16 p, u64 hash)
+{
+	if (m_cached_blocks.size() >= CLIENT_CACHED_BLOCKS_MAX &&
+			m_cached_blocks.find(p) == m_cached_blocks.end())
+		return;
+	m_cached_blocks[p] = hash;
+}
+
+bool RemoteClient::takeCachedBlock(v3s16 p, u64 *hash)
+{
+	auto it = m_cached_blocks.find(p);
+	if (it == m_cached_blocks.end())
+		return false;
+	*hash = it->second;
+	m_cached_blocks.erase(it);
+	return true;
+}
+
+void RemoteClient::updateSendBudget(float dtime, const con::PeerLinkStats &stats)
+{
+	if (m_adaptive_block_send)
+		m_send_budget.update(dtime, stats, m_blocks_sending.size());
+}
+
 LuaEntitySAO *getAttachedObject(PlayerSAO *sao, ServerEnvironment *env)
 {
 	if (!sao->isAttached())
@@ -124,8 +155,10 @@ void RemoteClient::GetNextBlocks (
 	if (!sao)
 		return;
 
+	const u16 max_simul_sends = m_send_budget.get();
+
 	// Won't send anything if already sending
-	if (m_blocks_sending.size() >= m_max_simul_sends) {
+	if (m_blocks_sending.size() >= max_simul_sends) {
 		//infostream<<"Not sending any blocks, Queue full."<<std::endl;
 		return;
 	}
@@ -153,7 +186,7 @@ void RemoteClient::GetNextBlocks (
 	if (sao->getCameraInverted())
 		camera_dir = -camera_dir;
 
-	u16 max_simul_sends_usually = m_max_simul_sends;
+	u16 max_simul_sends_usually = max_simul_sends;
 
 	/*
 		Check the time from last addNode/removeNode.
@@ -255,6 +288,14 @@ void RemoteClient::GetNextBlocks (
 	//bool queue_is_full = false;
 
 	const v3s16 cam_pos_nodes = floatToInt(camera_pos, BS);
+	const bool moving = playerspeed.getLength() > 1.0f * BS;
+
+	m_blocks_sent.setCenter(center);
+	m_blocks_occ.setCenter(center);
+
+	// Per-shell scratch space
+	static thread_local std::vector<f32> shell_dist;
+	static thread_local std::vector<u8> shell_in_sight;
 
 	s16 d;
 	for (d = d_start; d <= d_max; d++) {
@@ -263,9 +304,36 @@ void RemoteClient::GetNextBlocks (
 			box
 		*/
 		const auto &list = FacePositionCache::getFacePositions(d);
+		const auto &offsets = FacePositionCache::getFaceOffsets(d);
+		const size_t count = list.size();
 
-		for (auto li = list.begin(); li != list.end(); ++li) {
-			v3s16 p = *li + center;
+		/*
+			Don't generate or send if not in sight
+			FIXME This only works if the client uses a small enough
+			FOV setting. The default of 72 degrees is fine.
+			Also retrieve a smaller view cone in the direction of the player's
+			movement.
+			(0.1 is about 5 degrees)
+		*/
+		shell_dist.resize(count);
+		shell_in_sight.assign(count, 0);
+		blocksInSight(center, offsets.x.data(), offsets.y.data(), offsets.z.data(),
+				count, camera_pos, camera_dir, camera_fov, d_blocks_in_sight,
+				shell_dist.data(), shell_in_sight.data());
+		if (moving) {
+			// The distances do not depend on the direction, the buffer is
+			// just overwritten with the same values
+			blocksInSight(center, offsets.x.data(), offsets.y.data(),
+					offsets.z.data(), count, camera_pos, playerspeeddir, 0.1f,
+					d_blocks_in_sight, shell_dist.data(),
+					shell_in_sight.data());
+		}
+
+		for (size_t i = 0; i < count; i++) {
+			if (!shell_in_sight[i])
+				continue;
+
+			v3s16 p = list[i] + center;
 
 			/*
 				Send throttling
@@ -280,7 +348,7 @@ void RemoteClient::GetNextBlocks (
 
 			// If block is very close, allow full maximum
 			if (d <= BLOCK_SEND_DISABLE_LIMITS_MAX_D)
-				max_simul_dynamic = m_max_simul_sends;
+				max_simul_dynamic = max_simul_sends;
 
 			/*
 				Do not go over max mapgen limit
@@ -291,22 +359,7 @@ void RemoteClient::GetNextBlocks (
 			// If this is true, inexistent block will be made from scratch
 			bool generate = d <= d_max_gen;
 
-			/*
-				Don't generate or send if not in sight
-				FIXME This only works if the client uses a small enough
-				FOV setting. The default of 72 degrees is fine.
-				Also retrieve a smaller view cone in the direction of the player's
-				movement.
-				(0.1 is about 5 degrees)
-			*/
-			f32 dist;
-			if (!(isBlockInSight(p, camera_pos, camera_dir, camera_fov,
-						d_blocks_in_sight, &dist) ||
-					(playerspeed.getLength() > 1.0f * BS &&
-					isBlockInSight(p, camera_pos, playerspeeddir, 0.1f,
-						d_blocks_in_sight)))) {
-				continue;
-			}
+			const f32 dist = shell_dist[i];
 
 			/*
 				Check if map has this block
@@ -330,7 +383,7 @@ void RemoteClient::GetNextBlocks (
 			/*
 				Don't send already sent blocks
 			*/
-			if (m_blocks_sent.find(p) != m_blocks_sent.end())
+			if (m_blocks_sent.contains(p))
 				continue;
 
 			bool block_not_found = false;
@@ -354,7 +407,7 @@ void RemoteClient::GetNextBlocks (
 				/*
 					Check occlusion cache first.
 				 */
-				if (m_blocks_occ.find(p) != m_blocks_occ.end())
+				if (m_blocks_occ.contains(p))
 					continue;
 
 				if (m_occ_cull && !block_not_found &&
@@ -434,22 +487,27 @@ void RemoteClient::GetNextBlocks (
 	}
 }
 
-void RemoteClient::GotBlock(v3s16 p)
+float RemoteClient::GotBlock(v3s16 p)
 {
-	if (m_blocks_sending.find(p) != m_blocks_sending.end()) {
-		m_blocks_sending.erase(p);
-		// only add to sent blocks if it actually was sending
-		// (it might have been modified since)
-		m_blocks_sent.insert(p);
-	} else {
+	auto it = m_blocks_sending.find(p);
+	if (it == m_blocks_sending.end()) {
 		m_excess_gotblocks++;
+		return -1.0f;
 	}
+
+	const u64 sent_ms = it->second;
+	m_blocks_sending.erase(it);
+	// only add to sent blocks if it actually was sending
+	// (it might have been modified since)
+	m_blocks_sent.insert(p);
+	m_send_budget.onBlockAcked();
+	return (porting::getTimeMs() - sent_ms) / 1000.0f;
 }
 
 void RemoteClient::SentBlock(v3s16 p)
 {
 	if (m_blocks_sending.find(p) == m_blocks_sending.end())
-		m_blocks_sending[p] = 0.0f;
+		m_blocks_sending[p] = porting::getTimeMs();
 	else
 		infostream<<"RemoteClient::SentBlock(): Sent block"
 				" already in m_blocks_sending"<<std::endl;
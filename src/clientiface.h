@@ -29,6 +29,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "porting.h"
 #include "threading/mutex_auto_lock.h"
 #include "clientdynamicinfo.h"
+#include "server/blocksendbudget.h"
+#include "util/blockposset.h"
 
 #include <list>
 #include <vector>
@@ -169,6 +171,7 @@ class EmergeManager;
 */
 namespace con {
 	class Connection;
+	struct PeerLinkStats;
 }
 
 
@@ -263,7 +266,8 @@ class RemoteClient
 	void GetNextBlocks(ServerEnvironment *env, EmergeManager* emerge,
 			float dtime, std::vector<PrioritySortedBlockTransfer> &dest);
 
-	void GotBlock(v3s16 p);
+	// Returns the time since the block was sent in seconds, or -1 if it wasn't
+	float GotBlock(v3s16 p);
 
 	void SentBlock(v3s16 p);
 
@@ -280,11 +284,25 @@ class RemoteClient
 
 	u32 getSendingCount() const { return m_blocks_sending.size(); }
 
+	/*
+		Adapts the number of blocks that may be in flight to the
+		measured link quality. No-op if adaptive_block_send is disabled.
+	*/
+	void updateSendBudget(float dtime, const con::PeerLinkStats &stats);
+
+	// Maximum number of blocks that may be in flight at once
+	u16 getSendBudget() const { return m_send_budget.get(); }
+
 	bool isBlockSent(v3s16 p) const
 	{
-		return m_blocks_sent.find(p) != m_blocks_sent.end();
+		return m_blocks_sent.contains(p);
 	}
 
+	// Remembers that the client has a block with the given hash cached
+	void addCachedBlock(v3s16 p, u64 hash);
+	// Returns and forgets the hash of the client's cached copy of a block
+	bool takeCachedBlock(v3s16 p, u64 *hash);
+
 	// Increments timeouts and removes timed-out blocks from list
 	// NOTE: This doesn't fix the server-not-sending-block bug
 	//       because it is related to emerging, not sending.
@@ -379,21 +397,24 @@ class RemoteClient
 
 		List of block positions.
 		No MapBlock* is stored here because the blocks can get deleted.
+		Dense around the player, where GetNextBlocks looks things up.
 	*/
-	std::unordered_set<v3s16> m_blocks_sent;
+	BlockPosSet m_blocks_sent;
 
 	/*
 		Cache of blocks that have been occlusion culled at the current distance.
 		As GetNextBlocks traverses the same distance multiple times, this saves
 		significant CPU time.
 	 */
-	std::unordered_set<v3s16> m_blocks_occ;
+	BlockPosSet m_blocks_occ;
 
 	s16 m_nearest_unsent_d = 0;
 	v3s16 m_last_center;
 	v3f m_last_camera_dir;
 
 	const u16 m_max_simul_sends;
+	const bool m_adaptive_block_send;
+	BlockSendBudget m_send_budget;
 	const float m_min_time_from_building;
 	const s16 m_max_send_distance;
 	const s16 m_block_optimize_distance;
@@ -407,9 +428,9 @@ class RemoteClient
 		- The size of this list is limited to some value
 		Block is added when it is sent with BLOCKDATA.
 		Block is removed when GOTBLOCKS is received.
-		Value is time from sending. (not used at the moment)
+		Value is the time of sending in milliseconds.
 	*/
-	std::unordered_map<v3s16, float> m_blocks_sending;
+	std::unordered_map<v3s16, u64> m_blocks_sending;
 
 	/*
 		Blocks that have been modified since blocks were
@@ -421,6 +442,12 @@ class RemoteClient
 	*/
 	std::unordered_set<v3s16> m_blocks_modified;
 
+	/*
+		Blocks the client announced with TOSERVER_HAVE_BLOCKS, with the hash
+		of the cached data. An entry is used up when the block is sent.
+	*/
+	std::unordered_map<v3s16, u64> m_cached_blocks;
+
 	/*
 		Count of excess GotBlocks().
 		There is an excess amount because the client sometimes
@@ -229,12 +229,17 @@ collisionMoveResult collisionMoveSimple(Environment *env, IGameDef *gamedef,
 		v3f accel_f, ActiveObject *self,
 		bool collideWithObjects)
 {
-	#define PROFILER_NAME(text) (s_env ? ("Server: " text) : ("Client: " text))
+	// Interned once for each use
+	#define PROFILER_ID(text) [s_env] { \
+		static const auto server_id = ScopeProfiler::intern("Server: " text); \
+		static const auto client_id = ScopeProfiler::intern("Client: " text); \
+		return s_env ? server_id : client_id; \
+	}()
 	static bool time_notification_done = false;
 	Map *map = &env->getMap();
 	ServerEnvironment *s_env = dynamic_cast<ServerEnvironment*>(env);
 
-	ScopeProfiler sp(g_profiler, PROFILER_NAME("collisionMoveSimple()"), SPT_AVG);
+	ScopeProfiler sp(g_profiler, PROFILER_ID("collisionMoveSimple()"), SPT_AVG);
 
 	collisionMoveResult result;
 
@@ -273,7 +278,7 @@ collisionMoveResult collisionMoveSimple(Environment *env, IGameDef *gamedef,
 	std::vector<NearbyCollisionInfo> cinfo;
 	{
 	//TimeTaker tt2("collisionMoveSimple collect boxes");
-	ScopeProfiler sp2(g_profiler, PROFILER_NAME("collision collect boxes"), SPT_AVG);
+	ScopeProfiler sp2(g_profiler, PROFILER_ID("collision collect boxes"), SPT_AVG);
 
 	v3f minpos_f(
 		MYMIN(pos_f->X, newpos_f.X),
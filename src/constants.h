@@ -55,6 +55,10 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #define LIMITED_MAX_SIMULTANEOUS_BLOCK_SENDS 0
 // Override for the previous one when distance of block is very low
 #define BLOCK_SEND_DISABLE_LIMITS_MAX_D 1
+// Lower limit of the adaptive per-client block send budget
+#define ADAPTIVE_BLOCK_SENDS_MIN 2
+// Upper limit of the cached blocks remembered per client
+#define CLIENT_CACHED_BLOCKS_MAX 65536
 
 /*
     Client/Server
@@ -52,23 +52,34 @@ inline u64 getHashForString(const std::string &recipe_str)
 	return murmur_hash_64_ua(recipe_str.data(), recipe_str.length(), 0xdeadbeef);
 }
 
-static u64 getHashForGrid(CraftHashType type, const std::vector<std::string> &grid_names)
+inline const std::string &craftItemName(const ItemStack &item)
+{
+	return item.name;
+}
+
+inline const std::string &craftItemName(const CraftRecipeItem &item)
+{
+	return item.name;
+}
+
+// The names are hashed regardless of their order, so that neither the
+// recipe nor the input grid need to be sorted
+template <typename T>
+static u64 getHashForGrid(CraftHashType type, const std::vector<T> &grid)
 {
 	switch (type) {
 		case CRAFT_HASH_TYPE_ITEM_NAMES: {
-			std::ostringstream os;
-			bool is_first = true;
-			for (const std::string &grid_name : grid_names) {
-				if (!grid_name.empty()) {
-					os << (is_first ? "" : "\n") << grid_name;
-					is_first = false;
-				}
+			u64 hash = 0;
+			for (const T &item : grid) {
+				const std::string &name = craftItemName(item);
+				if (!name.empty())
+					hash += getHashForString(name);
 			}
-			return getHashForString(os.str());
+			return hash;
 		} case CRAFT_HASH_TYPE_COUNT: {
 			u64 cnt = 0;
-			for (const std::string &grid_name : grid_names)
-				if (!grid_name.empty())
+			for (const T &item : grid)
+				if (!craftItemName(item).empty())
 					cnt++;
 			return cnt;
 		} case CRAFT_HASH_TYPE_UNHASHED:
@@ -116,26 +127,14 @@ static std::string craftGetItemName(const std::string &itemstring, IGameDef *gam
 	return item.name;
 }
 
-// (mapcar craftGetItemName itemstrings)
-static std::vector<std::string> craftGetItemNames(
+// Resolve the items of a recipe
+static std::vector<CraftRecipeItem> craftGetRecipeItems(
 		const std::vector<std::string> &itemstrings, IGameDef *gamedef)
 {
-	std::vector<std::string> result;
+	std::vector<CraftRecipeItem> result;
 	result.reserve(itemstrings.size());
 	for (const auto &itemstring : itemstrings) {
-		result.push_back(craftGetItemName(itemstring, gamedef));
-	}
-	return result;
-}
-
-// Get name of each item, and return them as a new list.
-static std::vector<std::string> craftGetItemNames(
-		const std::vector<ItemStack> &items, IGameDef *gamedef)
-{
-	std::vector<std::string> result;
-	result.reserve(items.size());
-	for (const auto &item : items) {
-		result.push_back(item.name);
+		result.emplace_back(itemstring, gamedef->idef());
 	}
 	return result;
 }
@@ -155,16 +154,17 @@ static std::vector<ItemStack> craftGetItems(
 
 // Compute bounding rectangle given a matrix of items
 // Returns false if every item is ""
-static bool craftGetBounds(const std::vector<std::string> &items, unsigned int width,
+template <typename T>
+static bool craftGetBounds(const std::vector<T> &items, unsigned int width,
 		unsigned int &min_x, unsigned int &max_x,
 		unsigned int &min_y, unsigned int &max_y)
 {
 	bool success = false;
 	unsigned int x = 0;
 	unsigned int y = 0;
-	for (const std::string &item : items) {
+	for (const T &item : items) {
 		// Is this an actual item?
-		if (!item.empty()) {
+		if (!craftItemName(item).empty()) {
 			if (!success) {
 				// This is the first nonempty item
 				min_x = max_x = x;
@@ -188,6 +188,29 @@ static bool craftGetBounds(const std::vector<std::string> &items, unsigned int w
 	return success;
 }
 
+// Name of the item at index i of a matrix, missing items of the last row
+// are empty
+template <typename T>
+static const std::string &craftGetMatrixName(const std::vector<T> &items, size_t i)
+{
+	static const std::string empty_name;
+	return i < items.size() ? craftItemName(items[i]) : empty_name;
+}
+
+// Returns the only non-empty input item, nullptr if there is none or more
+static const ItemStack *craftGetSingleItem(const CraftInput &input)
+{
+	const ItemStack *found = nullptr;
+	for (const auto &item : input.items) {
+		if (item.name.empty())
+			continue;
+		if (found)
+			return nullptr;
+		found = &item;
+	}
+	return found;
+}
+
 // Removes 1 from each item stack
 static void craftDecrementInput(CraftInput &input, IGameDef *gamedef)
 {
@@ -335,6 +358,41 @@ std::string CraftReplacements::dump() const
 	return os.str();
 }
 
+/*
+	CraftRecipeItem
+*/
+
+CraftRecipeItem::CraftRecipeItem(const std::string &itemstring, IItemDefManager *idef)
+{
+	ItemStack item;
+	item.deSerialize(itemstring, idef);
+	name = item.name;
+
+	if (isGroupRecipeStr(name)) {
+		Strfnd f(name.substr(6));
+		do {
+			groups.push_back(f.next(","));
+		} while (!f.at_end());
+	}
+}
+
+bool CraftRecipeItem::matches(const std::string &inp_name, IItemDefManager *idef) const
+{
+	// Exact name
+	if (inp_name == name)
+		return true;
+
+	// Group
+	if (groups.empty() || !idef->isKnown(inp_name))
+		return false;
+	const ItemGroupList &inp_groups = idef->get(inp_name).groups;
+	for (const std::string &group : groups) {
+		if (itemgroup_get(inp_groups, group) == 0)
+			return false;
+	}
+	return true;
+}
+
 /*
 	CraftDefinitionShaped
 */
@@ -357,41 +415,27 @@ std::string CraftDefinitionShaped::getName() const
 	return "shaped";
 }
 
-bool CraftDefinitionShaped::check(const CraftInput &input, IGameDef *gamedef) const
+// Checks whether the input matrix is arranged like the recipe matrix
+static bool craftShapedMatches(const CraftInput &input,
+		const std::vector<CraftRecipeItem> &rec_items, unsigned int rec_width,
+		IItemDefManager *idef)
 {
-	if (input.method != CRAFT_METHOD_NORMAL)
-		return false;
-
-	// Get input item matrix
-	std::vector<std::string> inp_names = craftGetItemNames(input.items, gamedef);
+	const std::vector<ItemStack> &inp_items = input.items;
 	unsigned int inp_width = input.width;
 	if (inp_width == 0)
 		return false;
-	while (inp_names.size() % inp_width != 0)
-		inp_names.emplace_back("");
 
 	// Get input bounds
 	unsigned int inp_min_x = 0, inp_max_x = 0, inp_min_y = 0, inp_max_y = 0;
-	if (!craftGetBounds(inp_names, inp_width, inp_min_x, inp_max_x,
+	if (!craftGetBounds(inp_items, inp_width, inp_min_x, inp_max_x,
 			inp_min_y, inp_max_y))
 		return false;  // it was empty
 
-	std::vector<std::string> rec_names;
-	if (hash_inited)
-		rec_names = recipe_names;
-	else
-		rec_names = craftGetItemNames(recipe, gamedef);
-
-	// Get recipe item matrix
-	unsigned int rec_width = width;
+	// Get recipe bounds
 	if (rec_width == 0)
 		return false;
-	while (rec_names.size() % rec_width != 0)
-		rec_names.emplace_back("");
-
-	// Get recipe bounds
 	unsigned int rec_min_x=0, rec_max_x=0, rec_min_y=0, rec_max_y=0;
-	if (!craftGetBounds(rec_names, rec_width, rec_min_x, rec_max_x,
+	if (!craftGetBounds(rec_items, rec_width, rec_min_x, rec_max_x,
 			rec_min_y, rec_max_y))
 		return false;  // it was empty
 
@@ -400,7 +444,7 @@ bool CraftDefinitionShaped::check(const CraftInput &input, IGameDef *gamedef) co
 			inp_max_y - inp_min_y != rec_max_y - rec_min_y)
 		return false;
 
-	// Verify that all item names in the bounding box are equal
+	// Verify that all items in the bounding box match
 	unsigned int w = inp_max_x - inp_min_x + 1;
 	unsigned int h = inp_max_y - inp_min_y + 1;
 
@@ -412,9 +456,12 @@ bool CraftDefinitionShaped::check(const CraftInput &input, IGameDef *gamedef) co
 			unsigned int inp_x = inp_min_x + x;
 			unsigned int rec_x = rec_min_x + x;
 
-			if (!inputItemMatchesRecipe(
-					inp_names[inp_y + inp_x],
-					rec_names[rec_y + rec_x], gamedef->idef())) {
+			size_t rec_i = rec_y + rec_x;
+			const std::string &inp_name = craftGetMatrixName(inp_items, inp_y + inp_x);
+			if (rec_i >= rec_items.size()) {
+				if (!inp_name.empty())
+					return false;
+			} else if (!rec_items[rec_i].matches(inp_name, idef)) {
 				return false;
 			}
 		}
@@ -423,6 +470,17 @@ bool CraftDefinitionShaped::check(const CraftInput &input, IGameDef *gamedef) co
 	return true;
 }
 
+bool CraftDefinitionShaped::check(const CraftInput &input, IGameDef *gamedef) const
+{
+	if (input.method != CRAFT_METHOD_NORMAL)
+		return false;
+
+	if (hash_inited)
+		return craftShapedMatches(input, recipe_items, width, gamedef->idef());
+	return craftShapedMatches(input, craftGetRecipeItems(recipe, gamedef),
+			width, gamedef->idef());
+}
+
 CraftOutput CraftDefinitionShaped::getOutput(const CraftInput &input, IGameDef *gamedef) const
 {
 	return CraftOutput(output, 0);
@@ -445,9 +503,7 @@ u64 CraftDefinitionShaped::getHash(CraftHashType type) const
 	assert((type == CRAFT_HASH_TYPE_ITEM_NAMES)
 		|| (type == CRAFT_HASH_TYPE_COUNT)); // Pre-condition
 
-	std::vector<std::string> rec_names = recipe_names;
-	std::sort(rec_names.begin(), rec_names.end());
-	return getHashForGrid(type, rec_names);
+	return getHashForGrid(type, recipe_items);
 }
 
 void CraftDefinitionShaped::initHash(IGameDef *gamedef)
@@ -455,14 +511,37 @@ void CraftDefinitionShaped::initHash(IGameDef *gamedef)
 	if (hash_inited)
 		return;
 	hash_inited = true;
-	recipe_names = craftGetItemNames(recipe, gamedef);
+	recipe_items = craftGetRecipeItems(recipe, gamedef);
 
-	if (hasGroupItem(recipe_names))
+	bool has_group = false;
+	for (const CraftRecipeItem &item : recipe_items)
+		has_group |= item.isGroup();
+	if (has_group)
 		hash_type = CRAFT_HASH_TYPE_COUNT;
 	else
 		hash_type = CRAFT_HASH_TYPE_ITEM_NAMES;
 }
 
+// An item is preferred over a group, it has fewer matching inputs
+static const CraftRecipeItem *craftGetIndexItem(const std::vector<CraftRecipeItem> &items)
+{
+	const CraftRecipeItem *group_item = nullptr;
+	for (const CraftRecipeItem &item : items) {
+		if (item.isGroup()) {
+			if (!group_item)
+				group_item = &item;
+		} else if (!item.name.empty()) {
+			return &item;
+		}
+	}
+	return group_item;
+}
+
+const CraftRecipeItem *CraftDefinitionShaped::getIndexItem() const
+{
+	return craftGetIndexItem(recipe_items);
+}
+
 std::string CraftDefinitionShaped::dump() const
 {
 	std::ostringstream os(std::ios::binary);
@@ -600,75 +679,82 @@ static bool hopcroft_karp_can_match_all(const std::vector<std::vector<u16>> &bip
 	return num_matched == graph_size;
 }
 
-bool CraftDefinitionShapeless::check(const CraftInput &input, IGameDef *gamedef) const
+// Splits a recipe into the sorted items without groups and the group items
+static void craftSplitShapelessRecipe(const std::vector<std::string> &recipe,
+		IGameDef *gamedef, std::vector<CraftRecipeItem> &rec_items,
+		std::vector<CraftRecipeItem> &rec_groups)
 {
-	if (input.method != CRAFT_METHOD_NORMAL)
-		return false;
+	for (CraftRecipeItem &item : craftGetRecipeItems(recipe, gamedef)) {
+		if (item.isGroup())
+			rec_groups.push_back(std::move(item));
+		else
+			rec_items.push_back(std::move(item));
+	}
+	std::sort(rec_items.begin(), rec_items.end(),
+			[](const CraftRecipeItem &a, const CraftRecipeItem &b) {
+				return a.name < b.name;
+			});
+}
+
+static bool craftShapelessMatches(const CraftInput &input,
+		const std::vector<CraftRecipeItem> &rec_items,
+		const std::vector<CraftRecipeItem> &rec_groups, IItemDefManager *idef)
+{
+	// Kept between calls so that checking does not allocate
+	thread_local std::vector<const std::string *> input_filtered;
+	thread_local std::vector<const std::string *> input_for_group;
 
 	// Filter empty items out of input
-	std::vector<std::string> input_filtered;
+	input_filtered.clear();
 	for (const auto &item : input.items) {
 		if (!item.name.empty())
-			input_filtered.push_back(item.name);
+			input_filtered.push_back(&item.name);
 	}
 
 	// If there is a wrong number of items in input, no match
-	if (input_filtered.size() != recipe.size()) {
-		/*dstream<<"Number of input items ("<<input_filtered.size()
-				<<") does not match recipe size ("<<recipe.size()<<") "
-				<<"of recipe with output="<<output<<std::endl;*/
+	if (input_filtered.size() != rec_items.size() + rec_groups.size())
 		return false;
-	}
-
-	// Sort input and recipe
-	std::sort(input_filtered.begin(), input_filtered.end());
-
-	std::vector<std::string> recipe_copy;
-	if (hash_inited) {
-		recipe_copy = recipe_names;
-	} else {
-		recipe_copy = craftGetItemNames(recipe, gamedef);
-		std::sort(recipe_copy.begin(), recipe_copy.end());
-	}
 
-	// Split recipe in group and non-group
-	std::vector<std::string> recipe_nogroup;
-	std::vector<std::string> recipe_onlygroup;
-	std::partition_copy(recipe_copy.begin(), recipe_copy.end(),
-			std::back_inserter(recipe_onlygroup),
-			std::back_inserter(recipe_nogroup),
-			[](const std::string &name) { return str_starts_with(name, "group:"); });
+	// Sort input, the recipe items without groups are sorted already
+	std::sort(input_filtered.begin(), input_filtered.end(),
+			[](const std::string *a, const std::string *b) { return *a < *b; });
 
 	// Filter out non-group recipe slots, using sorted merge.
-	// (This prefiltering is only a performance optimization and not strictly
-	// necessary.)
-	std::vector<std::string> input_for_group;
-	std::set_difference(input_filtered.begin(), input_filtered.end(),
-			recipe_nogroup.begin(), recipe_nogroup.end(),
-			std::back_inserter(input_for_group));
-
-	// All non-group slots must be satisfied
-	if (input_filtered.size() - input_for_group.size() != recipe_nogroup.size())
+	// All of them must be satisfied.
+	input_for_group.clear();
+	auto rec_it = rec_items.begin();
+	for (const std::string *name : input_filtered) {
+		if (rec_it != rec_items.end() && rec_it->name < *name)
+			return false;
+		if (rec_it != rec_items.end() && rec_it->name == *name)
+			++rec_it;
+		else
+			input_for_group.push_back(name);
+	}
+	if (rec_it != rec_items.end())
 		return false;
 
 	// Find out which recipe slots each input item satisfies. This creates a
 	// bipartite graph
-	assert(recipe_onlygroup.size() == input_for_group.size());
-	if (recipe_onlygroup.size() > SHAPELESS_GROUPS_MAX) {
+	assert(rec_groups.size() == input_for_group.size());
+	if (rec_groups.empty())
+		return true;
+	if (rec_groups.size() == 1)
+		return rec_groups[0].matches(*input_for_group[0], idef);
+	if (rec_groups.size() > SHAPELESS_GROUPS_MAX) {
 		// SHAPELESS_GROUPS_MAX is large enough that this should never happen by
 		// accident
 		errorstream << "Too many groups in shapless craft." << std::endl;
 		return false;
 	}
-	u16 graph_size = recipe_onlygroup.size();
+	u16 graph_size = rec_groups.size();
 	// bip_graph[i] are the group-slots that item i can satisfy
 	std::vector<std::vector<u16>> bip_graph;
 	bip_graph.resize(graph_size);
 	for (u16 i = 0; i < graph_size; ++i) {
 		std::vector<u16> &neighbors_i = bip_graph[i];
 		for (u16 j = 0; j < graph_size; ++j) {
-			if (inputItemMatchesRecipe(input_for_group[i], recipe_onlygroup[j],
-					gamedef->idef()))
+			if (rec_groups[j].matches(*input_for_group[i], idef))
 				neighbors_i.push_back(j);
 		}
 	}
@@ -677,6 +763,19 @@ bool CraftDefinitionShapeless::check(const CraftInput &input, IGameDef *gamedef)
 	return hopcroft_karp_can_match_all(bip_graph);
 }
 
+bool CraftDefinitionShapeless::check(const CraftInput &input, IGameDef *gamedef) const
+{
+	if (input.method != CRAFT_METHOD_NORMAL)
+		return false;
+
+	if (hash_inited)
+		return craftShapelessMatches(input, recipe_items, recipe_groups, gamedef->idef());
+
+	std::vector<CraftRecipeItem> rec_items, rec_groups;
+	craftSplitShapelessRecipe(recipe, gamedef, rec_items, rec_groups);
+	return craftShapelessMatches(input, rec_items, rec_groups, gamedef->idef());
+}
+
 CraftOutput CraftDefinitionShapeless::getOutput(const CraftInput &input, IGameDef *gamedef) const
 {
 	return CraftOutput(output, 0);
@@ -698,7 +797,7 @@ u64 CraftDefinitionShapeless::getHash(CraftHashType type) const
 	assert(hash_inited); // Pre-condition
 	assert(type == CRAFT_HASH_TYPE_ITEM_NAMES
 		|| type == CRAFT_HASH_TYPE_COUNT); // Pre-condition
-	return getHashForGrid(type, recipe_names);
+	return getHashForGrid(type, recipe_items) + getHashForGrid(type, recipe_groups);
 }
 
 void CraftDefinitionShapeless::initHash(IGameDef *gamedef)
@@ -706,15 +805,20 @@ void CraftDefinitionShapeless::initHash(IGameDef *gamedef)
 	if (hash_inited)
 		return;
 	hash_inited = true;
-	recipe_names = craftGetItemNames(recipe, gamedef);
-	std::sort(recipe_names.begin(), recipe_names.end());
+	craftSplitShapelessRecipe(recipe, gamedef, recipe_items, recipe_groups);
 
-	if (hasGroupItem(recipe_names))
+	if (!recipe_groups.empty())
 		hash_type = CRAFT_HASH_TYPE_COUNT;
 	else
 		hash_type = CRAFT_HASH_TYPE_ITEM_NAMES;
 }
 
+const CraftRecipeItem *CraftDefinitionShapeless::getIndexItem() const
+{
+	const CraftRecipeItem *item = craftGetIndexItem(recipe_items);
+	return item ? item : craftGetIndexItem(recipe_groups);
+}
+
 std::string CraftDefinitionShapeless::dump() const
 {
 	std::ostringstream os(std::ios::binary);
@@ -851,25 +955,15 @@ bool CraftDefinitionCooking::check(const CraftInput &input, IGameDef *gamedef) c
 	if (input.method != CRAFT_METHOD_COOKING)
 		return false;
 
-	// Filter empty items out of input
-	std::vector<std::string> input_filtered;
-	for (const auto &item : input.items) {
-		const std::string &name = item.name;
-		if (!name.empty())
-			input_filtered.push_back(name);
-	}
-
-	// If there is a wrong number of items in input, no match
-	if (input_filtered.size() != 1) {
-		/*dstream<<"Number of input items ("<<input_filtered.size()
-				<<") does not match recipe size (1) "
-				<<"of cooking recipe with output="<<output<<std::endl;*/
+	// There must be a single input item
+	const ItemStack *item = craftGetSingleItem(input);
+	if (!item)
 		return false;
-	}
 
 	// Check the single input item
-	std::string rec_name = craftGetItemName(recipe, gamedef);
-	return inputItemMatchesRecipe(input_filtered[0], rec_name, gamedef->idef());
+	if (hash_inited)
+		return recipe_item.matches(item->name, gamedef->idef());
+	return CraftRecipeItem(recipe, gamedef->idef()).matches(item->name, gamedef->idef());
 }
 
 CraftOutput CraftDefinitionCooking::getOutput(const CraftInput &input, IGameDef *gamedef) const
@@ -893,7 +987,7 @@ void CraftDefinitionCooking::decrementInput(CraftInput &input, std::vector<ItemS
 u64 CraftDefinitionCooking::getHash(CraftHashType type) const
 {
 	if (type == CRAFT_HASH_TYPE_ITEM_NAMES) {
-		return getHashForString(recipe_name);
+		return getHashForString(recipe_item.name);
 	}
 
 	if (type == CRAFT_HASH_TYPE_COUNT) {
@@ -910,9 +1004,9 @@ void CraftDefinitionCooking::initHash(IGameDef *gamedef)
 	if (hash_inited)
 		return;
 	hash_inited = true;
-	recipe_name = craftGetItemName(recipe, gamedef);
+	recipe_item = CraftRecipeItem(recipe, gamedef->idef());
 
-	if (isGroupRecipeStr(recipe_name))
+	if (recipe_item.isGroup())
 		hash_type = CRAFT_HASH_TYPE_COUNT;
 	else
 		hash_type = CRAFT_HASH_TYPE_ITEM_NAMES;
@@ -938,7 +1032,7 @@ CraftDefinitionFuel::CraftDefinitionFuel(
 		const CraftReplacements &replacements_):
 	recipe(recipe_), burntime(burntime_), replacements(replacements_)
 {
-	if (isGroupRecipeStr(recipe_name))
+	if (isGroupRecipeStr(recipe))
 		priority = PRIORITY_SHAPELESS_AND_GROUPS;
 	else
 		priority = PRIORITY_SHAPELESS;
@@ -954,25 +1048,15 @@ bool CraftDefinitionFuel::check(const CraftInput &input, IGameDef *gamedef) cons
 	if (input.method != CRAFT_METHOD_FUEL)
 		return false;
 
-	// Filter empty items out of input
-	std::vector<std::string> input_filtered;
-	for (const auto &item : input.items) {
-		const std::string &name = item.name;
-		if (!name.empty())
-			input_filtered.push_back(name);
-	}
-
-	// If there is a wrong number of items in input, no match
-	if (input_filtered.size() != 1) {
-		/*dstream<<"Number of input items ("<<input_filtered.size()
-				<<") does not match recipe size (1) "
-				<<"of fuel recipe with burntime="<<burntime<<std::endl;*/
+	// There must be a single input item
+	const ItemStack *item = craftGetSingleItem(input);
+	if (!item)
 		return false;
-	}
 
 	// Check the single input item
-	std::string rec_name = craftGetItemName(recipe, gamedef);
-	return inputItemMatchesRecipe(input_filtered[0], rec_name, gamedef->idef());
+	if (hash_inited)
+		return recipe_item.matches(item->name, gamedef->idef());
+	return CraftRecipeItem(recipe, gamedef->idef()).matches(item->name, gamedef->idef());
 }
 
 CraftOutput CraftDefinitionFuel::getOutput(const CraftInput &input, IGameDef *gamedef) const
@@ -996,7 +1080,7 @@ void CraftDefinitionFuel::decrementInput(CraftInput &input, std::vector<ItemStac
 u64 CraftDefinitionFuel::getHash(CraftHashType type) const
 {
 	if (type == CRAFT_HASH_TYPE_ITEM_NAMES) {
-		return getHashForString(recipe_name);
+		return getHashForString(recipe_item.name);
 	}
 
 	if (type == CRAFT_HASH_TYPE_COUNT) {
@@ -1013,9 +1097,9 @@ void CraftDefinitionFuel::initHash(IGameDef *gamedef)
 	if (hash_inited)
 		return;
 	hash_inited = true;
-	recipe_name = craftGetItemName(recipe, gamedef);
+	recipe_item = CraftRecipeItem(recipe, gamedef->idef());
 
-	if (isGroupRecipeStr(recipe_name))
+	if (recipe_item.isGroup())
 		hash_type = CRAFT_HASH_TYPE_COUNT;
 	else
 		hash_type = CRAFT_HASH_TYPE_ITEM_NAMES;
@@ -1054,56 +1138,111 @@ class CCraftDefManager: public IWritableCraftDefManager
 		if (input.empty())
 			return false;
 
-		std::vector<std::string> input_names;
-		input_names = craftGetItemNames(input.items, gamedef);
-		std::sort(input_names.begin(), input_names.end());
+		IItemDefManager *idef = gamedef->idef();
 
-		// Try hash types with increasing collision rate
-		// while remembering the latest, highest priority recipe.
+		// Remember the latest, highest priority recipe.
+		// Only the group recipes are ordered, recipes without groups
+		// always win over group recipes of the same priority.
 		CraftDefinition::RecipePriority priority_best =
 			CraftDefinition::PRIORITY_NO_RECIPE;
 		CraftDefinition *def_best = nullptr;
-		for (int type = 0; type <= craft_hash_type_max; type++) {
-			u64 hash = getHashForGrid((CraftHashType) type, input_names);
+		u32 order_best = 0;
 
-			/*errorstream << "Checking type " << type << " with hash " << hash << std::endl;*/
+		auto try_def = [&](CraftDefinition *def) -> bool {
+			if (!def->check(input, gamedef))
+				return false;
 
-			// We'd like to do "const [...] hash_collisions = m_craft_defs[type][hash];"
-			// but that doesn't compile for some reason. This does.
-			auto col_iter = (m_craft_defs[type]).find(hash);
+			// Check if the crafted node/item exists
+			CraftOutput out = def->getOutput(input, gamedef);
+			ItemStack is;
+			is.deSerialize(out.item, idef);
+			if (!is.isKnown(idef)) {
+				infostream << "trying to craft non-existent "
+					<< out.item << ", ignoring recipe" << std::endl;
+				return false;
+			}
 
-			if (col_iter == (m_craft_defs[type]).end())
-				continue;
+			output = out;
+			priority_best = def->getPriority();
+			def_best = def;
+			return true;
+		};
 
+		// Recipes without groups are found by the names of the input items
+		u64 hash = getHashForGrid(CRAFT_HASH_TYPE_ITEM_NAMES, input.items);
+		auto col_iter = m_craft_defs[CRAFT_HASH_TYPE_ITEM_NAMES].find(hash);
+		if (col_iter != m_craft_defs[CRAFT_HASH_TYPE_ITEM_NAMES].end()) {
 			const std::vector<CraftDefinition*> &hash_collisions = col_iter->second;
 			// Walk crafting definitions from back to front, so that later
 			// definitions can override earlier ones.
 			for (std::vector<CraftDefinition*>::size_type
 					i = hash_collisions.size(); i > 0; i--) {
 				CraftDefinition *def = hash_collisions[i - 1];
+				if (def->getPriority() > priority_best && try_def(def))
+					order_best = U32_MAX;
+			}
+		}
 
-				/*errorstream << "Checking " << input.dump() << std::endl
-					<< " against " << def->dump() << std::endl;*/
-
-				CraftDefinition::RecipePriority priority = def->getPriority();
-				if (priority > priority_best
-						&& def->check(input, gamedef)) {
-					// Check if the crafted node/item exists
-					CraftOutput out = def->getOutput(input, gamedef);
-					ItemStack is;
-					is.deSerialize(out.item, gamedef->idef());
-					if (!is.isKnown(gamedef->idef())) {
-						infostream << "trying to craft non-existent "
-							<< out.item << ", ignoring recipe" << std::endl;
-						continue;
-					}
+		// Recipes with groups are found by the items and groups of the input
+		// items. The same group can be reached through several items.
+		thread_local std::vector<const std::vector<IndexedCraftDefinition> *> visited;
+		visited.clear();
+		u64 count = getHashForGrid(CRAFT_HASH_TYPE_COUNT, input.items);
+
+		auto try_indexed = [&](const std::vector<IndexedCraftDefinition> &defs) {
+			if (std::find(visited.begin(), visited.end(), &defs) != visited.end())
+				return;
+			visited.push_back(&defs);
+
+			for (const IndexedCraftDefinition &entry : defs) {
+				CraftDefinition::RecipePriority priority = entry.def->getPriority();
+				if (entry.count != count || priority < priority_best)
+					continue;
+				if (priority == priority_best && entry.order <= order_best)
+					continue;
+				if (try_def(entry.def))
+					order_best = entry.order;
+			}
+		};
 
-					output = out;
-					priority_best = priority;
-					def_best = def;
-				}
+		for (size_t i = 0; i < input.items.size(); i++) {
+			const std::string &name = input.items[i].name;
+			if (name.empty())
+				continue;
+			bool seen = false;
+			for (size_t j = 0; j < i && !seen; j++)
+				seen = input.items[j].name == name;
+			if (seen)
+				continue;
+
+			auto by_item = m_index_by_item.find(name);
+			if (by_item != m_index_by_item.end())
+				try_indexed(by_item->second);
+
+			if (!idef->isKnown(name))
+				continue;
+			for (const auto &group : idef->get(name).groups) {
+				if (group.second == 0)
+					continue;
+				auto by_group = m_index_by_group.find(group.first);
+				if (by_group != m_index_by_group.end())
+					try_indexed(by_group->second);
 			}
 		}
+		try_indexed(m_unindexed);
+
+		// Definitions that are not hashed yet, which are all before initHashes()
+		auto unhashed = m_craft_defs[CRAFT_HASH_TYPE_UNHASHED].find(0);
+		if (unhashed != m_craft_defs[CRAFT_HASH_TYPE_UNHASHED].end()) {
+			const std::vector<CraftDefinition*> &defs = unhashed->second;
+			for (std::vector<CraftDefinition*>::size_type
+					i = defs.size(); i > 0; i--) {
+				CraftDefinition *def = defs[i - 1];
+				if (def->getPriority() > priority_best)
+					try_def(def);
+			}
+		}
+
 		if (priority_best == CraftDefinition::PRIORITY_NO_RECIPE)
 			return false;
 		if (decrementInput)
@@ -1228,6 +1367,10 @@ class CCraftDefManager: public IWritableCraftDefManager
 			m_craft_defs[type].clear();
 		}
 		m_output_craft_definitions.clear();
+		m_index_by_item.clear();
+		m_index_by_group.clear();
+		m_unindexed.clear();
+		m_index_order = 0;
 	}
 	virtual void initHashes(IGameDef *gamedef)
 	{
@@ -1242,14 +1385,45 @@ class CCraftDefManager: public IWritableCraftDefManager
 
 			// Enter the definition
 			m_craft_defs[type][hash].push_back(def);
+			if (type == CRAFT_HASH_TYPE_COUNT)
+				addToIndex(def, hash);
 		}
 		unhashed.clear();
 	}
 private:
+	struct IndexedCraftDefinition
+	{
+		CraftDefinition *def;
+		// Number of non-empty input items
+		u64 count;
+		// Later registered definitions have a higher order
+		u32 order;
+	};
+
+	void addToIndex(CraftDefinition *def, u64 count)
+	{
+		IndexedCraftDefinition entry{def, count, ++m_index_order};
+		const CraftRecipeItem *item = def->getIndexItem();
+		if (!item)
+			m_unindexed.push_back(entry);
+		else if (item->isGroup())
+			m_index_by_group[item->groups[0]].push_back(entry);
+		else
+			m_index_by_item[item->name].push_back(entry);
+	}
+
 	std::vector<std::unordered_map<u64, std::vector<CraftDefinition*> > >
 		m_craft_defs;
 	std::unordered_map<std::string, std::vector<CraftDefinition*> >
 		m_output_craft_definitions;
+	// Definitions of the CRAFT_HASH_TYPE_COUNT layer, by an item or a group
+	// that every matching input contains. Not owned.
+	std::unordered_map<std::string, std::vector<IndexedCraftDefinition> >
+		m_index_by_item;
+	std::unordered_map<std::string, std::vector<IndexedCraftDefinition> >
+		m_index_by_group;
+	std::vector<IndexedCraftDefinition> m_unindexed;
+	u32 m_index_order = 0;
 };
 
 IWritableCraftDefManager* createCraftDefManager()
@@ -49,12 +49,15 @@ enum CraftMethod
  */
 enum CraftHashType
 {
-	// Hashes the normalized names of the recipe's elements.
+	// Hashes the normalized names of the recipe's elements, regardless
+	// of their order.
 	// Only recipes without group usage can be found here,
 	// because groups can't be guessed efficiently.
 	CRAFT_HASH_TYPE_ITEM_NAMES,
 
 	// Counts the non-empty slots.
+	// The manager additionally indexes these recipes by an item or group
+	// every matching input has to contain, see getIndexItem().
 	CRAFT_HASH_TYPE_COUNT,
 
 	// This layer both spares an extra variable, and helps to retain (albeit rarely used) functionality. Maps to 0.
@@ -126,6 +129,27 @@ struct CraftReplacements
 	std::string dump() const;
 };
 
+/*
+	A recipe item with its alias resolved, as used for matching.
+	"group:a,b" is split into its groups once, so that matching an input
+	item only needs lookups in the groups of its definition.
+*/
+struct CraftRecipeItem
+{
+	// Item name, or the whole "group:..." string
+	std::string name;
+	// Required groups, empty if this is not a group item
+	std::vector<std::string> groups;
+
+	CraftRecipeItem() = default;
+	CraftRecipeItem(const std::string &itemstring, IItemDefManager *idef);
+
+	bool isGroup() const { return !groups.empty(); }
+
+	// Checks whether an input item with the given name can be used
+	bool matches(const std::string &inp_name, IItemDefManager *idef) const;
+};
+
 /*
 	Crafting definition base class
 */
@@ -179,6 +203,10 @@ class CraftDefinition
 	// to be called after all mods are loaded, so that we catch all aliases
 	virtual void initHash(IGameDef *gamedef) = 0;
 
+	// Returns a recipe item that every matching input contains, or nullptr.
+	// Only valid after initHash.
+	virtual const CraftRecipeItem *getIndexItem() const { return nullptr; }
+
 	virtual std::string dump() const=0;
 
 protected:
@@ -214,6 +242,7 @@ class CraftDefinitionShaped: public CraftDefinition
 	virtual u64 getHash(CraftHashType type) const;
 
 	virtual void initHash(IGameDef *gamedef);
+	virtual const CraftRecipeItem *getIndexItem() const;
 
 	virtual std::string dump() const;
 
@@ -224,8 +253,8 @@ class CraftDefinitionShaped: public CraftDefinition
 	unsigned int width = 1;
 	// Recipe matrix (itemstrings)
 	std::vector<std::string> recipe;
-	// Recipe matrix (item names)
-	std::vector<std::string> recipe_names;
+	// Recipe matrix (resolved items)
+	std::vector<CraftRecipeItem> recipe_items;
 	// bool indicating if initHash has been called already
 	bool hash_inited = false;
 	// Replacement items for decrementInput()
@@ -258,6 +287,7 @@ class CraftDefinitionShapeless: public CraftDefinition
 	virtual u64 getHash(CraftHashType type) const;
 
 	virtual void initHash(IGameDef *gamedef);
+	virtual const CraftRecipeItem *getIndexItem() const;
 
 	virtual std::string dump() const;
 
@@ -266,8 +296,10 @@ class CraftDefinitionShapeless: public CraftDefinition
 	std::string output;
 	// Recipe list (itemstrings)
 	std::vector<std::string> recipe;
-	// Recipe list (item names), sorted
-	std::vector<std::string> recipe_names;
+	// Recipe items without groups, sorted by name
+	std::vector<CraftRecipeItem> recipe_items;
+	// Recipe items with groups
+	std::vector<CraftRecipeItem> recipe_groups;
 	// bool indicating if initHash has been called already
 	bool hash_inited = false;
 	// Replacement items for decrementInput()
@@ -339,6 +371,7 @@ class CraftDefinitionCooking: public CraftDefinition
 	virtual u64 getHash(CraftHashType type) const;
 
 	virtual void initHash(IGameDef *gamedef);
+	virtual const CraftRecipeItem *getIndexItem() const { return &recipe_item; }
 
 	virtual std::string dump() const;
 
@@ -347,8 +380,8 @@ class CraftDefinitionCooking: public CraftDefinition
 	std::string output;
 	// Recipe itemstring
 	std::string recipe;
-	// Recipe item name
-	std::string recipe_name;
+	// Recipe item (resolved)
+	CraftRecipeItem recipe_item;
 	// bool indicating if initHash has been called already
 	bool hash_inited = false;
 	// Time in seconds
@@ -382,14 +415,15 @@ class CraftDefinitionFuel: public CraftDefinition
 	virtual u64 getHash(CraftHashType type) const;
 
 	virtual void initHash(IGameDef *gamedef);
+	virtual const CraftRecipeItem *getIndexItem() const { return &recipe_item; }
 
 	virtual std::string dump() const;
 
 private:
 	// Recipe itemstring
 	std::string recipe;
-	// Recipe item name
-	std::string recipe_name;
+	// Recipe item (resolved)
+	CraftRecipeItem recipe_item;
 	// bool indicating if initHash has been called already
 	bool hash_inited = false;
 	// Time in seconds
@@ -35,6 +35,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "remoteplayer.h"
 #include "server/player_sao.h"
 #include <cstdlib>
+#include <cstring>
+#include <unordered_map>
 
 Database_PostgreSQL::Database_PostgreSQL(const std::string &connect_string,
 	const char *type) :
@@ -196,6 +198,15 @@ void MapDatabasePostgreSQL::initStatements()
 			"WHERE posX = $1::int4 AND posY = $2::int4 AND "
 			"posZ = $3::int4");
 
+	// unnest() with several arrays needs PostgreSQL 9.4
+	if (getPGVersion() >= 90400) {
+		prepareStatement("read_blocks",
+			"SELECT blocks.posX, blocks.posY, blocks.posZ, blocks.data "
+				"FROM blocks JOIN unnest($1::int4[], $2::int4[], $3::int4[]) "
+				"AS p(x, y, z) ON blocks.posX = p.x AND blocks.posY = p.y AND "
+				"blocks.posZ = p.z");
+	}
+
 	if (getPGVersion() < 90500) {
 		prepareStatement("write_block_insert",
 			"INSERT INTO blocks (posX, posY, posZ, data) SELECT "
@@ -279,6 +290,54 @@ void MapDatabasePostgreSQL::loadBlock(const v3s16 &pos, std::string *block)
 	PQclear(results);
 }
 
+void MapDatabasePostgreSQL::loadBlocks(const std::vector<v3s16> &pos,
+	std::vector<std::string> &blocks)
+{
+	if (getPGVersion() < 90400) {
+		MapDatabase::loadBlocks(pos, blocks);
+		return;
+	}
+
+	verifyDatabase();
+
+	blocks.assign(pos.size(), std::string());
+	if (pos.empty())
+		return;
+
+	// Arrays in text format, e.g. "{1,2,3}"
+	std::string xs("{"), ys("{"), zs("{");
+	std::unordered_multimap<v3s16, size_t> indices;
+	for (size_t i = 0; i < pos.size(); i++) {
+		xs.append(itos(pos[i].X)).push_back(',');
+		ys.append(itos(pos[i].Y)).push_back(',');
+		zs.append(itos(pos[i].Z)).push_back(',');
+		indices.emplace(pos[i], i);
+	}
+	xs.back() = ys.back() = zs.back() = '}';
+
+	const void *args[] = { xs.c_str(), ys.c_str(), zs.c_str() };
+
+	PGresult *results = execPrepared("read_blocks", ARRLEN(args), args,
+		NULL, NULL, false);
+
+	// Binary results: int4 is in network byte order
+	auto get_int4 = [results] (int row, int col) -> s16 {
+		u32 value;
+		memcpy(&value, PQgetvalue(results, row, col), sizeof(value));
+		return (s32)ntohl(value);
+	};
+
+	int numrows = PQntuples(results);
+	for (int row = 0; row < numrows; ++row) {
+		v3s16 p(get_int4(row, 0), get_int4(row, 1), get_int4(row, 2));
+		auto range = indices.equal_range(p);
+		for (auto it = range.first; it != range.second; ++it)
+			blocks[it->second] = pg_to_string(results, row, 3);
+	}
+
+	PQclear(results);
+}
+
 bool MapDatabasePostgreSQL::deleteBlock(const v3s16 &pos)
 {
 	verifyDatabase();
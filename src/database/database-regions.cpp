@@ -0,0 +1,528 @@
+/*
+Minetest
+Copyright (C) 2024 Minetest Authors
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "database-regions.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include "exceptions.h"
+#include "filesys.h"
+#include "log.h"
+#include "irrlicht_changes/printing.h"
+#include "util/numeric.h"
+#include "util/serialize.h"
+#include "util/string.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+static constexpr char REGION_MAGIC[4] = {'M', 'T', 'R', 'G'};
+static constexpr u32 REGION_VERSION = 1;
+
+// Files are only compacted once the garbage is worth the rewrite
+static constexpr u64 REGION_COMPACT_MIN_GARBAGE = 1024 * 1024;
+
+// Bytes of blocks copied to the compacted file per save
+static constexpr u64 REGION_COMPACT_STEP = 1024 * 1024;
+
+// Each open region holds a file descriptor and a mapping
+static constexpr size_t MAX_OPEN_REGIONS = 64;
+
+// Makes sure the contents of the file are on the disk
+static bool syncFile(const std::string &path)
+{
+#ifndef _WIN32
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+	bool ok = fsync(fd) == 0;
+	::close(fd);
+	return ok;
+#else
+	return true;
+#endif
+}
+
+/*
+	RegionFile
+*/
+
+RegionFile::RegionFile(const std::string &path) :
+	m_path(path)
+{
+	open();
+}
+
+RegionFile::~RegionFile()
+{
+	abortCompaction();
+	close();
+}
+
+void RegionFile::writeHeader(std::ostream &os, const Entry *index)
+{
+	std::string header(HEADER_SIZE, '\0');
+	u8 *p = reinterpret_cast<u8 *>(&header[0]);
+	memcpy(p, REGION_MAGIC, 4);
+	writeU32(p + 4, REGION_VERSION);
+	for (u32 i = 0; i < BLOCKS; i++) {
+		writeU64(p + 8 + i * ENTRY_SIZE, index[i].offset);
+		writeU32(p + 8 + i * ENTRY_SIZE + 8, index[i].length);
+	}
+	os.write(header.data(), header.size());
+}
+
+void RegionFile::open()
+{
+	if (!fs::PathExists(m_path)) {
+		for (Entry &e : m_index)
+			e = {0, 0};
+		std::ofstream os(m_path, std::ios::binary);
+		writeHeader(os, m_index);
+		if (!os.good())
+			throw DatabaseException("Failed to create region file " + m_path);
+	}
+
+	m_file.open(m_path, std::ios::in | std::ios::out | std::ios::binary);
+	std::string header(HEADER_SIZE, '\0');
+	m_file.read(&header[0], HEADER_SIZE);
+	if (!m_file.good() || memcmp(header.data(), REGION_MAGIC, 4) != 0)
+		throw DatabaseException("Failed to read region file " + m_path);
+
+	const u8 *p = reinterpret_cast<const u8 *>(header.data());
+	if (readU32(p + 4) != REGION_VERSION)
+		throw DatabaseException("Unsupported version of region file " + m_path);
+
+	m_file.seekg(0, std::ios::end);
+	m_end = m_file.tellg();
+	m_live = 0;
+	for (u32 i = 0; i < BLOCKS; i++) {
+		Entry &e = m_index[i];
+		e.offset = readU64(p + 8 + i * ENTRY_SIZE);
+		e.length = readU32(p + 8 + i * ENTRY_SIZE + 8);
+		if (e.offset != 0 && (e.offset < HEADER_SIZE || e.offset + e.length > m_end)) {
+			// Written to the index, but the data never made it to the disk
+			errorstream << "RegionFile: Dropping truncated block " << i
+				<< " of " << m_path << std::endl;
+			e = {0, 0};
+		}
+		m_live += e.length;
+	}
+
+#ifndef _WIN32
+	m_fd = ::open(m_path.c_str(), O_RDONLY);
+	if (m_fd < 0)
+		throw DatabaseException("Failed to open region file " + m_path);
+#endif
+}
+
+void RegionFile::close()
+{
+	if (!sync()) {
+		errorstream << "RegionFile: Failed to write the index of " << m_path
+			<< std::endl;
+	}
+
+#ifndef _WIN32
+	if (m_view)
+		munmap(const_cast<char *>(m_view), m_view_size);
+	m_view = nullptr;
+	m_view_size = 0;
+	if (m_fd >= 0)
+		::close(m_fd);
+	m_fd = -1;
+#endif
+	m_file.close();
+}
+
+bool RegionFile::mapRange(u64 offset, u32 length)
+{
+#ifndef _WIN32
+	if (offset + length <= m_view_size)
+		return true;
+
+	// The block was appended after the file was mapped
+	if (m_view)
+		munmap(const_cast<char *>(m_view), m_view_size);
+	m_view = nullptr;
+	m_view_size = 0;
+
+	void *view = mmap(nullptr, m_end, PROT_READ, MAP_SHARED, m_fd, 0);
+	if (view == MAP_FAILED)
+		return false;
+	m_view = static_cast<const char *>(view);
+	m_view_size = m_end;
+	return offset + length <= m_view_size;
+#else
+	return false;
+#endif
+}
+
+bool RegionFile::read(u16 index, std::string *data)
+{
+	const Entry &e = m_index[index];
+	if (e.offset == 0) {
+		data->clear();
+		return false;
+	}
+
+#ifndef _WIN32
+	if (mapRange(e.offset, e.length)) {
+		data->assign(m_view + e.offset, e.length);
+		return true;
+	}
+#endif
+
+	data->resize(e.length);
+	m_file.seekg(e.offset);
+	m_file.read(&(*data)[0], e.length);
+	if (!m_file.good()) {
+		m_file.clear();
+		data->clear();
+		return false;
+	}
+	return true;
+}
+
+bool RegionFile::writeEntry(u16 index)
+{
+	u8 buf[ENTRY_SIZE];
+	writeU64(buf, m_index[index].offset);
+	writeU32(buf + 8, m_index[index].length);
+
+	m_file.seekp(8 + (u64)index * ENTRY_SIZE);
+	m_file.write(reinterpret_cast<const char *>(buf), ENTRY_SIZE);
+	if (!m_file.good()) {
+		m_file.clear();
+		return false;
+	}
+	return true;
+}
+
+bool RegionFile::write(u16 index, const std::string &data)
+{
+	if (data.size() > U32_MAX)
+		return false;
+
+	// The index entry pointing to the data is written by sync(), so an
+	// interrupted write leaves the old version of the block in place
+	m_file.seekp(m_end);
+	m_file.write(data.data(), data.size());
+	// Readable through m_fd from now on
+	m_file.flush();
+	if (!m_file.good()) {
+		m_file.clear();
+		return false;
+	}
+
+	Entry &e = m_index[index];
+	m_live -= e.length;
+	e = {m_end, (u32)data.size()};
+	m_live += e.length;
+	m_end += data.size();
+	m_dirty.insert(index);
+	return true;
+}
+
+bool RegionFile::remove(u16 index)
+{
+	Entry &e = m_index[index];
+	if (e.offset == 0)
+		return true;
+
+	m_live -= e.length;
+	e = {0, 0};
+	m_dirty.insert(index);
+	return true;
+}
+
+void RegionFile::listBlocks(const v3s16 &region, std::vector<v3s16> &dst) const
+{
+	for (u32 i = 0; i < BLOCKS; i++) {
+		if (m_index[i].offset == 0)
+			continue;
+		dst.emplace_back(region.X * 16 + i % 16,
+			region.Y * 16 + (i / 16) % 16,
+			region.Z * 16 + i / (16 * 16));
+	}
+}
+
+bool RegionFile::needsCompaction() const
+{
+	const u64 garbage = getGarbageSize();
+	return garbage >= REGION_COMPACT_MIN_GARBAGE && garbage > m_live;
+}
+
+bool RegionFile::sync()
+{
+	if (m_dirty.empty())
+		return true;
+
+	// The blocks must reach the disk first, or a crash could leave index
+	// entries pointing to garbage
+#ifndef _WIN32
+	if (fsync(m_fd) != 0)
+		return false;
+#endif
+
+	for (u16 index : m_dirty) {
+		if (!writeEntry(index))
+			return false;
+	}
+	m_file.flush();
+	if (!m_file.good()) {
+		m_file.clear();
+		return false;
+	}
+	m_dirty.clear();
+	return true;
+}
+
+void RegionFile::copyBlock(u16 i, std::string &buf)
+{
+	Compaction &c = *m_compaction;
+	c.copied[i] = m_index[i];
+	c.index[i] = {0, 0};
+	if (m_index[i].offset == 0)
+		return;
+
+	if (!read(i, &buf)) {
+		c.os.setstate(std::ios::failbit);
+		return;
+	}
+	c.os.write(buf.data(), buf.size());
+	c.index[i] = {c.end, (u32)buf.size()};
+	c.end += buf.size();
+}
+
+bool RegionFile::compactStep(u64 budget)
+{
+	if (!m_compaction) {
+		m_compaction = std::make_unique<Compaction>();
+		Compaction &c = *m_compaction;
+		c.copied.assign(BLOCKS, Entry{0, 0});
+		c.index.assign(BLOCKS, Entry{0, 0});
+		c.end = HEADER_SIZE;
+		c.os.open(m_path + ".tmp", std::ios::binary | std::ios::trunc);
+		// Written again with the real index when finishing
+		writeHeader(c.os, c.index.data());
+	}
+
+	Compaction &c = *m_compaction;
+	const u64 end_before = c.end;
+	std::string buf;
+	while (c.next < BLOCKS && c.end - end_before < budget && c.os.good())
+		copyBlock(c.next++, buf);
+
+	if (!c.os.good()) {
+		abortCompaction();
+		return false;
+	}
+	if (c.next < BLOCKS)
+		return true;
+	return finishCompaction();
+}
+
+bool RegionFile::finishCompaction()
+{
+	const std::string tmp_path = m_path + ".tmp";
+	{
+		Compaction &c = *m_compaction;
+		// Blocks saved or deleted since they were copied
+		std::string buf;
+		for (u32 i = 0; i < BLOCKS && c.os.good(); i++) {
+			if (m_index[i].offset != c.copied[i].offset)
+				copyBlock(i, buf);
+		}
+
+		c.os.seekp(0);
+		writeHeader(c.os, c.index.data());
+		c.os.close();
+		if (!c.os.good() || !syncFile(tmp_path)) {
+			abortCompaction();
+			return false;
+		}
+	}
+	m_compaction.reset();
+
+	close();
+	bool ok = fs::Rename(tmp_path, m_path);
+	if (!ok) {
+		// Renaming onto an existing file fails on Windows
+		const std::string old_path = m_path + ".old";
+		ok = fs::Rename(m_path, old_path) && fs::Rename(tmp_path, m_path);
+		if (ok)
+			fs::DeleteSingleFileOrEmptyDirectory(old_path);
+		else if (!fs::PathExists(m_path))
+			fs::Rename(old_path, m_path);
+	}
+	if (!ok)
+		fs::DeleteSingleFileOrEmptyDirectory(tmp_path);
+	open();
+	return ok;
+}
+
+void RegionFile::abortCompaction()
+{
+	if (!m_compaction)
+		return;
+	m_compaction.reset();
+	fs::DeleteSingleFileOrEmptyDirectory(m_path + ".tmp");
+}
+
+/*
+	MapDatabaseRegions
+*/
+
+MapDatabaseRegions::MapDatabaseRegions(const std::string &savedir) :
+	m_dir(savedir + DIR_DELIM + "map_regions")
+{
+	if (!fs::CreateAllDirs(m_dir))
+		throw DatabaseException("Failed to create directory " + m_dir);
+}
+
+v3s16 MapDatabaseRegions::getRegionPos(const v3s16 &pos)
+{
+	return getContainerPos(pos, 16);
+}
+
+std::string MapDatabaseRegions::getRegionPath(const v3s16 &region) const
+{
+	return m_dir + DIR_DELIM + "r." + itos(region.X) + "." + itos(region.Y)
+		+ "." + itos(region.Z) + ".mtr";
+}
+
+RegionFile *MapDatabaseRegions::getRegion(const v3s16 &region, bool create)
+{
+	auto it = m_regions.find(region);
+	if (it != m_regions.end()) {
+		it->second->last_use = ++m_use_counter;
+		return it->second.get();
+	}
+
+	if (!create && m_missing.count(region) != 0)
+		return nullptr;
+	const std::string path = getRegionPath(region);
+	if (!create && !fs::PathExists(path)) {
+		m_missing.insert(region);
+		return nullptr;
+	}
+
+	if (m_regions.size() >= MAX_OPEN_REGIONS) {
+		auto oldest = std::min_element(m_regions.begin(), m_regions.end(),
+			[] (const auto &a, const auto &b) {
+				return a.second->last_use < b.second->last_use;
+			});
+		m_regions.erase(oldest);
+	}
+
+	auto file = std::make_unique<RegionFile>(path);
+	file->last_use = ++m_use_counter;
+	m_missing.erase(region);
+	RegionFile *ret = file.get();
+	m_regions.emplace(region, std::move(file));
+	return ret;
+}
+
+bool MapDatabaseRegions::saveBlock(const v3s16 &pos, const std::string &data)
+{
+	RegionFile *region = getRegion(getRegionPos(pos), true);
+	if (!region->write(RegionFile::getBlockIndex(pos), data)) {
+		warningstream << "saveBlock: Error writing block " << pos
+			<< " to its region file" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+void MapDatabaseRegions::loadBlock(const v3s16 &pos, std::string *block)
+{
+	RegionFile *region = getRegion(getRegionPos(pos), false);
+	if (region)
+		region->read(RegionFile::getBlockIndex(pos), block);
+	else
+		block->clear();
+}
+
+bool MapDatabaseRegions::deleteBlock(const v3s16 &pos)
+{
+	RegionFile *region = getRegion(getRegionPos(pos), false);
+	if (!region || region->remove(RegionFile::getBlockIndex(pos)))
+		return true;
+
+	warningstream << "deleteBlock: Error deleting block " << pos
+		<< " from its region file" << std::endl;
+	return false;
+}
+
+void MapDatabaseRegions::listAllLoadableBlocks(std::vector<v3s16> &dst)
+{
+	for (const fs::DirListNode &node : fs::GetDirListing(m_dir)) {
+		v3s16 region;
+		if (node.dir || !str_ends_with(node.name, ".mtr") ||
+				sscanf(node.name.c_str(), "r.%hd.%hd.%hd.mtr",
+					&region.X, &region.Y, &region.Z) != 3)
+			continue;
+		// Skip names that don't round-trip, like "r.01.0.0.mtr"
+		if (node.name != fs::GetFilenameFromPath(getRegionPath(region).c_str()))
+			continue;
+
+		if (RegionFile *file = getRegion(region, false))
+			file->listBlocks(region, dst);
+	}
+}
+
+void MapDatabaseRegions::endSave()
+{
+	for (auto &it : m_regions) {
+		if (!it.second->sync()) {
+			errorstream << "MapDatabaseRegions: Failed to write the index of region "
+				<< it.first << std::endl;
+		}
+	}
+
+	// Compaction is spread over the saves to keep each pause short. One file
+	// at a time, the one with the most garbage first.
+	RegionFile *file = nullptr;
+	for (auto &it : m_regions) {
+		if (it.second->isCompacting()) {
+			file = it.second.get();
+			break;
+		}
+		if (it.second->needsCompaction() && (!file ||
+				it.second->getGarbageSize() > file->getGarbageSize()))
+			file = it.second.get();
+	}
+	if (!file)
+		return;
+
+	// Don't close it for other regions in between
+	file->last_use = ++m_use_counter;
+	if (!file->compactStep(REGION_COMPACT_STEP)) {
+		warningstream << "MapDatabaseRegions: Failed to compact a region file"
+			<< std::endl;
+	} else if (!file->isCompacting()) {
+		verbosestream << "MapDatabaseRegions: Compacted a region file to "
+			<< file->getFileSize() << " bytes" << std::endl;
+	}
+}
@@ -0,0 +1,157 @@
+/*
+Minetest
+Copyright (C) 2024 Minetest Authors
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#pragma once
+
+#include <fstream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "database.h"
+
+/*
+	Stores the map in region files of 16x16x16 blocks. Each file starts with
+	an index of the offset and length of every block, the blocks themselves
+	are only ever appended. The index entries pointing to them are written
+	by sync(), after the blocks reached the disk. Overwritten space is
+	reclaimed by compacting the file once it holds more garbage than data.
+	See doc/world_format.md for the file format.
+*/
+
+class RegionFile
+{
+public:
+	static constexpr u32 BLOCKS = 16 * 16 * 16;
+
+	// Opens an existing file or creates an empty one, throws
+	// DatabaseException if that fails or the file is corrupted
+	RegionFile(const std::string &path);
+	~RegionFile();
+	DISABLE_CLASS_COPY(RegionFile)
+
+	static u16 getBlockIndex(const v3s16 &pos)
+	{
+		return ((pos.Z & 15) * 16 + (pos.Y & 15)) * 16 + (pos.X & 15);
+	}
+
+	bool read(u16 index, std::string *data);
+	bool write(u16 index, const std::string &data);
+	bool remove(u16 index);
+
+	// Appends the positions of the stored blocks, 'region' is the position
+	// of the region in units of 16 blocks
+	void listBlocks(const v3s16 &region, std::vector<v3s16> &dst) const;
+
+	bool hasBlock(u16 index) const { return m_index[index].offset != 0; }
+
+	u64 getFileSize() const { return m_end; }
+	u64 getGarbageSize() const { return m_end - HEADER_SIZE - m_live; }
+	bool needsCompaction() const;
+
+	// Writes the appended blocks to the disk, then the index entries
+	// pointing to them
+	bool sync();
+
+	// Copies about 'budget' bytes of blocks to a file without the unused
+	// space, which replaces this file once all blocks are copied
+	bool compactStep(u64 budget);
+	bool isCompacting() const { return m_compaction != nullptr; }
+
+	u64 last_use = 0;
+
+private:
+	struct Entry {
+		u64 offset;
+		u32 length;
+	};
+
+	struct Compaction {
+		std::ofstream os;
+		// Version of each block that was copied, compared to the current
+		// one when finishing
+		std::vector<Entry> copied;
+		// Index of the compacted file
+		std::vector<Entry> index;
+		u64 end;
+		u32 next = 0;
+	};
+
+	static constexpr u32 ENTRY_SIZE = 8 + 4;
+	static constexpr u32 HEADER_SIZE = 4 + 4 + BLOCKS * ENTRY_SIZE;
+
+	static void writeHeader(std::ostream &os, const Entry *index);
+
+	void open();
+	void close();
+	bool writeEntry(u16 index);
+	// Makes [offset, offset + length) readable through m_view
+	bool mapRange(u64 offset, u32 length);
+	// Appends the current version of block 'i' to the compacted file
+	void copyBlock(u16 i, std::string &buf);
+	bool finishCompaction();
+	void abortCompaction();
+
+	const std::string m_path;
+	std::fstream m_file;
+	Entry m_index[BLOCKS];
+	// End of the file, new blocks are appended here
+	u64 m_end = 0;
+	// Sum of the lengths of all stored blocks
+	u64 m_live = 0;
+	// Index entries that changed since the last sync()
+	std::unordered_set<u16> m_dirty;
+	std::unique_ptr<Compaction> m_compaction;
+
+#ifndef _WIN32
+	int m_fd = -1;
+	const char *m_view = nullptr;
+	u64 m_view_size = 0;
+#endif
+};
+
+class MapDatabaseRegions : public MapDatabase
+{
+public:
+	MapDatabaseRegions(const std::string &savedir);
+	~MapDatabaseRegions() = default;
+
+	bool saveBlock(const v3s16 &pos, const std::string &data);
+	void loadBlock(const v3s16 &pos, std::string *block);
+	bool deleteBlock(const v3s16 &pos);
+	void listAllLoadableBlocks(std::vector<v3s16> &dst);
+
+	void beginSave() {}
+	void endSave();
+
+private:
+	static v3s16 getRegionPos(const v3s16 &pos);
+	std::string getRegionPath(const v3s16 &region) const;
+
+	// Returns nullptr if the region has no file and 'create' is false
+	RegionFile *getRegion(const v3s16 &region, bool create);
+
+	const std::string m_dir;
+	std::unordered_map<v3s16, std::unique_ptr<RegionFile>> m_regions;
+	// Regions known to have no file yet, saves a lookup for every block
+	// of newly generated terrain
+	std::unordered_set<v3s16> m_missing;
+	u64 m_use_counter = 0;
+};
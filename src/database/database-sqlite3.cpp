@@ -37,6 +37,7 @@ SQLite format specification:
 #include "irrlicht_changes/printing.h"
 #include "server/player_sao.h"
 
+#include <algorithm>
 #include <cassert>
 
 // When to print messages when the database is being held locked by another process
@@ -207,6 +208,7 @@ MapDatabaseSQLite3::MapDatabaseSQLite3(const std::string &savedir):
 MapDatabaseSQLite3::~MapDatabaseSQLite3()
 {
 	FINALIZE_STATEMENT(m_stmt_read)
+	FINALIZE_STATEMENT(m_stmt_read_batch)
 	FINALIZE_STATEMENT(m_stmt_write)
 	FINALIZE_STATEMENT(m_stmt_list)
 	FINALIZE_STATEMENT(m_stmt_delete)
@@ -229,6 +231,10 @@ void MapDatabaseSQLite3::createDatabase()
 void MapDatabaseSQLite3::initStatements()
 {
 	PREPARE_STATEMENT(read, "SELECT `data` FROM `blocks` WHERE `pos` = ? LIMIT 1");
+	// Must have READ_BATCH_SIZE parameters
+	PREPARE_STATEMENT(read_batch, "SELECT `pos`, `data` FROM `blocks` WHERE `pos` IN "
+		"(?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, "
+		"?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)");
 	PREPARE_STATEMENT(write, "REPLACE INTO `blocks` (`pos`, `data`) VALUES (?, ?)");
 	PREPARE_STATEMENT(delete, "DELETE FROM `blocks` WHERE `pos` = ?");
 	PREPARE_STATEMENT(list, "SELECT `pos` FROM `blocks`");
@@ -296,6 +302,39 @@ void MapDatabaseSQLite3::loadBlock(const v3s16 &pos, std::string *block)
 	sqlite3_reset(m_stmt_read);
 }
 
+void MapDatabaseSQLite3::loadBlocks(const std::vector<v3s16> &pos,
+	std::vector<std::string> &blocks)
+{
+	static constexpr size_t READ_BATCH_SIZE = 32;
+
+	verifyDatabase();
+
+	blocks.assign(pos.size(), std::string());
+
+	for (size_t start = 0; start < pos.size(); start += READ_BATCH_SIZE) {
+		size_t end = std::min(start + READ_BATCH_SIZE, pos.size());
+
+		// Unused parameters repeat the last position
+		for (size_t i = 0; i < READ_BATCH_SIZE; i++)
+			bindPos(m_stmt_read_batch, pos[std::min(start + i, end - 1)], i + 1);
+
+		while (sqlite3_step(m_stmt_read_batch) == SQLITE_ROW) {
+			s64 found = sqlite3_column_int64(m_stmt_read_batch, 0);
+			const char *data = (const char *) sqlite3_column_blob(m_stmt_read_batch, 1);
+			size_t len = sqlite3_column_bytes(m_stmt_read_batch, 1);
+			if (!data)
+				continue;
+
+			// The same position may have been requested more than once
+			for (size_t i = start; i < end; i++) {
+				if (getBlockAsInteger(pos[i]) == found)
+					blocks[i].assign(data, len);
+			}
+		}
+		sqlite3_reset(m_stmt_read_batch);
+	}
+}
+
 void MapDatabaseSQLite3::listAllLoadableBlocks(std::vector<v3s16> &dst)
 {
 	verifyDatabase();
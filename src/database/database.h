@@ -44,6 +44,12 @@ class MapDatabase : public Database
 	virtual void loadBlock(const v3s16 &pos, std::string *block) = 0;
 	virtual bool deleteBlock(const v3s16 &pos) = 0;
 
+	// Loads the block at each position into the same index of 'blocks',
+	// which is left empty for missing blocks. Backends reached over the
+	// network answer it with a single request.
+	virtual void loadBlocks(const std::vector<v3s16> &pos,
+		std::vector<std::string> &blocks);
+
 	static s64 getBlockAsInteger(const v3s16 &pos);
 	static v3s16 getIntegerAsBlock(s64 i);
 
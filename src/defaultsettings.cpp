@@ -236,6 +236,8 @@ void set_default_settings()
 	settings->setDefault("desynchronize_mapblock_texture_animation", "false");
 	settings->setDefault("hud_hotbar_max_width", "1.0");
 	settings->setDefault("enable_local_map_saving", "false");
+	settings->setDefault("enable_client_block_cache", "false");
+	settings->setDefault("client_block_cache_size", "50000");
 	settings->setDefault("show_entity_selectionbox", "false");
 	settings->setDefault("ambient_occlusion_gamma", "1.8");
 	settings->setDefault("enable_shaders", "true");
@@ -356,6 +358,7 @@ void set_default_settings()
 	// Server
 	settings->setDefault("disable_escape_sequences", "false");
 	settings->setDefault("strip_color_codes", "false");
+	settings->setDefault("metrics_dump_interval", "0");
 #if USE_PROMETHEUS
 	settings->setDefault("prometheus_listener_address", "127.0.0.1:30000");
 #endif
@@ -369,6 +372,8 @@ void set_default_settings()
 	settings->setDefault("protocol_version_min", "1");
 	settings->setDefault("player_transfer_distance", "0");
 	settings->setDefault("max_simultaneous_block_sends_per_client", "40");
+	settings->setDefault("adaptive_block_send", "true");
+	settings->setDefault("max_adaptive_block_sends_per_client", "200");
 	settings->setDefault("time_send_interval", "5");
 
 	settings->setDefault("motd", "");
@@ -390,6 +395,10 @@ void set_default_settings()
 
 	settings->setDefault("chat_message_format", "<@name> @message");
 	settings->setDefault("profiler_print_interval", "0");
+	settings->setDefault("profiler_tracing", "false");
+	settings->setDefault("profiler_trace_step_threshold", "0");
+	settings->setDefault("lua_cpu_accounting", "off");
+	settings->setDefault("lua_cpu_accounting_sample_interval", "16");
 	settings->setDefault("active_object_send_range_blocks", "8");
 	settings->setDefault("active_block_range", "4");
 	//settings->setDefault("max_simultaneous_block_sends_per_client", "1");
@@ -404,6 +413,7 @@ void set_default_settings()
 	settings->setDefault("time_speed", "72");
 	settings->setDefault("world_start_time", "6125");
 	settings->setDefault("server_unload_unused_data_timeout", "29");
+	settings->setDefault("compact_mapblocks", "true");
 	settings->setDefault("max_objects_per_block", "256");
 	settings->setDefault("server_map_save_interval", "5.3");
 	settings->setDefault("chat_message_max_size", "500");
@@ -411,6 +421,7 @@ void set_default_settings()
 	settings->setDefault("chat_message_limit_trigger_kick", "50");
 	settings->setDefault("sqlite_synchronous", "2");
 	settings->setDefault("map_compression_level_disk", "-1");
+	settings->setDefault("map_compression_dictionary", "false");
 	settings->setDefault("map_compression_level_net", "-1");
 	settings->setDefault("full_block_send_enable_min_time_from_building", "2.0");
 	settings->setDefault("dedicated_server_step", "0.09");
@@ -427,6 +438,7 @@ void set_default_settings()
 	settings->setDefault("emergequeue_limit_diskonly", "128");
 	settings->setDefault("emergequeue_limit_generate", "128");
 	settings->setDefault("num_emerge_threads", "1");
+	settings->setDefault("mapgen_column_cache_size", "128");
 	settings->setDefault("secure.enable_security", "true");
 	settings->setDefault("secure.trusted_mods", "");
 	settings->setDefault("secure.http_mods", "");
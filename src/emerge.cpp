@@ -21,8 +21,9 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "emerge.h"
 
+#include <deque>
 #include <iostream>
-#include <queue>
+#include <unordered_map>
 
 #include "util/container.h"
 #include "util/thread.h"
@@ -40,12 +41,16 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "mapgen/mg_decoration.h"
 #include "mapgen/mg_schematic.h"
 #include "nodedef.h"
+#include "porting.h"
 #include "profiler.h"
 #include "scripting_server.h"
 #include "server.h"
 #include "settings.h"
 #include "voxel.h"
 
+// Number of queued blocks an emerge thread loads with one database request
+static constexpr size_t EMERGE_PREFETCH_MAX = 64;
+
 class EmergeThread : public Thread {
 public:
 	bool enable_mapgen_debug_info;
@@ -66,7 +71,7 @@ class EmergeThread : public Thread {
 
 	void runCompletionCallbacks(
 		const v3s16 &pos, EmergeAction action,
-		const EmergeCallbackList &callbacks);
+		const BlockEmergeData &bedata);
 
 private:
 	Server *m_server;
@@ -75,12 +80,32 @@ class EmergeThread : public Thread {
 	Mapgen *m_mapgen;
 
 	Event m_queue_event;
-	std::queue<v3s16> m_block_queue;
+	std::deque<v3s16> m_block_queue;
+	enum PrefetchState : u8 {
+		// Not looked up, it was in memory, being loaded by another thread
+		// or known to be missing. It may have changed since.
+		PREFETCH_SKIPPED,
+		// Not found in the database
+		PREFETCH_NOT_ON_DISK,
+		// Loaded from the database
+		PREFETCH_LOADED,
+	};
+	// Blocks that were looked up in the database ahead of time
+	std::unordered_map<v3s16, PrefetchState> m_prefetched;
 
 	bool popBlockEmerge(v3s16 *pos, BlockEmergeData *bedata);
-
-	EmergeAction getBlockOrStartGen(
-		const v3s16 &pos, bool allow_gen, MapBlock **block, BlockMakeData *data);
+	// Loads the block at 'pos' together with the next queued ones
+	void prefetchBlocks(const v3s16 &pos);
+	// Loads the existing blocks of the area a generation of 'pos' needs
+	void prefetchChunk(const v3s16 &pos);
+	// Finishes loads started with ServerMap::startLoadBlocks(), holding the
+	// environment lock only to insert the blocks
+	void loadBlocks(std::vector<ServerMap::BlockLoad> &loads,
+		std::vector<v3s16> *loaded = nullptr,
+		std::vector<v3s16> *not_found = nullptr);
+
+	EmergeAction getBlockOrStartGen(const v3s16 &pos, bool allow_gen,
+		PrefetchState prefetched, MapBlock **block, BlockMakeData *data);
 	MapBlock *finishGen(v3s16 pos, BlockMakeData *bmdata,
 		std::map<v3s16, MapBlock *> *modified_blocks);
 
@@ -132,9 +157,11 @@ EmergeParams::EmergeParams(EmergeManager *parent, const BiomeGen *biomegen,
 	gen_notify_on(parent->gen_notify_on),
 	gen_notify_on_deco_ids(&parent->gen_notify_on_deco_ids),
 	biomemgr(biomemgr->clone()), oremgr(oremgr->clone()),
-	decomgr(decomgr->clone()), schemmgr(schemmgr->clone())
+	decomgr(decomgr->clone()), schemmgr(schemmgr->clone()),
+	column_cache(parent->m_column_cache.get())
 {
 	this->biomegen = biomegen->clone(this->biomemgr);
+	this->biomegen->setColumnCache(column_cache);
 }
 
 ////
@@ -170,6 +197,11 @@ EmergeManager::EmergeManager(Server *server, MetricsBackend *mb)
 		);
 	}
 
+	m_emerge_latency_histogram = mb->addHistogram(
+		"minetest_emerge_latency_seconds",
+		"Time from queueing a block until its emerge completed (in seconds)",
+		MetricHistogram::exponentialBuckets(0.001, 2.0, 15));
+
 	s16 nthreads = 1;
 	g_settings->getS16NoEx("num_emerge_threads", nthreads);
 	// If automatic, leave a proc for the main thread and one for
@@ -179,6 +211,9 @@ EmergeManager::EmergeManager(Server *server, MetricsBackend *mb)
 	if (nthreads < 1)
 		nthreads = 1;
 
+	m_column_cache = std::make_unique<MapgenColumnCache>(
+		g_settings->getU32("mapgen_column_cache_size"));
+
 	m_qlimit_total = g_settings->getU32("emergequeue_limit_total");
 	// FIXME: these fallback values are probably not good
 	if (!g_settings->getU32NoEx("emergequeue_limit_diskonly", m_qlimit_diskonly))
@@ -452,6 +487,7 @@ bool EmergeManager::pushBlockEmergeData(
 	} else {
 		bedata.flags = flags;
 		bedata.peer_requested = peer_requested;
+		bedata.time_queued = porting::getTimeUs();
 
 		count_peer++;
 	}
@@ -503,10 +539,14 @@ EmergeThread *EmergeManager::getOptimalThread()
 	return m_threads[index];
 }
 
-void EmergeManager::reportCompletedEmerge(EmergeAction action)
+void EmergeManager::reportCompletedEmerge(EmergeAction action, u64 time_queued)
 {
 	assert((size_t)action < ARRLEN(m_completed_emerge_counter));
 	m_completed_emerge_counter[(int)action]->increment();
+
+	// Cancellations say nothing about how fast blocks are delivered
+	if (action != EMERGE_CANCELLED)
+		m_emerge_latency_histogram->observe((porting::getTimeUs() - time_queued) * 1e-6);
 }
 
 
@@ -534,7 +574,7 @@ void EmergeThread::signal()
 
 bool EmergeThread::pushBlock(const v3s16 &pos)
 {
-	m_block_queue.push(pos);
+	m_block_queue.push_back(pos);
 	return true;
 }
 
@@ -548,19 +588,22 @@ void EmergeThread::cancelPendingItems()
 		v3s16 pos;
 
 		pos = m_block_queue.front();
-		m_block_queue.pop();
+		m_block_queue.pop_front();
 
 		m_emerge->popBlockEmergeData(pos, &bedata);
 
-		runCompletionCallbacks(pos, EMERGE_CANCELLED, bedata.callbacks);
+		runCompletionCallbacks(pos, EMERGE_CANCELLED, bedata);
 	}
+	m_prefetched.clear();
 }
 
 
 void EmergeThread::runCompletionCallbacks(const v3s16 &pos, EmergeAction action,
-	const EmergeCallbackList &callbacks)
+	const BlockEmergeData &bedata)
 {
-	m_emerge->reportCompletedEmerge(action);
+	m_emerge->reportCompletedEmerge(action, bedata.time_queued);
+
+	const EmergeCallbackList &callbacks = bedata.callbacks;
 
 	for (size_t i = 0; i != callbacks.size(); i++) {
 		EmergeCompletionCallback callback;
@@ -582,7 +625,7 @@ bool EmergeThread::popBlockEmerge(v3s16 *pos, BlockEmergeData *bedata)
 		return false;
 
 	*pos = m_block_queue.front();
-	m_block_queue.pop();
+	m_block_queue.pop_front();
 
 	m_emerge->popBlockEmergeData(*pos, bedata);
 
@@ -590,8 +633,83 @@ bool EmergeThread::popBlockEmerge(v3s16 *pos, BlockEmergeData *bedata)
 }
 
 
-EmergeAction EmergeThread::getBlockOrStartGen(
-	const v3s16 &pos, bool allow_gen, MapBlock **block, BlockMakeData *bmdata)
+void EmergeThread::prefetchBlocks(const v3s16 &pos)
+{
+	std::vector<v3s16> positions{pos};
+	{
+		MutexAutoLock queuelock(m_emerge->m_queue_mutex);
+		for (const v3s16 &p : m_block_queue) {
+			if (positions.size() >= EMERGE_PREFETCH_MAX)
+				break;
+			if (!blockpos_over_max_limit(p) &&
+					m_prefetched.find(p) == m_prefetched.end())
+				positions.push_back(p);
+		}
+	}
+
+	std::vector<ServerMap::BlockLoad> loads;
+	{
+		MutexAutoLock envlock(m_server->m_env_mutex);
+		m_map->startLoadBlocks(positions, loads);
+	}
+	std::vector<v3s16> loaded, not_found;
+	loadBlocks(loads, &loaded, &not_found);
+
+	for (const v3s16 &p : positions)
+		m_prefetched[p] = PREFETCH_SKIPPED;
+	for (const v3s16 &p : not_found)
+		m_prefetched[p] = PREFETCH_NOT_ON_DISK;
+	// A stale load may have found the block when it was loaded again
+	for (const v3s16 &p : loaded)
+		m_prefetched[p] = PREFETCH_LOADED;
+}
+
+
+void EmergeThread::prefetchChunk(const v3s16 &pos)
+{
+	std::vector<ServerMap::BlockLoad> loads;
+	{
+		MutexAutoLock envlock(m_server->m_env_mutex);
+		MapBlock *block = m_map->getBlockNoCreateNoEx(pos);
+		if (block && block->isGenerated())
+			return;
+
+		// Same area as in ServerMap::initBlockMake()
+		s16 csize = m_map->getMapgenParams()->chunksize;
+		v3s16 bpmin = EmergeManager::getContainingChunk(pos, csize) - v3s16(1, 1, 1);
+		v3s16 bpmax = bpmin + v3s16(1, 1, 1) * (csize + 1);
+		std::vector<v3s16> area;
+		for (s16 x = bpmin.X; x <= bpmax.X; x++)
+		for (s16 z = bpmin.Z; z <= bpmax.Z; z++)
+		for (s16 y = bpmin.Y; y <= bpmax.Y; y++)
+			area.emplace_back(x, y, z);
+		m_map->startLoadBlocks(area, loads);
+	}
+	loadBlocks(loads);
+}
+
+
+void EmergeThread::loadBlocks(std::vector<ServerMap::BlockLoad> &loads,
+	std::vector<v3s16> *loaded, std::vector<v3s16> *not_found)
+{
+	if (loads.empty())
+		return;
+
+	m_map->readBlocks(loads);
+	if (not_found) {
+		for (const ServerMap::BlockLoad &load : loads) {
+			if (!load.block && load.blob.empty())
+				not_found->push_back(load.pos);
+		}
+	}
+
+	MutexAutoLock envlock(m_server->m_env_mutex);
+	m_map->finishLoadBlocks(loads, loaded);
+}
+
+
+EmergeAction EmergeThread::getBlockOrStartGen(const v3s16 &pos, bool allow_gen,
+	PrefetchState prefetched, MapBlock **block, BlockMakeData *bmdata)
 {
 	MutexAutoLock envlock(m_server->m_env_mutex);
 
@@ -599,9 +717,11 @@ EmergeAction EmergeThread::getBlockOrStartGen(
 	*block = m_map->getBlockNoCreateNoEx(pos);
 	if (*block) {
 		if ((*block)->isGenerated())
-			return EMERGE_FROM_MEMORY;
+			return prefetched == PREFETCH_LOADED ? EMERGE_FROM_DISK : EMERGE_FROM_MEMORY;
 	} else {
-		// 2). Attempt to load block from disk if it was not in the memory
+		// 2). Attempt to load it from disk. It may have been saved and
+		// unloaded since it was prefetched, ServerMap knows the blocks that
+		// are still missing.
 		*block = m_map->loadBlock(pos);
 		if (*block && (*block)->isGenerated())
 			return EMERGE_FROM_DISK;
@@ -620,8 +740,9 @@ MapBlock *EmergeThread::finishGen(v3s16 pos, BlockMakeData *bmdata,
 	std::map<v3s16, MapBlock *> *modified_blocks)
 {
 	MutexAutoLock envlock(m_server->m_env_mutex);
-	ScopeProfiler sp(g_profiler,
-		"EmergeThread: after Mapgen::makeChunk", SPT_AVG);
+	static const auto sp_id = ScopeProfiler::intern(
+		"EmergeThread: after Mapgen::makeChunk");
+	ScopeProfiler sp(g_profiler, sp_id, SPT_AVG);
 
 	/*
 		Perform post-processing on blocks (invalidate lighting, queue liquid
@@ -704,11 +825,22 @@ void *EmergeThread::run()
 		bool allow_gen = bedata.flags & BLOCK_EMERGE_ALLOW_GEN;
 		EMERGE_DBG_OUT("pos=" << pos << " allow_gen=" << allow_gen);
 
-		action = getBlockOrStartGen(pos, allow_gen, &block, &bmdata);
+		// Look this and the next queued blocks up in the database at once
+		if (m_prefetched.find(pos) == m_prefetched.end())
+			prefetchBlocks(pos);
+		PrefetchState prefetched = m_prefetched[pos];
+		m_prefetched.erase(pos);
+
+		// Whatever exists of the chunk is needed to generate the rest
+		if (allow_gen && prefetched != PREFETCH_LOADED)
+			prefetchChunk(pos);
+
+		action = getBlockOrStartGen(pos, allow_gen, prefetched, &block, &bmdata);
 		if (action == EMERGE_GENERATED) {
 			{
-				ScopeProfiler sp(g_profiler,
-					"EmergeThread: Mapgen::makeChunk", SPT_AVG);
+				static const auto sp_id = ScopeProfiler::intern(
+					"EmergeThread: Mapgen::makeChunk");
+				ScopeProfiler sp(g_profiler, sp_id, SPT_AVG);
 
 				m_mapgen->makeChunk(&bmdata);
 			}
@@ -718,7 +850,7 @@ void *EmergeThread::run()
 				action = EMERGE_ERRORED;
 		}
 
-		runCompletionCallbacks(pos, action, bedata.callbacks);
+		runCompletionCallbacks(pos, action, bedata);
 
 		if (block)
 			modified_blocks[pos] = block;
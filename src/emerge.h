@@ -20,6 +20,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #pragma once
 
 #include <map>
+#include <memory>
 #include <mutex>
 #include "network/networkprotocol.h"
 #include "irr_v3d.h"
@@ -93,6 +94,8 @@ struct BlockEmergeData {
 	u16 peer_requested;
 	u16 flags;
 	EmergeCallbackList callbacks;
+	// porting::getTimeUs() when the block was first queued
+	u64 time_queued = 0;
 };
 
 class EmergeParams {
@@ -114,6 +117,8 @@ class EmergeParams {
 	DecorationManager *decomgr;
 	SchematicManager *schemmgr;
 
+	MapgenColumnCache *column_cache; // shared
+
 private:
 	EmergeParams(EmergeManager *parent, const BiomeGen *biomegen,
 		const BiomeManager *biomemgr,
@@ -127,6 +132,7 @@ class EmergeManager {
 	 * - using schemmgr to load and place schematics
 	 */
 	friend class ModApiMapgen;
+	friend class BenchmarkServer;
 public:
 	const NodeDefManager *ndef;
 	bool enable_mapgen_debug_info;
@@ -206,8 +212,12 @@ class EmergeManager {
 	u32 m_qlimit_diskonly;
 	u32 m_qlimit_generate;
 
+	// 2D noise of recently generated mapchunk columns, used by all mapgens
+	std::unique_ptr<MapgenColumnCache> m_column_cache;
+
 	// Emerge metrics
 	MetricCounterPtr m_completed_emerge_counter[5];
+	MetricHistogramPtr m_emerge_latency_histogram;
 
 	// Managers of various map generation-related components
 	// Note that each Mapgen gets a copy(!) of these to work with
@@ -230,7 +240,7 @@ class EmergeManager {
 
 	bool popBlockEmergeData(v3s16 pos, BlockEmergeData *bedata);
 
-	void reportCompletedEmerge(EmergeAction action);
+	void reportCompletedEmerge(EmergeAction action, u64 time_queued);
 
 	friend class EmergeThread;
 };
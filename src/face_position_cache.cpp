@@ -19,9 +19,11 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "face_position_cache.h"
 #include "threading/mutex_auto_lock.h"
+#include "constants.h"
 
 
 std::unordered_map<u16, std::vector<v3s16>> FacePositionCache::cache;
+std::unordered_map<u16, FacePositionOffsets> FacePositionCache::offsets_cache;
 std::mutex FacePositionCache::cache_mutex;
 
 // Calculate the borders of a "d-radius" cube
@@ -35,6 +37,29 @@ const std::vector<v3s16> &FacePositionCache::getFacePositions(u16 d)
 	return generateFacePosition(d);
 }
 
+const FacePositionOffsets &FacePositionCache::getFaceOffsets(u16 d)
+{
+	MutexAutoLock lock(cache_mutex);
+	auto it = offsets_cache.find(d);
+	if (it != offsets_cache.end())
+		return it->second;
+
+	auto pos_it = cache.find(d);
+	const std::vector<v3s16> &positions = pos_it != cache.end() ?
+			pos_it->second : generateFacePosition(d);
+
+	FacePositionOffsets &o = offsets_cache[d];
+	o.x.reserve(positions.size());
+	o.y.reserve(positions.size());
+	o.z.reserve(positions.size());
+	for (const v3s16 &p : positions) {
+		o.x.push_back(p.X * MAP_BLOCKSIZE * BS);
+		o.y.push_back(p.Y * MAP_BLOCKSIZE * BS);
+		o.z.push_back(p.Z * MAP_BLOCKSIZE * BS);
+	}
+	return o;
+}
+
 const std::vector<v3s16> &FacePositionCache::generateFacePosition(u16 d)
 {
 	cache[d] = std::vector<v3s16>();
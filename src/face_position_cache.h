@@ -30,12 +30,22 @@ with this program; if not, write to the Free Software Foundation, Inc.,
  * This class permits caching getFacePosition call results.
  * This reduces CPU usage and vector calls.
  */
+/*
+ * The same positions as separate coordinate arrays, scaled to world units.
+ * Lets whole shells be processed at once, see blocksInSight().
+ */
+struct FacePositionOffsets {
+	std::vector<f32> x, y, z;
+};
+
 class FacePositionCache {
 public:
 	static const std::vector<v3s16> &getFacePositions(u16 d);
+	static const FacePositionOffsets &getFaceOffsets(u16 d);
 
 private:
 	static const std::vector<v3s16> &generateFacePosition(u16 d);
 	static std::unordered_map<u16, std::vector<v3s16>> cache;
+	static std::unordered_map<u16, FacePositionOffsets> offsets_cache;
 	static std::mutex cache_mutex;
 };
@@ -304,7 +304,7 @@ class CItemDefManager: public IWritableItemDefManager
 	virtual const ItemDefinition& get(const std::string &name_) const
 	{
 		// Convert name according to possible alias
-		std::string name = getAlias(name_);
+		const std::string &name = getAlias(name_);
 		// Get the definition
 		auto i = m_item_definitions.find(name);
 		if (i == m_item_definitions.cend())
@@ -333,7 +333,7 @@ class CItemDefManager: public IWritableItemDefManager
 	virtual bool isKnown(const std::string &name_) const
 	{
 		// Convert name according to possible alias
-		std::string name = getAlias(name_);
+		const std::string &name = getAlias(name_);
 		// Get the definition
 		return m_item_definitions.find(name) != m_item_definitions.cend();
 	}
@@ -23,6 +23,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "filesys.h"
 #include "voxel.h"
 #include "voxelalgorithms.h"
+#include "nodechangebatch.h"
 #include "porting.h"
 #include "serialization.h"
 #include "nodemetadata.h"
@@ -42,11 +43,13 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "server.h"
 #include "database/database.h"
 #include "database/database-dummy.h"
+#include "database/database-regions.h"
 #include "database/database-sqlite3.h"
 #include "script/scripting_server.h"
 #include "irrlicht_changes/printing.h"
+#include "threading/mutex_auto_lock.h"
+#include <algorithm>
 #include <deque>
-#include <queue>
 #if USE_LEVELDB
 #include "database/database-leveldb.h"
 #endif
@@ -250,6 +253,49 @@ void Map::removeNodeAndUpdate(v3s16 p,
 	addNodeAndUpdate(p, MapNode(CONTENT_AIR), modified_blocks, true);
 }
 
+void Map::addNodesAndUpdate(const NodeChangeBatch &batch,
+		std::map<v3s16, MapBlock*> &modified_blocks)
+{
+	const v3s16 blockpos = batch.getBlockPos();
+	MapBlock *block = getBlockNoCreateNoEx(blockpos);
+	if (!block || batch.empty())
+		return;
+
+	const v3s16 blockpos_nodes = blockpos * MAP_BLOCKSIZE;
+	std::vector<std::pair<v3s16, MapNode> > oldnodes;
+
+	for (const auto &it : batch.getChanges()) {
+		const v3s16 relpos = NodeChangeBatch::indexToPos(it.first);
+		const v3s16 p = blockpos_nodes + relpos;
+		MapNode n = it.second.n;
+		MapNode oldnode = block->getNodeNoCheck(relpos);
+
+		if (!it.second.keep_metadata)
+			removeNodeMetadata(p);
+
+		ContentLightingFlags f = m_nodedef->getLightingFlags(n);
+		ContentLightingFlags oldf = m_nodedef->getLightingFlags(oldnode);
+		if (f == oldf) {
+			n.setLight(LIGHTBANK_DAY, oldnode.getLightRaw(LIGHTBANK_DAY, oldf), f);
+			n.setLight(LIGHTBANK_NIGHT, oldnode.getLightRaw(LIGHTBANK_NIGHT, oldf), f);
+		} else {
+			n.setLight(LIGHTBANK_DAY, 0, f);
+			n.setLight(LIGHTBANK_NIGHT, 0, f);
+			oldnodes.emplace_back(p, oldnode);
+		}
+		set_node_in_block(m_gamedef->ndef(), block, relpos, n);
+	}
+	modified_blocks[blockpos] = block;
+
+	if (!oldnodes.empty()) {
+		voxalgo::update_lighting_nodes(this, oldnodes, modified_blocks);
+
+		for (auto &modified_block : modified_blocks) {
+			modified_block.second->expireDayNightDiff();
+		}
+	}
+}
+
 bool Map::addNodeWithEvent(v3s16 p, MapNode n, bool remove_metadata)
 {
 	MapEditEvent event;
@@ -295,21 +341,6 @@ bool Map::removeNodeWithEvent(v3s16 p)
 	return succeeded;
 }
 
-struct TimeOrderedMapBlock {
-	MapSector *sect;
-	MapBlock *block;
-
-	TimeOrderedMapBlock(MapSector *sect, MapBlock *block) :
-		sect(sect),
-		block(block)
-	{}
-
-	bool operator<(const TimeOrderedMapBlock &b) const
-	{
-		return block->getUsageTimer() < b.block->getUsageTimer();
-	};
-};
-
 /*
 	Updates usage timers
 */
@@ -321,121 +352,81 @@ void Map::timerUpdate(float dtime, float unload_timeout, s32 max_loaded_blocks,
 	// Profile modified reasons
 	Profiler modprofiler;
 
-	std::vector<v2s16> sector_deletion_queue;
 	u32 deleted_blocks_count = 0;
 	u32 saved_blocks_count = 0;
-	u32 block_count_all = 0;
-	u32 locked_blocks = 0;
 
 	const auto start_time = porting::getTimeUs();
-	beginSave();
-
-	// If there is no practical limit, we spare creation of mapblock_queue
-	if (max_loaded_blocks < 0) {
-		for (auto &sector_it : m_sectors) {
-			MapSector *sector = sector_it.second;
-
-			bool all_blocks_deleted = true;
-
-			MapBlockVect blocks;
-			sector->getBlocks(blocks);
-
-			for (MapBlock *block : blocks) {
-				block->incrementUsageTimer(dtime);
-
-				if (block->refGet() == 0
-						&& block->getUsageTimer() > unload_timeout) {
-					v3s16 p = block->getPos();
-
-					// Save if modified
-					if (block->getModified() != MOD_STATE_CLEAN
-							&& save_before_unloading) {
-						modprofiler.add(block->getModifiedReasonString(), 1);
-						if (!saveBlock(block))
-							continue;
-						saved_blocks_count++;
-					}
-
-					// Delete from memory
-					sector->deleteBlock(block);
-
-					if (unloaded_blocks)
-						unloaded_blocks->push_back(p);
+	m_block_usage.now += dtime;
+
+	// Old blocks and, while over the limit, the least recently used ones.
+	// Referenced blocks are not in the list, so none of them is looked at.
+	const size_t block_count = m_block_usage.getBlockCount();
+	std::vector<MapBlock *> blocks_to_unload;
+	for (MapBlock *block = m_block_usage.getOldest(); block;
+			block = m_block_usage.getNext(block)) {
+		const bool over_limit = max_loaded_blocks >= 0 &&
+			block_count - blocks_to_unload.size() > (size_t)max_loaded_blocks;
+		if (!over_limit && block->getUsageTimer() <= unload_timeout)
+			break;
+		blocks_to_unload.push_back(block);
+	}
 
-					deleted_blocks_count++;
-				} else {
-					all_blocks_deleted = false;
-					block_count_all++;
-				}
-			}
+	beginSave();
 
-			// Delete sector if we emptied it
-			if (all_blocks_deleted) {
-				sector_deletion_queue.push_back(sector_it.first);
+	// Save modified blocks together
+	if (save_before_unloading) {
+		std::vector<MapBlock *> blocks_to_save;
+		for (MapBlock *block : blocks_to_unload) {
+			if (block->getModified() != MOD_STATE_CLEAN) {
+				modprofiler.add(block->getModifiedReasonString(), 1);
+				blocks_to_save.push_back(block);
 			}
 		}
-	} else {
-		std::priority_queue<TimeOrderedMapBlock> mapblock_queue;
-		for (auto &sector_it : m_sectors) {
-			MapSector *sector = sector_it.second;
-
-			MapBlockVect blocks;
-			sector->getBlocks(blocks);
-
-			for (MapBlock *block : blocks) {
-				block->incrementUsageTimer(dtime);
-				mapblock_queue.push(TimeOrderedMapBlock(sector, block));
-			}
+		saveBlocks(blocks_to_save);
+		for (MapBlock *block : blocks_to_save) {
+			if (block->getModified() == MOD_STATE_CLEAN)
+				saved_blocks_count++;
 		}
-		block_count_all = mapblock_queue.size();
-
-		// Delete old blocks, and blocks over the limit from the memory
-		while (!mapblock_queue.empty() && ((s32)mapblock_queue.size() > max_loaded_blocks
-				|| mapblock_queue.top().block->getUsageTimer() > unload_timeout)) {
-			TimeOrderedMapBlock b = mapblock_queue.top();
-			mapblock_queue.pop();
-
-			MapBlock *block = b.block;
-
-			if (block->refGet() != 0) {
-				locked_blocks++;
-				continue;
-			}
-
-			v3s16 p = block->getPos();
+	}
 
-			// Save if modified
-			if (block->getModified() != MOD_STATE_CLEAN && save_before_unloading) {
-				modprofiler.add(block->getModifiedReasonString(), 1);
-				if (!saveBlock(block))
-					continue;
-				saved_blocks_count++;
-			}
+	for (MapBlock *block : blocks_to_unload) {
+		// Failed to save, try again later
+		if (save_before_unloading && block->getModified() != MOD_STATE_CLEAN) {
+			block->resetUsageTimer();
+			continue;
+		}
 
-			// Delete from memory
-			b.sect->deleteBlock(block);
+		v3s16 p = block->getPos();
 
-			if (unloaded_blocks)
-				unloaded_blocks->push_back(p);
+		// Delete from memory
+		MapSector *sector = getSectorNoGenerate(v2s16(p.X, p.Z));
+		sector->deleteBlock(block);
 
-			deleted_blocks_count++;
-			block_count_all--;
-		}
+		if (unloaded_blocks)
+			unloaded_blocks->push_back(p);
 
-		// Delete empty sectors
-		for (auto &sector_it : m_sectors) {
-			if (sector_it.second->empty()) {
-				sector_deletion_queue.push_back(sector_it.first);
-			}
-		}
+		deleted_blocks_count++;
 	}
 
 	endSave();
 	const auto end_time = porting::getTimeUs();
 
+	const u32 block_count_all = m_block_usage.getBlockCount();
+	const u32 locked_blocks = block_count_all - m_block_usage.size();
 	reportMetrics(end_time - start_time, saved_blocks_count, block_count_all);
 
-	// Finally delete the empty sectors
+	// Finally delete the sectors that were emptied
+	std::vector<v2s16> sector_deletion_queue;
+	std::sort(m_empty_sectors.begin(), m_empty_sectors.end(),
+		[] (v2s16 a, v2s16 b) { return a.X < b.X || (a.X == b.X && a.Y < b.Y); });
+	m_empty_sectors.erase(std::unique(m_empty_sectors.begin(), m_empty_sectors.end()),
+		m_empty_sectors.end());
+	for (v2s16 p : m_empty_sectors) {
+		MapSector *sector = getSectorNoGenerate(p);
+		if (sector && sector->empty())
+			sector_deletion_queue.push_back(p);
+	}
+	m_empty_sectors.clear();
 	deleteSectors(sector_deletion_queue);
 
 	if(deleted_blocks_count != 0)
@@ -455,6 +446,12 @@ void Map::timerUpdate(float dtime, float unload_timeout, s32 max_loaded_blocks,
 	}
 }
 
+void Map::saveBlocks(const std::vector<MapBlock *> &blocks)
+{
+	for (MapBlock *block : blocks)
+		saveBlock(block);
+}
+
 void Map::unloadUnreferencedBlocks(std::vector<v3s16> *unloaded_blocks)
 {
 	timerUpdate(0.0, -1.0, 0, unloaded_blocks);
@@ -1221,6 +1218,10 @@ bool Map::isBlockOccluded(MapBlock *block, v3s16 cam_pos_nodes, bool simple_chec
 /*
 	ServerMap
 */
+
+// Bounds the memory used to remember blocks that are not in the database
+static constexpr size_t BLOCKS_NOT_ON_DISK_MAX = 16384;
+
 ServerMap::ServerMap(const std::string &savedir, IGameDef *gamedef,
 		EmergeManager *emerge, MetricsBackend *mb):
 	Map(gamedef),
@@ -1262,8 +1263,18 @@ ServerMap::ServerMap(const std::string &savedir, IGameDef *gamedef,
 		"minetest_map_saved_blocks", "Number of blocks saved");
 	m_loaded_blocks_gauge = mb->addGauge(
 		"minetest_map_loaded_blocks", "Number of loaded blocks");
+	// 10 us to ~160 ms
+	const auto db_buckets = MetricHistogram::exponentialBuckets(0.00001, 2.0, 15);
+	m_block_load_histogram = mb->addHistogram(
+		"minetest_map_block_load_seconds",
+		"Time spent reading a block from the database (in seconds)", db_buckets);
+	m_block_save_histogram = mb->addHistogram(
+		"minetest_map_block_save_seconds",
+		"Time spent serializing and writing a block (in seconds)", db_buckets);
 
 	m_map_compression_level = rangelim(g_settings->getS16("map_compression_level_disk"), -1, 9);
+	m_compact_blocks = g_settings->getBool("compact_mapblocks");
+	loadCompressionDictionary();
 
 	try {
 		// If directory exists, check contents and load if possible
@@ -1305,6 +1316,96 @@ ServerMap::ServerMap(const std::string &savedir, IGameDef *gamedef,
 	}
 }
 
+// Training needs a varied sample, more only costs time and memory
+static constexpr size_t DICT_SAMPLES_MIN = 1000;
+static constexpr size_t DICT_SAMPLES_MAX = 2000;
+static constexpr size_t DICT_MAX_SIZE = 64 * 1024;
+// Samples are taken from every other block column within this distance of
+// the origin, where the map is generated first, in the given height range
+static constexpr s16 DICT_SAMPLE_RADIUS = 24;
+static constexpr s16 DICT_SAMPLE_Y_MIN = -3;
+static constexpr s16 DICT_SAMPLE_Y_MAX = 4;
+
+void ServerMap::loadCompressionDictionary()
+{
+	// As the zlib levels are mapped by compress()
+	const int zstd_level = m_map_compression_level + 1;
+	const bool enabled = g_settings->getBool("map_compression_dictionary");
+	const std::string path = m_savedir + DIR_DELIM + "map_dictionary.zst";
+
+	std::string data;
+	if (fs::PathExists(path)) {
+		// Blocks saved with it can't be read otherwise
+		if (!fs::ReadFile(path, data))
+			throw SerializationError("Failed to read " + path);
+		m_compression_dict = std::make_unique<ZstdDictionary>(data, zstd_level);
+		m_use_compression_dict = enabled;
+		infostream << "ServerMap: Loaded compression dictionary "
+			<< m_compression_dict->getId() << std::endl;
+		return;
+	}
+	if (!enabled)
+		return;
+
+	// A bounded number of lookups, listing a big database takes too long
+	std::vector<v3s16> positions;
+	v3s16 p;
+	for (p.Z = -DICT_SAMPLE_RADIUS; p.Z < DICT_SAMPLE_RADIUS; p.Z += 2)
+	for (p.X = -DICT_SAMPLE_RADIUS; p.X < DICT_SAMPLE_RADIUS; p.X += 2)
+	for (p.Y = DICT_SAMPLE_Y_MIN; p.Y <= DICT_SAMPLE_Y_MAX; p.Y++)
+		positions.push_back(p);
+	std::vector<std::string> blobs;
+	dbase->loadBlocks(positions, blobs);
+
+	const auto usable = [] (const std::string &blob) {
+		return blob.size() >= 2 && (u8)blob[0] >= 29;
+	};
+	// Spread over the whole area
+	const size_t found = std::count_if(blobs.begin(), blobs.end(), usable);
+	const size_t step = std::max<size_t>(1,
+		(found + DICT_SAMPLES_MAX - 1) / DICT_SAMPLES_MAX);
+
+	std::vector<std::string> samples;
+	size_t i = 0;
+	for (const std::string &blob : blobs) {
+		if (!usable(blob) || i++ % step != 0)
+			continue;
+		std::string raw;
+		try {
+			decompressZstd(reinterpret_cast<const u8 *>(blob.data()) + 1,
+				blob.size() - 1, raw);
+		} catch (SerializationError &e) {
+			continue;
+		}
+		samples.push_back(std::move(raw));
+	}
+	if (samples.size() < DICT_SAMPLES_MIN) {
+		infostream << "ServerMap: Not enough blocks to train a compression "
+			"dictionary yet" << std::endl;
+		return;
+	}
+
+	std::unique_ptr<ZstdDictionary> dict;
+	try {
+		data = ZstdDictionary::train(samples, DICT_MAX_SIZE);
+		dict = std::make_unique<ZstdDictionary>(data, zstd_level);
+	} catch (SerializationError &e) {
+		warningstream << "ServerMap: Failed to train a compression dictionary: "
+			<< e.what() << std::endl;
+		return;
+	}
+	// Must be on disk before the first block uses it
+	if (!fs::safeWriteToFile(path, data)) {
+		errorstream << "ServerMap: Failed to write " << path << std::endl;
+		return;
+	}
+
+	actionstream << "ServerMap: Trained compression dictionary " << dict->getId()
+		<< " from " << samples.size() << " blocks" << std::endl;
+	m_compression_dict = std::move(dict);
+	m_use_compression_dict = true;
+}
+
 ServerMap::~ServerMap()
 {
 	verbosestream<<FUNCTION_NAME<<std::endl;
@@ -1385,6 +1486,16 @@ bool ServerMap::initBlockMake(v3s16 blockpos, BlockMakeData *data)
 	data->blockpos_max = bpmax;
 	data->nodedef = m_nodedef;
 
+	/*
+		Load the existing blocks of the area with one database request
+	*/
+	std::vector<v3s16> area_blocks;
+	for (s16 x = full_bpmin.X; x <= full_bpmax.X; x++)
+	for (s16 z = full_bpmin.Z; z <= full_bpmax.Z; z++)
+	for (s16 y = full_bpmin.Y; y <= full_bpmax.Y; y++)
+		area_blocks.emplace_back(x, y, z);
+	prefetchBlocks(area_blocks);
+
 	/*
 		Create the whole area of this and the neighboring blocks
 	*/
@@ -1398,7 +1509,8 @@ bool ServerMap::initBlockMake(v3s16 blockpos, BlockMakeData *data)
 		for (s16 y = full_bpmin.Y; y <= full_bpmax.Y; y++) {
 			v3s16 p(x, y, z);
 
-			MapBlock *block = emergeBlock(p, false);
+			// Everything that is in the database was loaded above
+			MapBlock *block = getBlockNoCreateNoEx(p);
 			if (block == NULL) {
 				block = createBlock(p);
 
@@ -1718,6 +1830,7 @@ void ServerMap::save(ModifiedState save_level)
 
 void ServerMap::listAllLoadableBlocks(std::vector<v3s16> &dst)
 {
+	MutexAutoLock dblock(m_db_mutex);
 	dbase->listAllLoadableBlocks(dst);
 	if (dbase_ro)
 		dbase_ro->listAllLoadableBlocks(dst);
@@ -1747,6 +1860,8 @@ MapDatabase *ServerMap::createDatabase(
 		return new MapDatabaseSQLite3(savedir);
 	if (name == "dummy")
 		return new Database_Dummy();
+	if (name == "regions")
+		return new MapDatabaseRegions(savedir);
 	#if USE_LEVELDB
 	if (name == "leveldb")
 		return new Database_LevelDB(savedir);
@@ -1768,23 +1883,74 @@ MapDatabase *ServerMap::createDatabase(
 
 void ServerMap::beginSave()
 {
+	MutexAutoLock dblock(m_db_mutex);
 	dbase->beginSave();
 }
 
 void ServerMap::endSave()
 {
+	MutexAutoLock dblock(m_db_mutex);
 	dbase->endSave();
 }
 
 bool ServerMap::saveBlock(MapBlock *block)
 {
-	return saveBlock(block, dbase, m_map_compression_level);
+	onBlockChangedOnDisk(block->getPos());
+	m_blocks_not_on_disk.erase(block->getPos());
+
+	MutexAutoLock dblock(m_db_mutex);
+	const u64 t0 = porting::getTimeUs();
+	bool ret = saveBlock(block, dbase, m_map_compression_level,
+		m_use_compression_dict ? m_compression_dict.get() : nullptr);
+	m_block_save_histogram->observe((porting::getTimeUs() - t0) * 1e-6);
+	if (ret && m_compact_blocks)
+		block->tryShrinkNodes();
+	return ret;
 }
 
-bool ServerMap::saveBlock(MapBlock *block, MapDatabase *db, int compression_level)
+// Bounds the serialized data held at once and how long readBlocks() may
+// have to wait for the database
+static constexpr size_t SAVE_BATCH_SIZE = 64;
+
+void ServerMap::saveBlocks(const std::vector<MapBlock *> &blocks)
 {
-	v3s16 p3d = block->getPos();
+	const ZstdDictionary *dict = m_use_compression_dict ?
+		m_compression_dict.get() : nullptr;
+
+	std::vector<std::string> data;
+	std::vector<u64> serialize_times;
+	for (size_t start = 0; start < blocks.size(); start += SAVE_BATCH_SIZE) {
+		const size_t end = std::min(blocks.size(), start + SAVE_BATCH_SIZE);
+
+		// Serialize without holding the database lock
+		data.clear();
+		serialize_times.clear();
+		for (size_t i = start; i < end; i++) {
+			onBlockChangedOnDisk(blocks[i]->getPos());
+			m_blocks_not_on_disk.erase(blocks[i]->getPos());
+			const u64 t0 = porting::getTimeUs();
+			data.push_back(serializeBlock(blocks[i], m_map_compression_level, dict));
+			serialize_times.push_back(porting::getTimeUs() - t0);
+		}
+
+		MutexAutoLock dblock(m_db_mutex);
+		for (size_t i = start; i < end; i++) {
+			const u64 t0 = porting::getTimeUs();
+			if (dbase->saveBlock(blocks[i]->getPos(), data[i - start])) {
+				blocks[i]->resetModified();
+				// Done changing for now, most likely
+				if (m_compact_blocks)
+					blocks[i]->tryShrinkNodes();
+			}
+			m_block_save_histogram->observe(
+				(porting::getTimeUs() - t0 + serialize_times[i - start]) * 1e-6);
+		}
+	}
+}
 
+std::string ServerMap::serializeBlock(MapBlock *block, int compression_level,
+	const ZstdDictionary *dict)
+{
 	// Format used for writing
 	u8 version = SER_FMT_VER_HIGHEST_WRITE;
 
@@ -1794,9 +1960,15 @@ bool ServerMap::saveBlock(MapBlock *block, MapDatabase *db, int compression_leve
 	*/
 	std::ostringstream o(std::ios_base::binary);
 	o.write((char*) &version, 1);
-	block->serialize(o, version, true, compression_level);
+	block->serialize(o, version, true, compression_level, dict);
+	return o.str();
+}
 
-	bool ret = db->saveBlock(p3d, o.str());
+bool ServerMap::saveBlock(MapBlock *block, MapDatabase *db, int compression_level,
+	const ZstdDictionary *dict)
+{
+	bool ret = db->saveBlock(block->getPos(),
+		serializeBlock(block, compression_level, dict));
 	if (ret) {
 		// We just wrote it to the disk so clear modified flag
 		block->resetModified();
@@ -1807,14 +1979,10 @@ bool ServerMap::saveBlock(MapBlock *block, MapDatabase *db, int compression_leve
 void ServerMap::loadBlock(std::string *blob, v3s16 p3d, MapSector *sector, bool save_after_load)
 {
 	try {
-		std::istringstream is(*blob, std::ios_base::binary);
-
-		u8 version = SER_FMT_VER_INVALID;
-		is.read((char*)&version, 1);
-
-		if(is.fail())
+		if (blob->empty())
 			throw SerializationError("ServerMap::loadBlock(): Failed"
 					" to read MapBlock version");
+		const u8 version = (*blob)[0];
 
 		MapBlock *block = nullptr;
 		std::unique_ptr<MapBlock> block_created_new;
@@ -1825,9 +1993,11 @@ void ServerMap::loadBlock(std::string *blob, v3s16 p3d, MapSector *sector, bool
 		}
 
 		{
-		ScopeProfiler sp(g_profiler, "ServerMap: deSer block", SPT_AVG);
+		static const auto sp_id = ScopeProfiler::intern("ServerMap: deSer block");
+		ScopeProfiler sp(g_profiler, sp_id, SPT_AVG);
 		// Read basic data
-		block->deSerialize(is, version, true);
+		block->deSerialize(reinterpret_cast<const u8 *>(blob->data()) + 1,
+			blob->size() - 1, version, true, nullptr, m_compression_dict.get());
 		}
 
 		// If it's a new block, insert it to the map
@@ -1848,6 +2018,9 @@ void ServerMap::loadBlock(std::string *blob, v3s16 p3d, MapSector *sector, bool
 
 		// We just loaded it from, so it's up-to-date.
 		block->resetModified();
+
+		if (m_compact_blocks)
+			block->tryShrinkNodes();
 	}
 	catch(SerializationError &e)
 	{
@@ -1869,44 +2042,225 @@ void ServerMap::loadBlock(std::string *blob, v3s16 p3d, MapSector *sector, bool
 
 MapBlock* ServerMap::loadBlock(v3s16 blockpos)
 {
-	ScopeProfiler sp(g_profiler, "ServerMap: load block", SPT_AVG);
+	static const auto sp_id = ScopeProfiler::intern("ServerMap: load block");
+	ScopeProfiler sp(g_profiler, sp_id, SPT_AVG);
 	bool created_new = (getBlockNoCreateNoEx(blockpos) == NULL);
+	if (created_new && m_blocks_not_on_disk.count(blockpos) != 0)
+		return NULL;
 
 	v2s16 p2d(blockpos.X, blockpos.Z);
 
 	std::string ret;
-	dbase->loadBlock(blockpos, &ret);
-	if (!ret.empty()) {
-		loadBlock(&ret, blockpos, createSector(p2d), false);
-	} else if (dbase_ro) {
-		dbase_ro->loadBlock(blockpos, &ret);
-		if (!ret.empty()) {
-			loadBlock(&ret, blockpos, createSector(p2d), false);
-		}
-	} else {
+	{
+		MutexAutoLock dblock(m_db_mutex);
+		const u64 t0 = porting::getTimeUs();
+		dbase->loadBlock(blockpos, &ret);
+		m_block_load_histogram->observe((porting::getTimeUs() - t0) * 1e-6);
+		if (ret.empty() && dbase_ro)
+			dbase_ro->loadBlock(blockpos, &ret);
+	}
+	if (ret.empty())
 		return NULL;
-	}
+	loadBlock(&ret, blockpos, createSector(p2d), false);
 
 	MapBlock *block = getBlockNoCreateNoEx(blockpos);
-	if (created_new && (block != NULL)) {
-		std::map<v3s16, MapBlock*> modified_blocks;
-		// Fix lighting if necessary
-		voxalgo::update_block_border_lighting(this, block, modified_blocks);
-		if (!modified_blocks.empty()) {
-			//Modified lighting, send event
-			MapEditEvent event;
-			event.type = MEET_OTHER;
-			event.setModifiedBlocks(modified_blocks);
-			dispatchEvent(event);
+	if (created_new && (block != NULL))
+		updateLoadedBlockLighting(block);
+	return block;
+}
+
+void ServerMap::prefetchBlocks(const std::vector<v3s16> &blockpos,
+	std::vector<v3s16> *loaded)
+{
+	std::vector<v3s16> missing;
+	for (v3s16 p : blockpos) {
+		if (!blockpos_over_max_limit(p) && !getBlockNoCreateNoEx(p) &&
+				m_blocks_not_on_disk.count(p) == 0)
+			missing.push_back(p);
+	}
+	if (missing.empty())
+		return;
+
+	static const auto sp_id = ScopeProfiler::intern("ServerMap: prefetch blocks");
+	ScopeProfiler sp(g_profiler, sp_id, SPT_AVG);
+
+	std::vector<std::string> blobs;
+	loadBlobs(missing, blobs);
+
+	for (size_t i = 0; i < missing.size(); i++) {
+		if (blobs[i].empty())
+			continue;
+		v3s16 p = missing[i];
+		loadBlock(&blobs[i], p, createSector(v2s16(p.X, p.Z)), false);
+
+		MapBlock *block = getBlockNoCreateNoEx(p);
+		if (!block)
+			continue;
+		updateLoadedBlockLighting(block);
+		if (loaded)
+			loaded->push_back(p);
+	}
+}
+
+void ServerMap::loadBlobs(const std::vector<v3s16> &blockpos,
+	std::vector<std::string> &blobs)
+{
+	MutexAutoLock dblock(m_db_mutex);
+
+	const u64 t0 = porting::getTimeUs();
+	dbase->loadBlocks(blockpos, blobs);
+	// Keep the histogram per block
+	const double per_block = (porting::getTimeUs() - t0) * 1e-6 / blockpos.size();
+	for (size_t i = 0; i < blockpos.size(); i++)
+		m_block_load_histogram->observe(per_block);
+
+	if (dbase_ro) {
+		std::vector<v3s16> missing_ro;
+		for (size_t i = 0; i < blockpos.size(); i++) {
+			if (blobs[i].empty())
+				missing_ro.push_back(blockpos[i]);
+		}
+		std::vector<std::string> blobs_ro;
+		dbase_ro->loadBlocks(missing_ro, blobs_ro);
+		for (size_t i = 0, j = 0; i < blockpos.size(); i++) {
+			if (blobs[i].empty())
+				blobs[i] = std::move(blobs_ro[j++]);
 		}
 	}
-	return block;
+}
+
+void ServerMap::startLoadBlocks(const std::vector<v3s16> &blockpos,
+	std::vector<BlockLoad> &loads)
+{
+	for (v3s16 p : blockpos) {
+		if (blockpos_over_max_limit(p) || getBlockNoCreateNoEx(p) ||
+				m_blocks_not_on_disk.count(p) != 0)
+			continue;
+		if (!m_blocks_loading.emplace(p, false).second)
+			continue;
+		loads.emplace_back();
+		loads.back().pos = p;
+	}
+}
+
+void ServerMap::readBlocks(std::vector<BlockLoad> &loads)
+{
+	if (loads.empty())
+		return;
+
+	std::vector<v3s16> blockpos;
+	blockpos.reserve(loads.size());
+	for (const BlockLoad &load : loads)
+		blockpos.push_back(load.pos);
+	std::vector<std::string> blobs;
+	loadBlobs(blockpos, blobs);
+
+	static const auto sp_id = ScopeProfiler::intern("ServerMap: deSer block");
+	for (size_t i = 0; i < loads.size(); i++) {
+		BlockLoad &load = loads[i];
+		load.blob = std::move(blobs[i]);
+		if (load.blob.empty())
+			continue;
+
+		// The node definitions may only be used with the lock, the content
+		// ids are corrected by finishLoadBlocks(). Broken blocks are reported
+		// by loadBlock(), which is left to finishLoadBlocks() as well.
+		try {
+			const u8 version = load.blob[0];
+			auto block = std::make_unique<MapBlock>(load.pos, m_gamedef);
+			{
+				ScopeProfiler sp(g_profiler, sp_id, SPT_AVG);
+				block->deSerialize(reinterpret_cast<const u8 *>(load.blob.data()) + 1,
+					load.blob.size() - 1, version, true, &load.nimap,
+					m_compression_dict.get());
+			}
+			load.block = std::move(block);
+			load.blob.clear();
+		} catch (BaseException &e) {
+		}
+	}
+}
+
+void ServerMap::finishLoadBlocks(std::vector<BlockLoad> &loads,
+	std::vector<v3s16> *loaded)
+{
+	for (BlockLoad &load : loads) {
+		auto it = m_blocks_loading.find(load.pos);
+		assert(it != m_blocks_loading.end());
+		const bool stale = it->second;
+		m_blocks_loading.erase(it);
+
+		// Whatever is in memory or on disk now is newer
+		if (getBlockNoCreateNoEx(load.pos))
+			continue;
+		if (stale) {
+			infostream << "ServerMap: Block " << load.pos << " changed on disk"
+				" while it was read, loading it again" << std::endl;
+			if (loadBlock(load.pos) && loaded)
+				loaded->push_back(load.pos);
+			continue;
+		}
+
+		if (!load.block && load.blob.empty()) {
+			if (m_blocks_not_on_disk.size() >= BLOCKS_NOT_ON_DISK_MAX)
+				m_blocks_not_on_disk.clear();
+			m_blocks_not_on_disk.insert(load.pos);
+			continue;
+		}
+
+		MapSector *sector = createSector(v2s16(load.pos.X, load.pos.Z));
+		if (load.block) {
+			MapBlock *block = load.block.get();
+			block->correctNodeIds(load.nimap);
+			if (m_compact_blocks)
+				block->tryShrinkNodes();
+			sector->insertBlock(std::move(load.block));
+			ReflowScan scanner(this, m_emerge->ndef);
+			scanner.scan(block, &m_transforming_liquid);
+			block->resetModified();
+		} else {
+			loadBlock(&load.blob, load.pos, sector, false);
+		}
+
+		MapBlock *block = getBlockNoCreateNoEx(load.pos);
+		if (!block)
+			continue;
+		updateLoadedBlockLighting(block);
+		if (loaded)
+			loaded->push_back(load.pos);
+	}
+	loads.clear();
+}
+
+void ServerMap::onBlockChangedOnDisk(v3s16 blockpos)
+{
+	auto it = m_blocks_loading.find(blockpos);
+	if (it != m_blocks_loading.end())
+		it->second = true;
+}
+
+void ServerMap::updateLoadedBlockLighting(MapBlock *block)
+{
+	std::map<v3s16, MapBlock*> modified_blocks;
+	// Fix lighting if necessary
+	voxalgo::update_block_border_lighting(this, block, modified_blocks);
+	if (!modified_blocks.empty()) {
+		//Modified lighting, send event
+		MapEditEvent event;
+		event.type = MEET_OTHER;
+		event.setModifiedBlocks(modified_blocks);
+		dispatchEvent(event);
+	}
 }
 
 bool ServerMap::deleteBlock(v3s16 blockpos)
 {
-	if (!dbase->deleteBlock(blockpos))
-		return false;
+	onBlockChangedOnDisk(blockpos);
+	{
+		MutexAutoLock dblock(m_db_mutex);
+		if (!dbase->deleteBlock(blockpos))
+			return false;
+	}
 
 	MapBlock *block = getBlockNoCreateNoEx(blockpos);
 	if (block) {
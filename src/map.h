@@ -24,10 +24,14 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <set>
 #include <map>
 #include <list>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
 
 #include "irrlichttypes_bloated.h"
 #include "mapblock.h"
 #include "mapnode.h"
+#include "nameidmapping.h"
 #include "constants.h"
 #include "voxel.h"
 #include "modifiedstate.h"
@@ -50,7 +54,9 @@ class IRollbackManager;
 class EmergeManager;
 class MetricsBackend;
 class ServerEnvironment;
+class NodeChangeBatch;
 struct BlockMakeData;
+class ZstdDictionary;
 
 /*
 	MapEditEvent
@@ -187,6 +193,10 @@ class Map /*: public NodeContainer*/
 			bool remove_metadata = true);
 	void removeNodeAndUpdate(v3s16 p,
 			std::map<v3s16, MapBlock*> &modified_blocks);
+	// Applies all changes of the batch with a single lighting update.
+	// Does not report to rollback.
+	void addNodesAndUpdate(const NodeChangeBatch &batch,
+			std::map<v3s16, MapBlock*> &modified_blocks);
 
 	/*
 		Wrappers for the latter ones.
@@ -211,10 +221,13 @@ class Map /*: public NodeContainer*/
 	// Client leaves them as no-op.
 	virtual bool saveBlock(MapBlock *block) { return false; }
 	virtual bool deleteBlock(v3s16 blockpos) { return false; }
+	// Saves the blocks, those that were saved are no longer modified
+	virtual void saveBlocks(const std::vector<MapBlock *> &blocks);
 
 	/*
 		Updates usage timers and unloads unused blocks and sectors.
 		Saves modified blocks before unloading if possible.
+		Only looks at the blocks it unloads, see MapBlockUsageList.
 	*/
 	void timerUpdate(float dtime, float unload_timeout, s32 max_loaded_blocks,
 			std::vector<v3s16> *unloaded_blocks=NULL);
@@ -307,6 +320,8 @@ class Map /*: public NodeContainer*/
 
 	bool isBlockOccluded(MapBlock *block, v3s16 cam_pos_nodes, bool simple_check = false);
 protected:
+	friend class MapSector; // for m_block_usage and m_empty_sectors
+
 	IGameDef *m_gamedef;
 
 	std::set<MapEventReceiver*> m_event_receivers;
@@ -317,6 +332,11 @@ class Map /*: public NodeContainer*/
 	MapSector *m_sector_cache = nullptr;
 	v2s16 m_sector_cache_p;
 
+	// Unreferenced blocks in the order they were used
+	MapBlockUsageList m_block_usage;
+	// Sectors whose last block was removed, deleted by timerUpdate()
+	std::vector<v2s16> m_empty_sectors;
+
 	// This stores the properties of the nodes on the map.
 	const NodeDefManager *m_nodedef;
 
@@ -407,10 +427,50 @@ class ServerMap : public Map
 	MapgenParams *getMapgenParams();
 
 	bool saveBlock(MapBlock *block) override;
-	static bool saveBlock(MapBlock *block, MapDatabase *db, int compression_level = -1);
+	static bool saveBlock(MapBlock *block, MapDatabase *db, int compression_level = -1,
+		const ZstdDictionary *dict = nullptr);
+	// Serializes each batch of blocks before locking the database for it
+	void saveBlocks(const std::vector<MapBlock *> &blocks) override;
+	// Returns the block as stored in the database
+	static std::string serializeBlock(MapBlock *block, int compression_level,
+		const ZstdDictionary *dict = nullptr);
 	MapBlock* loadBlock(v3s16 p);
 	// Database version
 	void loadBlock(std::string *blob, v3s16 p3d, MapSector *sector, bool save_after_load=false);
+	/*
+		Loads those of the given blocks that are not in memory yet with a
+		single database request. The positions of the blocks that were found
+		are added to 'loaded' if given.
+	*/
+	void prefetchBlocks(const std::vector<v3s16> &blockpos,
+		std::vector<v3s16> *loaded = nullptr);
+
+	/*
+		Loading blocks without holding the environment lock during the
+		database access and the deserialization:
+		1. startLoadBlocks() picks the blocks that are neither in memory nor
+		   being loaded by another thread already.
+		2. readBlocks() reads and deserializes them. It touches neither the
+		   map nor the node definitions and is the only step that may run
+		   without the lock.
+		3. finishLoadBlocks() maps the content ids of the blocks to the node
+		   definitions and inserts them into the map. Those saved or deleted
+		   in the meantime are loaded again. The positions of the inserted
+		   blocks are added to 'loaded' if given.
+	*/
+	struct BlockLoad {
+		v3s16 pos;
+		// Deserialized block, or the blob if that has to wait for the lock
+		std::unique_ptr<MapBlock> block;
+		std::string blob;
+		// Id-name mapping of 'block', its ids are not corrected yet
+		NameIdMapping nimap;
+	};
+	void startLoadBlocks(const std::vector<v3s16> &blockpos,
+		std::vector<BlockLoad> &loads);
+	void readBlocks(std::vector<BlockLoad> &loads);
+	void finishLoadBlocks(std::vector<BlockLoad> &loads,
+		std::vector<v3s16> *loaded = nullptr);
 
 	// Blocks are removed from the map but not deleted from memory until
 	// deleteDetachedBlocks() is called, since pointers to them may still exist
@@ -461,6 +521,11 @@ class ServerMap : public Map
 	bool m_map_saving_enabled;
 
 	int m_map_compression_level;
+	// Keep blocks with few distinct nodes compact, see MapBlock::tryShrinkNodes()
+	bool m_compact_blocks;
+	// Needed to read blocks once it exists, used for saving if enabled
+	std::unique_ptr<ZstdDictionary> m_compression_dict;
+	bool m_use_compression_dict = false;
 
 	std::set<v3s16> m_chunks_in_progress;
 
@@ -481,11 +546,33 @@ class ServerMap : public Map
 	bool m_map_metadata_changed = true;
 	MapDatabase *dbase = nullptr;
 	MapDatabase *dbase_ro = nullptr;
+	// Guards the databases, which readBlocks() uses without the
+	// environment lock. Always taken after the environment lock.
+	std::mutex m_db_mutex;
+
+	// Blocks between startLoadBlocks() and finishLoadBlocks(), true once
+	// they were saved or deleted since, which makes the read data stale
+	std::unordered_map<v3s16, bool> m_blocks_loading;
+	// Blocks found missing in the database by readBlocks(), until saved
+	std::unordered_set<v3s16> m_blocks_not_on_disk;
+	// Marks the block as changed on disk for loads in progress
+	void onBlockChangedOnDisk(v3s16 blockpos);
+	// Reads the blobs from the database, falling back to the read-only one
+	void loadBlobs(const std::vector<v3s16> &blockpos,
+		std::vector<std::string> &blobs);
+	// Loads the compression dictionary of the world, or trains one from
+	// the stored blocks around the origin if enabled and there are enough
+	void loadCompressionDictionary();
 
 	// Map metrics
 	MetricGaugePtr m_loaded_blocks_gauge;
 	MetricCounterPtr m_save_time_counter;
 	MetricCounterPtr m_save_count_counter;
+	// Fixes the lighting at the borders of a block that was just loaded
+	void updateLoadedBlockLighting(MapBlock *block);
+
+	MetricHistogramPtr m_block_load_histogram;
+	MetricHistogramPtr m_block_save_histogram;
 };
 
 
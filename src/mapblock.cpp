@@ -19,6 +19,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "mapblock.h"
 
+#include <algorithm>
 #include <sstream>
 #include "map.h"
 #include "light.h"
@@ -37,6 +38,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "porting.h"
 #include "util/string.h"
 #include "util/serialize.h"
+#include "util/stream.h"
 #include "util/basic_macros.h"
 
 static const char *modified_reason_strings[] = {
@@ -77,6 +79,8 @@ MapBlock::MapBlock(v3s16 pos, IGameDef *gamedef):
 
 MapBlock::~MapBlock()
 {
+	setUsageList(nullptr);
+
 #ifndef SERVER
 	{
 		delete mesh;
@@ -87,6 +91,22 @@ MapBlock::~MapBlock()
 	delete[] data;
 }
 
+void MapBlock::setUsageList(MapBlockUsageList *list)
+{
+	if (m_usage_list) {
+		m_usage_list->unlink(this);
+		m_usage_list->m_block_count--;
+	}
+
+	m_usage_list = list;
+	if (!list)
+		return;
+	list->m_block_count++;
+	m_last_use = list->now;
+	if (m_refcount == 0)
+		list->link(this);
+}
+
 bool MapBlock::onObjectsActivation()
 {
 	// Ignore if no stored objects (to not set changed flag)
@@ -129,10 +149,10 @@ bool MapBlock::saveStaticObject(u16 id, const StaticObject &obj, u32 reason)
 }
 
 // This method is only for Server, don't call it on client
-void MapBlock::step(float dtime, const std::function<bool(v3s16, MapNode, f32)> &on_timer_cb)
+void MapBlock::runNodeTimers(const std::function<bool(v3s16, MapNode, f32)> &on_timer_cb)
 {
 	// Run script callbacks for elapsed node_timers
-	std::vector<NodeTimer> elapsed_timers = m_node_timers.step(dtime);
+	std::vector<NodeTimer> elapsed_timers = m_node_timers.takeElapsed();
 	if (!elapsed_timers.empty()) {
 		MapNode n;
 		v3s16 p;
@@ -172,8 +192,18 @@ void MapBlock::copyTo(VoxelManipulator &dst)
 	v3s16 data_size(MAP_BLOCKSIZE, MAP_BLOCKSIZE, MAP_BLOCKSIZE);
 	VoxelArea data_area(v3s16(0,0,0), data_size - v3s16(1,1,1));
 
+	// Compact blocks are copied out instead of expanded, this is a read
+	thread_local std::unique_ptr<MapNode[]> tmp_nodes;
+	const MapNode *nodes = data;
+	if (!nodes) {
+		if (!tmp_nodes)
+			tmp_nodes = std::make_unique<MapNode[]>(nodecount);
+		copyNodes(tmp_nodes.get());
+		nodes = tmp_nodes.get();
+	}
+
 	// Copy from data to VoxelManipulator
-	dst.copyFrom(data, data_area, v3s16(0,0,0),
+	dst.copyFrom(nodes, data_area, v3s16(0,0,0),
 			getPosRelative(), data_size);
 }
 
@@ -183,6 +213,7 @@ void MapBlock::copyFrom(VoxelManipulator &dst)
 	VoxelArea data_area(v3s16(0,0,0), data_size - v3s16(1,1,1));
 
 	// Copy from VoxelManipulator to data
+	expandNodes();
 	dst.copyTo(data, data_area, v3s16(0,0,0),
 			getPosRelative(), data_size);
 }
@@ -196,13 +227,17 @@ void MapBlock::actuallyUpdateDayNightDiff()
 
 	bool differs = false;
 
+	// The palette of a compact block has each of its nodes once
+	const MapNode *nodes = data ? data : m_palette.data();
+	const u32 count = data ? nodecount : m_palette.size();
+
 	/*
 		Check if any lighting value differs
 	*/
 
 	MapNode previous_n(CONTENT_IGNORE);
-	for (u32 i = 0; i < nodecount; i++) {
-		MapNode n = data[i];
+	for (u32 i = 0; i < count; i++) {
+		MapNode n = nodes[i];
 
 		// If node is identical to previous node, don't verify if it differs
 		if (n == previous_n)
@@ -220,8 +255,8 @@ void MapBlock::actuallyUpdateDayNightDiff()
 	*/
 	if (differs) {
 		bool only_air = true;
-		for (u32 i = 0; i < nodecount; i++) {
-			MapNode &n = data[i];
+		for (u32 i = 0; i < count; i++) {
+			const MapNode &n = nodes[i];
 			if (n.getContent() != CONTENT_AIR) {
 				only_air = false;
 				break;
@@ -240,6 +275,96 @@ void MapBlock::expireDayNightDiff()
 	m_day_night_differs_expired = true;
 }
 
+void MapBlock::tryShrinkNodes()
+{
+	if (!data)
+		return;
+
+	// Finds the palette index of a node, open addressing on all its bits
+	constexpr u32 TABLE_SIZE = 512;
+	u32 keys[TABLE_SIZE];
+	u16 slots[TABLE_SIZE] = {}; // index + 1, 0 if free
+	MapNode palette[256];
+	u32 palette_size = 0;
+	u8 indices[nodecount];
+
+	MapNode previous_n = data[0];
+	u8 previous_index = 0;
+	palette[palette_size++] = previous_n;
+	{
+		const u32 key = (u32)previous_n.param0 << 16 | previous_n.param1 << 8 | previous_n.param2;
+		const u32 h = (key * 2654435761U) >> 23;
+		keys[h] = key;
+		slots[h] = 1;
+	}
+
+	for (u32 i = 0; i < nodecount; i++) {
+		const MapNode n = data[i];
+		// Runs of the same node are common
+		if (n == previous_n) {
+			indices[i] = previous_index;
+			continue;
+		}
+
+		const u32 key = (u32)n.param0 << 16 | n.param1 << 8 | n.param2;
+		u32 h = (key * 2654435761U) >> 23;
+		while (slots[h] != 0 && keys[h] != key)
+			h = (h + 1) % TABLE_SIZE;
+		if (slots[h] == 0) {
+			if (palette_size == 256)
+				return; // too many distinct nodes
+			keys[h] = key;
+			slots[h] = palette_size + 1;
+			palette[palette_size++] = n;
+		}
+
+		previous_n = n;
+		previous_index = slots[h] - 1;
+		indices[i] = previous_index;
+	}
+
+	m_palette.assign(palette, palette + palette_size);
+	if (palette_size == 1) {
+		m_palette_bits = 0;
+	} else if (palette_size <= 16) {
+		m_palette_bits = 4;
+		m_palette_indices = std::make_unique<u8[]>(nodecount / 2);
+		for (u32 i = 0; i < nodecount; i += 2)
+			m_palette_indices[i / 2] = indices[i] | indices[i + 1] << 4;
+	} else {
+		m_palette_bits = 8;
+		m_palette_indices = std::make_unique<u8[]>(nodecount);
+		memcpy(m_palette_indices.get(), indices, nodecount);
+	}
+
+	delete[] data;
+	data = nullptr;
+}
+
+void MapBlock::actuallyExpandNodes()
+{
+	MapNode *nodes = new MapNode[nodecount];
+	copyNodes(nodes);
+	data = nodes;
+
+	m_palette.clear();
+	m_palette.shrink_to_fit();
+	m_palette_indices.reset();
+	m_palette_bits = 0;
+}
+
+void MapBlock::copyNodes(MapNode *dst) const
+{
+	if (data) {
+		memcpy(dst, data, nodecount * sizeof(MapNode));
+	} else if (m_palette_bits == 0) {
+		std::fill(dst, dst + nodecount, m_palette[0]);
+	} else {
+		for (u32 i = 0; i < nodecount; i++)
+			dst[i] = getCompactNode(i);
+	}
+}
+
 /*
 	Serialization
 */
@@ -356,7 +481,8 @@ static void correctBlockNodeIds(const NameIdMapping *nimap, MapNode *nodes,
 	}
 }
 
-void MapBlock::serialize(std::ostream &os_compressed, u8 version, bool disk, int compression_level)
+void MapBlock::serialize(std::ostream &os_compressed, u8 version, bool disk, int compression_level,
+	const ZstdDictionary *dict)
 {
 	if(!ser_ver_supported(version))
 		throw VersionMismatchException("ERROR: MapBlock format not supported");
@@ -389,7 +515,7 @@ void MapBlock::serialize(std::ostream &os_compressed, u8 version, bool disk, int
  	if(disk)
 	{
 		MapNode *tmp_nodes = new MapNode[nodecount];
-		memcpy(tmp_nodes, data, nodecount * sizeof(MapNode));
+		copyNodes(tmp_nodes);
 		getBlockNodeIdMapping(&nimap, tmp_nodes, m_gamedef->ndef());
 
 		buf = MapNode::serializeBulk(version, tmp_nodes, nodecount,
@@ -403,11 +529,18 @@ void MapBlock::serialize(std::ostream &os_compressed, u8 version, bool disk, int
 			nimap.serialize(os);
 		}
 	}
-	else
+	else if (data)
 	{
 		buf = MapNode::serializeBulk(version, data, nodecount,
 				content_width, params_width);
 	}
+	else
+	{
+		std::unique_ptr<MapNode[]> tmp_nodes(new MapNode[nodecount]);
+		copyNodes(tmp_nodes.get());
+		buf = MapNode::serializeBulk(version, tmp_nodes.get(), nodecount,
+				content_width, params_width);
+	}
 
 	writeU8(os, content_width);
 	writeU8(os, params_width);
@@ -458,7 +591,12 @@ void MapBlock::serialize(std::ostream &os_compressed, u8 version, bool disk, int
 
 	if (version >= 29) {
 		// now compress the whole thing
-		compress(os_raw.str(), os_compressed, version, compression_level);
+		const std::string raw = os_raw.str();
+		if (dict)
+			compressZstd(reinterpret_cast<const u8 *>(raw.data()), raw.size(),
+				os_compressed, *dict);
+		else
+			compress(raw, os_compressed, version, compression_level);
 	}
 }
 
@@ -467,26 +605,36 @@ void MapBlock::serializeNetworkSpecific(std::ostream &os)
 	writeU8(os, 2); // version
 }
 
-void MapBlock::deSerialize(std::istream &in_compressed, u8 version, bool disk)
+void MapBlock::deSerialize(std::istream &in_compressed, u8 version, bool disk,
+	NameIdMapping *nimap_out)
 {
 	if(!ser_ver_supported(version))
 		throw VersionMismatchException("ERROR: MapBlock format not supported");
 
 	TRACESTREAM(<<"MapBlock::deSerialize "<<getPos()<<std::endl);
 
+	expandNodes();
 	m_day_night_differs_expired = false;
 
 	if(version <= 21)
 	{
+		if (nimap_out)
+			throw SerializationError("Legacy MapBlock format needs content ids");
 		deSerialize_pre22(in_compressed, version, disk);
 		return;
 	}
 
 	// Decompress the whole block (version >= 29)
+	if (version >= 29) {
+		std::ostringstream os(std::ios_base::binary);
+		decompress(in_compressed, os, version);
+		const std::string raw = os.str();
+		deSerializeRaw(reinterpret_cast<const u8 *>(raw.data()), raw.size(),
+			version, disk, nimap_out);
+		return;
+	}
+	std::istream &is = in_compressed;
 	std::stringstream in_raw(std::ios_base::binary | std::ios_base::in | std::ios_base::out);
-	if (version >= 29)
-		decompress(in_compressed, in_raw, version);
-	std::istream &is = version >= 29 ? in_raw : in_compressed;
 
 	u8 flags = readU8(is);
 	is_underground = (flags & 0x01) != 0;
@@ -498,18 +646,6 @@ void MapBlock::deSerialize(std::istream &in_compressed, u8 version, bool disk)
 	m_generated = (flags & 0x08) == 0;
 
 	NameIdMapping nimap;
-	if (disk && version >= 29) {
-		// Timestamp
-		TRACESTREAM(<<"MapBlock::deSerialize "<<getPos()
-				<<": Timestamp"<<std::endl);
-		setTimestampNoChangedFlag(readU32(is));
-		m_disk_timestamp = m_timestamp;
-
-		// Node/id mapping
-		TRACESTREAM(<<"MapBlock::deSerialize "<<getPos()
-				<<": NameIdMapping"<<std::endl);
-		nimap.deSerialize(is);
-	}
 
 	TRACESTREAM(<<"MapBlock::deSerialize "<<getPos()
 			<<": Bulk node data"<<std::endl);
@@ -523,40 +659,30 @@ void MapBlock::deSerialize(std::istream &in_compressed, u8 version, bool disk)
 	/*
 		Bulk node data
 	*/
-	if (version >= 29) {
-		MapNode::deSerializeBulk(is, version, data, nodecount,
-			content_width, params_width);
-	} else {
-		// use in_raw from above to avoid allocating another stream object
-		decompress(is, in_raw, version);
-		MapNode::deSerializeBulk(in_raw, version, data, nodecount,
-			content_width, params_width);
-	}
+	decompress(is, in_raw, version);
+	MapNode::deSerializeBulk(in_raw, version, data, nodecount,
+		content_width, params_width);
 
 	/*
 		NodeMetadata
 	*/
 	TRACESTREAM(<<"MapBlock::deSerialize "<<getPos()
 			<<": Node metadata"<<std::endl);
-	if (version >= 29) {
-		m_node_metadata.deSerialize(is, m_gamedef->idef());
-	} else {
-		try {
-			// reuse in_raw
-			in_raw.str("");
-			in_raw.clear();
-			decompress(is, in_raw, version);
-			if (version >= 23)
-				m_node_metadata.deSerialize(in_raw, m_gamedef->idef());
-			else
-				content_nodemeta_deserialize_legacy(in_raw,
-					&m_node_metadata, &m_node_timers,
-					m_gamedef->idef());
-		} catch(SerializationError &e) {
-			warningstream<<"MapBlock::deSerialize(): Ignoring an error"
-					<<" while deserializing node metadata at ("
-					<<getPos()<<": "<<e.what()<<std::endl;
-		}
+	try {
+		// reuse in_raw
+		in_raw.str("");
+		in_raw.clear();
+		decompress(is, in_raw, version);
+		if (version >= 23)
+			m_node_metadata.deSerialize(in_raw, m_gamedef->idef());
+		else
+			content_nodemeta_deserialize_legacy(in_raw,
+				&m_node_metadata, &m_node_timers,
+				m_gamedef->idef());
+	} catch(SerializationError &e) {
+		warningstream<<"MapBlock::deSerialize(): Ignoring an error"
+				<<" while deserializing node metadata at ("
+				<<getPos()<<": "<<e.what()<<std::endl;
 	}
 
 	/*
@@ -579,21 +705,22 @@ void MapBlock::deSerialize(std::istream &in_compressed, u8 version, bool disk)
 				<<": Static objects"<<std::endl);
 		m_static_objects.deSerialize(is);
 
-		if (version < 29) {
-			// Timestamp
-			TRACESTREAM(<<"MapBlock::deSerialize "<<getPos()
-				    <<": Timestamp"<<std::endl);
-			setTimestampNoChangedFlag(readU32(is));
-			m_disk_timestamp = m_timestamp;
+		// Timestamp
+		TRACESTREAM(<<"MapBlock::deSerialize "<<getPos()
+			    <<": Timestamp"<<std::endl);
+		setTimestampNoChangedFlag(readU32(is));
+		m_disk_timestamp = m_timestamp;
 
-			// Node/id mapping
-			TRACESTREAM(<<"MapBlock::deSerialize "<<getPos()
-				    <<": NameIdMapping"<<std::endl);
-			nimap.deSerialize(is);
-		}
+		// Node/id mapping
+		TRACESTREAM(<<"MapBlock::deSerialize "<<getPos()
+			    <<": NameIdMapping"<<std::endl);
+		nimap.deSerialize(is);
 
 		// Dynamically re-set ids based on node names
-		correctBlockNodeIds(&nimap, data, m_gamedef);
+		if (nimap_out)
+			*nimap_out = std::move(nimap);
+		else
+			correctBlockNodeIds(&nimap, data, m_gamedef);
 
 		if(version >= 25){
 			TRACESTREAM(<<"MapBlock::deSerialize "<<getPos()
@@ -606,6 +733,113 @@ void MapBlock::deSerialize(std::istream &in_compressed, u8 version, bool disk)
 			<<": Done."<<std::endl);
 }
 
+size_t MapBlock::deSerialize(const u8 *data, size_t size, u8 version, bool disk,
+	NameIdMapping *nimap_out, const ZstdDictionary *dict)
+{
+	// Older formats are made of several compressed parts, read them as a stream
+	if (version < 29) {
+		MemoryStreamBuffer buf(reinterpret_cast<const char *>(data), size);
+		std::istream is(&buf);
+		deSerialize(is, version, disk, nimap_out);
+		return buf.tell();
+	}
+
+	if(!ser_ver_supported(version))
+		throw VersionMismatchException("ERROR: MapBlock format not supported");
+
+	TRACESTREAM(<<"MapBlock::deSerialize "<<getPos()<<std::endl);
+
+	m_day_night_differs_expired = false;
+
+	// Keeps its storage between blocks, which mostly have a similar size
+	thread_local std::string raw;
+	const size_t used = decompressZstd(data, size, raw, dict);
+	deSerializeRaw(reinterpret_cast<const u8 *>(raw.data()), raw.size(),
+		version, disk, nimap_out);
+	return used;
+}
+
+void MapBlock::deSerializeRaw(const u8 *raw, size_t size, u8 version, bool disk,
+	NameIdMapping *nimap_out)
+{
+	MemoryStreamBuffer buf(reinterpret_cast<const char *>(raw), size);
+	std::istream is(&buf);
+
+	expandNodes();
+
+	u8 flags = readU8(is);
+	is_underground = (flags & 0x01) != 0;
+	m_day_night_differs = (flags & 0x02) != 0;
+	m_lighting_complete = readU16(is);
+	m_generated = (flags & 0x08) == 0;
+
+	NameIdMapping nimap;
+	if (disk) {
+		// Timestamp
+		TRACESTREAM(<<"MapBlock::deSerialize "<<getPos()
+				<<": Timestamp"<<std::endl);
+		setTimestampNoChangedFlag(readU32(is));
+		m_disk_timestamp = m_timestamp;
+
+		// Node/id mapping
+		TRACESTREAM(<<"MapBlock::deSerialize "<<getPos()
+				<<": NameIdMapping"<<std::endl);
+		nimap.deSerialize(is);
+	}
+
+	TRACESTREAM(<<"MapBlock::deSerialize "<<getPos()
+			<<": Bulk node data"<<std::endl);
+	u8 content_width = readU8(is);
+	u8 params_width = readU8(is);
+	if(content_width != 1 && content_width != 2)
+		throw SerializationError("MapBlock::deSerialize(): invalid content_width");
+	if(params_width != 2)
+		throw SerializationError("MapBlock::deSerialize(): invalid params_width");
+
+	/*
+		Bulk node data, straight from the buffer
+	*/
+	const size_t pos = buf.tell();
+	buf.skip(MapNode::deSerializeBulk(raw + pos, size - pos, version,
+		data, nodecount, content_width, params_width));
+
+	/*
+		NodeMetadata
+	*/
+	TRACESTREAM(<<"MapBlock::deSerialize "<<getPos()
+			<<": Node metadata"<<std::endl);
+	m_node_metadata.deSerialize(is, m_gamedef->idef());
+
+	/*
+		Data that is only on disk
+	*/
+	if (disk) {
+		// Static objects
+		TRACESTREAM(<<"MapBlock::deSerialize "<<getPos()
+				<<": Static objects"<<std::endl);
+		m_static_objects.deSerialize(is);
+
+		// Dynamically re-set ids based on node names
+		if (nimap_out)
+			*nimap_out = std::move(nimap);
+		else
+			correctBlockNodeIds(&nimap, data, m_gamedef);
+
+		TRACESTREAM(<<"MapBlock::deSerialize "<<getPos()
+				<<": Node timers (ver>=25)"<<std::endl);
+		m_node_timers.deSerialize(is, version);
+	}
+
+	TRACESTREAM(<<"MapBlock::deSerialize "<<getPos()
+			<<": Done."<<std::endl);
+}
+
+void MapBlock::correctNodeIds(const NameIdMapping &nimap)
+{
+	expandNodes();
+	correctBlockNodeIds(&nimap, data, m_gamedef);
+}
+
 void MapBlock::deSerializeNetworkSpecific(std::istream &is)
 {
 	try {
@@ -931,4 +1165,44 @@ std::string analyze_block(MapBlock *block)
 }
 
 
+/*
+	MapBlockUsageList
+*/
+
+MapBlock *MapBlockUsageList::getNext(const MapBlock *block) const
+{
+	return block->m_usage_next;
+}
+
+void MapBlockUsageList::link(MapBlock *block)
+{
+	assert(!block->m_usage_linked);
+	block->m_usage_prev = m_tail;
+	block->m_usage_next = nullptr;
+	if (m_tail)
+		m_tail->m_usage_next = block;
+	else
+		m_head = block;
+	m_tail = block;
+	block->m_usage_linked = true;
+	m_size++;
+}
+
+void MapBlockUsageList::unlink(MapBlock *block)
+{
+	if (!block->m_usage_linked)
+		return;
+	if (block->m_usage_prev)
+		block->m_usage_prev->m_usage_next = block->m_usage_next;
+	else
+		m_head = block->m_usage_next;
+	if (block->m_usage_next)
+		block->m_usage_next->m_usage_prev = block->m_usage_prev;
+	else
+		m_tail = block->m_usage_prev;
+	block->m_usage_prev = block->m_usage_next = nullptr;
+	block->m_usage_linked = false;
+	m_size--;
+}
+
 //END
@@ -19,6 +19,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #pragma once
 
+#include <memory>
 #include <vector>
 #include "irr_v3d.h"
 #include "mapnode.h"
@@ -28,6 +29,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "nodemetadata.h"
 #include "nodetimer.h"
 #include "modifiedstate.h"
+#include "util/basic_macros.h"
 #include "util/numeric.h" // getContainerPos
 #include "settings.h"
 
@@ -36,6 +38,9 @@ class NodeMetadataList;
 class IGameDef;
 class MapBlockMesh;
 class VoxelManipulator;
+class MapBlock;
+class NameIdMapping;
+class ZstdDictionary;
 
 #define BLOCK_TIMESTAMP_UNDEFINED 0xffffffff
 
@@ -65,6 +70,44 @@ class VoxelManipulator;
 #define MOD_REASON_VMANIP                    (1 << 19)
 #define MOD_REASON_UNKNOWN                   (1 << 20)
 
+////
+//// List of unused MapBlocks
+////
+
+/*
+	The unreferenced blocks of a map, least recently used first. Blocks move
+	to the end when they are used and leave the list while referenced, so
+	the blocks to unload are found without looking at every loaded block.
+*/
+class MapBlockUsageList
+{
+public:
+	MapBlockUsageList() = default;
+	DISABLE_CLASS_COPY(MapBlockUsageList)
+
+	// Seconds the map was updated for, see Map::timerUpdate()
+	double now = 0;
+
+	MapBlock *getOldest() const { return m_head; }
+	MapBlock *getNext(const MapBlock *block) const;
+
+	// Number of blocks in the list
+	size_t size() const { return m_size; }
+	// Number of blocks of the map, including the referenced ones
+	size_t getBlockCount() const { return m_block_count; }
+
+private:
+	friend class MapBlock;
+
+	void link(MapBlock *block);
+	void unlink(MapBlock *block);
+
+	MapBlock *m_head = nullptr;
+	MapBlock *m_tail = nullptr;
+	size_t m_size = 0;
+	size_t m_block_count = 0;
+};
+
 ////
 //// MapBlock itself
 ////
@@ -90,6 +133,7 @@ class MapBlock
 
 	void reallocate()
 	{
+		expandNodes();
 		for (u32 i = 0; i < nodecount; i++)
 			data[i] = MapNode(CONTENT_IGNORE);
 		raiseModified(MOD_STATE_WRITE_NEEDED, MOD_REASON_REALLOCATE);
@@ -97,9 +141,39 @@ class MapBlock
 
 	MapNode* getData()
 	{
+		expandNodes();
 		return data;
 	}
 
+	////
+	//// Compact node storage
+	////
+
+	/*
+		Blocks with few distinct nodes can be kept as a palette of those
+		nodes plus a 4 or 8 bit index per node, or as a single node if
+		they are uniform. Reading works on either form, writing expands
+		the block to the full array first.
+		Expanding is not thread-safe, so this is only used on the server.
+	*/
+
+	// Switches to the compact form if the block allows for it
+	void tryShrinkNodes();
+
+	inline void expandNodes()
+	{
+		if (!data)
+			actuallyExpandNodes();
+	}
+
+	inline bool isCompact() const
+	{
+		return !data;
+	}
+
+	// Copies all nodes of the block to 'dst', of `nodecount` elements
+	void copyNodes(MapNode *dst) const;
+
 	////
 	//// Modification tracking methods
 	////
@@ -247,7 +321,7 @@ class MapBlock
 		if (!*valid_position)
 			return {CONTENT_IGNORE};
 
-		return data[z * zstride + y * ystride + x];
+		return getNodeNoCheck(x, y, z);
 	}
 
 	inline MapNode getNode(v3s16 p, bool *valid_position)
@@ -266,6 +340,7 @@ class MapBlock
 		if (!isValidPosition(x, y, z))
 			throw InvalidPositionException();
 
+		expandNodes();
 		data[z * zstride + y * ystride + x] = n;
 		raiseModified(MOD_STATE_WRITE_NEEDED, MOD_REASON_SET_NODE);
 	}
@@ -281,7 +356,9 @@ class MapBlock
 
 	inline MapNode getNodeNoCheck(s16 x, s16 y, s16 z)
 	{
-		return data[z * zstride + y * ystride + x];
+		if (data)
+			return data[z * zstride + y * ystride + x];
+		return getCompactNode(z * zstride + y * ystride + x);
 	}
 
 	inline MapNode getNodeNoCheck(v3s16 p)
@@ -291,6 +368,7 @@ class MapBlock
 
 	inline void setNodeNoCheck(s16 x, s16 y, s16 z, MapNode n)
 	{
+		expandNodes();
 		data[z * zstride + y * ystride + x] = n;
 		raiseModified(MOD_STATE_WRITE_NEEDED, MOD_REASON_SET_NODE_NO_CHECK);
 	}
@@ -325,7 +403,8 @@ class MapBlock
 	bool onObjectsActivation();
 	bool saveStaticObject(u16 id, const StaticObject &obj, u32 reason);
 
-	void step(float dtime, const std::function<bool(v3s16, MapNode, f32)> &on_timer_cb);
+	// Runs the node timers that elapsed by the time of the timer list
+	void runNodeTimers(const std::function<bool(v3s16, MapNode, f32)> &on_timer_cb);
 
 	////
 	//// Timestamp (see m_timestamp)
@@ -360,18 +439,22 @@ class MapBlock
 
 	inline void resetUsageTimer()
 	{
-		m_usage_timer = 0;
+		if (!m_usage_list)
+			return;
+		m_last_use = m_usage_list->now;
+		if (m_refcount == 0) {
+			m_usage_list->unlink(this);
+			m_usage_list->link(this);
+		}
 	}
 
-	inline void incrementUsageTimer(float dtime)
+	inline float getUsageTimer() const
 	{
-		m_usage_timer += dtime;
+		return m_usage_list ? m_usage_list->now - m_last_use : 0.0f;
 	}
 
-	inline float getUsageTimer()
-	{
-		return m_usage_timer;
-	}
+	// Set by the map while the block is part of it
+	void setUsageList(MapBlockUsageList *list);
 
 	////
 	//// Reference counting (see m_refcount)
@@ -380,13 +463,16 @@ class MapBlock
 	inline void refGrab()
 	{
 		assert(m_refcount < SHRT_MAX);
-		m_refcount++;
+		if (m_refcount++ == 0 && m_usage_list)
+			m_usage_list->unlink(this);
 	}
 
+	// Dropping the last reference counts as a use
 	inline void refDrop()
 	{
 		assert(m_refcount > 0);
-		m_refcount--;
+		if (--m_refcount == 0)
+			resetUsageTimer();
 	}
 
 	inline short refGet()
@@ -418,6 +504,22 @@ class MapBlock
 		m_node_timers.clear();
 	}
 
+	// See NodeTimerList::attach
+	inline void attachNodeTimers(NodeTimerWheel *wheel, double catch_up)
+	{
+		m_node_timers.attach(wheel, getPos(), catch_up);
+	}
+
+	inline void detachNodeTimers()
+	{
+		m_node_timers.detach();
+	}
+
+	inline bool hasAttachedNodeTimers() const
+	{
+		return m_node_timers.isAttached();
+	}
+
 	////
 	//// Serialization
 	///
@@ -425,10 +527,23 @@ class MapBlock
 	// These don't write or read version by itself
 	// Set disk to true for on-disk format, false for over-the-network format
 	// Precondition: version >= SER_FMT_VER_LOWEST_WRITE
-	void serialize(std::ostream &result, u8 version, bool disk, int compression_level);
+	// 'dict' replaces the compression level for version >= 29 if given
+	void serialize(std::ostream &result, u8 version, bool disk, int compression_level,
+		const ZstdDictionary *dict = nullptr);
 	// If disk == true: In addition to doing other things, will add
-	// unknown blocks from id-name mapping to wndef
-	void deSerialize(std::istream &is, u8 version, bool disk);
+	// unknown blocks from id-name mapping to wndef.
+	// If 'nimap' is given, the ids are left as stored and the id-name
+	// mapping is put there instead, so that the node definitions are not
+	// touched. correctNodeIds() has to be called with it before use.
+	void deSerialize(std::istream &is, u8 version, bool disk,
+		NameIdMapping *nimap = nullptr);
+	// Same as above, reading from memory without copying it first.
+	// Returns the number of bytes used, anything after them is left alone.
+	// 'dict' is needed for blocks that were serialized with it.
+	size_t deSerialize(const u8 *data, size_t size, u8 version, bool disk,
+		NameIdMapping *nimap = nullptr, const ZstdDictionary *dict = nullptr);
+	// Second part of deSerialize() with 'nimap' given
+	void correctNodeIds(const NameIdMapping &nimap);
 
 	void serializeNetworkSpecific(std::ostream &os);
 	void deSerializeNetworkSpecific(std::istream &is);
@@ -448,6 +563,20 @@ class MapBlock
 	*/
 
 	void deSerialize_pre22(std::istream &is, u8 version, bool disk);
+	// Reads the decompressed contents of a block of version >= 29
+	void deSerializeRaw(const u8 *raw, size_t size, u8 version, bool disk,
+		NameIdMapping *nimap_out);
+
+	void actuallyExpandNodes();
+
+	inline MapNode getCompactNode(u32 i) const
+	{
+		if (m_palette_bits == 8)
+			return m_palette[m_palette_indices[i]];
+		if (m_palette_bits == 4)
+			return m_palette[(m_palette_indices[i / 2] >> (i % 2 * 4)) & 0x0f];
+		return m_palette[0];
+	}
 
 	/*
 	 * PLEASE NOTE: When adding something here be mindful of position and size
@@ -489,17 +618,32 @@ class MapBlock
 	 * Note that this is not an inline array because that has implications for
 	 * heap fragmentation (the array is exactly 16K), CPU caches and/or
 	 * optimizability of algorithms working on this array.
+	 * It is null while the block is compact.
 	 */
-	MapNode *const data; // of `nodecount` elements
+	MapNode *data; // of `nodecount` elements
+
+	// The distinct nodes of a compact block
+	std::vector<MapNode> m_palette;
+	// Index into m_palette for each node, 4 or 8 bits as per m_palette_bits.
+	// Not used if there is only one node in the palette.
+	std::unique_ptr<u8[]> m_palette_indices;
+	u8 m_palette_bits = 0;
 
 	// provides the item and node definitions
 	IGameDef *m_gamedef;
 
 	/*
-		When the block is accessed, this is set to 0.
-		Map will unload the block when this reaches a timeout.
+		When the block is accessed, this is set to the current time of the
+		usage list. Map will unload the block when it is too long ago.
 	*/
-	float m_usage_timer = 0;
+	double m_last_use = 0;
+
+	// Links of the usage list, only while unreferenced
+	friend class MapBlockUsageList;
+	MapBlockUsageList *m_usage_list = nullptr;
+	MapBlock *m_usage_prev = nullptr;
+	MapBlock *m_usage_next = nullptr;
+	bool m_usage_linked = false;
 
 public:
 	//// ABM optimizations ////
@@ -51,6 +51,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "mapgen_singlenode.h"
 #include "cavegen.h"
 #include "dungeongen.h"
+#include "threading/mutex_auto_lock.h"
 
 FlagDesc flagdesc_mapgen[] = {
 	{"caves",       MG_CAVES},
@@ -233,6 +234,61 @@ void Mapgen::setDefaultSettings(Settings *settings)
 	}
 }
 
+const char *Mapgen::getPhaseName(MapgenPhase phase)
+{
+	static const char *names[] = {
+		"noise",
+		"terrain",
+		"biomes",
+		"caves",
+		"dungeons",
+		"ores",
+		"decorations",
+		"dust",
+		"liquids",
+		"lighting",
+	};
+	static_assert(ARRLEN(names) == MGPHASE_COUNT, "enum size mismatches");
+
+	if ((size_t)phase >= ARRLEN(names))
+		return "invalid";
+	return names[phase];
+}
+
+u64 MapgenPhaseTimes::getTotalUs() const
+{
+	u64 total = 0;
+	for (u64 t : time_us)
+		total += t;
+	return total;
+}
+
+void Mapgen::beginPhases()
+{
+	phase_times.chunks++;
+	m_phase_start_us = porting::getTimeUs();
+}
+
+void Mapgen::endPhase(MapgenPhase phase)
+{
+	u64 now = porting::getTimeUs();
+	phase_times.time_us[phase] += now - m_phase_start_us;
+	m_phase_start_us = now;
+}
+
+void Mapgen::calcColumnNoise(v3s16 pmin, MapgenColumnGroup group,
+	std::initializer_list<Noise *> noises, const std::function<void()> &calc)
+{
+	MapgenColumnCache *cache = m_emerge ? m_emerge->column_cache : nullptr;
+	if (cache && cache->load(pmin, group, noises))
+		return;
+
+	calc();
+
+	if (cache)
+		cache->store(pmin, group, noises);
+}
+
 u32 Mapgen::getBlockSeed(v3s16 p, s32 seed)
 {
 	return (u32)seed   +
@@ -430,7 +486,8 @@ void Mapgen::updateLiquid(UniqueQueue<v3s16> *trans_liquid, v3s16 nmin, v3s16 nm
 
 void Mapgen::setLighting(u8 light, v3s16 nmin, v3s16 nmax)
 {
-	ScopeProfiler sp(g_profiler, "EmergeThread: update lighting", SPT_AVG);
+	static const auto sp_id = ScopeProfiler::intern("EmergeThread: update lighting");
+	ScopeProfiler sp(g_profiler, sp_id, SPT_AVG);
 	VoxelArea a(nmin, nmax);
 
 	for (int z = a.MinEdge.Z; z <= a.MaxEdge.Z; z++) {
@@ -483,7 +540,8 @@ void Mapgen::lightSpread(VoxelArea &a, std::queue<std::pair<v3s16, u8>> &queue,
 void Mapgen::calcLighting(v3s16 nmin, v3s16 nmax, v3s16 full_nmin, v3s16 full_nmax,
 	bool propagate_shadow)
 {
-	ScopeProfiler sp(g_profiler, "EmergeThread: update lighting", SPT_AVG);
+	static const auto sp_id = ScopeProfiler::intern("EmergeThread: update lighting");
+	ScopeProfiler sp(g_profiler, sp_id, SPT_AVG);
 
 	propagateSunlight(nmin, nmax, propagate_shadow);
 	spreadLight(full_nmin, full_nmax);
@@ -646,7 +704,9 @@ void MapgenBasic::generateBiomes()
 	const v3s16 &em = vm->m_area.getExtent();
 	u32 index = 0;
 
-	noise_filler_depth->perlinMap2D(node_min.X, node_min.Z);
+	calcColumnNoise(node_min, MGCOLUMN_FILLER_DEPTH, {noise_filler_depth}, [&] {
+		noise_filler_depth->perlinMap2D(node_min.X, node_min.Z);
+	});
 
 	s16 *biome_transitions = biomegen->getBiomeTransitions();
 
@@ -1028,6 +1088,75 @@ void GenerateNotifier::clearEvents()
 }
 
 
+////
+//// MapgenColumnCache
+////
+
+bool MapgenColumnCache::load(v3s16 pmin, MapgenColumnGroup group,
+	std::initializer_list<Noise *> noises)
+{
+	MutexAutoLock lock(m_mutex);
+
+	auto it = m_entries.find(getKey(pmin, group));
+	if (it == m_entries.end())
+		return false;
+
+	Entry &entry = it->second;
+	m_lru.splice(m_lru.begin(), m_lru, entry.lru_it);
+
+	const float *src = entry.results.data();
+	for (Noise *noise : noises) {
+		if (!noise)
+			continue;
+		u32 count = noise->sx * noise->sy;
+		memcpy(noise->result, src, count * sizeof(float));
+		src += count;
+	}
+	return true;
+}
+
+void MapgenColumnCache::store(v3s16 pmin, MapgenColumnGroup group,
+	std::initializer_list<Noise *> noises)
+{
+	if (m_max_entries == 0)
+		return;
+
+	std::vector<float> results;
+	for (Noise *noise : noises) {
+		if (noise)
+			results.insert(results.end(), noise->result,
+				noise->result + noise->sx * noise->sy);
+	}
+
+	MutexAutoLock lock(m_mutex);
+
+	v3s16 key = getKey(pmin, group);
+	auto it = m_entries.find(key);
+	if (it != m_entries.end()) {
+		// Another thread was faster, the results are the same
+		m_lru.splice(m_lru.begin(), m_lru, it->second.lru_it);
+		return;
+	}
+
+	if (m_entries.size() >= m_max_entries) {
+		m_entries.erase(m_lru.back());
+		m_lru.pop_back();
+	}
+
+	m_lru.push_front(key);
+	Entry &entry = m_entries[key];
+	entry.results = std::move(results);
+	entry.lru_it = m_lru.begin();
+}
+
+void MapgenColumnCache::clear()
+{
+	MutexAutoLock lock(m_mutex);
+	m_entries.clear();
+	m_lru.clear();
+}
+
+
 ////
 //// MapgenParams
 ////
@@ -25,6 +25,11 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "nodedef.h"
 #include "util/string.h"
 #include "util/container.h"
+#include <functional>
+#include <initializer_list>
+#include <list>
+#include <mutex>
+#include <unordered_map>
 #include <utility>
 
 #define MAPGEN_DEFAULT MAPGEN_V7
@@ -79,6 +84,73 @@ enum GenNotifyType {
 	NUM_GENNOTIFY_TYPES
 };
 
+// Phases of Mapgen::makeChunk() whose time is accounted separately
+enum MapgenPhase {
+	MGPHASE_NOISE,
+	MGPHASE_TERRAIN,
+	MGPHASE_BIOMES,
+	MGPHASE_CAVES,
+	MGPHASE_DUNGEONS,
+	MGPHASE_ORES,
+	MGPHASE_DECORATIONS,
+	MGPHASE_DUST,
+	MGPHASE_LIQUIDS,
+	MGPHASE_LIGHTING,
+	MGPHASE_COUNT
+};
+
+struct MapgenPhaseTimes {
+	u32 chunks = 0;
+	u64 time_us[MGPHASE_COUNT] = {};
+
+	u64 getTotalUs() const;
+};
+
+// Sets of 2D noises that are kept in the MapgenColumnCache
+enum MapgenColumnGroup {
+	MGCOLUMN_TERRAIN,
+	MGCOLUMN_TERRAIN_EXTRA,
+	MGCOLUMN_BIOMES,
+	MGCOLUMN_FILLER_DEPTH,
+};
+
+/*
+	Results of the 2D noises of recently generated mapchunk columns, shared by
+	the mapgens of all emerge threads. Mapchunks stacked on top of each other
+	have the same 2D noise, so only the first one of a column calculates it.
+	The least recently used columns are dropped when the cache is full.
+*/
+class MapgenColumnCache {
+public:
+	MapgenColumnCache(u32 max_entries) : m_max_entries(max_entries) {}
+	DISABLE_CLASS_COPY(MapgenColumnCache);
+
+	// Copies the cached results into the noises. Null noises are skipped.
+	// Returns false if the column is not cached.
+	bool load(v3s16 pmin, MapgenColumnGroup group,
+		std::initializer_list<Noise *> noises);
+	void store(v3s16 pmin, MapgenColumnGroup group,
+		std::initializer_list<Noise *> noises);
+	void clear();
+
+private:
+	struct Entry {
+		std::vector<float> results;
+		std::list<v3s16>::iterator lru_it;
+	};
+
+	static v3s16 getKey(v3s16 pmin, MapgenColumnGroup group)
+	{
+		return v3s16(pmin.X, group, pmin.Z);
+	}
+
+	std::mutex m_mutex;
+	std::unordered_map<v3s16, Entry> m_entries;
+	// Most recently used first
+	std::list<v3s16> m_lru;
+	const u32 m_max_entries;
+};
+
 struct GenNotifyEvent {
 	GenNotifyType type;
 	v3s16 pos;
@@ -176,6 +248,9 @@ class Mapgen {
 	BiomeGen *biomegen = nullptr;
 	GenerateNotifier gennotify;
 
+	// Time spent in the phases of all makeChunk() calls of this mapgen
+	MapgenPhaseTimes phase_times;
+
 	Mapgen() = default;
 	Mapgen(int mapgenid, MapgenParams *params, EmergeParams *emerge);
 	virtual ~Mapgen();
@@ -245,8 +320,22 @@ class Mapgen {
 	static MapgenParams *createMapgenParams(MapgenType mgtype);
 	static void getMapgenNames(std::vector<const char *> *mgnames, bool include_hidden);
 	static void setDefaultSettings(Settings *settings);
+	static const char *getPhaseName(MapgenPhase phase);
+
+protected:
+	// Starts accounting the phases of a makeChunk() call
+	void beginPhases();
+	// Adds the time since the previous call to the given phase
+	void endPhase(MapgenPhase phase);
+
+	// Runs 'calc' to calculate the 2D noises of the mapchunk column at 'pmin'
+	// unless another mapchunk of that column already did.
+	void calcColumnNoise(v3s16 pmin, MapgenColumnGroup group,
+		std::initializer_list<Noise *> noises, const std::function<void()> &calc);
 
 private:
+	u64 m_phase_start_us = 0;
+
 	/**
 	 * Spread light to the node at the given position, add to queue if changed.
 	 * The given light value is diminished once.
@@ -275,17 +275,22 @@ void MapgenCarpathian::makeChunk(BlockMakeData *data)
 	// Create a block-specific seed
 	blockseed = getBlockSeed2(full_node_min, seed);
 
+	beginPhases();
+
 	// Generate terrain
 	s16 stone_surface_max_y = generateTerrain();
 
 	// Create heightmap
 	updateHeightmap(node_min, node_max);
+	endPhase(MGPHASE_TERRAIN);
 
 	// Init biome generator, place biome-specific nodes, and build biomemap
 	if (flags & MG_BIOMES) {
 		biomegen->calcBiomeNoise(node_min);
+		endPhase(MGPHASE_NOISE);
 		generateBiomes();
 	}
+	endPhase(MGPHASE_BIOMES);
 
 	// Generate tunnels, caverns and large randomwalk caves
 	if (flags & MG_CAVES) {
@@ -307,31 +312,38 @@ void MapgenCarpathian::makeChunk(BlockMakeData *data)
 		else
 			generateCavesRandomWalk(stone_surface_max_y, large_cave_depth);
 	}
+	endPhase(MGPHASE_CAVES);
 
 	// Generate the registered ores
 	if (flags & MG_ORES)
 		m_emerge->oremgr->placeAllOres(this, blockseed, node_min, node_max);
+	endPhase(MGPHASE_ORES);
 
 	// Generate dungeons
 	if (flags & MG_DUNGEONS)
 		generateDungeons(stone_surface_max_y);
+	endPhase(MGPHASE_DUNGEONS);
 
 	// Generate the registered decorations
 	if (flags & MG_DECORATIONS)
 		m_emerge->decomgr->placeAllDecos(this, blockseed, node_min, node_max);
+	endPhase(MGPHASE_DECORATIONS);
 
 	// Sprinkle some dust on top after everything else was generated
 	if (flags & MG_BIOMES)
 		dustTopNodes();
+	endPhase(MGPHASE_DUST);
 
 	// Update liquids
 	updateLiquid(&data->transforming_liquid, full_node_min, full_node_max);
+	endPhase(MGPHASE_LIQUIDS);
 
 	// Calculate lighting
 	if (flags & MG_LIGHT) {
 		calcLighting(node_min - v3s16(0, 1, 0), node_max + v3s16(0, 1, 0),
 				full_node_min, full_node_max);
 	}
+	endPhase(MGPHASE_LIGHTING);
 
 	this->generating = false;
 }
@@ -444,20 +456,26 @@ int MapgenCarpathian::generateTerrain()
 	MapNode mn_water(c_water_source);
 
 	// Calculate noise for terrain generation
-	noise_height1->perlinMap2D(node_min.X, node_min.Z);
-	noise_height2->perlinMap2D(node_min.X, node_min.Z);
-	noise_height3->perlinMap2D(node_min.X, node_min.Z);
-	noise_height4->perlinMap2D(node_min.X, node_min.Z);
-	noise_hills_terrain->perlinMap2D(node_min.X, node_min.Z);
-	noise_ridge_terrain->perlinMap2D(node_min.X, node_min.Z);
-	noise_step_terrain->perlinMap2D(node_min.X, node_min.Z);
-	noise_hills->perlinMap2D(node_min.X, node_min.Z);
-	noise_ridge_mnt->perlinMap2D(node_min.X, node_min.Z);
-	noise_step_mnt->perlinMap2D(node_min.X, node_min.Z);
+	Noise *rivers = (spflags & MGCARPATHIAN_RIVERS) ? noise_rivers : nullptr;
+	calcColumnNoise(node_min, MGCOLUMN_TERRAIN, {noise_height1, noise_height2,
+			noise_height3, noise_height4, noise_hills_terrain, noise_ridge_terrain,
+			noise_step_terrain, noise_hills, noise_ridge_mnt, noise_step_mnt,
+			rivers}, [&] {
+		noise_height1->perlinMap2D(node_min.X, node_min.Z);
+		noise_height2->perlinMap2D(node_min.X, node_min.Z);
+		noise_height3->perlinMap2D(node_min.X, node_min.Z);
+		noise_height4->perlinMap2D(node_min.X, node_min.Z);
+		noise_hills_terrain->perlinMap2D(node_min.X, node_min.Z);
+		noise_ridge_terrain->perlinMap2D(node_min.X, node_min.Z);
+		noise_step_terrain->perlinMap2D(node_min.X, node_min.Z);
+		noise_hills->perlinMap2D(node_min.X, node_min.Z);
+		noise_ridge_mnt->perlinMap2D(node_min.X, node_min.Z);
+		noise_step_mnt->perlinMap2D(node_min.X, node_min.Z);
+		if (rivers)
+			rivers->perlinMap2D(node_min.X, node_min.Z);
+	});
 	noise_mnt_var->perlinMap3D(node_min.X, node_min.Y - 1, node_min.Z);
-
-	if (spflags & MGCARPATHIAN_RIVERS)
-		noise_rivers->perlinMap2D(node_min.X, node_min.Z);
+	endPhase(MGPHASE_NOISE);
 
 	//// Place nodes
 	const v3s16 &em = vm->m_area.getExtent();
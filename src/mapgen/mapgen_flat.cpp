@@ -224,17 +224,22 @@ void MapgenFlat::makeChunk(BlockMakeData *data)
 
 	blockseed = getBlockSeed2(full_node_min, seed);
 
+	beginPhases();
+
 	// Generate base terrain, mountains, and ridges with initial heightmaps
 	s16 stone_surface_max_y = generateTerrain();
 
 	// Create heightmap
 	updateHeightmap(node_min, node_max);
+	endPhase(MGPHASE_TERRAIN);
 
 	// Init biome generator, place biome-specific nodes, and build biomemap
 	if (flags & MG_BIOMES) {
 		biomegen->calcBiomeNoise(node_min);
+		endPhase(MGPHASE_NOISE);
 		generateBiomes();
 	}
+	endPhase(MGPHASE_BIOMES);
 
 	// Generate tunnels, caverns and large randomwalk caves
 	if (flags & MG_CAVES) {
@@ -256,29 +261,36 @@ void MapgenFlat::makeChunk(BlockMakeData *data)
 		else
 			generateCavesRandomWalk(stone_surface_max_y, large_cave_depth);
 	}
+	endPhase(MGPHASE_CAVES);
 
 	// Generate the registered ores
 	if (flags & MG_ORES)
 		m_emerge->oremgr->placeAllOres(this, blockseed, node_min, node_max);
+	endPhase(MGPHASE_ORES);
 
 	if (flags & MG_DUNGEONS)
 		generateDungeons(stone_surface_max_y);
+	endPhase(MGPHASE_DUNGEONS);
 
 	// Generate the registered decorations
 	if (flags & MG_DECORATIONS)
 		m_emerge->decomgr->placeAllDecos(this, blockseed, node_min, node_max);
+	endPhase(MGPHASE_DECORATIONS);
 
 	// Sprinkle some dust on top after everything else was generated
 	if (flags & MG_BIOMES)
 		dustTopNodes();
+	endPhase(MGPHASE_DUST);
 
 	//printf("makeChunk: %dms\n", t.stop());
 
 	updateLiquid(&data->transforming_liquid, full_node_min, full_node_max);
+	endPhase(MGPHASE_LIQUIDS);
 
 	if (flags & MG_LIGHT)
 		calcLighting(node_min - v3s16(0, 1, 0), node_max + v3s16(0, 1, 0),
 			full_node_min, full_node_max);
+	endPhase(MGPHASE_LIGHTING);
 
 	//setLighting(node_min - v3s16(1, 0, 1) * MAP_BLOCKSIZE,
 	//			node_max + v3s16(1, 0, 1) * MAP_BLOCKSIZE, 0xFF);
@@ -298,8 +310,12 @@ s16 MapgenFlat::generateTerrain()
 	u32 ni2d = 0;
 
 	bool use_noise = (spflags & MGFLAT_LAKES) || (spflags & MGFLAT_HILLS);
-	if (use_noise)
-		noise_terrain->perlinMap2D(node_min.X, node_min.Z);
+	if (use_noise) {
+		calcColumnNoise(node_min, MGCOLUMN_TERRAIN, {noise_terrain}, [&] {
+			noise_terrain->perlinMap2D(node_min.X, node_min.Z);
+		});
+	}
+	endPhase(MGPHASE_NOISE);
 
 	for (s16 z = node_min.Z; z <= node_max.Z; z++)
 	for (s16 x = node_min.X; x <= node_max.X; x++, ni2d++) {
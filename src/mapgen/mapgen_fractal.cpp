@@ -226,48 +226,60 @@ void MapgenFractal::makeChunk(BlockMakeData *data)
 
 	blockseed = getBlockSeed2(full_node_min, seed);
 
+	beginPhases();
+
 	// Generate fractal and optional terrain
 	s16 stone_surface_max_y = generateTerrain();
 
 	// Create heightmap
 	updateHeightmap(node_min, node_max);
+	endPhase(MGPHASE_TERRAIN);
 
 	// Init biome generator, place biome-specific nodes, and build biomemap
 	if (flags & MG_BIOMES) {
 		biomegen->calcBiomeNoise(node_min);
+		endPhase(MGPHASE_NOISE);
 		generateBiomes();
 	}
+	endPhase(MGPHASE_BIOMES);
 
 	// Generate tunnels and randomwalk caves
 	if (flags & MG_CAVES) {
 		generateCavesNoiseIntersection(stone_surface_max_y);
 		generateCavesRandomWalk(stone_surface_max_y, large_cave_depth);
 	}
+	endPhase(MGPHASE_CAVES);
 
 	// Generate the registered ores
 	if (flags & MG_ORES)
 		m_emerge->oremgr->placeAllOres(this, blockseed, node_min, node_max);
+	endPhase(MGPHASE_ORES);
 
 	// Generate dungeons
 	if (flags & MG_DUNGEONS)
 		generateDungeons(stone_surface_max_y);
+	endPhase(MGPHASE_DUNGEONS);
 
 	// Generate the registered decorations
 	if (flags & MG_DECORATIONS)
 		m_emerge->decomgr->placeAllDecos(this, blockseed, node_min, node_max);
+	endPhase(MGPHASE_DECORATIONS);
 
 	// Sprinkle some dust on top after everything else was generated
 	if (flags & MG_BIOMES)
 		dustTopNodes();
+	endPhase(MGPHASE_DUST);
 
 	// Update liquids
 	if (spflags & MGFRACTAL_TERRAIN)
 		updateLiquid(&data->transforming_liquid, full_node_min, full_node_max);
+	endPhase(MGPHASE_LIQUIDS);
 
 	// Calculate lighting
 	if (flags & MG_LIGHT)
 		calcLighting(node_min - v3s16(0, 1, 0), node_max + v3s16(0, 1, 0),
 			full_node_min, full_node_max);
+	endPhase(MGPHASE_LIGHTING);
 
 	this->generating = false;
 
@@ -414,8 +426,12 @@ s16 MapgenFractal::generateTerrain()
 	s16 stone_surface_max_y = -MAX_MAP_GENERATION_LIMIT;
 	u32 index2d = 0;
 
-	if (noise_seabed)
-		noise_seabed->perlinMap2D(node_min.X, node_min.Z);
+	if (noise_seabed) {
+		calcColumnNoise(node_min, MGCOLUMN_TERRAIN, {noise_seabed}, [&] {
+			noise_seabed->perlinMap2D(node_min.X, node_min.Z);
+		});
+	}
+	endPhase(MGPHASE_NOISE);
 
 	for (s16 z = node_min.Z; z <= node_max.Z; z++) {
 		for (s16 y = node_min.Y - 1; y <= node_max.Y + 1; y++) {
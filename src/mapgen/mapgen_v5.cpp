@@ -217,17 +217,22 @@ void MapgenV5::makeChunk(BlockMakeData *data)
 	// Create a block-specific seed
 	blockseed = getBlockSeed2(full_node_min, seed);
 
+	beginPhases();
+
 	// Generate base terrain
 	s16 stone_surface_max_y = generateBaseTerrain();
 
 	// Create heightmap
 	updateHeightmap(node_min, node_max);
+	endPhase(MGPHASE_TERRAIN);
 
 	// Init biome generator, place biome-specific nodes, and build biomemap
 	if (flags & MG_BIOMES) {
 		biomegen->calcBiomeNoise(node_min);
+		endPhase(MGPHASE_NOISE);
 		generateBiomes();
 	}
+	endPhase(MGPHASE_BIOMES);
 
 	// Generate tunnels, caverns and large randomwalk caves
 	if (flags & MG_CAVES) {
@@ -249,33 +254,40 @@ void MapgenV5::makeChunk(BlockMakeData *data)
 		else
 			generateCavesRandomWalk(stone_surface_max_y, large_cave_depth);
 	}
+	endPhase(MGPHASE_CAVES);
 
 	// Generate the registered ores
 	if (flags & MG_ORES)
 		m_emerge->oremgr->placeAllOres(this, blockseed, node_min, node_max);
+	endPhase(MGPHASE_ORES);
 
 	// Generate dungeons and desert temples
 	if (flags & MG_DUNGEONS)
 		generateDungeons(stone_surface_max_y);
+	endPhase(MGPHASE_DUNGEONS);
 
 	// Generate the registered decorations
 	if (flags & MG_DECORATIONS)
 		m_emerge->decomgr->placeAllDecos(this, blockseed, node_min, node_max);
+	endPhase(MGPHASE_DECORATIONS);
 
 	// Sprinkle some dust on top after everything else was generated
 	if (flags & MG_BIOMES)
 		dustTopNodes();
+	endPhase(MGPHASE_DUST);
 
 	//printf("makeChunk: %dms\n", t.stop());
 
 	// Add top and bottom side of water to transforming_liquid queue
 	updateLiquid(&data->transforming_liquid, full_node_min, full_node_max);
+	endPhase(MGPHASE_LIQUIDS);
 
 	// Calculate lighting
 	if (flags & MG_LIGHT) {
 		calcLighting(node_min - v3s16(0, 1, 0), node_max + v3s16(0, 1, 0),
 			full_node_min, full_node_max);
 	}
+	endPhase(MGPHASE_LIGHTING);
 
 	this->generating = false;
 }
@@ -287,9 +299,12 @@ int MapgenV5::generateBaseTerrain()
 	u32 index2d = 0;
 	int stone_surface_max_y = -MAX_MAP_GENERATION_LIMIT;
 
-	noise_factor->perlinMap2D(node_min.X, node_min.Z);
-	noise_height->perlinMap2D(node_min.X, node_min.Z);
+	calcColumnNoise(node_min, MGCOLUMN_TERRAIN, {noise_factor, noise_height}, [&] {
+		noise_factor->perlinMap2D(node_min.X, node_min.Z);
+		noise_height->perlinMap2D(node_min.X, node_min.Z);
+	});
 	noise_ground->perlinMap3D(node_min.X, node_min.Y - 1, node_min.Z);
+	endPhase(MGPHASE_NOISE);
 
 	for (s16 z=node_min.Z; z<=node_max.Z; z++) {
 		for (s16 y=node_min.Y - 1; y<=node_max.Y + 1; y++) {
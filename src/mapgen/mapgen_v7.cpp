@@ -333,17 +333,22 @@ void MapgenV7::makeChunk(BlockMakeData *data)
 
 	blockseed = getBlockSeed2(full_node_min, seed);
 
+	beginPhases();
+
 	// Generate base and mountain terrain
 	s16 stone_surface_max_y = generateTerrain();
 
 	// Create heightmap
 	updateHeightmap(node_min, node_max);
+	endPhase(MGPHASE_TERRAIN);
 
 	// Init biome generator, place biome-specific nodes, and build biomemap
 	if (flags & MG_BIOMES) {
 		biomegen->calcBiomeNoise(node_min);
+		endPhase(MGPHASE_NOISE);
 		generateBiomes();
 	}
+	endPhase(MGPHASE_BIOMES);
 
 	// Generate tunnels, caverns and large randomwalk caves
 	if (flags & MG_CAVES) {
@@ -365,25 +370,31 @@ void MapgenV7::makeChunk(BlockMakeData *data)
 		else
 			generateCavesRandomWalk(stone_surface_max_y, large_cave_depth);
 	}
+	endPhase(MGPHASE_CAVES);
 
 	// Generate the registered ores
 	if (flags & MG_ORES)
 		m_emerge->oremgr->placeAllOres(this, blockseed, node_min, node_max);
+	endPhase(MGPHASE_ORES);
 
 	// Generate dungeons
 	if (flags & MG_DUNGEONS)
 		generateDungeons(stone_surface_max_y);
+	endPhase(MGPHASE_DUNGEONS);
 
 	// Generate the registered decorations
 	if (flags & MG_DECORATIONS)
 		m_emerge->decomgr->placeAllDecos(this, blockseed, node_min, node_max);
+	endPhase(MGPHASE_DECORATIONS);
 
 	// Sprinkle some dust on top after everything else was generated
 	if (flags & MG_BIOMES)
 		dustTopNodes();
+	endPhase(MGPHASE_DUST);
 
 	// Update liquids
 	updateLiquid(&data->transforming_liquid, full_node_min, full_node_max);
+	endPhase(MGPHASE_LIQUIDS);
 
 	// Calculate lighting
 	// Limit floatland shadows
@@ -393,6 +404,7 @@ void MapgenV7::makeChunk(BlockMakeData *data)
 	if (flags & MG_LIGHT)
 		calcLighting(node_min - v3s16(0, 1, 0), node_max + v3s16(0, 1, 0),
 			full_node_min, full_node_max, propagate_shadow);
+	endPhase(MGPHASE_LIGHTING);
 
 	this->generating = false;
 
@@ -487,17 +499,21 @@ int MapgenV7::generateTerrain()
 	MapNode n_water(c_water_source);
 
 	//// Calculate noise for terrain generation
-	noise_terrain_persist->perlinMap2D(node_min.X, node_min.Z);
-	float *persistmap = noise_terrain_persist->result;
-
-	noise_terrain_base->perlinMap2D(node_min.X, node_min.Z, persistmap);
-	noise_terrain_alt->perlinMap2D(node_min.X, node_min.Z, persistmap);
-	noise_height_select->perlinMap2D(node_min.X, node_min.Z);
-
-	if (spflags & MGV7_MOUNTAINS) {
-		noise_mount_height->perlinMap2D(node_min.X, node_min.Z);
+	Noise *mount_height = (spflags & MGV7_MOUNTAINS) ? noise_mount_height : nullptr;
+	calcColumnNoise(node_min, MGCOLUMN_TERRAIN, {noise_terrain_base,
+			noise_terrain_alt, noise_height_select, mount_height}, [&] {
+		noise_terrain_persist->perlinMap2D(node_min.X, node_min.Z);
+		float *persistmap = noise_terrain_persist->result;
+
+		noise_terrain_base->perlinMap2D(node_min.X, node_min.Z, persistmap);
+		noise_terrain_alt->perlinMap2D(node_min.X, node_min.Z, persistmap);
+		noise_height_select->perlinMap2D(node_min.X, node_min.Z);
+		if (mount_height)
+			mount_height->perlinMap2D(node_min.X, node_min.Z);
+	});
+
+	if (spflags & MGV7_MOUNTAINS)
 		noise_mountain->perlinMap3D(node_min.X, node_min.Y - 1, node_min.Z);
-	}
 
 	//// Floatlands
 	// 'Generate floatlands in this mapchunk' bool for
@@ -534,8 +550,11 @@ int MapgenV7::generateTerrain()
 		!gen_floatlands;
 	if (gen_rivers) {
 		noise_ridge->perlinMap3D(node_min.X, node_min.Y - 1, node_min.Z);
-		noise_ridge_uwater->perlinMap2D(node_min.X, node_min.Z);
+		calcColumnNoise(node_min, MGCOLUMN_TERRAIN_EXTRA, {noise_ridge_uwater}, [&] {
+			noise_ridge_uwater->perlinMap2D(node_min.X, node_min.Z);
+		});
 	}
+	endPhase(MGPHASE_NOISE);
 
 	//// Place nodes
 	const v3s16 &em = vm->m_area.getExtent();
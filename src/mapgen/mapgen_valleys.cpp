@@ -227,21 +227,26 @@ void MapgenValleys::makeChunk(BlockMakeData *data)
 
 	blockseed = getBlockSeed2(full_node_min, seed);
 
+	beginPhases();
+
 	// Generate biome noises. Note this must be executed strictly before
 	// generateTerrain, because generateTerrain depends on intermediate
 	// biome-related noises.
 	m_bgen->calcBiomeNoise(node_min);
+	endPhase(MGPHASE_NOISE);
 
 	// Generate terrain
 	s16 stone_surface_max_y = generateTerrain();
 
 	// Create heightmap
 	updateHeightmap(node_min, node_max);
+	endPhase(MGPHASE_TERRAIN);
 
 	// Place biome-specific nodes and build biomemap
 	if (flags & MG_BIOMES) {
 		generateBiomes();
 	}
+	endPhase(MGPHASE_BIOMES);
 
 	// Generate tunnels, caverns and large randomwalk caves
 	if (flags & MG_CAVES) {
@@ -261,28 +266,35 @@ void MapgenValleys::makeChunk(BlockMakeData *data)
 		else
 			generateCavesRandomWalk(stone_surface_max_y, large_cave_depth);
 	}
+	endPhase(MGPHASE_CAVES);
 
 	// Generate the registered ores
 	if (flags & MG_ORES)
 		m_emerge->oremgr->placeAllOres(this, blockseed, node_min, node_max);
+	endPhase(MGPHASE_ORES);
 
 	// Dungeon creation
 	if (flags & MG_DUNGEONS)
 		generateDungeons(stone_surface_max_y);
+	endPhase(MGPHASE_DUNGEONS);
 
 	// Generate the registered decorations
 	if (flags & MG_DECORATIONS)
 		m_emerge->decomgr->placeAllDecos(this, blockseed, node_min, node_max);
+	endPhase(MGPHASE_DECORATIONS);
 
 	// Sprinkle some dust on top after everything else was generated
 	if (flags & MG_BIOMES)
 		dustTopNodes();
+	endPhase(MGPHASE_DUST);
 
 	updateLiquid(&data->transforming_liquid, full_node_min, full_node_max);
+	endPhase(MGPHASE_LIQUIDS);
 
 	if (flags & MG_LIGHT)
 		calcLighting(node_min - v3s16(0, 1, 0), node_max + v3s16(0, 1, 0),
 			full_node_min, full_node_max);
+	endPhase(MGPHASE_LIGHTING);
 
 	this->generating = false;
 
@@ -349,13 +361,18 @@ int MapgenValleys::generateTerrain()
 	MapNode n_stone(c_stone);
 	MapNode n_water(c_water_source);
 
-	noise_inter_valley_slope->perlinMap2D(node_min.X, node_min.Z);
-	noise_rivers->perlinMap2D(node_min.X, node_min.Z);
-	noise_terrain_height->perlinMap2D(node_min.X, node_min.Z);
-	noise_valley_depth->perlinMap2D(node_min.X, node_min.Z);
-	noise_valley_profile->perlinMap2D(node_min.X, node_min.Z);
+	calcColumnNoise(node_min, MGCOLUMN_TERRAIN, {noise_inter_valley_slope,
+			noise_rivers, noise_terrain_height, noise_valley_depth,
+			noise_valley_profile}, [&] {
+		noise_inter_valley_slope->perlinMap2D(node_min.X, node_min.Z);
+		noise_rivers->perlinMap2D(node_min.X, node_min.Z);
+		noise_terrain_height->perlinMap2D(node_min.X, node_min.Z);
+		noise_valley_depth->perlinMap2D(node_min.X, node_min.Z);
+		noise_valley_profile->perlinMap2D(node_min.X, node_min.Z);
+	});
 
 	noise_inter_valley_fill->perlinMap3D(node_min.X, node_min.Y - 1, node_min.Z);
+	endPhase(MGPHASE_NOISE);
 
 	const v3s16 &em = vm->m_area.getExtent();
 	s16 surface_max_y = -MAX_MAP_GENERATION_LIMIT;
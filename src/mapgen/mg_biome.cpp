@@ -218,6 +218,11 @@ void BiomeGenOriginal::calcBiomeNoise(v3s16 pmin)
 {
 	m_pmin = pmin;
 
+	// Only the blended results are used
+	if (m_column_cache && m_column_cache->load(pmin, MGCOLUMN_BIOMES,
+			{noise_heat, noise_humidity}))
+		return;
+
 	noise_heat->perlinMap2D(pmin.X, pmin.Z);
 	noise_humidity->perlinMap2D(pmin.X, pmin.Z);
 	noise_heat_blend->perlinMap2D(pmin.X, pmin.Z);
@@ -227,6 +232,9 @@ void BiomeGenOriginal::calcBiomeNoise(v3s16 pmin)
 		noise_heat->result[i]     += noise_heat_blend->result[i];
 		noise_humidity->result[i] += noise_humidity_blend->result[i];
 	}
+
+	if (m_column_cache)
+		m_column_cache->store(pmin, MGCOLUMN_BIOMES, {noise_heat, noise_humidity});
 }
 
 
@@ -27,6 +27,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 class Server;
 class Settings;
 class BiomeManager;
+class MapgenColumnCache;
 
 ////
 //// Biome
@@ -130,12 +131,16 @@ class BiomeGen {
 
 	virtual s16 *getBiomeTransitions() const = 0;
 
+	// Lets calcBiomeNoise() share its results with other mapchunks of a column.
+	void setColumnCache(MapgenColumnCache *cache) { m_column_cache = cache; }
+
 	// Result of calcBiomes bulk computation.
 	biome_t *biomemap = nullptr;
 	s16 *biome_transitions = nullptr;
 
 protected:
 	BiomeManager *m_bmgr = nullptr;
+	MapgenColumnCache *m_column_cache = nullptr;
 	v3s16 m_pmin;
 	v3s16 m_csize;
 };
@@ -55,12 +55,15 @@ size_t DecorationManager::placeAllDecos(Mapgen *mg, u32 blockseed,
 {
 	size_t nplaced = 0;
 
+	DecorationChunkData chunk;
+	chunk.init(mg, nmin, nmax);
+
 	for (size_t i = 0; i != m_objects.size(); i++) {
 		Decoration *deco = (Decoration *)m_objects[i];
 		if (!deco)
 			continue;
 
-		nplaced += deco->placeDeco(mg, blockseed, nmin, nmax);
+		nplaced += deco->placeDeco(mg, blockseed, nmin, nmax, &chunk);
 		blockseed++;
 	}
 
@@ -78,6 +81,72 @@ DecorationManager *DecorationManager::clone() const
 ///////////////////////////////////////////////////////////////////////////////
 
 
+void DecorationChunkData::init(Mapgen *mg, v3s16 nmin, v3s16 nmax)
+{
+	biomes.clear();
+	m_noise.clear();
+	height_min = MAX_MAP_GENERATION_LIMIT;
+	height_max = -MAX_MAP_GENERATION_LIMIT;
+
+	const u32 area = (nmax.X - nmin.X + 1) * (nmax.Z - nmin.Z + 1);
+
+	if (mg->biomemap) {
+		for (u32 i = 0; i < area; i++) {
+			biome_t biome = mg->biomemap[i];
+			if (biome >= biomes.size())
+				biomes.resize(biome + 1, false);
+			biomes[biome] = true;
+		}
+	}
+
+	if (mg->heightmap) {
+		for (u32 i = 0; i < area; i++) {
+			height_min = std::min(height_min, mg->heightmap[i]);
+			height_max = std::max(height_max, mg->heightmap[i]);
+		}
+	}
+}
+
+
+static bool noiseParamsEqual(const NoiseParams &a, const NoiseParams &b)
+{
+	// v3f::operator== has a tolerance
+	return a.offset == b.offset && a.scale == b.scale &&
+		a.spread.X == b.spread.X && a.spread.Y == b.spread.Y &&
+		a.spread.Z == b.spread.Z && a.seed == b.seed &&
+		a.octaves == b.octaves && a.persist == b.persist &&
+		a.lacunarity == b.lacunarity && a.flags == b.flags;
+}
+
+
+const float *DecorationChunkData::getDivisionNoise(const NoiseParams &np,
+	s32 seed, v3s16 nmin, s16 sidelen, s16 divlen)
+{
+	for (const DivisionNoise &noise : m_noise) {
+		if (noise.seed == seed && noise.sidelen == sidelen &&
+				noiseParamsEqual(noise.np, np))
+			return noise.values.data();
+	}
+
+	m_noise.emplace_back();
+	DivisionNoise &noise = m_noise.back();
+	noise.np = np;
+	noise.seed = seed;
+	noise.sidelen = sidelen;
+	noise.values.reserve(divlen * divlen);
+	for (s16 z0 = 0; z0 < divlen; z0++)
+	for (s16 x0 = 0; x0 < divlen; x0++) {
+		noise.values.push_back(NoisePerlin2D(&np,
+			nmin.X + sidelen / 2 + sidelen * x0,
+			nmin.Z + sidelen / 2 + sidelen * z0, seed));
+	}
+	return noise.values.data();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+
+
 void Decoration::resolveNodeNames()
 {
 	getIdsFromNrBacklog(&c_place_on);
@@ -142,9 +211,15 @@ bool Decoration::canPlaceDecoration(MMVManip *vm, v3s16 p)
 }
 
 
-size_t Decoration::placeDeco(Mapgen *mg, u32 blockseed, v3s16 nmin, v3s16 nmax)
+size_t Decoration::placeDeco(Mapgen *mg, u32 blockseed, v3s16 nmin, v3s16 nmax,
+	DecorationChunkData *chunk)
 {
-	PcgRandom ps(blockseed + 53);
+	DecorationChunkData own_chunk;
+	if (!chunk) {
+		own_chunk.init(mg, nmin, nmax);
+		chunk = &own_chunk;
+	}
+
 	int carea_size = nmax.X - nmin.X + 1;
 
 	// Divide area into parts
@@ -152,15 +227,48 @@ size_t Decoration::placeDeco(Mapgen *mg, u32 blockseed, v3s16 nmin, v3s16 nmax)
 	if (carea_size % sidelen)
 		sidelen = carea_size;
 
+	// Reject decorations that can't be placed anywhere in this area before
+	// doing any work per column. This only skips candidates that would be
+	// rejected further below, and the random generator is only used by this
+	// decoration, so the result is the same.
+	if (y_max < nmin.Y || y_min > nmax.Y)
+		return 0;
+
+	const bool heightmap_deco = !(flags &
+		(DECO_ALL_FLOORS | DECO_ALL_CEILINGS | DECO_LIQUID_SURFACE));
+	if (heightmap_deco && mg->heightmap &&
+			(y_max < chunk->height_min || y_min > chunk->height_max))
+		return 0;
+
+	// Biomes of this decoration that occur in the area, indexed by biome id
+	const bool check_biome = mg->biomemap && !biomes.empty();
+	std::vector<bool> biome_mask;
+	if (check_biome) {
+		biome_mask.resize(chunk->biomes.size(), false);
+		bool any_biome = false;
+		for (biome_t biome : biomes) {
+			if (biome < biome_mask.size() && chunk->biomes[biome]) {
+				biome_mask[biome] = true;
+				any_biome = true;
+			}
+		}
+		if (!any_biome)
+			return 0;
+	}
+	auto in_biome = [&] (int mapindex) -> bool {
+		biome_t biome = mg->biomemap[mapindex];
+		return biome < biome_mask.size() && biome_mask[biome];
+	};
+
+	PcgRandom ps(blockseed + 53);
 	s16 divlen = carea_size / sidelen;
 	int area = sidelen * sidelen;
 
+	const float *division_noise = (flags & DECO_USE_NOISE) ?
+		chunk->getDivisionNoise(np, mapseed, nmin, sidelen, divlen) : nullptr;
+
 	for (s16 z0 = 0; z0 < divlen; z0++)
 	for (s16 x0 = 0; x0 < divlen; x0++) {
-		v2s16 p2d_center( // Center position of part of division
-			nmin.X + sidelen / 2 + sidelen * x0,
-			nmin.Z + sidelen / 2 + sidelen * z0
-		);
 		v2s16 p2d_min( // Minimum edge of part of division
 			nmin.X + sidelen * x0,
 			nmin.Z + sidelen * z0
@@ -172,9 +280,8 @@ size_t Decoration::placeDeco(Mapgen *mg, u32 blockseed, v3s16 nmin, v3s16 nmax)
 
 		bool cover = false;
 		// Amount of decorations
-		float nval = (flags & DECO_USE_NOISE) ?
-			NoisePerlin2D(&np, p2d_center.X, p2d_center.Y, mapseed) :
-			fill_ratio;
+		float nval = division_noise ?
+			division_noise[z0 * divlen + x0] : fill_ratio;
 		u32 deco_count = 0;
 
 		if (nval >= 10.0f) {
@@ -213,11 +320,8 @@ size_t Decoration::placeDeco(Mapgen *mg, u32 blockseed, v3s16 nmin, v3s16 nmax)
 					(flags & DECO_ALL_CEILINGS)) {
 				// All-surfaces decorations
 				// Check biome of column
-				if (mg->biomemap && !biomes.empty()) {
-					auto iter = biomes.find(mg->biomemap[mapindex]);
-					if (iter == biomes.end())
-						continue;
-				}
+				if (check_biome && !in_biome(mapindex))
+					continue;
 
 				// Get all floors and ceilings in node column
 				u16 size = (nmax.Y - nmin.Y + 1) / 2;
@@ -265,11 +369,8 @@ size_t Decoration::placeDeco(Mapgen *mg, u32 blockseed, v3s16 nmin, v3s16 nmax)
 				if (y < y_min || y > y_max || y < nmin.Y || y > nmax.Y)
 					continue;
 
-				if (mg->biomemap && !biomes.empty()) {
-					auto iter = biomes.find(mg->biomemap[mapindex]);
-					if (iter == biomes.end())
-						continue;
-				}
+				if (check_biome && !in_biome(mapindex))
+					continue;
 
 				v3s16 pos(x, y, z);
 				if (generate(mg->vm, &ps, pos, false))
@@ -21,6 +21,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #pragma once
 
 #include <unordered_set>
+#include <vector>
 #include "objdef.h"
 #include "noise.h"
 #include "nodedef.h"
@@ -49,6 +50,36 @@ enum DecorationType {
 
 extern FlagDesc flagdesc_deco[];
 
+/*
+	Data about the area decorations are placed in that is gathered once and
+	then used by all decorations, so that most of them can be rejected for a
+	mapchunk without looking at single columns.
+*/
+struct DecorationChunkData {
+	// Whether a biome occurs in the biomemap, indexed by biome id.
+	// Empty if the mapgen has no biomemap.
+	std::vector<bool> biomes;
+	// Range of the heightmap, if the mapgen has one
+	s16 height_min;
+	s16 height_max;
+
+	void init(Mapgen *mg, v3s16 nmin, v3s16 nmax);
+
+	// Returns the fill noise at the division centers, computed only once for
+	// all decorations with the same noise parameters and division size
+	const float *getDivisionNoise(const NoiseParams &np, s32 seed,
+		v3s16 nmin, s16 sidelen, s16 divlen);
+
+private:
+	struct DivisionNoise {
+		NoiseParams np;
+		s32 seed;
+		s16 sidelen;
+		std::vector<float> values;
+	};
+	std::vector<DivisionNoise> m_noise;
+};
+
 
 class Decoration : public ObjDef, public NodeResolver {
 public:
@@ -58,7 +89,9 @@ class Decoration : public ObjDef, public NodeResolver {
 	virtual void resolveNodeNames();
 
 	bool canPlaceDecoration(MMVManip *vm, v3s16 p);
-	size_t placeDeco(Mapgen *mg, u32 blockseed, v3s16 nmin, v3s16 nmax);
+	// chunk may be shared between the decorations placed in the same area
+	size_t placeDeco(Mapgen *mg, u32 blockseed, v3s16 nmin, v3s16 nmax,
+		DecorationChunkData *chunk = nullptr);
 
 	virtual size_t generate(MMVManip *vm, PcgRandom *pr, v3s16 p, bool ceiling) = 0;
 
@@ -48,13 +48,58 @@ OreManager::OreManager(IGameDef *gamedef) :
 size_t OreManager::placeAllOres(Mapgen *mg, u32 blockseed, v3s16 nmin, v3s16 nmax)
 {
 	size_t nplaced = 0;
+	if (m_objects.empty())
+		return 0;
+
+	// Which nodes occur in the area. An ore that can only replace nodes
+	// which don't would place nothing, so it can be skipped. Every ore has
+	// its own random generator, so this doesn't change what the others place.
+	std::vector<bool> present;
+	{
+		const VoxelArea &area = mg->vm->m_area;
+		v3s16 pmin(MYMAX(nmin.X, area.MinEdge.X), MYMAX(nmin.Y, area.MinEdge.Y),
+			MYMAX(nmin.Z, area.MinEdge.Z));
+		v3s16 pmax(MYMIN(nmax.X, area.MaxEdge.X), MYMIN(nmax.Y, area.MaxEdge.Y),
+			MYMIN(nmax.Z, area.MaxEdge.Z));
+		const MapNode *data = mg->vm->m_data;
+		content_t c_last = CONTENT_IGNORE;
+		for (s16 z = pmin.Z; z <= pmax.Z; z++)
+		for (s16 y = pmin.Y; y <= pmax.Y; y++) {
+			u32 vi = area.index(pmin.X, y, z);
+			for (s16 x = pmin.X; x <= pmax.X; x++, vi++) {
+				content_t c = data[vi].getContent();
+				if (c == c_last)
+					continue;
+				c_last = c;
+				if (c >= present.size())
+					present.resize(c + 1, false);
+				present[c] = true;
+			}
+		}
+	}
 
 	for (size_t i = 0; i != m_objects.size(); i++) {
 		Ore *ore = (Ore *)m_objects[i];
 		if (!ore)
 			continue;
 
-		nplaced += ore->placeOre(mg, blockseed, nmin, nmax);
+		bool skip = ore->staysInArea();
+		for (content_t c : ore->c_wherein) {
+			if (c < present.size() && present[c]) {
+				skip = false;
+				break;
+			}
+		}
+
+		if (!skip) {
+			size_t placed = ore->placeOre(mg, blockseed, nmin, nmax);
+			nplaced += placed;
+			if (placed) {
+				if (ore->c_ore >= present.size())
+					present.resize(ore->c_ore + 1, false);
+				present[ore->c_ore] = true;
+			}
+		}
 		blockseed++;
 	}
 
@@ -93,6 +138,20 @@ void Ore::resolveNodeNames()
 {
 	getIdFromNrBacklog(&c_ore, "", CONTENT_AIR);
 	getIdsFromNrBacklog(&c_wherein);
+
+	m_wherein_mask.clear();
+	for (content_t c : c_wherein) {
+		if (c >= m_wherein_mask.size())
+			m_wherein_mask.resize(c + 1, false);
+		m_wherein_mask[c] = true;
+	}
+
+	m_biome_mask.clear();
+	for (biome_t biome : biomes) {
+		if (biome >= m_biome_mask.size())
+			m_biome_mask.resize(biome + 1, false);
+		m_biome_mask[biome] = true;
+	}
 }
 
 
@@ -131,6 +190,8 @@ void Ore::cloneTo(Ore *def) const
 	def->np = np;
 	def->noise = nullptr; // cannot be shared! so created on demand
 	def->biomes = biomes;
+	def->m_wherein_mask = m_wherein_mask;
+	def->m_biome_mask = m_biome_mask;
 }
 
 
@@ -170,8 +231,7 @@ void OreScatter::generate(MMVManip *vm, int mapseed, u32 blockseed,
 
 		if (biomemap && !biomes.empty()) {
 			u32 index = sizex * (z0 - nmin.Z) + (x0 - nmin.X);
-			auto it = biomes.find(biomemap[index]);
-			if (it == biomes.end())
+			if (!isInBiome(biomemap[index]))
 				continue;
 		}
 
@@ -182,7 +242,7 @@ void OreScatter::generate(MMVManip *vm, int mapseed, u32 blockseed,
 				continue;
 
 			u32 i = vm->m_area.index(x0 + x1, y0 + y1, z0 + z1);
-			if (!CONTAINS(c_wherein, vm->m_data[i].getContent()))
+			if (!isWherein(vm->m_data[i].getContent()))
 				continue;
 
 			vm->m_data[i] = n_ore;
@@ -237,8 +297,7 @@ void OreSheet::generate(MMVManip *vm, int mapseed, u32 blockseed,
 			continue;
 
 		if (biomemap && !biomes.empty()) {
-			auto it = biomes.find(biomemap[index]);
-			if (it == biomes.end())
+			if (!isInBiome(biomemap[index]))
 				continue;
 		}
 
@@ -251,7 +310,7 @@ void OreSheet::generate(MMVManip *vm, int mapseed, u32 blockseed,
 			u32 i = vm->m_area.index(x, y, z);
 			if (!vm->m_area.contains(i))
 				continue;
-			if (!CONTAINS(c_wherein, vm->m_data[i].getContent()))
+			if (!isWherein(vm->m_data[i].getContent()))
 				continue;
 
 			vm->m_data[i] = n_ore;
@@ -312,8 +371,7 @@ void OrePuff::generate(MMVManip *vm, int mapseed, u32 blockseed,
 			continue;
 
 		if (biomemap && !biomes.empty()) {
-			auto it = biomes.find(biomemap[index]);
-			if (it == biomes.end())
+			if (!isInBiome(biomemap[index]))
 				continue;
 		}
 
@@ -345,7 +403,7 @@ void OrePuff::generate(MMVManip *vm, int mapseed, u32 blockseed,
 			u32 i = vm->m_area.index(x, y, z);
 			if (!vm->m_area.contains(i))
 				continue;
-			if (!CONTAINS(c_wherein, vm->m_data[i].getContent()))
+			if (!isWherein(vm->m_data[i].getContent()))
 				continue;
 
 			vm->m_data[i] = n_ore;
@@ -388,8 +446,7 @@ void OreBlob::generate(MMVManip *vm, int mapseed, u32 blockseed,
 
 		if (biomemap && !biomes.empty()) {
 			u32 bmapidx = sizex * (z0 - nmin.Z) + (x0 - nmin.X);
-			auto it = biomes.find(biomemap[bmapidx]);
-			if (it == biomes.end())
+			if (!isInBiome(biomemap[bmapidx]))
 				continue;
 		}
 
@@ -401,7 +458,7 @@ void OreBlob::generate(MMVManip *vm, int mapseed, u32 blockseed,
 		for (u32 y1 = 0; y1 != csize; y1++)
 		for (u32 x1 = 0; x1 != csize; x1++, index++) {
 			u32 i = vm->m_area.index(x0 + x1, y0 + y1, z0 + z1);
-			if (!CONTAINS(c_wherein, vm->m_data[i].getContent()))
+			if (!isWherein(vm->m_data[i].getContent()))
 				continue;
 
 			// Lazily generate noise only if there's a chance of ore being placed
@@ -475,40 +532,41 @@ void OreVein::generate(MMVManip *vm, int mapseed, u32 blockseed,
 	bool noise_generated = false;
 	size_t index = 0;
 	for (int z = nmin.Z; z <= nmax.Z; z++)
-	for (int y = nmin.Y; y <= nmax.Y; y++)
-	for (int x = nmin.X; x <= nmax.X; x++, index++) {
-		u32 i = vm->m_area.index(x, y, z);
-		if (!vm->m_area.contains(i))
-			continue;
-		if (!CONTAINS(c_wherein, vm->m_data[i].getContent()))
-			continue;
-
-		if (biomemap && !biomes.empty()) {
-			u32 bmapidx = sizex * (z - nmin.Z) + (x - nmin.X);
-			auto it = biomes.find(biomemap[bmapidx]);
-			if (it == biomes.end())
+	for (int y = nmin.Y; y <= nmax.Y; y++) {
+		// Consecutive x share a row of the voxel area
+		u32 i = vm->m_area.index(nmin.X, y, z);
+		for (int x = nmin.X; x <= nmax.X; x++, index++, i++) {
+			if (!vm->m_area.contains(i))
+				continue;
+			if (!isWherein(vm->m_data[i].getContent()))
 				continue;
-		}
 
-		// Same lazy generation optimization as in OreBlob
-		if (!noise_generated) {
-			noise_generated = true;
-			noise->perlinMap3D(nmin.X, nmin.Y, nmin.Z);
-			noise2->perlinMap3D(nmin.X, nmin.Y, nmin.Z);
-		}
+			if (biomemap && !biomes.empty()) {
+				u32 bmapidx = sizex * (z - nmin.Z) + (x - nmin.X);
+				if (!isInBiome(biomemap[bmapidx]))
+					continue;
+			}
 
-		// randval ranges from -1..1
-		/*
-			Note: can generate values slightly larger than 1
-			but this can't be changed as mapgen must be deterministic accross versions.
-		*/
-		float randval   = (float)pr.next() / float(pr.RANDOM_RANGE / 2) - 1.f;
-		float noiseval  = contour(noise->result[index]);
-		float noiseval2 = contour(noise2->result[index]);
-		if (noiseval * noiseval2 + randval * random_factor < nthresh)
-			continue;
+			// Same lazy generation optimization as in OreBlob
+			if (!noise_generated) {
+				noise_generated = true;
+				noise->perlinMap3D(nmin.X, nmin.Y, nmin.Z);
+				noise2->perlinMap3D(nmin.X, nmin.Y, nmin.Z);
+			}
 
-		vm->m_data[i] = n_ore;
+			// randval ranges from -1..1
+			/*
+				Note: can generate values slightly larger than 1
+				but this can't be changed as mapgen must be deterministic accross versions.
+			*/
+			float randval   = (float)pr.next() / float(pr.RANDOM_RANGE / 2) - 1.f;
+			float noiseval  = contour(noise->result[index]);
+			float noiseval2 = contour(noise2->result[index]);
+			if (noiseval * noiseval2 + randval * random_factor < nthresh)
+				continue;
+
+			vm->m_data[i] = n_ore;
+		}
 	}
 }
 
@@ -564,8 +622,7 @@ void OreStratum::generate(MMVManip *vm, int mapseed, u32 blockseed,
 	for (int z = nmin.Z; z <= nmax.Z; z++)
 	for (int x = nmin.X; x <= nmax.X; x++, index++) {
 		if (biomemap && !biomes.empty()) {
-			auto it = biomes.find(biomemap[index]);
-			if (it == biomes.end())
+			if (!isInBiome(biomemap[index]))
 				continue;
 		}
 
@@ -591,7 +648,7 @@ void OreStratum::generate(MMVManip *vm, int mapseed, u32 blockseed,
 			u32 i = vm->m_area.index(x, y, z);
 			if (!vm->m_area.contains(i))
 				continue;
-			if (!CONTAINS(c_wherein, vm->m_data[i].getContent()))
+			if (!isWherein(vm->m_data[i].getContent()))
 				continue;
 
 			vm->m_data[i] = n_ore;
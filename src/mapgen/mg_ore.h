@@ -21,6 +21,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #pragma once
 
 #include <unordered_set>
+#include <vector>
 #include "objdef.h"
 #include "noise.h"
 #include "nodedef.h"
@@ -77,8 +78,26 @@ class Ore : public ObjDef, public NodeResolver {
 	virtual void generate(MMVManip *vm, int mapseed, u32 blockseed,
 		v3s16 nmin, v3s16 nmax, biome_t *biomemap) = 0;
 
+	// Whether generate() only places nodes between nmin and nmax
+	virtual bool staysInArea() const { return true; }
+
+	inline bool isWherein(content_t c) const
+	{
+		return c < m_wherein_mask.size() && m_wherein_mask[c];
+	}
+
+	inline bool isInBiome(biome_t biome) const
+	{
+		return biome < m_biome_mask.size() && m_biome_mask[biome];
+	}
+
 protected:
 	void cloneTo(Ore *def) const;
+
+private:
+	// c_wherein and biomes as lookup tables, built when the nodes are resolved
+	std::vector<bool> m_wherein_mask;
+	std::vector<bool> m_biome_mask;
 };
 
 class OreScatter : public Ore {
@@ -119,6 +138,9 @@ class OrePuff : public Ore {
 
 	void generate(MMVManip *vm, int mapseed, u32 blockseed,
 			v3s16 nmin, v3s16 nmax, biome_t *biomemap) override;
+
+	// The puffs can extend above and below the area
+	bool staysInArea() const override { return false; }
 };
 
 class OreBlob : public Ore {
@@ -97,6 +97,8 @@ ObjDef *Schematic::clone() const
 	memcpy(def->schemdata, schemdata, sizeof(MapNode) * nodecount);
 	def->slice_probs = new u8[size.Y];
 	memcpy(def->slice_probs, slice_probs, sizeof(u8) * size.Y);
+	for (int rot = ROTATE_0; rot <= ROTATE_270; rot++)
+		def->m_variants[rot] = m_variants[rot];
 
 	return def;
 }
@@ -118,6 +120,9 @@ void Schematic::resolveNodeNames()
 		// Unfold condensed ID layout to content_t
 		schemdata[i].setContent(c_nodes[c_original]);
 	}
+
+	// Done once at registration so that placing only copies nodes around
+	buildVariants();
 }
 
 
@@ -126,6 +131,76 @@ void Schematic::blitToVManip(MMVManip *vm, v3s16 p, Rotation rot, bool force_pla
 	assert(schemdata && slice_probs);
 	sanity_check(m_ndef != NULL);
 
+	const Variant &v = getVariant(rot);
+	const VoxelArea &area = vm->m_area;
+
+	// Range of schematic x positions that are inside the voxelmanip
+	const s32 x_min = area.MinEdge.X - p.X;
+	const s32 x_max = area.MaxEdge.X - p.X;
+
+	s16 y_map = p.Y;
+	for (s16 y = 0; y != v.size.Y; y++, y_map++) {
+		if ((slice_probs[y] != MTSCHEM_PROB_ALWAYS) &&
+			(slice_probs[y] <= myrand_range(1, MTSCHEM_PROB_ALWAYS)))
+			continue;
+
+		if (y_map < area.MinEdge.Y || y_map > area.MaxEdge.Y)
+			continue;
+
+		for (s16 z = 0; z != v.size.Z; z++) {
+			s16 z_map = p.Z + z;
+			if (z_map < area.MinEdge.Z || z_map > area.MaxEdge.Z)
+				continue;
+
+			u32 row = y * v.size.Z + z;
+			for (u32 si = v.row_start[row]; si != v.row_start[row + 1]; si++) {
+				const Span &span = v.spans[si];
+				s32 x0 = MYMAX((s32)span.x, x_min);
+				s32 x1 = MYMIN(span.x + span.length - 1, x_max);
+				if (x0 > x1)
+					continue;
+
+				u32 i = row * v.size.X + x0;
+				u32 vi = area.index(p.X + x0, y_map, z_map);
+				u32 count = x1 - x0 + 1;
+
+				if (span.kind == SPAN_FORCE ||
+						(span.kind == SPAN_CHECK && force_place)) {
+					memcpy(&vm->m_data[vi], &v.nodes[i], count * sizeof(MapNode));
+					continue;
+				}
+
+				for (u32 end = i + count; i != end; i++, vi++) {
+					if (!force_place && !(v.probs[i] & MTSCHEM_FORCE_PLACE)) {
+						content_t c = vm->m_data[vi].getContent();
+						if (c != CONTENT_AIR && c != CONTENT_IGNORE)
+							continue;
+					}
+
+					u8 placement_prob = v.probs[i] & MTSCHEM_PROB_MASK;
+					if ((placement_prob != MTSCHEM_PROB_ALWAYS) &&
+						(placement_prob <= myrand_range(1, MTSCHEM_PROB_ALWAYS)))
+						continue;
+
+					vm->m_data[vi] = v.nodes[i];
+				}
+			}
+		}
+	}
+}
+
+
+const Schematic::Variant &Schematic::getVariant(Rotation rot)
+{
+	Variant &v = m_variants[rot & 3];
+	if (!v.built)
+		buildVariant(v, (Rotation)(rot & 3));
+	return v;
+}
+
+
+void Schematic::buildVariant(Variant &v, Rotation rot) const
+{
 	int xstride = 1;
 	int ystride = size.X;
 	int zstride = size.X * size.Y;
@@ -159,48 +234,64 @@ void Schematic::blitToVManip(MMVManip *vm, v3s16 p, Rotation rot, bool force_pla
 			i_step_z = zstride;
 	}
 
-	s16 y_map = p.Y;
-	for (s16 y = 0; y != sy; y++) {
-		if ((slice_probs[y] != MTSCHEM_PROB_ALWAYS) &&
-			(slice_probs[y] <= myrand_range(1, MTSCHEM_PROB_ALWAYS)))
-			continue;
-
-		for (s16 z = 0; z != sz; z++) {
-			u32 i = z * i_step_z + y * ystride + i_start;
-			for (s16 x = 0; x != sx; x++, i += i_step_x) {
-				v3s16 pos(p.X + x, y_map, p.Z + z);
-				if (!vm->m_area.contains(pos))
+	u32 nodecount = sx * sy * sz;
+	v.size = v3s16(sx, sy, sz);
+	v.nodes.resize(nodecount);
+	v.probs.resize(nodecount);
+	v.spans.clear();
+	v.row_start.clear();
+	v.row_start.reserve(sy * sz + 1);
+
+	u32 vi = 0;
+	for (s16 y = 0; y != sy; y++)
+	for (s16 z = 0; z != sz; z++) {
+		v.row_start.push_back(v.spans.size());
+
+		u32 i = z * i_step_z + y * ystride + i_start;
+		for (s16 x = 0; x != sx; x++, i += i_step_x, vi++) {
+			v.probs[vi] = schemdata[i].param1;
+			v.nodes[vi] = schemdata[i];
+			v.nodes[vi].param1 = 0;
+			if (rot)
+				v.nodes[vi].rotateAlongYAxis(m_ndef, rot);
+
+			u8 placement_prob = schemdata[i].param1 & MTSCHEM_PROB_MASK;
+			if (schemdata[i].getContent() == CONTENT_IGNORE ||
+					placement_prob == MTSCHEM_PROB_NEVER)
+				continue;
+
+			SpanKind kind = SPAN_RANDOM;
+			if (placement_prob == MTSCHEM_PROB_ALWAYS)
+				kind = (schemdata[i].param1 & MTSCHEM_FORCE_PLACE) ?
+					SPAN_FORCE : SPAN_CHECK;
+
+			// Extend the previous span of this row if possible
+			if (v.spans.size() > v.row_start.back()) {
+				Span &last = v.spans.back();
+				if (last.kind == kind && last.x + last.length == x) {
+					last.length++;
 					continue;
-
-				if (schemdata[i].getContent() == CONTENT_IGNORE)
-					continue;
-
-				u8 placement_prob     = schemdata[i].param1 & MTSCHEM_PROB_MASK;
-				bool force_place_node = schemdata[i].param1 & MTSCHEM_FORCE_PLACE;
-
-				if (placement_prob == MTSCHEM_PROB_NEVER)
-					continue;
-
-				u32 vi = vm->m_area.index(pos);
-				if (!force_place && !force_place_node) {
-					content_t c = vm->m_data[vi].getContent();
-					if (c != CONTENT_AIR && c != CONTENT_IGNORE)
-						continue;
 				}
-
-				if ((placement_prob != MTSCHEM_PROB_ALWAYS) &&
-					(placement_prob <= myrand_range(1, MTSCHEM_PROB_ALWAYS)))
-					continue;
-
-				vm->m_data[vi] = schemdata[i];
-				vm->m_data[vi].param1 = 0;
-
-				if (rot)
-					vm->m_data[vi].rotateAlongYAxis(m_ndef, rot);
 			}
+			v.spans.push_back({x, 1, kind});
 		}
-		y_map++;
 	}
+	v.row_start.push_back(v.spans.size());
+	v.built = true;
+}
+
+
+void Schematic::buildVariants()
+{
+	for (int rot = ROTATE_0; rot <= ROTATE_270; rot++)
+		buildVariant(m_variants[rot], (Rotation)rot);
+}
+
+
+void Schematic::invalidateVariants()
+{
+	for (Variant &v : m_variants)
+		v = Variant();
 }
 
 
@@ -285,6 +376,8 @@ bool Schematic::deserializeFromMts(std::istream *is)
 	content_t cignore = CONTENT_IGNORE;
 	bool have_cignore = false;
 
+	invalidateVariants();
+
 	//// Read signature
 	u32 signature = readU32(ss);
 	if (signature != MTSCHEM_FILE_SIGNATURE) {
@@ -554,6 +647,7 @@ bool Schematic::getSchematicFromMap(Map *map, v3s16 p1, v3s16 p2)
 	v3s16 bp2 = getNodeBlockPos(p2);
 	vm->initialEmerge(bp1, bp2);
 
+	invalidateVariants();
 	size = p2 - p1 + 1;
 
 	slice_probs = new u8[size.Y];
@@ -585,6 +679,8 @@ void Schematic::applyProbabilities(v3s16 p0,
 	std::vector<std::pair<v3s16, u8> > *plist,
 	std::vector<std::pair<s16, u8> > *splist)
 {
+	invalidateVariants();
+
 	for (size_t i = 0; i != plist->size(); i++) {
 		v3s16 p = (*plist)[i].first - p0;
 		int index = p.Z * (size.Y * size.X) + p.Y * size.X + p.X;
@@ -613,6 +709,7 @@ void Schematic::condenseContentIds()
 
 	// Reset node resolve fields
 	NodeResolver::reset();
+	invalidateVariants();
 
 	size_t nodecount = size.X * size.Y * size.Z;
 	for (size_t i = 0; i != nodecount; i++) {
@@ -127,6 +127,43 @@ class Schematic : public ObjDef, public NodeResolver {
 private:
 	// Counterpart to the node resolver: Condense content_t to a sequential "m_nodenames" list
 	void condenseContentIds();
+
+	/*
+		Resolved copy of the schematic for one rotation, laid out in the
+		rotated frame so that blitting walks it linearly. Each row (y, z) is
+		split into spans of placeable nodes that share the same placement
+		rule; never-placed and ignore nodes are not part of any span.
+	*/
+	enum SpanKind : u8 {
+		SPAN_FORCE,  // Always placed, replaces anything
+		SPAN_CHECK,  // Always placed, only into air or ignore
+		SPAN_RANDOM, // Placed with a probability
+	};
+
+	struct Span {
+		s16 x;
+		u16 length;
+		SpanKind kind;
+	};
+
+	struct Variant {
+		bool built = false;
+		v3s16 size;
+		// param1 cleared and param2 rotated, ready to be copied
+		std::vector<MapNode> nodes;
+		// Original param1: probability and force placement flag
+		std::vector<u8> probs;
+		std::vector<Span> spans;
+		// First span of each row, indexed by y * size.Z + z, plus an end marker
+		std::vector<u32> row_start;
+	};
+
+	const Variant &getVariant(Rotation rot);
+	void buildVariant(Variant &v, Rotation rot) const;
+	void buildVariants();
+	void invalidateVariants();
+
+	Variant m_variants[4];
 };
 
 class SchematicManager : public ObjDefManager {
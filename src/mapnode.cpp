@@ -693,6 +693,19 @@ SharedBuffer<u8> MapNode::serializeBulk(int version,
 void MapNode::deSerializeBulk(std::istream &is, int version,
 		MapNode *nodes, u32 nodecount,
 		u8 content_width, u8 params_width)
+{
+	// read data
+	const u32 len = nodecount * (content_width + params_width);
+	Buffer<u8> databuf(len);
+	is.read(reinterpret_cast<char*>(*databuf), len);
+
+	deSerializeBulk(*databuf, len, version, nodes, nodecount,
+		content_width, params_width);
+}
+
+size_t MapNode::deSerializeBulk(const u8 *data, size_t size, int version,
+		MapNode *nodes, u32 nodecount,
+		u8 content_width, u8 params_width)
 {
 	if(!ser_ver_supported(version))
 		throw VersionMismatchException("ERROR: MapNode format not supported");
@@ -702,46 +715,33 @@ void MapNode::deSerializeBulk(std::istream &is, int version,
 			|| params_width != 2)
 		FATAL_ERROR("Deserialize bulk node data error");
 
-	// read data
 	const u32 len = nodecount * (content_width + params_width);
-	Buffer<u8> databuf(len);
-	is.read(reinterpret_cast<char*>(*databuf), len);
-
-	// Deserialize content
-	if(content_width == 1)
-	{
-		for(u32 i=0; i<nodecount; i++)
-			nodes[i].param0 = readU8(&databuf[i]);
-	}
-	else if(content_width == 2)
-	{
-		for(u32 i=0; i<nodecount; i++)
-			nodes[i].param0 = readU16(&databuf[i*2]);
-	}
-
-	// Deserialize param1
-	u32 start1 = content_width * nodecount;
-	for(u32 i=0; i<nodecount; i++)
-		nodes[i].param1 = readU8(&databuf[start1 + i]);
-
-	// Deserialize param2
-	u32 start2 = (content_width + 1) * nodecount;
-	if(content_width == 1)
-	{
-		for(u32 i=0; i<nodecount; i++) {
-			nodes[i].param2 = readU8(&databuf[start2 + i]);
-			if(nodes[i].param0 > 0x7F){
+	if (size < len)
+		throw SerializationError("MapNode::deSerializeBulk(): truncated data");
+
+	// Each node is put together from the three arrays in one pass
+	const u8 *param1 = data + content_width * nodecount;
+	const u8 *param2 = data + (content_width + 1) * nodecount;
+	if (content_width == 2) {
+		for (u32 i = 0; i < nodecount; i++) {
+			nodes[i].param0 = readU16(&data[i * 2]);
+			nodes[i].param1 = param1[i];
+			nodes[i].param2 = param2[i];
+		}
+	} else {
+		for (u32 i = 0; i < nodecount; i++) {
+			nodes[i].param0 = data[i];
+			nodes[i].param1 = param1[i];
+			nodes[i].param2 = param2[i];
+			if (nodes[i].param0 > 0x7F) {
 				nodes[i].param0 <<= 4;
-				nodes[i].param0 |= (nodes[i].param2&0xF0)>>4;
+				nodes[i].param0 |= (nodes[i].param2 & 0xF0) >> 4;
 				nodes[i].param2 &= 0x0F;
 			}
 		}
 	}
-	else if(content_width == 2)
-	{
-		for(u32 i=0; i<nodecount; i++)
-			nodes[i].param2 = readU8(&databuf[start2 + i]);
-	}
+
+	return len;
 }
 
 /*
@@ -322,6 +322,10 @@ struct alignas(u32) MapNode
 	static void deSerializeBulk(std::istream &is, int version,
 			MapNode *nodes, u32 nodecount,
 			u8 content_width, u8 params_width);
+	// Same as above, reading from memory. Returns the number of bytes used.
+	static size_t deSerializeBulk(const u8 *data, size_t size, int version,
+			MapNode *nodes, u32 nodecount,
+			u8 content_width, u8 params_width);
 
 private:
 	// Deprecated serialization methods
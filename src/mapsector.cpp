@@ -19,6 +19,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "mapsector.h"
 #include "exceptions.h"
+#include "map.h"
 #include "mapblock.h"
 #include "serialization.h"
 
@@ -81,6 +82,7 @@ MapBlock *MapSector::createBlankBlock(s16 y)
 	std::unique_ptr<MapBlock> block_u = createBlankBlockNoInsert(y);
 	MapBlock *block = block_u.get();
 
+	block->setUsageList(m_parent ? &m_parent->m_block_usage : nullptr);
 	m_blocks[y] = std::move(block_u);
 
 	return block;
@@ -99,6 +101,7 @@ void MapSector::insertBlock(std::unique_ptr<MapBlock> block)
 	assert(p2d == m_pos);
 
 	// Insert into container
+	block->setUsageList(m_parent ? &m_parent->m_block_usage : nullptr);
 	m_blocks[block_y] = std::move(block);
 }
 
@@ -124,6 +127,9 @@ std::unique_ptr<MapBlock> MapSector::detachBlock(MapBlock *block)
 
 	// Mark as removed
 	block->makeOrphan();
+	block->setUsageList(nullptr);
+	if (m_blocks.empty() && m_parent)
+		m_parent->m_empty_sectors.push_back(m_pos);
 
 	return ret;
 }
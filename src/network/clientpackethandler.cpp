@@ -30,11 +30,13 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "client/minimap.h"
 #include "modchannels.h"
 #include "nodedef.h"
+#include "nodechangebatch.h"
 #include "serialization.h"
 #include "util/strfnd.h"
 #include "client/clientevent.h"
 #include "client/sound.h"
 #include "client/localplayer.h"
+#include "client/blockcache.h"
 #include "network/clientopcodes.h"
 #include "network/connection.h"
 #include "network/networkpacket.h"
@@ -267,6 +269,23 @@ void Client::handleCommand_AddNode(NetworkPacket* pkt)
 	addNode(p, n, remove_metadata);
 }
 
+void Client::handleCommand_NodeBatch(NetworkPacket *pkt)
+{
+	std::istringstream is(std::string(pkt->getString(0), pkt->getSize()),
+		std::ios::binary);
+
+	NodeChangeBatch batch;
+	try {
+		batch.deSerialize(is);
+	} catch (SerializationError &e) {
+		errorstream << "Client: Invalid TOCLIENT_NODE_BATCH: " << e.what()
+			<< std::endl;
+		return;
+	}
+
+	addNodes(batch);
+}
+
 void Client::handleCommand_NodemetaChanged(NetworkPacket *pkt)
 {
 	if (pkt->getSize() < 1)
@@ -280,16 +299,15 @@ void Client::handleCommand_NodemetaChanged(NetworkPacket *pkt)
 	meta_updates_list.deSerialize(sstr, m_itemdef, true);
 
 	Map &map = m_env.getMap();
-	for (NodeMetadataMap::const_iterator i = meta_updates_list.begin();
-			i != meta_updates_list.end(); ++i) {
-		v3s16 pos = i->first;
+	for (v3s16 pos : meta_updates_list.getAllKeys()) {
+		NodeMetadata *meta = meta_updates_list.get(pos);
 
 		if (map.isValidPosition(pos) &&
-				map.setNodeMetadata(pos, i->second))
+				map.setNodeMetadata(pos, meta))
 			continue; // Prevent from deleting metadata
 
 		// Meta couldn't be set, unused metadata
-		delete i->second;
+		delete meta;
 	}
 }
 
@@ -303,8 +321,31 @@ void Client::handleCommand_BlockData(NetworkPacket* pkt)
 	*pkt >> p;
 
 	std::string datastring(pkt->getString(6), pkt->getSize() - 6);
-	std::istringstream istr(datastring, std::ios_base::binary);
+	deSerializeBlock(p, datastring);
+
+	if (m_block_cache)
+		m_block_cache->store(p, datastring, m_server_ser_ver);
+}
 
+void Client::handleCommand_BlockDataCached(NetworkPacket* pkt)
+{
+	v3s16 p;
+	u64 hash;
+	*pkt >> p >> hash;
+
+	std::string datastring;
+	if (!m_block_cache || !m_block_cache->load(p, hash, &datastring)) {
+		// Lost our copy, have the server send the block again
+		std::vector<v3s16> blocks{p};
+		sendDeletedBlocks(blocks);
+		return;
+	}
+
+	deSerializeBlock(p, datastring);
+}
+
+void Client::deSerializeBlock(v3s16 p, const std::string &datastring)
+{
 	MapSector *sector;
 	MapBlock *block;
 
@@ -313,22 +354,16 @@ void Client::handleCommand_BlockData(NetworkPacket* pkt)
 
 	assert(sector->getPos() == p2d);
 
+	// Update an existing block or create a new one
 	block = sector->getBlockNoCreateNoEx(p.Y);
-	if (block) {
-		/*
-			Update an existing block
-		*/
-		block->deSerialize(istr, m_server_ser_ver, false);
-		block->deSerializeNetworkSpecific(istr);
-	}
-	else {
-		/*
-			Create a new block
-		*/
+	if (!block)
 		block = sector->createBlankBlock(p.Y);
-		block->deSerialize(istr, m_server_ser_ver, false);
-		block->deSerializeNetworkSpecific(istr);
-	}
+
+	const size_t used = block->deSerialize(
+		reinterpret_cast<const u8 *>(datastring.data()), datastring.size(),
+		m_server_ser_ver, false);
+	std::istringstream istr(datastring.substr(used), std::ios_base::binary);
+	block->deSerializeNetworkSpecific(istr);
 
 	if (m_localdb) {
 		ServerMap::saveBlock(block, m_localdb);
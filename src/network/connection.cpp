@@ -1503,6 +1503,26 @@ float Connection::getPeerStat(session_t peer_id, rtt_stat_type type)
 	return peer->getStat(type);
 }
 
+bool Connection::getPeerLinkStats(session_t peer_id, u8 channelnum,
+		PeerLinkStats &ret)
+{
+	assert(channelnum < CHANNEL_COUNT); // Pre-condition
+
+	PeerHelper peer = getPeerNoEx(peer_id);
+	if (!peer)
+		return false;
+	UDPPeer *udp_peer = dynamic_cast<UDPPeer *>(&peer);
+	if (!udp_peer)
+		return false;
+
+	ret.avg_rtt = udp_peer->getStat(AVG_RTT);
+	ret.avg_jitter = udp_peer->getStat(AVG_JITTER);
+
+	udp_peer->channels[channelnum].getSendStats(&ret.cur_kbps,
+			&ret.cur_kbps_lost, &ret.window_size);
+	return true;
+}
+
 float Connection::getLocalStat(rate_stat_type type)
 {
 	PeerHelper peer = getPeerNoEx(PEER_ID_SERVER);
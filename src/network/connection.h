@@ -419,13 +419,26 @@ class Channel
 	float getAvgIncomingRateKB()
 		{ MutexAutoLock lock(m_internal_mutex); return avg_incoming_kbps; };
 
+	// Only safe from the send thread, which is the one changing it
 	u16 getWindowSize() const { return m_window_size; };
 
 	void setWindowSize(long size)
 	{
+		MutexAutoLock lock(m_internal_mutex);
 		m_window_size = (u16)rangelim(size, MIN_RELIABLE_WINDOW_SIZE, MAX_RELIABLE_WINDOW_SIZE);
 	}
 
+	// Rates of the data sent on this channel and the window size, read
+	// together for use from other threads
+	void getSendStats(float *kbps, float *kbps_lost, u16 *window_size)
+	{
+		MutexAutoLock lock(m_internal_mutex);
+		// cur_kbps counts the bytes passed to UpdateBytesSent()
+		*kbps = cur_kbps;
+		*kbps_lost = cur_kbps_lost;
+		*window_size = m_window_size;
+	}
+
 private:
 	std::mutex m_internal_mutex;
 	u16 m_window_size = MIN_RELIABLE_WINDOW_SIZE;
@@ -487,6 +500,19 @@ typedef enum {
 	AVG_LOSS_RATE,
 } rate_stat_type;
 
+// Snapshot of the link quality to a peer, as seen on one channel
+struct PeerLinkStats
+{
+	// Round trip time in seconds, -1 if not yet measured
+	float avg_rtt = -1.0f;
+	float avg_jitter = -1.0f;
+	// Outgoing and resent data rates in KB/s
+	float cur_kbps = 0.0f;
+	float cur_kbps_lost = 0.0f;
+	// Current reliable window size of the channel, in packets
+	u16 window_size = 0;
+};
+
 class Peer {
 	public:
 		friend class PeerHelper;
@@ -721,6 +747,7 @@ class Connection
 	session_t GetPeerID() const { return m_peer_id; }
 	Address GetPeerAddress(session_t peer_id);
 	float getPeerStat(session_t peer_id, rtt_stat_type type);
+	bool getPeerLinkStats(session_t peer_id, u8 channelnum, PeerLinkStats &ret);
 	float getLocalStat(rate_stat_type type);
 	u32 GetProtocolID() const { return m_protocol_id; };
 	const std::string getDesc();
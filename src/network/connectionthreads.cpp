@@ -97,6 +97,10 @@ void *ConnectionSendThread::run()
 		while (m_send_sleep_semaphore.wait(0)) {
 		}
 
+		/* only the work done is shown in traces, not the waiting */
+		static const auto trace_id = ScopeProfiler::intern("ConnectionSend: iteration");
+		ScopeProfiler trace(nullptr, trace_id);
+
 		lasttime = curtime;
 		curtime = porting::getTimeMs();
 		float dtime = CALC_DTIME(lasttime, curtime);
@@ -898,6 +902,9 @@ void ConnectionReceiveThread::receive(SharedBuffer<u8> &packetdata,
 		if (received_size < 0)
 			return;
 
+		static const auto trace_id = ScopeProfiler::intern("ConnectionReceive: packet");
+		ScopeProfiler trace(nullptr, trace_id);
+
 		if ((received_size < BASE_HEADER_SIZE) ||
 				(readU32(&packetdata[0]) != m_connection->GetProtocolID())) {
 			LOG(derr_con << m_connection->getDesc()
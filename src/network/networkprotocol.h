@@ -222,11 +222,18 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 	PROTOCOL VERSION 44:
 		AO_CMD_SET_BONE_POSITION extended
 		[scheduled bump for 5.9.0]
+	PROTOCOL VERSION 45:
+		TOCLIENT_NODE_BATCH added
+		TOSERVER_HAVE_BLOCKS and TOCLIENT_BLOCKDATA_CACHED added
 */
 
-#define LATEST_PROTOCOL_VERSION 44
+#define LATEST_PROTOCOL_VERSION 45
 #define LATEST_PROTOCOL_VERSION_STRING TOSTRING(LATEST_PROTOCOL_VERSION)
 
+// Minimal protocol versions of the peer for optional packets
+#define NODE_BATCH_PROTOCOL_VERSION_MIN 45
+#define BLOCK_CACHE_PROTOCOL_VERSION_MIN 45
+
 // Server's supported network protocol range
 #define SERVER_PROTOCOL_VERSION_MIN 37
 #define SERVER_PROTOCOL_VERSION_MAX LATEST_PROTOCOL_VERSION
@@ -873,7 +880,33 @@ enum ToClientCommand
 			f32 center_weight_power
 	*/
 
-	TOCLIENT_NUM_MSG_TYPES = 0x64,
+	TOCLIENT_NODE_BATCH = 0x64,
+	/*
+		Changes to nodes of one mapblock, to be applied all at once.
+		Replaces TOCLIENT_ADDNODE and TOCLIENT_REMOVENODE for these nodes.
+
+		v3s16 blockpos
+		u16 number of runs
+		for each run:
+			u16 index of the first node (z * 256 + y * 16 + x)
+			u16 number of nodes in the run
+			for each node:
+				u16 param0
+				u8 param1
+				u8 param2
+				u8 flags (0x01: keep metadata)
+	*/
+
+	TOCLIENT_BLOCKDATA_CACHED = 0x65,
+	/*
+		Answer to TOSERVER_HAVE_BLOCKS: the block did not change, the client
+		is to use its cached copy instead of TOCLIENT_BLOCKDATA.
+
+		v3s16 blockpos
+		u64 hash
+	*/
+
+	TOCLIENT_NUM_MSG_TYPES = 0x66,
 };
 
 enum ToServerCommand
@@ -1104,7 +1137,17 @@ enum ToServerCommand
 		v2f32 max_fs_info
 	*/
 
-	TOSERVER_NUM_MSG_TYPES = 0x54,
+	TOSERVER_HAVE_BLOCKS = 0x54,
+	/*
+		Blocks the client has in its block cache, see hashSerializedBlock()
+
+		u8 count
+		for each:
+			v3s16 blockpos
+			u64 hash
+	*/
+
+	TOSERVER_NUM_MSG_TYPES = 0x55,
 };
 
 enum AuthMechanism
@@ -452,7 +452,9 @@ void Server::handleCommand_GotBlocks(NetworkPacket* pkt)
 	for (u16 i = 0; i < count; i++) {
 		v3s16 p;
 		*pkt >> p;
-		client->GotBlock(p);
+		const float latency = client->GotBlock(p);
+		if (latency >= 0.0f)
+			m_block_send_latency_histogram->observe(latency);
 	}
 }
 
@@ -574,6 +576,26 @@ void Server::handleCommand_DeletedBlocks(NetworkPacket* pkt)
 	}
 }
 
+void Server::handleCommand_HaveBlocks(NetworkPacket* pkt)
+{
+	u8 count;
+	*pkt >> count;
+
+	if (pkt->getSize() < 1 + (u32)count * (6 + 8)) {
+		throw con::InvalidIncomingDataException
+				("HAVE_BLOCKS length is too short");
+	}
+
+	RemoteClient *client = getClient(pkt->getPeerId());
+
+	for (u16 i = 0; i < count; i++) {
+		v3s16 p;
+		u64 hash;
+		*pkt >> p >> hash;
+		client->addCachedBlock(p, hash);
+	}
+}
+
 void Server::handleCommand_InventoryAction(NetworkPacket* pkt)
 {
 	session_t peer_id = pkt->getPeerId();
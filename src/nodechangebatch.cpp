@@ -0,0 +1,92 @@
+/*
+Minetest
+Copyright (C) 2024 Minetest Authors
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "nodechangebatch.h"
+#include "exceptions.h"
+#include "util/serialize.h"
+
+#define NODE_BATCH_KEEP_METADATA 0x01
+
+void NodeChangeBatch::add(v3s16 relpos, MapNode n, bool keep_metadata)
+{
+	// Metadata removed by an earlier change in the same step stays removed
+	auto inserted = m_changes.emplace(posToIndex(relpos), Change());
+	Change &change = inserted.first->second;
+	const bool existing = !inserted.second;
+	change.n = n;
+	change.keep_metadata = existing ? (change.keep_metadata && keep_metadata) : keep_metadata;
+}
+
+void NodeChangeBatch::serialize(std::ostream &os) const
+{
+	writeV3S16(os, m_blockpos);
+
+	// Count the runs of consecutive indices first
+	u16 runs = 0;
+	s32 prev = -2;
+	for (const auto &it : m_changes) {
+		if (it.first != prev + 1)
+			runs++;
+		prev = it.first;
+	}
+	writeU16(os, runs);
+
+	auto it = m_changes.begin();
+	while (it != m_changes.end()) {
+		const u16 start = it->first;
+		auto end = it;
+		u16 length = 0;
+		do {
+			++end;
+			++length;
+		} while (end != m_changes.end() && end->first == start + length);
+
+		writeU16(os, start);
+		writeU16(os, length);
+		for (; it != end; ++it) {
+			const Change &change = it->second;
+			writeU16(os, change.n.param0);
+			writeU8(os, change.n.param1);
+			writeU8(os, change.n.param2);
+			writeU8(os, change.keep_metadata ? NODE_BATCH_KEEP_METADATA : 0);
+		}
+	}
+}
+
+void NodeChangeBatch::deSerialize(std::istream &is)
+{
+	m_changes.clear();
+	m_blockpos = readV3S16(is);
+
+	const u16 runs = readU16(is);
+	for (u16 r = 0; r < runs; r++) {
+		const u16 start = readU16(is);
+		const u16 length = readU16(is);
+		if (start + length > MAP_BLOCKSIZE * MAP_BLOCKSIZE * MAP_BLOCKSIZE)
+			throw SerializationError("NodeChangeBatch: run out of block bounds");
+
+		for (u16 i = 0; i < length; i++) {
+			Change &change = m_changes[start + i];
+			change.n.param0 = readU16(is);
+			change.n.param1 = readU8(is);
+			change.n.param2 = readU8(is);
+			change.keep_metadata = readU8(is) & NODE_BATCH_KEEP_METADATA;
+		}
+	}
+}
@@ -0,0 +1,73 @@
+/*
+Minetest
+Copyright (C) 2024 Minetest Authors
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#pragma once
+
+#include "irr_v3d.h"
+#include "mapnode.h"
+#include "constants.h"
+#include <iostream>
+#include <map>
+
+/*
+	Node changes within a single MapBlock, sent to the client as one
+	TOCLIENT_NODE_BATCH packet instead of one packet per node.
+	A later change of a node replaces the earlier ones.
+*/
+class NodeChangeBatch
+{
+public:
+	struct Change {
+		MapNode n;
+		bool keep_metadata;
+	};
+
+	NodeChangeBatch(v3s16 blockpos = v3s16()) : m_blockpos(blockpos) {}
+
+	// relpos is relative to the block
+	void add(v3s16 relpos, MapNode n, bool keep_metadata);
+
+	v3s16 getBlockPos() const { return m_blockpos; }
+	bool empty() const { return m_changes.empty(); }
+	size_t size() const { return m_changes.size(); }
+
+	// Node index (see posToIndex()) -> change, in ascending order
+	const std::map<u16, Change> &getChanges() const { return m_changes; }
+
+	// Same layout as MapBlock::data
+	static u16 posToIndex(v3s16 relpos)
+	{
+		return relpos.Z * MAP_BLOCKSIZE * MAP_BLOCKSIZE +
+			relpos.Y * MAP_BLOCKSIZE + relpos.X;
+	}
+	static v3s16 indexToPos(u16 index)
+	{
+		return v3s16(index % MAP_BLOCKSIZE,
+			(index / MAP_BLOCKSIZE) % MAP_BLOCKSIZE,
+			index / (MAP_BLOCKSIZE * MAP_BLOCKSIZE));
+	}
+
+	// Format is documented at TOCLIENT_NODE_BATCH
+	void serialize(std::ostream &os) const;
+	void deSerialize(std::istream &is);
+
+private:
+	v3s16 m_blockpos;
+	std::map<u16, Change> m_changes;
+};
@@ -24,7 +24,9 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "irrlicht_changes/printing.h"
 #include "log.h"
 #include "util/serialize.h"
+#include "util/stream.h"
 #include "constants.h" // MAP_BLOCKSIZE
+#include <algorithm>
 #include <sstream>
 
 /*
@@ -119,7 +121,7 @@ void NodeMetadataList::serialize(std::ostream &os, u8 blockver, bool disk,
 		Version 0 is a placeholder for "nothing to see here; go away."
 	*/
 
-	u16 count = include_empty ? m_data.size() : countNonEmpty();
+	u16 count = include_empty ? m_entries.size() : countNonEmpty();
 	if (count == 0) {
 		writeU8(os, 0); // version
 		return;
@@ -129,12 +131,10 @@ void NodeMetadataList::serialize(std::ostream &os, u8 blockver, bool disk,
 	writeU8(os, version);
 	writeU16(os, count);
 
-	for (NodeMetadataMap::const_iterator
-			i = m_data.begin();
-			i != m_data.end(); ++i) {
-		v3s16 p = i->first;
-		NodeMetadata *data = i->second;
-		if (!include_empty && data->empty())
+	for (const Entry &entry : m_entries) {
+		v3s16 p = entry.pos;
+		NodeMetadata *data = entry.meta;
+		if (!include_empty && (data ? data->empty() : entry.raw_empty))
 			continue;
 
 		if (absolute_pos) {
@@ -146,7 +146,10 @@ void NodeMetadataList::serialize(std::ostream &os, u8 blockver, bool disk,
 			u16 p16 = (p.Z * MAP_BLOCKSIZE + p.Y) * MAP_BLOCKSIZE + p.X;
 			writeU16(os, p16);
 		}
-		data->serialize(os, version, disk);
+		if (data)
+			data->serialize(os, version, disk);
+		else
+			serializeRaw(os, entry, version, disk);
 	}
 }
 
@@ -169,6 +172,13 @@ void NodeMetadataList::deSerialize(std::istream &is,
 		throw SerializationError(err_str);
 	}
 
+	// Metadata of blocks is read when it is needed
+	if (!absolute_pos && m_is_metadata_owner) {
+		m_item_def_mgr = item_def_mgr;
+		deSerializeRaw(is, version);
+		return;
+	}
+
 	u16 count = readU16(is);
 
 	for (u16 i = 0; i < count; i++) {
@@ -185,7 +195,7 @@ void NodeMetadataList::deSerialize(std::istream &is,
 			p16 /= MAP_BLOCKSIZE;
 			p.Z = p16;
 		}
-		if (m_data.find(p) != m_data.end()) {
+		if (find(p)) {
 			warningstream << "NodeMetadataList::deSerialize(): "
 					<< "already set data at position " << p
 					<< ": Ignoring." << std::endl;
@@ -194,8 +204,161 @@ void NodeMetadataList::deSerialize(std::istream &is,
 
 		NodeMetadata *data = new NodeMetadata(item_def_mgr);
 		data->deSerialize(is, version);
-		m_data[p] = data;
+		set(p, data);
+	}
+}
+
+// Copies one serialized NodeMetadata from 'is' to 'dst', checking only its
+// structure. Returns whether it has neither fields nor inventory lists.
+static bool copySerializedNodeMetadata(std::istream &is, u8 version,
+	std::string &dst)
+{
+	u8 buf[4];
+	auto copy_bytes = [&] (size_t size) {
+		// The size comes from the block, the buffer only grows with the data
+		// that is really there
+		while (size > 0) {
+			const size_t chunk = std::min<size_t>(size, 64 * 1024);
+			const size_t start = dst.size();
+			dst.resize(start + chunk);
+			is.read(&dst[start], chunk);
+			if (is.gcount() != (std::streamsize)chunk)
+				throw SerializationError("Node metadata truncated");
+			size -= chunk;
+		}
+	};
+
+	const u32 num_vars = readU32(is);
+	writeU32(buf, num_vars);
+	dst.append(reinterpret_cast<char *>(buf), 4);
+	for (u32 i = 0; i < num_vars; i++) {
+		const u16 name_size = readU16(is);
+		writeU16(buf, name_size);
+		dst.append(reinterpret_cast<char *>(buf), 2);
+		copy_bytes(name_size);
+
+		const u32 value_size = readU32(is);
+		// Same limit as deSerializeString32()
+		if (value_size > LONG_STRING_MAX_LEN)
+			throw SerializationError("Node metadata value too long");
+		writeU32(buf, value_size);
+		dst.append(reinterpret_cast<char *>(buf), 4);
+		copy_bytes(value_size);
+
+		if (version >= 2)
+			dst.push_back(readU8(is));
+	}
+
+	// The inventory is text, see Inventory::deSerialize()
+	bool has_lists = false;
+	bool in_list = false;
+	std::string line;
+	while (std::getline(is, line, '\n')) {
+		dst.append(line);
+		dst.push_back('\n');
+
+		const std::string name = line.substr(0, line.find(' '));
+		if (in_list) {
+			if (name == "EndInventoryList" || name == "end")
+				in_list = false;
+		} else if (name == "EndInventory" || name == "end") {
+			return num_vars == 0 && !has_lists;
+		} else if (name == "List") {
+			has_lists = in_list = true;
+		}
 	}
+	throw SerializationError("Malformatted node metadata inventory");
+}
+
+void NodeMetadataList::deSerializeRaw(std::istream &is, u8 version)
+{
+	u16 count = readU16(is);
+	m_raw_version = version;
+	m_entries.reserve(count);
+
+	bool sorted = true;
+	for (u16 i = 0; i < count; i++) {
+		u16 p16 = readU16(is);
+		v3s16 p;
+		p.X = p16 & (MAP_BLOCKSIZE - 1);
+		p16 /= MAP_BLOCKSIZE;
+		p.Y = p16 & (MAP_BLOCKSIZE - 1);
+		p16 /= MAP_BLOCKSIZE;
+		p.Z = p16;
+
+		Entry entry;
+		entry.pos = p;
+		entry.meta = nullptr;
+		entry.offset = m_raw.size();
+		entry.raw_empty = copySerializedNodeMetadata(is, version, m_raw);
+		entry.size = m_raw.size() - entry.offset;
+		if (!m_entries.empty() && !(m_entries.back().pos < p))
+			sorted = false;
+		m_entries.push_back(entry);
+	}
+
+	// Written in order, unless it was edited by hand
+	if (!sorted) {
+		auto less = [] (const Entry &a, const Entry &b) { return a.pos < b.pos; };
+		std::stable_sort(m_entries.begin(), m_entries.end(), less);
+		auto it = std::unique(m_entries.begin(), m_entries.end(),
+			[] (const Entry &a, const Entry &b) { return a.pos == b.pos; });
+		if (it != m_entries.end()) {
+			warningstream << "NodeMetadataList::deSerialize(): "
+					<< "already set data at position " << it->pos
+					<< ": Ignoring." << std::endl;
+			m_entries.erase(it, m_entries.end());
+		}
+	}
+	m_raw_count = m_entries.size();
+}
+
+void NodeMetadataList::serializeRaw(std::ostream &os, const Entry &entry,
+	u8 version, bool disk) const
+{
+	const char *data = m_raw.data() + entry.offset;
+	if (disk && version == m_raw_version) {
+		os.write(data, entry.size);
+		return;
+	}
+
+	// Same as NodeMetadata::serialize(), straight from the stored fields
+	const u8 *p = reinterpret_cast<const u8 *>(data);
+	const u32 num_vars = readU32(p);
+	const u8 *vars = p + 4;
+	auto next_var = [&] (const u8 *var, bool *priv) {
+		const u8 *value = var + 2 + readU16(var);
+		const u8 *end = value + 4 + readU32(value);
+		*priv = m_raw_version >= 2 && *end == 1;
+		return m_raw_version >= 2 ? end + 1 : end;
+	};
+
+	u32 count = 0;
+	const u8 *var = vars;
+	for (u32 i = 0; i < num_vars; i++) {
+		bool priv;
+		var = next_var(var, &priv);
+		if (disk || !priv)
+			count++;
+	}
+	const u8 *inventory = var;
+
+	writeU32(os, count);
+	var = vars;
+	for (u32 i = 0; i < num_vars; i++) {
+		bool priv;
+		const u8 *next = next_var(var, &priv);
+		if (disk || !priv) {
+			const u8 *end = m_raw_version >= 2 ? next - 1 : next;
+			os.write(reinterpret_cast<const char *>(var), end - var);
+			if (version >= 2)
+				writeU8(os, priv ? 1 : 0);
+		}
+		var = next;
+	}
+
+	os.write(reinterpret_cast<const char *>(inventory),
+		data + entry.size - reinterpret_cast<const char *>(inventory));
 }
 
 NodeMetadataList::~NodeMetadataList()
@@ -203,60 +366,103 @@ NodeMetadataList::~NodeMetadataList()
 	clear();
 }
 
+bool NodeMetadataList::entryBefore(const Entry &entry, v3s16 p)
+{
+	return entry.pos < p;
+}
+
+NodeMetadataList::Entry *NodeMetadataList::find(v3s16 p)
+{
+	auto it = std::lower_bound(m_entries.begin(), m_entries.end(), p, entryBefore);
+	if (it == m_entries.end() || it->pos != p)
+		return nullptr;
+	return &*it;
+}
+
 std::vector<v3s16> NodeMetadataList::getAllKeys()
 {
 	std::vector<v3s16> keys;
-	keys.reserve(m_data.size());
-	for (const auto &it : m_data)
-		keys.push_back(it.first);
+	keys.reserve(m_entries.size());
+	for (const Entry &entry : m_entries)
+		keys.push_back(entry.pos);
 
 	return keys;
 }
 
 NodeMetadata *NodeMetadataList::get(v3s16 p)
 {
-	NodeMetadataMap::const_iterator n = m_data.find(p);
-	if (n == m_data.end())
+	Entry *entry = find(p);
+	if (!entry)
 		return nullptr;
-	return n->second;
+	if (entry->meta)
+		return entry->meta;
+
+	// First access, read it
+	NodeMetadata *meta = new NodeMetadata(m_item_def_mgr);
+	MemoryStreamBuffer buf(m_raw.data() + entry->offset, entry->size);
+	std::istream is(&buf);
+	try {
+		meta->deSerialize(is, m_raw_version);
+	} catch (SerializationError &e) {
+		errorstream << "NodeMetadataList: Invalid metadata at " << p
+			<< ": " << e.what() << std::endl;
+	}
+	entry->meta = meta;
+
+	if (--m_raw_count == 0)
+		std::string().swap(m_raw);
+	return meta;
 }
 
 void NodeMetadataList::remove(v3s16 p)
 {
-	NodeMetadata *olddata = get(p);
-	if (olddata) {
-		if (m_is_metadata_owner) {
-			// clearing can throw an exception due to the invlist resize lock,
-			// which we don't want to happen in the noexcept destructor
-			// => call clear before
-			olddata->clear();
-			delete olddata;
-		}
-		m_data.erase(p);
+	Entry *entry = find(p);
+	if (!entry)
+		return;
+
+	NodeMetadata *olddata = entry->meta;
+	if (!olddata) {
+		if (--m_raw_count == 0)
+			std::string().swap(m_raw);
+	} else if (m_is_metadata_owner) {
+		// clearing can throw an exception due to the invlist resize lock,
+		// which we don't want to happen in the noexcept destructor
+		// => call clear before
+		olddata->clear();
+		delete olddata;
 	}
+	m_entries.erase(m_entries.begin() + (entry - m_entries.data()));
 }
 
 void NodeMetadataList::set(v3s16 p, NodeMetadata *d)
 {
 	remove(p);
-	m_data.emplace(p, d);
+
+	Entry entry;
+	entry.pos = p;
+	entry.raw_empty = false;
+	entry.meta = d;
+	entry.offset = entry.size = 0;
+	m_entries.insert(std::lower_bound(m_entries.begin(), m_entries.end(), p,
+		entryBefore), entry);
 }
 
 void NodeMetadataList::clear()
 {
 	if (m_is_metadata_owner) {
-		NodeMetadataMap::const_iterator it;
-		for (it = m_data.begin(); it != m_data.end(); ++it)
-			delete it->second;
+		for (const Entry &entry : m_entries)
+			delete entry.meta;
 	}
-	m_data.clear();
+	m_entries.clear();
+	std::string().swap(m_raw);
+	m_raw_count = 0;
 }
 
 int NodeMetadataList::countNonEmpty() const
 {
 	int n = 0;
-	for (const auto &it : m_data) {
-		if (!it.second->empty())
+	for (const Entry &entry : m_entries) {
+		if (entry.meta ? !entry.meta->empty() : !entry.raw_empty)
 			n++;
 	}
 	return n;
@@ -68,9 +68,12 @@ class NodeMetadata : public SimpleMetadata
 
 /*
 	List of metadata of all the nodes of a block
-*/
 
-typedef std::map<v3s16, NodeMetadata *> NodeMetadataMap;
+	Metadata loaded as part of a block stays in its serialized form until
+	it is accessed, so that blocks which are only sent or saved again do
+	not have to build the inventories. Serializing such metadata copies
+	the stored bytes.
+*/
 
 class NodeMetadataList
 {
@@ -97,21 +100,36 @@ class NodeMetadataList
 	// Deletes all
 	void clear();
 
-	size_t size() const { return m_data.size(); }
-
-	NodeMetadataMap::const_iterator begin()
-	{
-		return m_data.begin();
-	}
-
-	NodeMetadataMap::const_iterator end()
-	{
-		return m_data.end();
-	}
+	size_t size() const { return m_entries.size(); }
 
 private:
+	struct Entry {
+		v3s16 pos;
+		// Whether the metadata has neither fields nor an inventory,
+		// only used while it is serialized
+		bool raw_empty;
+		// Null while the metadata is still serialized, as the bytes
+		// [offset, offset + size) of m_raw
+		NodeMetadata *meta;
+		u32 offset;
+		u32 size;
+	};
+
 	int countNonEmpty() const;
 
+	static bool entryBefore(const Entry &entry, v3s16 p);
+	Entry *find(v3s16 p);
+	void deSerializeRaw(std::istream &is, u8 version);
+	void serializeRaw(std::ostream &os, const Entry &entry, u8 version,
+		bool disk) const;
+
 	bool m_is_metadata_owner;
-	NodeMetadataMap m_data;
+	// Sorted by position
+	std::vector<Entry> m_entries;
+
+	// Serialized metadata and the format it is in
+	std::string m_raw;
+	u8 m_raw_version = 0;
+	u32 m_raw_count = 0;
+	IItemDefManager *m_item_def_mgr = nullptr;
 };
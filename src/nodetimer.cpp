@@ -22,6 +22,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "serialization.h"
 #include "util/serialize.h"
 #include "constants.h" // MAP_BLOCKSIZE
+#include <cassert>
+#include <cmath>
 
 /*
 	NodeTimer
@@ -63,7 +65,7 @@ void NodeTimerList::serialize(std::ostream &os, u8 map_format_version) const
 	for (const auto &timer : m_timers) {
 		NodeTimer t = timer.second;
 		NodeTimer nt = NodeTimer(t.timeout,
-			t.timeout - (f32)(timer.first - m_time), t.position);
+			t.timeout - (f32)(timer.first - getTime()), t.position);
 		v3s16 p = t.position;
 
 		u16 p16 = p.Z * MAP_BLOCKSIZE * MAP_BLOCKSIZE + p.Y * MAP_BLOCKSIZE + p.X;
@@ -127,16 +129,25 @@ void NodeTimerList::deSerialize(std::istream &is, u8 map_format_version)
 
 std::vector<NodeTimer> NodeTimerList::step(float dtime)
 {
-	std::vector<NodeTimer> elapsed_timers;
+	assert(!m_wheel);
 	m_time += dtime;
-	if (m_next_trigger_time == -1. || m_time < m_next_trigger_time) {
+	return takeElapsed();
+}
+
+std::vector<NodeTimer> NodeTimerList::takeElapsed()
+{
+	std::vector<NodeTimer> elapsed_timers;
+	const double time = getTime();
+	if (m_next_trigger_time == -1. || time < m_next_trigger_time) {
+		// Woken up early, e.g. because the first timer was removed
+		rescheduleNext();
 		return elapsed_timers;
 	}
 	std::multimap<double, NodeTimer>::iterator i = m_timers.begin();
 	// Process timers
-	for (; i != m_timers.end() && i->first <= m_time; ++i) {
+	for (; i != m_timers.end() && i->first <= time; ++i) {
 		NodeTimer t = i->second;
-		t.elapsed = t.timeout + (f32)(m_time - i->first);
+		t.elapsed = t.timeout + (f32)(time - i->first);
 		elapsed_timers.push_back(t);
 		m_iterators.erase(t.position);
 	}
@@ -146,5 +157,127 @@ std::vector<NodeTimer> NodeTimerList::step(float dtime)
 		m_next_trigger_time = -1.;
 	else
 		m_next_trigger_time = m_timers.begin()->first;
+	rescheduleNext();
 	return elapsed_timers;
 }
+
+void NodeTimerList::attach(NodeTimerWheel *wheel, v3s16 blockpos, double catch_up)
+{
+	detach();
+
+	// Move the trigger times over to the clock of the wheel
+	const double offset = wheel->getTime() - catch_up - m_time;
+	if (!m_timers.empty() && offset != 0) {
+		std::multimap<double, NodeTimer> timers;
+		for (const auto &it : m_timers)
+			timers.emplace_hint(timers.end(), it.first + offset, it.second);
+		m_timers.swap(timers);
+		for (auto it = m_timers.begin(); it != m_timers.end(); ++it)
+			m_iterators[it->second.position] = it;
+		m_next_trigger_time = m_timers.begin()->first;
+	}
+
+	m_wheel = wheel;
+	m_blockpos = blockpos;
+	scheduleNext();
+}
+
+void NodeTimerList::detach()
+{
+	if (!m_wheel)
+		return;
+	m_time = m_wheel->getTime();
+	m_wheel->unschedule(m_blockpos);
+	m_wheel = nullptr;
+}
+
+void NodeTimerList::scheduleNext()
+{
+	if (m_wheel && m_next_trigger_time != -1.)
+		m_wheel->schedule(m_blockpos, m_next_trigger_time);
+}
+
+void NodeTimerList::rescheduleNext()
+{
+	if (!m_wheel)
+		return;
+	m_wheel->unschedule(m_blockpos);
+	scheduleNext();
+}
+
+/*
+	NodeTimerWheel
+*/
+
+NodeTimerWheel::NodeTimerWheel(float interval):
+	m_interval(std::fmax(interval, 0.001f))
+{
+}
+
+void NodeTimerWheel::schedule(v3s16 blockpos, double time)
+{
+	// Ticks are never in the past, the wheel would only reach them after
+	// a full turn. Allow for rounding so that timers are not a tick late.
+	double ticks = std::ceil(time / m_interval - 1e-6);
+	u64 tick = ticks > (double)m_tick ? (u64)std::fmin(ticks, 1e18) : m_tick + 1;
+
+	auto it = m_due.find(blockpos);
+	if (it != m_due.end()) {
+		if (it->second <= tick)
+			return;
+		it->second = tick;
+	} else {
+		m_due.emplace(blockpos, tick);
+	}
+	add({blockpos, tick});
+}
+
+void NodeTimerWheel::unschedule(v3s16 blockpos)
+{
+	m_due.erase(blockpos);
+}
+
+void NodeTimerWheel::add(const Entry &entry)
+{
+	const u64 delta = entry.tick > m_tick ? entry.tick - m_tick : 0;
+	u32 level = 0;
+	while (level < LEVELS - 1 && delta >> (SLOT_BITS * (level + 1)) != 0)
+		level++;
+
+	u64 slot = entry.tick >> (SLOT_BITS * level);
+	if (delta >> (SLOT_BITS * LEVELS) != 0) {
+		// Beyond the wheel, goes into the slot that comes up last
+		slot = (m_tick >> (SLOT_BITS * level)) - 1;
+	}
+	m_slots[level][slot & (SLOTS - 1)].push_back(entry);
+}
+
+void NodeTimerWheel::step(std::vector<v3s16> &due)
+{
+	m_tick++;
+	m_time = m_tick * (double)m_interval;
+
+	// Move the entries of the upper levels whose slot came up one level
+	// down, starting at the top so that they can fall through
+	for (u32 level = LEVELS - 1; level > 0; level--) {
+		if ((m_tick & ((1ULL << (SLOT_BITS * level)) - 1)) != 0)
+			continue;
+		std::vector<Entry> entries;
+		entries.swap(m_slots[level][(m_tick >> (SLOT_BITS * level)) & (SLOTS - 1)]);
+		for (const Entry &entry : entries) {
+			auto it = m_due.find(entry.blockpos);
+			if (it != m_due.end() && it->second == entry.tick)
+				add(entry);
+		}
+	}
+
+	std::vector<Entry> &slot = m_slots[0][m_tick & (SLOTS - 1)];
+	for (const Entry &entry : slot) {
+		auto it = m_due.find(entry.blockpos);
+		if (it == m_due.end() || it->second != entry.tick)
+			continue;
+		m_due.erase(it);
+		due.push_back(entry.blockpos);
+	}
+	slot.clear();
+}
@@ -22,8 +22,11 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "irr_v3d.h"
 #include <iostream>
 #include <map>
+#include <unordered_map>
 #include <vector>
 
+class NodeTimerWheel;
+
 /*
 	NodeTimer provides per-node timed callback functionality.
 	Can be used for:
@@ -70,7 +73,7 @@ class NodeTimerList
 		if (n == m_iterators.end())
 			return NodeTimer();
 		NodeTimer t = n->second->second;
-		t.elapsed = t.timeout - (n->second->first - m_time);
+		t.elapsed = t.timeout - (n->second->first - getTime());
 		return t;
 	}
 	// Deletes timer
@@ -95,11 +98,13 @@ class NodeTimerList
 	// Undefined behavior if there already is a timer
 	void insert(const NodeTimer &timer) {
 		v3s16 p = timer.position;
-		double trigger_time = m_time + (double)(timer.timeout - timer.elapsed);
+		double trigger_time = getTime() + (double)(timer.timeout - timer.elapsed);
 		std::multimap<double, NodeTimer>::iterator it = m_timers.emplace(trigger_time, timer);
 		m_iterators.emplace(p, it);
-		if (m_next_trigger_time == -1. || trigger_time < m_next_trigger_time)
+		if (m_next_trigger_time == -1. || trigger_time < m_next_trigger_time) {
 			m_next_trigger_time = trigger_time;
+			scheduleNext();
+		}
 	}
 	// Deletes old timer and sets a new one
 	inline void set(const NodeTimer &timer) {
@@ -113,12 +118,90 @@ class NodeTimerList
 		m_next_trigger_time = -1.;
 	}
 
-	// Move forward in time, returns elapsed timers
+	// Move forward in time, returns elapsed timers.
+	// Only for lists that are not attached to a wheel.
 	std::vector<NodeTimer> step(float dtime);
+	// Returns the timers that elapsed by the current time
+	std::vector<NodeTimer> takeElapsed();
+
+	/*
+		While attached, the list follows the clock of the wheel and gets the
+		block at 'blockpos' scheduled for its next timer. 'catch_up' is
+		the time that passed since the list was last used.
+		Detaching stops the clock of the list again.
+	*/
+	void attach(NodeTimerWheel *wheel, v3s16 blockpos, double catch_up);
+	void detach();
+	bool isAttached() const { return m_wheel != nullptr; }
 
 private:
+	inline double getTime() const;
+	// Makes the block due at the next trigger time, or earlier
+	void scheduleNext();
+	// Makes the block due at exactly the next trigger time
+	void rescheduleNext();
+
 	std::multimap<double, NodeTimer> m_timers;
 	std::map<v3s16, std::multimap<double, NodeTimer>::iterator> m_iterators;
 	double m_next_trigger_time = -1.0;
+	// Own clock, used while not attached to a wheel
+	double m_time = 0.0;
+	NodeTimerWheel *m_wheel = nullptr;
+	v3s16 m_blockpos;
+};
+
+/*
+	Schedules blocks by the time their next node timer is due, so that
+	running the timers of the active blocks costs as much as the timers
+	that elapse instead of one step per block and interval.
+
+	The blocks are kept in a hierarchical timing wheel with one tick per
+	node timer interval. Entries are block positions, they are dropped
+	lazily once the block is rescheduled or unscheduled.
+*/
+
+class NodeTimerWheel
+{
+public:
+	NodeTimerWheel(float interval);
+
+	double getTime() const { return m_time; }
+	float getInterval() const { return m_interval; }
+
+	// Makes the block due at the first tick at or after 'time', unless
+	// it is already due earlier
+	void schedule(v3s16 blockpos, double time);
+	void unschedule(v3s16 blockpos);
+
+	// Advances the clock by one interval, adds the blocks that became due
+	void step(std::vector<v3s16> &due);
+
+	// Number of scheduled blocks
+	size_t size() const { return m_due.size(); }
+
+private:
+	static constexpr u32 SLOT_BITS = 6;
+	static constexpr u32 SLOTS = 1 << SLOT_BITS;
+	static constexpr u32 LEVELS = 4;
+
+	struct Entry {
+		v3s16 blockpos;
+		u64 tick;
+	};
+
+	void add(const Entry &entry);
+
+	const float m_interval;
+	u64 m_tick = 0;
 	double m_time = 0.0;
+	// Level 0 holds the next SLOTS ticks, each further level SLOTS times
+	// as many, entries move down a level when their slot comes up
+	std::vector<Entry> m_slots[LEVELS][SLOTS];
+	// Tick each scheduled block is due at
+	std::unordered_map<v3s16, u64> m_due;
 };
+
+inline double NodeTimerList::getTime() const
+{
+	return m_wheel ? m_wheel->getTime() : m_time;
+}
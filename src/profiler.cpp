@@ -19,139 +19,369 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "profiler.h"
 #include "porting.h"
+#include "tracer.h"
+#include <deque>
+#include <unordered_map>
 
 static Profiler main_profiler;
 Profiler *g_profiler = &main_profiler;
+
+/*
+	Section name registry
+*/
+
+namespace {
+struct SectionRegistry {
+	std::mutex mutex;
+	std::unordered_map<std::string, Profiler::SectionId> ids;
+	std::deque<std::string> names;
+};
+}
+
+static SectionRegistry &getSectionRegistry()
+{
+	static SectionRegistry registry;
+	return registry;
+}
+
+Profiler::SectionId Profiler::intern(const std::string &name)
+{
+	// Avoids locking once a thread has seen the name
+	thread_local std::unordered_map<std::string, SectionId> cache;
+	auto it = cache.find(name);
+	if (it != cache.end())
+		return it->second;
+
+	SectionRegistry &registry = getSectionRegistry();
+	SectionId id;
+	{
+		MutexAutoLock lock(registry.mutex);
+		auto it2 = registry.ids.find(name);
+		if (it2 != registry.ids.end()) {
+			id = it2->second;
+		} else {
+			id = registry.names.size();
+			registry.names.push_back(name);
+			registry.ids.emplace(name, id);
+		}
+	}
+	cache.emplace(name, id);
+	return id;
+}
+
+std::string Profiler::getSectionName(SectionId id)
+{
+	SectionRegistry &registry = getSectionRegistry();
+	MutexAutoLock lock(registry.mutex);
+	return id < registry.names.size() ? registry.names[id] : std::string();
+}
+
+/*
+	ScopeProfiler
+*/
+
 ScopeProfiler::ScopeProfiler(
 		Profiler *profiler, const std::string &name, ScopeProfilerType type) :
-		m_profiler(profiler),
-		m_name(name), m_type(type)
+		ScopeProfiler(profiler,
+			profiler || Tracer::isEnabled() ? intern(name) : 0, type)
 {
-	m_name.append(" [ms]");
-	if (m_profiler)
-		m_timer = new TimeTaker(m_name, nullptr, PRECISION_MILLI);
+}
+
+ScopeProfiler::ScopeProfiler(
+		Profiler *profiler, Profiler::SectionId id, ScopeProfilerType type) :
+		m_profiler(profiler), m_id(id), m_type(type),
+		m_trace(Tracer::isEnabled())
+{
+	if (m_profiler || m_trace)
+		m_start_us = porting::getTimeUs();
 }
 
 ScopeProfiler::~ScopeProfiler()
 {
-	if (!m_timer)
+	if (!m_profiler && !m_trace)
 		return;
 
-	float duration_ms = m_timer->stop(true);
-	float duration = duration_ms;
-	if (m_profiler) {
-		switch (m_type) {
-		case SPT_ADD:
-			m_profiler->add(m_name, duration);
-			break;
-		case SPT_AVG:
-			m_profiler->avg(m_name, duration);
-			break;
-		case SPT_GRAPH_ADD:
-			m_profiler->graphAdd(m_name, duration);
-			break;
-		case SPT_MAX:
-			m_profiler->max(m_name, duration);
-			break;
-		}
+	const u64 end_us = porting::getTimeUs();
+	if (m_trace)
+		Tracer::record(m_id, m_start_us, end_us);
+	if (!m_profiler)
+		return;
+
+	float duration = (end_us - m_start_us) / 1000.0f;
+	switch (m_type) {
+	case SPT_ADD:
+		m_profiler->add(m_id, duration);
+		break;
+	case SPT_AVG:
+		m_profiler->avg(m_id, duration);
+		break;
+	case SPT_GRAPH_ADD:
+		m_profiler->graphAdd(m_id, duration);
+		break;
+	case SPT_MAX:
+		m_profiler->max(m_id, duration);
+		break;
 	}
-	delete m_timer;
 }
 
-Profiler::Profiler()
+Profiler::SectionId ScopeProfiler::intern(const std::string &name)
+{
+	// Avoids building the full name once a thread has seen it
+	thread_local std::unordered_map<std::string, Profiler::SectionId> cache;
+	auto it = cache.find(name);
+	if (it != cache.end())
+		return it->second;
+
+	const Profiler::SectionId id = Profiler::intern(name + " [ms]");
+	cache.emplace(name, id);
+	return id;
+}
+
+/*
+	Profiler
+*/
+
+Profiler::ThreadBuffer::~ThreadBuffer()
+{
+	for (auto &chunk : chunks)
+		delete[] chunk.load();
+}
+
+static std::atomic<u64> next_profiler_id(1);
+
+Profiler::Profiler() :
+	m_id(next_profiler_id++)
 {
 	m_start_time = porting::getTimeMs();
 }
 
-void Profiler::add(const std::string &name, float value)
+Profiler::~Profiler() = default;
+
+Profiler::ThreadBuffer *Profiler::getThreadBuffer()
 {
-	MutexAutoLock lock(m_mutex);
-	{
-		/* No average shall have been used; mark add/max used as -2 */
-		std::map<std::string, int>::iterator n = m_avgcounts.find(name);
-		if (n == m_avgcounts.end()) {
-			m_avgcounts[name] = -2;
-		} else {
-			if (n->second == -1)
-				n->second = -2;
-			assert(n->second == -2);
-		}
+	// Recently used buffers of this thread, by profiler id
+	struct CacheEntry {
+		u64 profiler_id = 0;
+		ThreadBuffer *buffer = nullptr;
+	};
+	thread_local CacheEntry cache[4];
+	thread_local u8 cache_next = 0;
+
+	for (const CacheEntry &entry : cache) {
+		if (entry.profiler_id == m_id)
+			return entry.buffer;
 	}
+
+	ThreadBuffer *buffer = nullptr;
 	{
-		std::map<std::string, float>::iterator n = m_data.find(name);
-		if (n == m_data.end())
-			m_data[name] = value;
-		else
-			n->second += value;
+		MutexAutoLock lock(m_mutex);
+		const std::thread::id thread = std::this_thread::get_id();
+		for (auto &it : m_buffers) {
+			if (it->thread == thread) {
+				buffer = it.get();
+				break;
+			}
+		}
+		if (!buffer) {
+			m_buffers.push_back(std::make_unique<ThreadBuffer>(thread));
+			buffer = m_buffers.back().get();
+			buffer->generation = m_generation.load();
+		}
 	}
+
+	CacheEntry &entry = cache[cache_next++ % 4];
+	entry.profiler_id = m_id;
+	entry.buffer = buffer;
+	return buffer;
 }
 
-void Profiler::max(const std::string &name, float value)
+Profiler::Slot *Profiler::getSlot(SectionId id, SlotKind kind)
 {
-	MutexAutoLock lock(m_mutex);
-	{
-		/* No average shall have been used; mark add/max used as -2 */
-		auto n = m_avgcounts.find(name);
-		if (n == m_avgcounts.end()) {
-			m_avgcounts[name] = -2;
-		} else {
-			if (n->second == -1)
-				n->second = -2;
-			assert(n->second == -2);
+	if (id >= CHUNK_SIZE * MAX_CHUNKS)
+		return nullptr;
+
+	ThreadBuffer *buffer = getThreadBuffer();
+
+	// Reset the values of this thread after clear()
+	const u32 generation = m_generation.load(std::memory_order_relaxed);
+	if (buffer->generation.load(std::memory_order_relaxed) != generation) {
+		for (auto &chunk_ptr : buffer->chunks) {
+			Slot *chunk = chunk_ptr.load(std::memory_order_relaxed);
+			if (!chunk)
+				continue;
+			for (u32 i = 0; i < CHUNK_SIZE; i++) {
+				chunk[i].value.store(0.0f, std::memory_order_relaxed);
+				chunk[i].count.store(0, std::memory_order_relaxed);
+			}
 		}
+		buffer->generation.store(generation, std::memory_order_release);
 	}
-	{
-		auto n = m_data.find(name);
-		if (n == m_data.end())
-			m_data[name] = value;
-		else if (value > n->second)
-			n->second = value;
+
+	std::atomic<Slot *> &chunk_ptr = buffer->chunks[id / CHUNK_SIZE];
+	Slot *chunk = chunk_ptr.load(std::memory_order_relaxed);
+	if (!chunk) {
+		chunk = new Slot[CHUNK_SIZE];
+		chunk_ptr.store(chunk, std::memory_order_release);
 	}
+
+	Slot *slot = &chunk[id % CHUNK_SIZE];
+	/* Averages must not be mixed with add/max */
+	assert(slot->kind.load(std::memory_order_relaxed) == SLOT_UNUSED ||
+			(slot->kind.load(std::memory_order_relaxed) == SLOT_AVG) ==
+			(kind == SLOT_AVG));
+	slot->kind.store(kind, std::memory_order_relaxed);
+	return slot;
 }
 
-void Profiler::avg(const std::string &name, float value)
+void Profiler::add(SectionId id, float value)
 {
-	MutexAutoLock lock(m_mutex);
-	int &count = m_avgcounts[name];
+	Slot *slot = getSlot(id, SLOT_ADD);
+	if (!slot)
+		return;
+	slot->value.store(slot->value.load(std::memory_order_relaxed) + value,
+			std::memory_order_relaxed);
+}
+
+void Profiler::max(SectionId id, float value)
+{
+	Slot *slot = getSlot(id, SLOT_MAX);
+	if (!slot)
+		return;
+	// The first value counts even if it is negative
+	if (slot->count.load(std::memory_order_relaxed) == 0 ||
+			value > slot->value.load(std::memory_order_relaxed)) {
+		slot->value.store(value, std::memory_order_relaxed);
+		slot->count.store(-1, std::memory_order_relaxed);
+	}
+}
+
+void Profiler::avg(SectionId id, float value)
+{
+	Slot *slot = getSlot(id, SLOT_AVG);
+	if (!slot)
+		return;
+	slot->value.store(slot->value.load(std::memory_order_relaxed) + value,
+			std::memory_order_relaxed);
+	slot->count.store(slot->count.load(std::memory_order_relaxed) + 1,
+			std::memory_order_relaxed);
+}
+
+void Profiler::graphGet(GraphValues &result)
+{
+	std::map<SectionId, float> values;
+	{
+		MutexAutoLock lock(m_graph_mutex);
+		values.swap(m_graphvalues);
+	}
 
-	assert(count != -2);
-	count = MYMAX(count, 0) + 1;
-	m_data[name] += value;
+	result.clear();
+	for (const auto &it : values)
+		result[getSectionName(it.first)] = it.second;
 }
 
 void Profiler::clear()
 {
+	// Every thread resets its own values on its next write
+	m_generation++;
+	m_start_time = porting::getTimeMs();
+}
+
+void Profiler::remove(const std::string &name)
+{
+	const SectionId id = intern(name);
+	if (id >= CHUNK_SIZE * MAX_CHUNKS)
+		return;
+
 	MutexAutoLock lock(m_mutex);
-	for (auto &it : m_data) {
-		it.second = 0;
+	for (auto &buffer : m_buffers) {
+		Slot *chunk = buffer->chunks[id / CHUNK_SIZE].load(std::memory_order_acquire);
+		if (!chunk)
+			continue;
+		Slot &slot = chunk[id % CHUNK_SIZE];
+		slot.kind.store(SLOT_UNUSED, std::memory_order_relaxed);
+		slot.value.store(0.0f, std::memory_order_relaxed);
+		slot.count.store(0, std::memory_order_relaxed);
 	}
-	m_avgcounts.clear();
-	m_start_time = porting::getTimeMs();
 }
 
-float Profiler::getValue(const std::string &name) const
+void Profiler::merge(const Slot &slot, bool current, Merged &dst) const
 {
-	auto numerator = m_data.find(name);
-	if (numerator == m_data.end())
-		return 0.f;
+	const SlotKind kind = (SlotKind)slot.kind.load(std::memory_order_relaxed);
+	if (kind == SLOT_UNUSED)
+		return;
+	if (dst.kind == SLOT_UNUSED)
+		dst.kind = kind;
+	// Values from before clear() are gone, but the section is still listed
+	if (!current)
+		return;
 
-	auto denominator = m_avgcounts.find(name);
-	if (denominator != m_avgcounts.end()) {
-		if (denominator->second >= 1)
-			return numerator->second / denominator->second;
+	const float value = slot.value.load(std::memory_order_relaxed);
+	const s32 count = slot.count.load(std::memory_order_relaxed);
+	switch (kind) {
+	case SLOT_ADD:
+		dst.value += value;
+		break;
+	case SLOT_AVG:
+		dst.value += value;
+		dst.count += count;
+		break;
+	case SLOT_MAX:
+		if (count != 0 && (dst.count == 0 || value > dst.value)) {
+			dst.value = value;
+			dst.count = -1;
+		}
+		break;
+	default:
+		break;
 	}
+}
 
-	return numerator->second;
+void Profiler::mergeAll(std::map<SectionId, Merged> &dst) const
+{
+	const u32 generation = m_generation.load();
+	for (const auto &buffer : m_buffers) {
+		const bool current = buffer->generation.load(std::memory_order_acquire) ==
+				generation;
+		for (u32 c = 0; c < MAX_CHUNKS; c++) {
+			const Slot *chunk = buffer->chunks[c].load(std::memory_order_acquire);
+			if (!chunk)
+				continue;
+			for (u32 i = 0; i < CHUNK_SIZE; i++) {
+				if (chunk[i].kind.load(std::memory_order_relaxed) != SLOT_UNUSED)
+					merge(chunk[i], current, dst[c * CHUNK_SIZE + i]);
+			}
+		}
+	}
 }
 
-int Profiler::getAvgCount(const std::string &name) const
+Profiler::Merged Profiler::mergeOne(SectionId id) const
 {
-	auto n = m_avgcounts.find(name);
+	Merged merged;
+	if (id >= CHUNK_SIZE * MAX_CHUNKS)
+		return merged;
 
-	if (n != m_avgcounts.end() && n->second >= 1)
-		return n->second;
+	const u32 generation = m_generation.load();
+	MutexAutoLock lock(m_mutex);
+	for (const auto &buffer : m_buffers) {
+		const Slot *chunk = buffer->chunks[id / CHUNK_SIZE].load(std::memory_order_acquire);
+		if (chunk) {
+			merge(chunk[id % CHUNK_SIZE],
+				buffer->generation.load(std::memory_order_acquire) == generation,
+				merged);
+		}
+	}
+	return merged;
+}
 
-	return 1;
+float Profiler::getValue(const std::string &name) const
+{
+	return mergeOne(intern(name)).get();
+}
+
+int Profiler::getAvgCount(const std::string &name) const
+{
+	const Merged merged = mergeOne(intern(name));
+	return merged.count >= 1 ? merged.count : 1;
 }
 
 u64 Profiler::getElapsedMs() const
@@ -189,12 +419,21 @@ int Profiler::print(std::ostream &o, u32 page, u32 pagecount)
 
 void Profiler::getPage(GraphValues &o, u32 page, u32 pagecount)
 {
-	MutexAutoLock lock(m_mutex);
+	std::map<SectionId, Merged> merged;
+	{
+		MutexAutoLock lock(m_mutex);
+		mergeAll(merged);
+	}
+
+	// Sort by name
+	std::map<std::string, float> data;
+	for (const auto &it : merged)
+		data[getSectionName(it.first)] = it.second.get();
 
 	u32 minindex, maxindex;
-	paging(m_data.size(), page, pagecount, minindex, maxindex);
+	paging(data.size(), page, pagecount, minindex, maxindex);
 
-	for (const auto &i : m_data) {
+	for (const auto &i : data) {
 		if (maxindex == 0)
 			break;
 		maxindex--;
@@ -204,6 +443,6 @@ void Profiler::getPage(GraphValues &o, u32 page, u32 pagecount)
 			continue;
 		}
 
-		o[i.first] = i.second / getAvgCount(i.first);
+		o[i.first] = i.second;
 	}
 }
@@ -20,10 +20,14 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #pragma once
 
 #include "irrlichttypes.h"
+#include <atomic>
 #include <cassert>
+#include <memory>
 #include <string>
 #include <map>
 #include <ostream>
+#include <thread>
+#include <vector>
 
 #include "threading/mutex_auto_lock.h"
 #include "util/timetaker.h"
@@ -35,16 +39,31 @@ extern Profiler *g_profiler;
 
 /*
 	Time profiler
+
+	Section names are interned into ids that are shared by all profilers.
+	Values are accumulated in per-thread buffers without locking and are
+	merged when they are read.
 */
 
 class Profiler
 {
 public:
+	typedef u32 SectionId;
+
+	// Returns the id of a section name, which is the same in all profilers
+	static SectionId intern(const std::string &name);
+	static std::string getSectionName(SectionId id);
+
 	Profiler();
+	~Profiler();
+
+	void add(SectionId id, float value);
+	void avg(SectionId id, float value);
+	void max(SectionId id, float value);
 
-	void add(const std::string &name, float value);
-	void avg(const std::string &name, float value);
-	void max(const std::string &name, float value);
+	void add(const std::string &name, float value) { add(intern(name), value); }
+	void avg(const std::string &name, float value) { avg(intern(name), value); }
+	void max(const std::string &name, float value) { max(intern(name), value); }
 	void clear();
 
 	float getValue(const std::string &name) const;
@@ -58,36 +77,71 @@ class Profiler
 	void getPage(GraphValues &o, u32 page, u32 pagecount);
 
 
-	void graphAdd(const std::string &id, float value)
+	void graphAdd(SectionId id, float value)
 	{
-		MutexAutoLock lock(m_mutex);
-		std::map<std::string, float>::iterator i =
-				m_graphvalues.find(id);
-		if(i == m_graphvalues.end())
-			m_graphvalues[id] = value;
-		else
-			i->second += value;
-	}
-	void graphGet(GraphValues &result)
-	{
-		MutexAutoLock lock(m_mutex);
-		result = m_graphvalues;
-		m_graphvalues.clear();
+		MutexAutoLock lock(m_graph_mutex);
+		m_graphvalues[id] += value;
 	}
+	void graphAdd(const std::string &name, float value) { graphAdd(intern(name), value); }
+	void graphGet(GraphValues &result);
 
-	void remove(const std::string& name)
-	{
-		MutexAutoLock lock(m_mutex);
-		m_avgcounts.erase(name);
-		m_data.erase(name);
-	}
+	void remove(const std::string &name);
 
 private:
-	std::mutex m_mutex;
-	std::map<std::string, float> m_data;
-	std::map<std::string, int> m_avgcounts;
-	std::map<std::string, float> m_graphvalues;
-	u64 m_start_time;
+	enum SlotKind : u8 {
+		SLOT_UNUSED,
+		SLOT_ADD,
+		SLOT_AVG,
+		SLOT_MAX,
+	};
+
+	// Written only by the thread owning the buffer, read by everyone
+	struct Slot {
+		std::atomic<float> value{0.0f};
+		std::atomic<s32> count{0};
+		std::atomic<u8> kind{SLOT_UNUSED};
+	};
+
+	static constexpr u32 CHUNK_SIZE = 256;
+	static constexpr u32 MAX_CHUNKS = 256;
+
+	struct ThreadBuffer {
+		ThreadBuffer(std::thread::id thread) : thread(thread) {}
+		~ThreadBuffer();
+
+		const std::thread::id thread;
+		// Value of Profiler::m_generation the slots belong to
+		std::atomic<u32> generation{0};
+		std::atomic<Slot *> chunks[MAX_CHUNKS] = {};
+	};
+
+	// Merged value of a section over all threads
+	struct Merged {
+		float value = 0.0f;
+		s32 count = 0;
+		SlotKind kind = SLOT_UNUSED;
+
+		float get() const { return count >= 1 ? value / count : value; }
+	};
+
+	// Returns nullptr if there are too many sections
+	Slot *getSlot(SectionId id, SlotKind kind);
+	ThreadBuffer *getThreadBuffer();
+	void merge(const Slot &slot, bool current, Merged &dst) const;
+	// m_mutex must be locked
+	void mergeAll(std::map<SectionId, Merged> &dst) const;
+	Merged mergeOne(SectionId id) const;
+
+	// Unique among all profilers ever created, used by the per-thread cache
+	const u64 m_id;
+	std::atomic<u32> m_generation{0};
+
+	mutable std::mutex m_mutex;
+	std::vector<std::unique_ptr<ThreadBuffer>> m_buffers;
+
+	std::mutex m_graph_mutex;
+	std::map<SectionId, float> m_graphvalues;
+	std::atomic<u64> m_start_time;
 };
 
 enum ScopeProfilerType{
@@ -97,15 +151,29 @@ enum ScopeProfilerType{
 	SPT_MAX
 };
 
+/*
+	Measures the time until it goes out of scope, in milliseconds.
+	Pass an id from ScopeProfiler::intern() on hot paths, which avoids
+	looking up the name every time.
+	The scope is also recorded by the Tracer if tracing is enabled.
+*/
 class ScopeProfiler
 {
 public:
 	ScopeProfiler(Profiler *profiler, const std::string &name,
 			ScopeProfilerType type = SPT_ADD);
+	ScopeProfiler(Profiler *profiler, Profiler::SectionId id,
+			ScopeProfilerType type = SPT_ADD);
 	~ScopeProfiler();
+
+	// Like Profiler::intern(), adding the unit to the name
+	static Profiler::SectionId intern(const std::string &name);
+
 private:
 	Profiler *m_profiler = nullptr;
-	std::string m_name;
-	TimeTaker *m_timer = nullptr;
+	Profiler::SectionId m_id;
+	u64 m_start_us;
 	enum ScopeProfilerType m_type;
+	// Also recorded by the Tracer
+	bool m_trace;
 };
@@ -31,6 +31,7 @@ extern "C" {
 #include "log.h"
 #include "filesys.h"
 #include "porting.h"
+#include "profiler.h"
 #include "common/c_internal.h"
 #include "common/c_packer.h"
 #include "lua_api/l_base.h"
@@ -336,6 +337,10 @@ void* AsyncWorkerThread::run()
 		if (!jobDispatcher->getJob(&j) || stopRequested())
 			continue;
 
+		// Recorded in traces only
+		static const auto trace_id = ScopeProfiler::intern("AsyncWorkerThread: job");
+		ScopeProfiler trace(nullptr, trace_id);
+
 		const bool use_ext = !!j.params_ext;
 
 		lua_getfield(L, -1, "job_processor");
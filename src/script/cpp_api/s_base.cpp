@@ -334,7 +334,10 @@ void ScriptApiBase::runCallbacksRaw(int nargs,
 	// Stack now looks like this:
 	// ... <error handler> <run_callbacks> <table> <mode> <arg#1> <arg#2> ... <arg#n>
 
+	// run_callbacks sets the origin of each callback
+	const char *old_callback = m_cpu_accounting.setCallback(fxn);
 	int result = lua_pcall(L, nargs + 2, 1, error_handler);
+	m_cpu_accounting.setCallback(old_callback);
 	if (result != 0)
 		scriptError(result, fxn);
 
@@ -387,6 +390,7 @@ void ScriptApiBase::stackDump(std::ostream &o)
 void ScriptApiBase::setOriginDirect(const char *origin)
 {
 	m_last_run_mod = origin ? origin : "??";
+	m_cpu_accounting.switchTo(m_last_run_mod);
 }
 
 void ScriptApiBase::setOriginFromTableRaw(int index, const char *fxn)
@@ -394,6 +398,23 @@ void ScriptApiBase::setOriginFromTableRaw(int index, const char *fxn)
 	lua_State *L = getStack();
 	m_last_run_mod = lua_istable(L, index) ?
 		getstringfield_default(L, index, "mod_origin", "") : "";
+	m_cpu_accounting.switchTo(m_last_run_mod, fxn);
+}
+
+void ScriptApiBase::setCpuAccounting(ScriptCpuAccounting::Mode mode,
+		u32 sample_interval)
+{
+	RecursiveMutexAutoLock scriptlock(m_luastackmutex);
+	m_cpu_accounting.setMode(mode, sample_interval);
+}
+
+bool ScriptApiBase::getCpuUsage(ScriptCpuAccounting::UsageMap &usage)
+{
+	RecursiveMutexAutoLock scriptlock(m_luastackmutex);
+	if (m_cpu_accounting.getMode() == ScriptCpuAccounting::OFF)
+		return false;
+	m_cpu_accounting.getUsage(usage);
+	return true;
 }
 
 /*
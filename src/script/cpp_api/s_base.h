@@ -35,6 +35,7 @@ extern "C" {
 #include "irrlichttypes.h"
 #include "common/c_types.h"
 #include "common/c_internal.h"
+#include "cpp_api/s_cpuaccounting.h"
 #include "debug.h"
 #include "config.h"
 
@@ -114,6 +115,10 @@ class ScriptApiBase : protected LuaHelper {
 	void setOriginDirect(const char *origin);
 	void setOriginFromTableRaw(int index, const char *fxn);
 
+	// Time spent in callbacks per mod (see lua_cpu_accounting)
+	void setCpuAccounting(ScriptCpuAccounting::Mode mode, u32 sample_interval);
+	bool getCpuUsage(ScriptCpuAccounting::UsageMap &usage);
+
 	void clientOpenLibs(lua_State *L);
 
 	// Check things that should be set by the builtin mod.
@@ -164,6 +169,7 @@ class ScriptApiBase : protected LuaHelper {
 
 	std::recursive_mutex m_luastackmutex;
 	std::string     m_last_run_mod;
+	ScriptCpuAccounting m_cpu_accounting;
 	bool            m_secure = false;
 #ifdef SCRIPTAPI_LOCK_DEBUG
 	int             m_lock_recursion_count{};
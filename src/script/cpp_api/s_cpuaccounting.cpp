@@ -0,0 +1,98 @@
+/*
+Minetest
+Copyright (C) 2024 Minetest Authors
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "cpp_api/s_cpuaccounting.h"
+#include "porting.h"
+
+void ScriptCpuAccounting::setMode(Mode mode, u32 sample_interval)
+{
+	m_mode = mode;
+	m_sample_interval = MYMAX(sample_interval, 1);
+	m_scale = mode == SAMPLED ? m_sample_interval : 1;
+	m_sample_counter = 0;
+}
+
+void ScriptCpuAccounting::enter(Frame &saved)
+{
+	saved.current = m_current;
+	saved.callback = m_callback;
+
+	if (m_depth++ > 0) {
+		// Whatever the engine does before the nested callback switches the
+		// origin is on behalf of the calling mod, so keep charging it
+		return;
+	}
+
+	if (m_mode == FULL || ++m_sample_counter >= m_sample_interval) {
+		m_sample_counter = 0;
+		m_measuring = true;
+		m_last_switch_us = porting::getTimeUs();
+	}
+	// Engine code until the first callback starts
+	m_current = nullptr;
+	m_callback = nullptr;
+}
+
+void ScriptCpuAccounting::leave(const Frame &saved)
+{
+	if (m_measuring)
+		charge(porting::getTimeUs());
+
+	m_current = saved.current;
+	m_callback = saved.callback;
+
+	if (--m_depth == 0)
+		m_measuring = false;
+}
+
+void ScriptCpuAccounting::charge(u64 now)
+{
+	if (m_current)
+		m_current->time_us += (now - m_last_switch_us) * m_scale;
+	m_last_switch_us = now;
+}
+
+void ScriptCpuAccounting::switchToRaw(const std::string &mod)
+{
+	charge(porting::getTimeUs());
+
+	if (!m_last_mod_callbacks || mod != m_last_mod) {
+		m_last_mod = mod;
+		m_last_mod_callbacks = &m_mods[mod];
+	}
+	m_current = &(*m_last_mod_callbacks)[m_callback];
+	m_current->calls += m_scale;
+}
+
+void ScriptCpuAccounting::getUsage(UsageMap &dst) const
+{
+	dst.clear();
+	for (const auto &mod : m_mods) {
+		ModUsage &mod_usage = dst[mod.first];
+		for (const auto &callback : mod.second) {
+			// The same name may be stored at different addresses
+			Usage &usage = mod_usage.callbacks[callback.first ?
+				callback.first : "other"];
+			usage.calls += callback.second.calls;
+			usage.time_us += callback.second.time_us;
+			mod_usage.total.calls += callback.second.calls;
+			mod_usage.total.time_us += callback.second.time_us;
+		}
+	}
+}
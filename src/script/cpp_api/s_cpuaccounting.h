@@ -0,0 +1,145 @@
+/*
+Minetest
+Copyright (C) 2024 Minetest Authors
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#pragma once
+
+#include "irrlichttypes.h"
+#include "util/basic_macros.h"
+#include <map>
+#include <string>
+#include <unordered_map>
+
+/*
+	Attributes the wall time spent in a script environment to the mod that
+	registered the running code and to the kind of callback that was run.
+
+	Time is charged whenever the script origin changes, so measuring costs one
+	clock read per callback. In sampled mode only every n-th call from the
+	engine into the script environment is measured, and the results are
+	scaled up accordingly.
+
+	Not thread-safe: must only be used while holding the script environment.
+*/
+class ScriptCpuAccounting
+{
+public:
+	enum Mode : u8 {
+		OFF,
+		SAMPLED,
+		FULL,
+	};
+
+	struct Usage {
+		u64 calls = 0;
+		u64 time_us = 0;
+	};
+
+	struct ModUsage {
+		Usage total;
+		std::map<std::string, Usage> callbacks;
+	};
+
+	typedef std::map<std::string, ModUsage> UsageMap;
+
+private:
+	struct Frame {
+		Usage *current;
+		const char *callback;
+	};
+
+public:
+	// Brackets a call from the engine into the script environment
+	class Scope {
+	public:
+		Scope(ScriptCpuAccounting &accounting) : m_accounting(accounting)
+		{
+			m_active = accounting.m_mode != OFF;
+			if (m_active)
+				accounting.enter(m_saved);
+		}
+
+		~Scope()
+		{
+			if (m_active)
+				m_accounting.leave(m_saved);
+		}
+
+		DISABLE_CLASS_COPY(Scope);
+
+	private:
+		ScriptCpuAccounting &m_accounting;
+		bool m_active;
+		Frame m_saved;
+	};
+
+	void setMode(Mode mode, u32 sample_interval);
+	Mode getMode() const { return m_mode; }
+
+	// Sets the kind of callback that is about to run and returns the old one.
+	// The name must be a string literal or otherwise outlive this object.
+	const char *setCallback(const char *callback)
+	{
+		const char *old = m_callback;
+		m_callback = callback;
+		return old;
+	}
+
+	// Called whenever the script origin changes
+	void switchTo(const std::string &mod)
+	{
+		if (m_measuring)
+			switchToRaw(mod);
+	}
+
+	void switchTo(const std::string &mod, const char *callback)
+	{
+		m_callback = callback;
+		if (m_measuring)
+			switchToRaw(mod);
+	}
+
+	void getUsage(UsageMap &dst) const;
+
+private:
+	// Usage per callback kind, keyed by the address of the name
+	typedef std::unordered_map<const char *, Usage> CallbackMap;
+
+	void enter(Frame &saved);
+	void leave(const Frame &saved);
+	void switchToRaw(const std::string &mod);
+	// Charges the time since the last switch to the current entry
+	void charge(u64 now);
+
+	Mode m_mode = OFF;
+	u32 m_sample_interval = 1;
+	u32 m_sample_counter = 0;
+	// Weight of a measured call
+	u32 m_scale = 1;
+
+	u32 m_depth = 0;
+	bool m_measuring = false;
+	u64 m_last_switch_us = 0;
+	Usage *m_current = nullptr;
+	const char *m_callback = nullptr;
+
+	std::unordered_map<std::string, CallbackMap> m_mods;
+	// Most callbacks in a row come from the same mod
+	std::string m_last_mod;
+	CallbackMap *m_last_mod_callbacks = nullptr;
+};
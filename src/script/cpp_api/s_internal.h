@@ -79,6 +79,7 @@ class LockChecker {
 #define SCRIPTAPI_PRECHECKHEADER                                               \
 		RecursiveMutexAutoLock scriptlock(this->m_luastackmutex);              \
 		SCRIPTAPI_LOCK_CHECK;                                                  \
+		ScriptCpuAccounting::Scope cpu_scope(this->m_cpu_accounting);          \
 		realityCheck();                                                        \
 		lua_State *L = getStack();                                             \
 		assert(lua_checkstack(L, 20));                                         \
@@ -250,7 +250,7 @@ bool ScriptApiItem::getItemCallback(const char *name, const char *callbackname,
 		luaL_checktype(L, -1, LUA_TTABLE);
 	}
 
-	setOriginFromTable(-1);
+	setOriginFromTableRaw(-1, callbackname);
 
 	lua_getfield(L, -1, callbackname);
 	lua_remove(L, -2); // Remove item def
@@ -70,6 +70,7 @@ void LuaABM::trigger(ServerEnvironment *env, v3s16 p, MapNode n,
 {
 	ServerScripting *scriptIface = env->getScriptIface();
 	scriptIface->realityCheck();
+	ScriptCpuAccounting::Scope cpu_scope(scriptIface->m_cpu_accounting);
 
 	lua_State *L = scriptIface->getStack();
 	sanity_check(lua_checkstack(L, 20));
@@ -114,6 +115,7 @@ void LuaLBM::trigger(ServerEnvironment *env, v3s16 p,
 {
 	ServerScripting *scriptIface = env->getScriptIface();
 	scriptIface->realityCheck();
+	ScriptCpuAccounting::Scope cpu_scope(scriptIface->m_cpu_accounting);
 
 	lua_State *L = scriptIface->getStack();
 	sanity_check(lua_checkstack(L, 20));
@@ -29,6 +29,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "environment.h"
 #include "remoteplayer.h"
 #include "log.h"
+#include "tracer.h"
 #include <algorithm>
 
 // request_shutdown()
@@ -503,6 +504,51 @@ int ModApiServer::l_get_worldpath(lua_State *L)
 	return 1;
 }
 
+// dump_trace()
+int ModApiServer::l_dump_trace(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+	if (!Tracer::isEnabled())
+		return 0;
+
+	std::string path = getServer(L)->dumpTrace();
+	if (path.empty())
+		return 0;
+	lua_pushstring(L, path.c_str());
+	return 1;
+}
+
+static void push_cpu_usage(lua_State *L, const ScriptCpuAccounting::Usage &usage)
+{
+	lua_createtable(L, 0, 2);
+	lua_pushnumber(L, usage.time_us * 1e-6);
+	lua_setfield(L, -2, "time");
+	lua_pushinteger(L, usage.calls);
+	lua_setfield(L, -2, "calls");
+}
+
+// get_mod_cpu_usage()
+int ModApiServer::l_get_mod_cpu_usage(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+	ScriptCpuAccounting::UsageMap usage;
+	if (!getScriptApiBase(L)->getCpuUsage(usage))
+		return 0;
+
+	lua_createtable(L, 0, usage.size());
+	for (const auto &mod : usage) {
+		push_cpu_usage(L, mod.second.total);
+		lua_createtable(L, 0, mod.second.callbacks.size());
+		for (const auto &callback : mod.second.callbacks) {
+			push_cpu_usage(L, callback.second);
+			lua_setfield(L, -2, callback.first.c_str());
+		}
+		lua_setfield(L, -2, "callbacks");
+		lua_setfield(L, -2, mod.first.c_str());
+	}
+	return 1;
+}
+
 // sound_play(spec, parameters, [ephemeral])
 int ModApiServer::l_sound_play(lua_State *L)
 {
@@ -673,6 +719,8 @@ void ModApiServer::Initialize(lua_State *L, int top)
 	API_FCT(get_server_uptime);
 	API_FCT(get_server_max_lag);
 	API_FCT(get_worldpath);
+	API_FCT(dump_trace);
+	API_FCT(get_mod_cpu_usage);
 	API_FCT(is_singleplayer);
 
 	API_FCT(get_current_modname);
@@ -39,6 +39,12 @@ class ModApiServer : public ModApiBase
 	// get_worldpath()
 	static int l_get_worldpath(lua_State *L);
 
+	// dump_trace()
+	static int l_dump_trace(lua_State *L);
+
+	// get_mod_cpu_usage()
+	static int l_get_mod_cpu_usage(lua_State *L);
+
 	// is_singleplayer()
 	static int l_is_singleplayer(lua_State *L);
 
@@ -20,9 +20,12 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "serialization.h"
 
 #include "util/serialize.h"
+#include "util/sha1.h"
 
+#include <algorithm>
 #include <zlib.h>
 #include <zstd.h>
+#include <zdict.h>
 
 /* report a zlib or i/o error */
 static void zerr(int ret)
@@ -295,6 +298,140 @@ void decompressZstd(std::istream &is, std::ostream &os)
 	}
 }
 
+ZstdDictionary::ZstdDictionary(const std::string &data, int level):
+	m_data(data)
+{
+	// Untrained data would be used as plain content without an id
+	m_id = ZSTD_getDictID_fromDict(m_data.data(), m_data.size());
+	if (m_id == 0)
+		throw SerializationError("ZstdDictionary: not a trained dictionary");
+
+	m_cdict = ZSTD_createCDict(m_data.data(), m_data.size(), level);
+	m_ddict = ZSTD_createDDict(m_data.data(), m_data.size());
+	if (!m_cdict || !m_ddict) {
+		ZSTD_freeCDict(m_cdict);
+		ZSTD_freeDDict(m_ddict);
+		throw SerializationError("ZstdDictionary: invalid dictionary");
+	}
+}
+
+ZstdDictionary::~ZstdDictionary()
+{
+	ZSTD_freeCDict(m_cdict);
+	ZSTD_freeDDict(m_ddict);
+}
+
+std::string ZstdDictionary::train(const std::vector<std::string> &samples,
+	size_t max_size)
+{
+	std::string buffer;
+	std::vector<size_t> sizes;
+	sizes.reserve(samples.size());
+	for (const std::string &sample : samples) {
+		buffer.append(sample);
+		sizes.push_back(sample.size());
+	}
+
+	std::string dict(max_size, '\0');
+	size_t ret = ZDICT_trainFromBuffer(&dict[0], dict.size(),
+		buffer.data(), sizes.data(), sizes.size());
+	if (ZDICT_isError(ret)) {
+		throw SerializationError(std::string("ZstdDictionary::train(): ") +
+			ZDICT_getErrorName(ret));
+	}
+	dict.resize(ret);
+	return dict;
+}
+
+void compressZstd(const u8 *data, size_t data_size, std::ostream &os,
+	const ZstdDictionary &dict)
+{
+	// reusing the context is recommended for performance
+	// it will be destroyed when the thread ends
+	thread_local std::unique_ptr<ZSTD_CCtx, ZSTD_Deleter> ctx(ZSTD_createCCtx());
+	thread_local std::string buffer;
+
+	buffer.resize(ZSTD_compressBound(data_size));
+	size_t ret = ZSTD_compress_usingCDict(ctx.get(), &buffer[0], buffer.size(),
+		data, data_size, dict.getCDict());
+	if (ZSTD_isError(ret)) {
+		dstream << ZSTD_getErrorName(ret) << std::endl;
+		throw SerializationError("compressZstd: failed");
+	}
+	os.write(buffer.data(), ret);
+}
+
+size_t decompressZstd(const u8 *data, size_t data_size, std::string &out,
+	const ZstdDictionary *dict)
+{
+	// reusing the context is recommended for performance
+	// it will be destroyed when the thread ends
+	thread_local std::unique_ptr<ZSTD_DStream, ZSTD_Deleter> stream(ZSTD_createDStream());
+
+	// Anything after the frame belongs to the caller
+	const size_t frame_size = ZSTD_findFrameCompressedSize(data, data_size);
+	if (ZSTD_isError(frame_size)) {
+		dstream << ZSTD_getErrorName(frame_size) << std::endl;
+		throw SerializationError("decompressZstd: failed");
+	}
+
+	const ZSTD_DDict *ddict = nullptr;
+	if (unsigned dict_id = ZSTD_getDictID_fromFrame(data, frame_size)) {
+		if (!dict || dict->getId() != dict_id)
+			throw SerializationError("decompressZstd: missing dictionary " +
+				std::to_string(dict_id));
+		ddict = dict->getDDict();
+	}
+
+	// Decompress in one go if the frame tells how much space it needs,
+	// an untrusted size is not worth allocating up front
+	const unsigned long long content_size = ZSTD_getFrameContentSize(data, frame_size);
+	if (content_size != ZSTD_CONTENTSIZE_UNKNOWN &&
+			content_size != ZSTD_CONTENTSIZE_ERROR &&
+			content_size <= 16 * 1024 * 1024) {
+		out.resize(content_size);
+		size_t ret = ddict ?
+			ZSTD_decompress_usingDDict(stream.get(), &out[0], out.size(),
+				data, frame_size, ddict) :
+			ZSTD_decompress_usingDict(stream.get(), &out[0], out.size(),
+				data, frame_size, nullptr, 0);
+		if (ZSTD_isError(ret) || ret != content_size) {
+			if (ZSTD_isError(ret))
+				dstream << ZSTD_getErrorName(ret) << std::endl;
+			throw SerializationError("decompressZstd: failed");
+		}
+		return frame_size;
+	}
+
+	// Otherwise stream straight into 'out', keeping the space it already has
+	ZSTD_DCtx_reset(stream.get(), ZSTD_reset_session_only);
+	ZSTD_DCtx_refDDict(stream.get(), ddict);
+	out.resize(std::max(out.capacity(), ZSTD_DStreamOutSize()));
+
+	ZSTD_inBuffer input = { data, frame_size, 0 };
+	ZSTD_outBuffer output = { &out[0], out.size(), 0 };
+	size_t ret;
+	do
+	{
+		if (output.pos == output.size) {
+			out.resize(out.size() * 2);
+			output.dst = &out[0];
+			output.size = out.size();
+		}
+
+		ret = ZSTD_decompressStream(stream.get(), &output, &input);
+		if (ZSTD_isError(ret)) {
+			dstream << ZSTD_getErrorName(ret) << std::endl;
+			throw SerializationError("decompressZstd: failed");
+		}
+		if (ret != 0 && input.pos == input.size && output.pos < output.size)
+			throw SerializationError("decompressZstd: truncated frame");
+	} while (ret != 0);
+
+	out.resize(output.pos);
+	return input.pos;
+}
+
 void compress(u8 *data, u32 size, std::ostream &os, u8 version, int level)
 {
 	if(version >= 29)
@@ -400,3 +537,15 @@ void decompress(std::istream &is, std::ostream &os, u8 version)
 }
 
 
+
+u64 hashSerializedBlock(const std::string &data, u8 version)
+{
+	SHA1 sha1;
+	sha1.addBytes((const char *)&version, 1);
+	sha1.addBytes(data.c_str(), data.size());
+
+	unsigned char *digest = sha1.getDigest();
+	u64 hash = readU64(digest);
+	free(digest);
+	return hash;
+}
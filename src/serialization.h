@@ -22,6 +22,9 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "irrlichttypes.h"
 #include "exceptions.h"
 #include <iostream>
+#include <string>
+#include <vector>
+#include "util/basic_macros.h"
 #include "util/pointer.h"
 
 /*
@@ -93,9 +96,55 @@ void decompressZlib(std::istream &is, std::ostream &os, size_t limit = 0);
 void compressZstd(const u8 *data, size_t data_size, std::ostream &os, int level = 0);
 void compressZstd(const std::string &data, std::ostream &os, int level = 0);
 void decompressZstd(std::istream &is, std::ostream &os);
+struct ZSTD_CDict_s;
+struct ZSTD_DDict_s;
+
+/*
+	A zstd dictionary trained on samples of the data to compress, which makes
+	a big difference for small inputs like single MapBlocks. Frames compressed
+	with it carry its id, so they can't be mixed up with plain ones.
+	Can be used by several threads at once.
+*/
+class ZstdDictionary
+{
+public:
+	// Throws SerializationError if 'data' is not a trained dictionary.
+	// 'level' is the zstd compression level, 0 for the default.
+	ZstdDictionary(const std::string &data, int level = 0);
+	~ZstdDictionary();
+	DISABLE_CLASS_COPY(ZstdDictionary)
+
+	// Returns a dictionary of at most 'max_size' bytes, throws
+	// SerializationError if there are not enough samples
+	static std::string train(const std::vector<std::string> &samples,
+		size_t max_size);
+
+	u32 getId() const { return m_id; }
+	const std::string &getData() const { return m_data; }
+
+	ZSTD_CDict_s *getCDict() const { return m_cdict; }
+	ZSTD_DDict_s *getDDict() const { return m_ddict; }
+
+private:
+	const std::string m_data;
+	u32 m_id = 0;
+	ZSTD_CDict_s *m_cdict = nullptr;
+	ZSTD_DDict_s *m_ddict = nullptr;
+};
+
+void compressZstd(const u8 *data, size_t data_size, std::ostream &os,
+	const ZstdDictionary &dict);
+// Decompresses the zstd frame at the start of 'data' into 'out', reusing its
+// storage. Returns the size of the frame, anything after it is left alone.
+// Frames made with a dictionary need 'dict' to be that dictionary.
+size_t decompressZstd(const u8 *data, size_t data_size, std::string &out,
+	const ZstdDictionary *dict = nullptr);
 
 // These choose between zlib and a self-made one according to version
 void compress(const SharedBuffer<u8> &data, std::ostream &os, u8 version, int level = -1);
 void compress(const std::string &data, std::ostream &os, u8 version, int level = -1);
 void compress(u8 *data, u32 size, std::ostream &os, u8 version, int level = -1);
 void decompress(std::istream &is, std::ostream &os, u8 version);
+
+// Hash of a block as serialized for the network, used by the client block cache
+u64 hashSerializedBlock(const std::string &data, u8 version);
@@ -35,8 +35,11 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "filesys.h"
 #include "mapblock.h"
 #include "server/serveractiveobject.h"
+#include "server/aombroadcast.h"
+#include "nodechangebatch.h"
 #include "settings.h"
 #include "profiler.h"
+#include "tracer.h"
 #include "log.h"
 #include "scripting_server.h"
 #include "nodedef.h"
@@ -121,7 +124,8 @@ void *ServerThread::run()
 	float dtime = 0.0f;
 
 	while (!stopRequested()) {
-		ScopeProfiler spm(g_profiler, "Server::RunStep() (max)", SPT_MAX);
+		static const auto spm_id = ScopeProfiler::intern("Server::RunStep() (max)");
+		ScopeProfiler spm(g_profiler, spm_id, SPT_MAX);
 
 		u64 t0 = porting::getTimeUs();
 
@@ -129,6 +133,7 @@ void *ServerThread::run()
 
 		try {
 			m_server->AsyncRunStep(step_settings.pause ? 0.0f : dtime);
+			m_server->reportStepTime(porting::getTimeUs() - t0);
 
 			const float remaining_time = step_settings.steplen
 					- 1e-6f * (porting::getTimeUs() - t0);
@@ -280,7 +285,20 @@ Server::Server(
 #else
 	if (true)
 #endif
-		m_metrics_backend = std::make_unique<MetricsBackend>();
+	{
+		m_metrics_dump_period = g_settings->getFloat("metrics_dump_interval");
+		if (m_metrics_dump_period > 0.0f) {
+			auto backend = std::make_unique<TextMetricsBackend>();
+			m_text_metrics_backend = backend.get();
+			m_metrics_backend = std::move(backend);
+		} else {
+			m_metrics_backend = std::make_unique<MetricsBackend>();
+		}
+	}
+
+	Tracer::setEnabled(g_settings->getBool("profiler_tracing"));
+	m_trace_step_threshold_us =
+			(u64)g_settings->getU32("profiler_trace_step_threshold") * 1000;
 
 	m_uptime_counter = m_metrics_backend->addCounter("minetest_core_server_uptime", "Server uptime (in seconds)");
 	m_player_gauge = m_metrics_backend->addGauge("minetest_core_player_number", "Number of connected players");
@@ -315,6 +333,23 @@ Server::Server(
 			"minetest_core_map_edit_events",
 			"Number of map edit events");
 
+	// 1 ms to ~16 s
+	const auto latency_buckets = MetricHistogram::exponentialBuckets(0.001, 2.0, 15);
+
+	m_step_time_histogram = m_metrics_backend->addHistogram(
+			"minetest_core_server_step_seconds",
+			"Duration of a server step (in seconds)", latency_buckets);
+
+	m_block_send_latency_histogram = m_metrics_backend->addHistogram(
+			"minetest_core_block_send_latency_seconds",
+			"Time from sending a block until the client acknowledges it (in seconds)",
+			latency_buckets);
+
+	m_rtt_histogram = m_metrics_backend->addHistogram(
+			"minetest_core_peer_rtt_seconds",
+			"Round trip time to the clients, sampled every second (in seconds)",
+			latency_buckets);
+
 	m_lag_gauge->set(g_settings->getFloat("dedicated_server_step"));
 }
 
@@ -454,6 +489,14 @@ void Server::init()
 
 	m_script = new ServerScripting(this);
 
+	{
+		const std::string mode = g_settings->get("lua_cpu_accounting");
+		m_script->setCpuAccounting(mode == "full" ? ScriptCpuAccounting::FULL :
+				mode == "sampled" ? ScriptCpuAccounting::SAMPLED :
+				ScriptCpuAccounting::OFF,
+				g_settings->getU32("lua_cpu_accounting_sample_interval"));
+	}
+
 	// Must be created before mod loading because we have some inventory creation
 	m_inventory_mgr = std::make_unique<ServerInventoryManager>();
 
@@ -615,7 +658,8 @@ void Server::AsyncRunStep(float dtime, bool initial_step)
 	if ((dtime < 0.001f) && !initial_step)
 		return;
 
-	ScopeProfiler sp(g_profiler, "Server::AsyncRunStep()", SPT_AVG);
+	static const auto sp_id = ScopeProfiler::intern("Server::AsyncRunStep()");
+	ScopeProfiler sp(g_profiler, sp_id, SPT_AVG);
 
 	/*
 		Update uptime
@@ -665,7 +709,8 @@ void Server::AsyncRunStep(float dtime, bool initial_step)
 	{
 		MutexAutoLock lock(m_env_mutex);
 		// Run Map's timers and unload unused data
-		ScopeProfiler sp(g_profiler, "Server: map timer and unload");
+		static const auto sp_id = ScopeProfiler::intern("Server: map timer and unload");
+		ScopeProfiler sp(g_profiler, sp_id);
 		m_env->getMap().timerUpdate(map_timer_and_unload_dtime,
 			std::max(g_settings->getFloat("server_unload_unused_data_timeout"), 0.0f),
 			-1);
@@ -704,7 +749,8 @@ void Server::AsyncRunStep(float dtime, bool initial_step)
 
 		MutexAutoLock lock(m_env_mutex);
 
-		ScopeProfiler sp(g_profiler, "Server: liquid transform");
+		static const auto sp_id = ScopeProfiler::intern("Server: liquid transform");
+		ScopeProfiler sp(g_profiler, sp_id);
 
 		std::map<v3s16, MapBlock*> modified_blocks;
 		m_env->getServerMap().transformLiquids(modified_blocks, m_env);
@@ -768,7 +814,8 @@ void Server::AsyncRunStep(float dtime, bool initial_step)
 		{
 			ClientInterface::AutoLock clientlock(m_clients);
 			const RemoteClientMap &clients = m_clients.getClientList();
-			ScopeProfiler sp(g_profiler, "Server: update objects within range");
+			static const auto sp_id = ScopeProfiler::intern("Server: update objects within range");
+			ScopeProfiler sp(g_profiler, sp_id);
 
 			m_player_gauge->set(clients.size());
 			for (const auto &client_it : clients) {
@@ -803,11 +850,11 @@ void Server::AsyncRunStep(float dtime, bool initial_step)
 	*/
 	{
 		MutexAutoLock envlock(m_env_mutex);
-		ScopeProfiler sp(g_profiler, "Server: send SAO messages");
+		static const auto sp_id = ScopeProfiler::intern("Server: send SAO messages");
+		ScopeProfiler sp(g_profiler, sp_id);
 
-		// Key = object id
-		// Value = data sent by object
-		std::unordered_map<u16, std::vector<ActiveObjectMessage>*> buffered_messages;
+		// Messages are grouped by object and encoded only once
+		server::AOMessageBroadcast broadcast;
 
 		// Get active object messages from environment
 		ActiveObjectMessage aom(0);
@@ -820,82 +867,75 @@ void Server::AsyncRunStep(float dtime, bool initial_step)
 			else
 				count_unreliable++;
 
-			std::vector<ActiveObjectMessage>* message_list = nullptr;
-			auto n = buffered_messages.find(aom.id);
-			if (n == buffered_messages.end()) {
-				message_list = new std::vector<ActiveObjectMessage>;
-				buffered_messages[aom.id] = message_list;
-			} else {
-				message_list = n->second;
-			}
-			message_list->push_back(std::move(aom));
+			broadcast.push(aom);
 		}
 
 		m_aom_buffer_counter[0]->increment(count_reliable);
 		m_aom_buffer_counter[1]->increment(count_unreliable);
 
-		{
+		if (!broadcast.empty()) {
+			broadcast.encode();
+
+			// Look up every object only once instead of once per client
+			const auto &batches = broadcast.getBatches();
+			std::vector<ServerActiveObject *> saos;
+			saos.reserve(batches.size());
+			for (const auto &batch : batches)
+				saos.push_back(m_env->getActiveObject(batch.id));
+
+			// Payload -> peers that receive it, per channel (reliable, unreliable)
+			std::unordered_map<const std::string *, std::vector<session_t>> recipients[2];
+			// Keeps the payloads alive until they are sent
+			std::vector<server::AOMessageBroadcast::Payload> payloads;
+
 			ClientInterface::AutoLock clientlock(m_clients);
 			const RemoteClientMap &clients = m_clients.getClientList();
 			// Route data to every client
-			std::string reliable_data, unreliable_data;
 			for (const auto &client_it : clients) {
-				reliable_data.clear();
-				unreliable_data.clear();
 				RemoteClient *client = client_it.second;
 				PlayerSAO *player = getPlayerSAO(client->peer_id);
-				// Go through all objects in message buffer
-				for (const auto &buffered_message : buffered_messages) {
+				const auto &known = client->m_known_objects;
+
+				auto payload = broadcast.build([&] (size_t i,
+						const server::AOMessageBroadcast::Batch &batch) {
 					// If object does not exist or is not known by client, skip it
-					u16 id = buffered_message.first;
-					ServerActiveObject *sao = m_env->getActiveObject(id);
-					if (!sao || client->m_known_objects.find(id) == client->m_known_objects.end())
-						continue;
+					ServerActiveObject *sao = saos[i];
+					if (!sao || known.find(batch.id) == known.end())
+						return server::AOMessageBroadcast::SELECT_NONE;
 
-					// Get message list of object
-					std::vector<ActiveObjectMessage>* list = buffered_message.second;
-					// Go through every message
-					for (const ActiveObjectMessage &aom : *list) {
-						// Send position updates to players who do not see the attachment
-						if (aom.datastring[0] == AO_CMD_UPDATE_POSITION) {
-							if (sao->getId() == player->getId())
-								continue;
-
-							// Do not send position updates for attached players
-							// as long the parent is known to the client
-							ServerActiveObject *parent = sao->getParent();
-							if (parent && client->m_known_objects.find(parent->getId()) !=
-									client->m_known_objects.end())
-								continue;
-						}
-
-						// Add full new data to appropriate buffer
-						std::string &buffer = aom.reliable ? reliable_data : unreliable_data;
-						char idbuf[2];
-						writeU16((u8*) idbuf, aom.id);
-						// u16 id
-						// std::string data
-						buffer.append(idbuf, sizeof(idbuf));
-						buffer.append(serializeString16(aom.datastring));
-					}
-				}
-				/*
-					reliable_data and unreliable_data are now ready.
-					Send them.
-				*/
-				if (!reliable_data.empty()) {
-					SendActiveObjectMessages(client->peer_id, reliable_data);
-				}
+					if (!batch.has_position)
+						return server::AOMessageBroadcast::SELECT_ALL;
+
+					// Send position updates to players who do not see the attachment
+					if (player && sao->getId() == player->getId())
+						return server::AOMessageBroadcast::SELECT_NO_POSITION;
+
+					// Do not send position updates for attached players
+					// as long the parent is known to the client
+					ServerActiveObject *parent = sao->getParent();
+					if (parent && known.find(parent->getId()) != known.end())
+						return server::AOMessageBroadcast::SELECT_NO_POSITION;
+
+					return server::AOMessageBroadcast::SELECT_ALL;
+				});
 
-				if (!unreliable_data.empty()) {
-					SendActiveObjectMessages(client->peer_id, unreliable_data, false);
+				if (payload.empty())
+					continue;
+				for (int channel = 0; channel < 2; channel++) {
+					if (payload.data[channel])
+						recipients[channel][payload.data[channel].get()].push_back(client->peer_id);
 				}
+				payloads.push_back(std::move(payload));
 			}
-		}
 
-		// Clear buffered_messages
-		for (auto &buffered_message : buffered_messages) {
-			delete buffered_message.second;
+			/*
+				Every distinct payload is now ready.
+				Send each one to all of its recipients.
+			*/
+			for (int channel = 0; channel < 2; channel++) {
+				for (const auto &it : recipients[channel])
+					SendActiveObjectMessages(it.second, *it.first, channel == 0);
+			}
 		}
 	}
 
@@ -915,34 +955,58 @@ void Server::AsyncRunStep(float dtime, bool initial_step)
 		m_map_edit_event_counter->increment(event_count);
 
 		// We'll log the amount of each
-		Profiler prof;
+		static const Profiler::SectionId meet_addnode_id =
+			Profiler::intern("MEET_ADDNODE");
+		static const Profiler::SectionId meet_removenode_id =
+			Profiler::intern("MEET_REMOVENODE");
+		static const Profiler::SectionId meet_meta_id =
+			Profiler::intern("MEET_BLOCK_NODE_METADATA_CHANGED");
+		static const Profiler::SectionId meet_other_id =
+			Profiler::intern("MEET_OTHER");
+		static const Profiler::SectionId meet_unknown_id =
+			Profiler::intern("unknown");
+		Profiler &prof = m_map_edit_profiler;
+		prof.clear();
 
 		std::unordered_set<v3s16> node_meta_updates;
 
+		// Node changes are collected per block and sent as one packet each
+		struct PendingNodeBatch {
+			NodeChangeBatch batch;
+			std::set<v3s16> modified_blocks;
+		};
+		std::map<v3s16, PendingNodeBatch> node_batches;
+
+		auto add_node_change = [&] (const MapEditEvent *event, MapNode n,
+				bool keep_metadata) {
+			v3s16 blockpos = getNodeBlockPos(event->p);
+			auto it = node_batches.find(blockpos);
+			if (it == node_batches.end()) {
+				it = node_batches.emplace(blockpos,
+					PendingNodeBatch{NodeChangeBatch(blockpos), {}}).first;
+			}
+			it->second.batch.add(event->p - blockpos * MAP_BLOCKSIZE, n,
+				keep_metadata);
+			it->second.modified_blocks.insert(event->modified_blocks.begin(),
+				event->modified_blocks.end());
+		};
+
 		while (!m_unsent_map_edit_queue.empty()) {
 			MapEditEvent* event = m_unsent_map_edit_queue.front();
 			m_unsent_map_edit_queue.pop();
 
-			// Players far away from the change are stored here.
-			// Instead of sending the changes, MapBlocks are set not sent
-			// for them.
-			std::unordered_set<u16> far_players;
-
 			switch (event->type) {
 			case MEET_ADDNODE:
 			case MEET_SWAPNODE:
-				prof.add("MEET_ADDNODE", 1);
-				sendAddNode(event->p, event->n, &far_players,
-						disable_single_change_sending ? 5 : 30,
-						event->type == MEET_ADDNODE);
+				prof.add(meet_addnode_id, 1);
+				add_node_change(event, event->n, event->type == MEET_SWAPNODE);
 				break;
 			case MEET_REMOVENODE:
-				prof.add("MEET_REMOVENODE", 1);
-				sendRemoveNode(event->p, &far_players,
-						disable_single_change_sending ? 5 : 30);
+				prof.add(meet_removenode_id, 1);
+				add_node_change(event, MapNode(CONTENT_AIR), false);
 				break;
 			case MEET_BLOCK_NODE_METADATA_CHANGED: {
-				prof.add("MEET_BLOCK_NODE_METADATA_CHANGED", 1);
+				prof.add(meet_meta_id, 1);
 				if (!event->is_private_change) {
 					node_meta_updates.emplace(event->p);
 				}
@@ -955,36 +1019,18 @@ void Server::AsyncRunStep(float dtime, bool initial_step)
 				break;
 			}
 			case MEET_OTHER:
-				prof.add("MEET_OTHER", 1);
+				prof.add(meet_other_id, 1);
 				for (const v3s16 &modified_block : event->modified_blocks) {
 					m_clients.markBlockposAsNotSent(modified_block);
 				}
 				break;
 			default:
-				prof.add("unknown", 1);
+				prof.add(meet_unknown_id, 1);
 				warningstream << "Server: Unknown MapEditEvent "
 						<< ((u32)event->type) << std::endl;
 				break;
 			}
 
-			/*
-				Set blocks not sent to far players
-			*/
-			if (!far_players.empty()) {
-				// Convert list format to that wanted by SetBlocksNotSent
-				std::map<v3s16, MapBlock*> modified_blocks2;
-				for (const v3s16 &modified_block : event->modified_blocks) {
-					modified_blocks2[modified_block] =
-							m_env->getMap().getBlockNoCreateNoEx(modified_block);
-				}
-
-				// Set blocks not sent
-				for (const u16 far_player : far_players) {
-					if (RemoteClient *client = getClient(far_player))
-						client->SetBlocksNotSent(modified_blocks2);
-				}
-			}
-
 			delete event;
 		}
 
@@ -996,6 +1042,12 @@ void Server::AsyncRunStep(float dtime, bool initial_step)
 			prof.print(verbosestream);
 		}
 
+		// Send all node changes, before the metadata that belongs to them
+		for (const auto &it : node_batches) {
+			sendNodeChangeBatch(it.second.batch, it.second.modified_blocks,
+					disable_single_change_sending ? 5 : 30);
+		}
+
 		// Send all metadata updates
 		if (!node_meta_updates.empty())
 			sendMetadataChanged(node_meta_updates);
@@ -1025,7 +1077,8 @@ void Server::AsyncRunStep(float dtime, bool initial_step)
 			counter = 0.0;
 			MutexAutoLock lock(m_env_mutex);
 
-			ScopeProfiler sp(g_profiler, "Server: map saving (sum)");
+			static const auto sp_id = ScopeProfiler::intern("Server: map saving (sum)");
+			ScopeProfiler sp(g_profiler, sp_id);
 
 			// Save ban file
 			if (m_banmanager->isModified()) {
@@ -1043,9 +1096,86 @@ void Server::AsyncRunStep(float dtime, bool initial_step)
 		}
 	}
 
+	if (m_lua_cpu_report_interval.step(dtime, 1.0f)) {
+		MutexAutoLock lock(m_env_mutex);
+		reportLuaCpuUsage();
+	}
+
+	if (m_text_metrics_backend &&
+			m_metrics_dump_interval.step(dtime, m_metrics_dump_period)) {
+		static const auto sp_id = ScopeProfiler::intern("Server: dump metrics");
+		ScopeProfiler sp(g_profiler, sp_id);
+
+		std::ostringstream os(std::ios_base::binary);
+		m_text_metrics_backend->dump(os);
+		const std::string path = m_path_world + DIR_DELIM + "metrics.prom";
+		if (!fs::safeWriteToFile(path, os.str()))
+			warningstream << "Failed to write metrics to " << path << std::endl;
+	}
+
 	m_shutdown_state.tick(dtime, this);
 }
 
+std::string Server::dumpTrace(u64 window_us)
+{
+	return Tracer::dumpToFile(m_path_world + DIR_DELIM + "traces", window_us);
+}
+
+void Server::reportLuaCpuUsage()
+{
+	ScriptCpuAccounting::UsageMap usage;
+	if (!m_script->getCpuUsage(usage))
+		return;
+
+	for (const auto &it : usage) {
+		LuaModMetrics &metrics = m_lua_mod_metrics[it.first];
+		if (!metrics.time_counter) {
+			metrics.time_counter = m_metrics_backend->addCounter(
+					"minetest_lua_mod_time_seconds",
+					"Time spent in Lua callbacks registered by a mod (in seconds)",
+					{{"mod", it.first}});
+			metrics.calls_counter = m_metrics_backend->addCounter(
+					"minetest_lua_mod_calls",
+					"Number of Lua callbacks registered by a mod that were run",
+					{{"mod", it.first}});
+			metrics.profiler_id = Profiler::intern("Lua: mod " + it.first + " [ms]");
+		}
+
+		const ScriptCpuAccounting::Usage &total = it.second.total;
+		const u64 time_us = total.time_us - metrics.reported.time_us;
+		metrics.time_counter->increment(time_us * 1e-6);
+		metrics.calls_counter->increment(total.calls - metrics.reported.calls);
+		g_profiler->add(metrics.profiler_id, time_us / 1000.0f);
+		metrics.reported = total;
+	}
+}
+
+void Server::reportStepTime(u64 step_us)
+{
+	m_step_time_histogram->observe(step_us * 1e-6);
+	traceSlowStep(step_us);
+}
+
+void Server::traceSlowStep(u64 step_us)
+{
+	if (m_trace_step_threshold_us == 0 || step_us < m_trace_step_threshold_us ||
+			!Tracer::isEnabled())
+		return;
+
+	// Don't flood the disk if every step is slow
+	const u64 now = porting::getTimeMs();
+	if (m_last_trace_dump_ms != 0 && now - m_last_trace_dump_ms < 10000)
+		return;
+	m_last_trace_dump_ms = now;
+
+	// The slow step and what happened right before it
+	const std::string path = dumpTrace(step_us + 2000000);
+	if (!path.empty()) {
+		warningstream << "Server step took " << step_us / 1000
+			<< " ms, timeline written to " << path << std::endl;
+	}
+}
+
 void Server::Receive(float timeout)
 {
 	const u64 t0 = porting::getTimeUs();
@@ -1173,7 +1303,8 @@ void Server::ProcessData(NetworkPacket *pkt)
 	// Environment is locked first.
 	MutexAutoLock envlock(m_env_mutex);
 
-	ScopeProfiler sp(g_profiler, "Server: Process network packet (sum)");
+	static const auto sp_id = ScopeProfiler::intern("Server: Process network packet (sum)");
+	ScopeProfiler sp(g_profiler, sp_id);
 	u32 peer_id = pkt->getPeerId();
 
 	try {
@@ -2141,17 +2272,18 @@ void Server::SendActiveObjectRemoveAdd(RemoteClient *client, PlayerSAO *playersa
 		<< "packet size is " << pkt.getSize() << std::endl;
 }
 
-void Server::SendActiveObjectMessages(session_t peer_id, const std::string &datas,
-		bool reliable)
+void Server::SendActiveObjectMessages(const std::vector<session_t> &peer_ids,
+		const std::string &datas, bool reliable)
 {
-	NetworkPacket pkt(TOCLIENT_ACTIVE_OBJECT_MESSAGES,
-			datas.size(), peer_id);
+	// The packet is built once and shared by all recipients
+	NetworkPacket pkt(TOCLIENT_ACTIVE_OBJECT_MESSAGES, datas.size());
 
 	pkt.putRawString(datas.c_str(), datas.size());
 
-	m_clients.send(pkt.getPeerId(),
-			reliable ? clientCommandFactoryTable[pkt.getCommand()].channel : 1,
-			&pkt, reliable);
+	const u8 channel = reliable ?
+			clientCommandFactoryTable[pkt.getCommand()].channel : 1;
+	for (session_t peer_id : peer_ids)
+		m_clients.send(peer_id, channel, &pkt, reliable);
 }
 
 void Server::SendCSMRestrictionFlags(session_t peer_id)
@@ -2303,34 +2435,33 @@ void Server::fadeSound(s32 handle, float step, float gain)
 		m_playing_sounds.erase(it);
 }
 
-void Server::sendRemoveNode(v3s16 p, std::unordered_set<u16> *far_players,
-		float far_d_nodes)
+void Server::sendNodeChangeBatch(const NodeChangeBatch &batch,
+		const std::set<v3s16> &modified_blocks, float far_d_nodes)
 {
-	v3f p_f = intToFloat(p, BS);
-	v3s16 block_pos = getNodeBlockPos(p);
-
-	NetworkPacket pkt(TOCLIENT_REMOVENODE, 6);
-	pkt << p;
-
-	sendNodeChangePkt(pkt, block_pos, p_f, far_d_nodes, far_players);
-}
+	const v3s16 block_pos = batch.getBlockPos();
+	const v3s16 block_pos_nodes = block_pos * MAP_BLOCKSIZE;
 
-void Server::sendAddNode(v3s16 p, MapNode n, std::unordered_set<u16> *far_players,
-		float far_d_nodes, bool remove_metadata)
-{
-	v3f p_f = intToFloat(p, BS);
-	v3s16 block_pos = getNodeBlockPos(p);
+	// Bounding box of the changed nodes, for the distance check
+	v3s16 minp(MAP_BLOCKSIZE, MAP_BLOCKSIZE, MAP_BLOCKSIZE);
+	v3s16 maxp(-1, -1, -1);
+	for (const auto &it : batch.getChanges()) {
+		const v3s16 relpos = NodeChangeBatch::indexToPos(it.first);
+		minp.X = std::min(minp.X, relpos.X);
+		minp.Y = std::min(minp.Y, relpos.Y);
+		minp.Z = std::min(minp.Z, relpos.Z);
+		maxp.X = std::max(maxp.X, relpos.X);
+		maxp.Y = std::max(maxp.Y, relpos.Y);
+		maxp.Z = std::max(maxp.Z, relpos.Z);
+	}
+	const v3f minp_f = intToFloat(block_pos_nodes + minp, BS);
+	const v3f maxp_f = intToFloat(block_pos_nodes + maxp, BS);
+	const float maxd = far_d_nodes * BS;
 
-	NetworkPacket pkt(TOCLIENT_ADDNODE, 6 + 2 + 1 + 1 + 1);
-	pkt << p << n.param0 << n.param1 << n.param2
-			<< (u8) (remove_metadata ? 0 : 1);
-	sendNodeChangePkt(pkt, block_pos, p_f, far_d_nodes, far_players);
-}
+	// Both packet types are built only once, if needed
+	std::unique_ptr<NetworkPacket> batch_pkt;
+	std::vector<NetworkPacket> legacy_pkts;
 
-void Server::sendNodeChangePkt(NetworkPacket &pkt, v3s16 block_pos,
-		v3f p, float far_d_nodes, std::unordered_set<u16> *far_players)
-{
-	float maxd = far_d_nodes * BS;
+	std::map<v3s16, MapBlock*> modified_blocks2;
 	std::vector<session_t> clients = m_clients.getClientIDs();
 	ClientInterface::AutoLock clientlock(m_clients);
 
@@ -2342,18 +2473,56 @@ void Server::sendNodeChangePkt(NetworkPacket &pkt, v3s16 block_pos,
 		RemotePlayer *player = m_env->getPlayer(client_id);
 		PlayerSAO *sao = player ? player->getPlayerSAO() : nullptr;
 
+		bool far = !client->isBlockSent(block_pos);
+		if (!far && sao) {
+			// Distance to the closest changed node
+			const v3f pos = sao->getBasePosition();
+			const v3f closest(rangelim(pos.X, minp_f.X, maxp_f.X),
+				rangelim(pos.Y, minp_f.Y, maxp_f.Y),
+				rangelim(pos.Z, minp_f.Z, maxp_f.Z));
+			far = pos.getDistanceFrom(closest) > maxd;
+		}
+
 		// If player is far away, only set modified blocks not sent
-		if (!client->isBlockSent(block_pos) || (sao &&
-				sao->getBasePosition().getDistanceFrom(p) > maxd)) {
-			if (far_players)
-				far_players->emplace(client_id);
-			else
-				client->SetBlockNotSent(block_pos);
+		if (far) {
+			if (modified_blocks2.empty()) {
+				for (const v3s16 &modified_block : modified_blocks) {
+					modified_blocks2[modified_block] =
+							m_env->getMap().getBlockNoCreateNoEx(modified_block);
+				}
+			}
+			client->SetBlocksNotSent(modified_blocks2);
 			continue;
 		}
 
-		// Send as reliable
-		m_clients.send(client_id, 0, &pkt, true);
+		if (client->net_proto_version >= NODE_BATCH_PROTOCOL_VERSION_MIN) {
+			if (!batch_pkt) {
+				std::ostringstream os(std::ios::binary);
+				batch.serialize(os);
+				std::string data = os.str();
+				batch_pkt = std::make_unique<NetworkPacket>(TOCLIENT_NODE_BATCH,
+						data.size());
+				batch_pkt->putRawString(data.c_str(), data.size());
+			}
+			// Send as reliable
+			m_clients.send(client_id, 0, batch_pkt.get(), true);
+			continue;
+		}
+
+		// Older clients need one packet per node
+		if (legacy_pkts.empty()) {
+			legacy_pkts.reserve(batch.size());
+			for (const auto &it : batch.getChanges()) {
+				const MapNode &n = it.second.n;
+				legacy_pkts.emplace_back(TOCLIENT_ADDNODE, 6 + 2 + 1 + 1 + 1);
+				legacy_pkts.back() << (block_pos_nodes +
+						NodeChangeBatch::indexToPos(it.first))
+					<< n.param0 << n.param1 << n.param2
+					<< (u8) (it.second.keep_metadata ? 1 : 0);
+			}
+		}
+		for (NetworkPacket &pkt : legacy_pkts)
+			m_clients.send(client_id, 0, &pkt, true);
 	}
 }
 
@@ -2410,7 +2579,8 @@ void Server::sendMetadataChanged(const std::unordered_set<v3s16> &positions, flo
 }
 
 void Server::SendBlockNoLock(session_t peer_id, MapBlock *block, u8 ver,
-		u16 net_proto_version, SerializedBlockCache *cache)
+		u16 net_proto_version, SerializedBlockCache *cache,
+		const u64 *cached_hash)
 {
 	thread_local const int net_compression_level = rangelim(g_settings->getS16("map_compression_level_net"), -1, 9);
 	std::string s, *sptr = nullptr;
@@ -2430,10 +2600,17 @@ void Server::SendBlockNoLock(session_t peer_id, MapBlock *block, u8 ver,
 		sptr = &s;
 	}
 
-	NetworkPacket pkt(TOCLIENT_BLOCKDATA, 2 + 2 + 2 + sptr->size(), peer_id);
-	pkt << block->getPos();
-	pkt.putRawString(*sptr);
-	Send(&pkt);
+	if (cached_hash && *cached_hash == hashSerializedBlock(*sptr, ver)) {
+		// The client has this very data already
+		NetworkPacket pkt(TOCLIENT_BLOCKDATA_CACHED, 2 + 2 + 2 + 8, peer_id);
+		pkt << block->getPos() << *cached_hash;
+		Send(&pkt);
+	} else {
+		NetworkPacket pkt(TOCLIENT_BLOCKDATA, 2 + 2 + 2 + sptr->size(), peer_id);
+		pkt << block->getPos();
+		pkt.putRawString(*sptr);
+		Send(&pkt);
+	}
 
 	// Store away in cache
 	if (cache && sptr == &s)
@@ -2447,12 +2624,15 @@ void Server::SendBlocks(float dtime)
 
 	std::vector<PrioritySortedBlockTransfer> queue;
 
-	u32 total_sending = 0, unique_clients = 0;
+	u32 total_sending = 0, unique_clients = 0, total_budget = 0;
+	const bool sample_rtt = m_rtt_sample_interval.step(dtime, 1.0f);
 
 	{
-		ScopeProfiler sp2(g_profiler, "Server::SendBlocks(): Collect list");
+		static const auto sp2_id = ScopeProfiler::intern("Server::SendBlocks(): Collect list");
+		ScopeProfiler sp2(g_profiler, sp2_id);
 
 		std::vector<session_t> clients = m_clients.getClientIDs();
+		const u8 block_channel = clientCommandFactoryTable[TOCLIENT_BLOCKDATA].channel;
 
 		ClientInterface::AutoLock clientlock(m_clients);
 		for (const session_t client_id : clients) {
@@ -2461,6 +2641,14 @@ void Server::SendBlocks(float dtime)
 			if (!client)
 				continue;
 
+			con::PeerLinkStats link_stats;
+			if (m_con->getPeerLinkStats(client_id, block_channel, link_stats)) {
+				client->updateSendBudget(dtime, link_stats);
+				if (sample_rtt && link_stats.avg_rtt >= 0.0f)
+					m_rtt_histogram->observe(link_stats.avg_rtt);
+			}
+			total_budget += client->getSendBudget();
+
 			total_sending += client->getSendingCount();
 			const auto old_count = queue.size();
 			client->GetNextBlocks(m_env,m_emerge, dtime, queue);
@@ -2479,8 +2667,13 @@ void Server::SendBlocks(float dtime)
 	// The per-client block sends is halved with the maximal online users
 	u32 max_blocks_to_send = (m_env->getPlayerCount() + g_settings->getU32("max_users")) *
 		g_settings->getU32("max_simultaneous_block_sends_per_client") / 4 + 1;
+	// Adaptive budgets already follow what each link can take, so don't
+	// hold back fast clients because of the static formula above
+	if (g_settings->getBool("adaptive_block_send"))
+		max_blocks_to_send = std::max(max_blocks_to_send, total_budget);
 
-	ScopeProfiler sp(g_profiler, "Server::SendBlocks(): Send to clients");
+	static const auto sp_id = ScopeProfiler::intern("Server::SendBlocks(): Send to clients");
+	ScopeProfiler sp(g_profiler, sp_id);
 	Map &map = m_env->getMap();
 
 	SerializedBlockCache cache, *cache_ptr = nullptr;
@@ -2502,8 +2695,11 @@ void Server::SendBlocks(float dtime)
 		if (!client)
 			continue;
 
+		u64 cached_hash;
+		const bool cached = client->takeCachedBlock(block_to_send.pos, &cached_hash);
 		SendBlockNoLock(block_to_send.peer_id, block, client->serialization_version,
-				client->net_proto_version, cache_ptr);
+				client->net_proto_version, cache_ptr,
+				cached ? &cached_hash : nullptr);
 
 		client->SentBlock(block_to_send.pos);
 		total_sending++;
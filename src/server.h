@@ -33,6 +33,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "util/thread.h"
 #include "util/basic_macros.h"
 #include "util/metricsbackend.h"
+#include "profiler.h"
+#include "script/cpp_api/s_cpuaccounting.h"
 #include "serverenvironment.h"
 #include "clientiface.h"
 #include "chatmessage.h"
@@ -42,6 +44,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <string>
 #include <list>
 #include <map>
+#include <set>
 #include <vector>
 #include <unordered_set>
 
@@ -57,6 +60,7 @@ class Inventory;
 class ModChannelMgr;
 class RemotePlayer;
 class PlayerSAO;
+class NodeChangeBatch;
 struct PlayerHPChangeReason;
 class IRollbackManager;
 struct RollbackAction;
@@ -203,6 +207,7 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 	void handleCommand_SrpBytesM(NetworkPacket* pkt);
 	void handleCommand_HaveMedia(NetworkPacket *pkt);
 	void handleCommand_UpdateClientInfo(NetworkPacket *pkt);
+	void handleCommand_HaveBlocks(NetworkPacket* pkt);
 
 	void ProcessData(NetworkPacket *pkt);
 
@@ -307,6 +312,11 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 	void setStepSettings(StepSettings spdata) { m_step_settings.store(spdata); }
 	StepSettings getStepSettings() { return m_step_settings.load(); }
 
+	// Writes the recent timeline into the world directory, returns the path
+	std::string dumpTrace(u64 window_us = 0);
+	// Called with the duration of every server step
+	void reportStepTime(u64 step_us);
+
 	inline void setAsyncFatalError(const std::string &error)
 			{ m_async_fatal_error.set(error); }
 	inline void setAsyncFatalError(const LuaError &e)
@@ -416,6 +426,7 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 	friend class EmergeThread;
 	friend class RemoteClient;
 	friend class TestServerShutdownState;
+	friend class BenchmarkServer;
 
 	struct ShutdownState {
 		friend class TestServerShutdownState;
@@ -490,26 +501,23 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 			const std::string &message, session_t from_peer);
 
 	/*
-		Send a node removal/addition event to all clients except ignore_id.
-		Additionally, if far_players!=NULL, players further away than
-		far_d_nodes are ignored and their peer_ids are added to far_players
+		Send the node changes of one block to all clients.
+		Clients further away than far_d_nodes only get the modified blocks
+		set not sent.
 	*/
-	// Envlock and conlock should be locked when calling these
-	void sendRemoveNode(v3s16 p, std::unordered_set<u16> *far_players = nullptr,
-			float far_d_nodes = 100);
-	void sendAddNode(v3s16 p, MapNode n,
-			std::unordered_set<u16> *far_players = nullptr,
-			float far_d_nodes = 100, bool remove_metadata = true);
-	void sendNodeChangePkt(NetworkPacket &pkt, v3s16 block_pos,
-			v3f p, float far_d_nodes, std::unordered_set<u16> *far_players);
+	// Envlock should be locked when calling this
+	void sendNodeChangeBatch(const NodeChangeBatch &batch,
+			const std::set<v3s16> &modified_blocks, float far_d_nodes = 100);
 
 	void sendMetadataChanged(const std::unordered_set<v3s16> &positions,
 			float far_d_nodes = 100);
 
 	// Environment and Connection must be locked when called
 	// `cache` may only be very short lived! (invalidation not handeled)
+	// If cached_hash is given and matches, TOCLIENT_BLOCKDATA_CACHED is sent
 	void SendBlockNoLock(session_t peer_id, MapBlock *block, u8 ver,
-		u16 net_proto_version, SerializedBlockCache *cache = nullptr);
+		u16 net_proto_version, SerializedBlockCache *cache = nullptr,
+		const u64 *cached_hash = nullptr);
 
 	// Sends blocks to clients (locks env and con on its own)
 	void SendBlocks(float dtime);
@@ -533,8 +541,8 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 		const ParticleParameters &p);
 
 	void SendActiveObjectRemoveAdd(RemoteClient *client, PlayerSAO *playersao);
-	void SendActiveObjectMessages(session_t peer_id, const std::string &datas,
-		bool reliable = true);
+	void SendActiveObjectMessages(const std::vector<session_t> &peer_ids,
+		const std::string &datas, bool reliable = true);
 	void SendCSMRestrictionFlags(session_t peer_id);
 
 	/*
@@ -597,6 +605,15 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 	float m_emergethread_trigger_timer = 0.0f;
 	float m_savemap_timer = 0.0f;
 	IntervalLimiter m_map_timer_and_unload_interval;
+	IntervalLimiter m_rtt_sample_interval;
+	IntervalLimiter m_metrics_dump_interval;
+	IntervalLimiter m_lua_cpu_report_interval;
+
+	// Timeline dumps of slow steps
+	// (see profiler_trace_step_threshold)
+	void traceSlowStep(u64 step_us);
+	u64 m_trace_step_threshold_us = 0;
+	u64 m_last_trace_dump_ms = 0;
 
 	// Environment
 	ServerEnvironment *m_env = nullptr;
@@ -691,6 +708,8 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 		This is behind m_env_mutex
 	*/
 	std::queue<MapEditEvent*> m_unsent_map_edit_queue;
+	// Counts the map edit events of one step, by type
+	Profiler m_map_edit_profiler;
 	/*
 		If a non-empty area, map edit events contained within are left
 		unsent. Done at map generation time to speed up editing of the
@@ -728,6 +747,9 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 
 	// Global server metrics backend
 	std::unique_ptr<MetricsBackend> m_metrics_backend;
+	// Same as m_metrics_backend if the metrics are periodically written to disk
+	TextMetricsBackend *m_text_metrics_backend = nullptr;
+	float m_metrics_dump_period = 0.0f;
 
 	// Server metrics
 	MetricCounterPtr m_uptime_counter;
@@ -738,6 +760,19 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 	MetricCounterPtr m_packet_recv_counter;
 	MetricCounterPtr m_packet_recv_processed_counter;
 	MetricCounterPtr m_map_edit_event_counter;
+	MetricHistogramPtr m_step_time_histogram;
+	MetricHistogramPtr m_block_send_latency_histogram;
+	MetricHistogramPtr m_rtt_histogram;
+
+	// Lua CPU accounting, reported every second
+	void reportLuaCpuUsage();
+	struct LuaModMetrics {
+		ScriptCpuAccounting::Usage reported;
+		MetricCounterPtr time_counter;
+		MetricCounterPtr calls_counter;
+		Profiler::SectionId profiler_id = 0;
+	};
+	std::unordered_map<std::string, LuaModMetrics> m_lua_mod_metrics;
 };
 
 /*
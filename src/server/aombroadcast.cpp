@@ -0,0 +1,119 @@
+/*
+Minetest
+Copyright (C) 2024 Minetest Authors
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "aombroadcast.h"
+#include "util/serialize.h"
+
+namespace server
+{
+
+static void appendMessage(std::string &buffer, const ActiveObjectMessage &aom)
+{
+	char idbuf[2];
+	writeU16((u8*) idbuf, aom.id);
+	// u16 id
+	// std::string data
+	buffer.append(idbuf, sizeof(idbuf));
+	buffer.append(serializeString16(aom.datastring));
+}
+
+static std::shared_ptr<const std::string> share(std::string &data)
+{
+	if (data.empty())
+		return nullptr;
+	return std::make_shared<const std::string>(std::move(data));
+}
+
+void AOMessageBroadcast::push(const ActiveObjectMessage &aom)
+{
+	size_t idx;
+	auto it = m_batch_index.find(aom.id);
+	if (it == m_batch_index.end()) {
+		idx = m_batches.size();
+		m_batch_index.emplace(aom.id, idx);
+		m_batches.emplace_back();
+		m_batches.back().id = aom.id;
+		m_pending.emplace_back();
+	} else {
+		idx = it->second;
+	}
+
+	Batch &batch = m_batches[idx];
+	PendingBatch &pending = m_pending[idx];
+	const int channel = aom.reliable ? 0 : 1;
+
+	appendMessage(pending.all[channel], aom);
+	if (!aom.datastring.empty() && aom.datastring[0] == AO_CMD_UPDATE_POSITION)
+		batch.has_position = true;
+	else
+		appendMessage(pending.no_position[channel], aom);
+}
+
+void AOMessageBroadcast::encode()
+{
+	for (size_t i = 0; i < m_pending.size(); i++) {
+		Batch &batch = m_batches[i];
+		PendingBatch &pending = m_pending[i];
+		for (int channel = 0; channel < 2; channel++) {
+			batch.all.data[channel] = share(pending.all[channel]);
+			if (batch.has_position)
+				batch.no_position.data[channel] = share(pending.no_position[channel]);
+		}
+		if (!batch.has_position)
+			batch.no_position = batch.all;
+	}
+	m_pending.clear();
+	m_assembled.clear();
+}
+
+AOMessageBroadcast::Payload AOMessageBroadcast::assemble()
+{
+	if (m_selection.empty())
+		return Payload();
+
+	const auto getPart = [this] (u32 sel) -> const Payload & {
+		const Batch &batch = m_batches[sel >> 2];
+		return (sel & 3) == SELECT_ALL ? batch.all : batch.no_position;
+	};
+
+	// A single batch can be handed out as-is
+	if (m_selection.size() == 1)
+		return getPart(m_selection[0]);
+
+	auto it = m_assembled.find(m_selection);
+	if (it != m_assembled.end())
+		return it->second;
+
+	std::string data[2];
+	for (u32 sel : m_selection) {
+		const Payload &part = getPart(sel);
+		for (int channel = 0; channel < 2; channel++) {
+			if (part.data[channel])
+				data[channel].append(*part.data[channel]);
+		}
+	}
+
+	Payload result;
+	for (int channel = 0; channel < 2; channel++)
+		result.data[channel] = share(data[channel]);
+	m_assembled.emplace(m_selection, result);
+	return result;
+}
+
+} // namespace server
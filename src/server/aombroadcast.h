@@ -0,0 +1,115 @@
+/*
+Minetest
+Copyright (C) 2024 Minetest Authors
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "activeobject.h"
+
+namespace server
+{
+
+/*
+	Collects the active object messages of one server step and encodes them
+	once, in the wire format of TOCLIENT_ACTIVE_OBJECT_MESSAGES.
+
+	The encoded batch of an object is refcounted and shared by every recipient.
+	Recipients that end up receiving the same set of batches also share the
+	assembled payload, so each distinct packet is only built once.
+*/
+class AOMessageBroadcast
+{
+public:
+	// Which part of an object's batch a recipient receives
+	enum Selection : u8 {
+		SELECT_NONE,
+		SELECT_ALL,
+		// Everything except AO_CMD_UPDATE_POSITION messages
+		SELECT_NO_POSITION,
+	};
+
+	// Index 0 is reliable data, index 1 unreliable data
+	struct Payload {
+		std::shared_ptr<const std::string> data[2];
+
+		bool empty() const { return !data[0] && !data[1]; }
+	};
+
+	struct Batch {
+		u16 id;
+		// Whether any message of the batch is a position update
+		bool has_position = false;
+		Payload all;
+		// Points to the same buffers as `all` if has_position is false
+		Payload no_position;
+	};
+
+	// Queues a message. Messages keep their order within an object.
+	void push(const ActiveObjectMessage &aom);
+
+	// Encodes all queued messages. Must be called before build().
+	void encode();
+
+	const std::vector<Batch> &getBatches() const { return m_batches; }
+	bool empty() const { return m_batches.empty(); }
+
+	/*
+		Returns the payload for one recipient.
+		`select(idx, batch)` is called for every batch and returns the part of
+		it the recipient should receive. Buffers of the result are null if
+		there is nothing to send on that channel.
+	*/
+	template <typename F>
+	Payload build(F &&select)
+	{
+		m_selection.clear();
+		for (size_t i = 0; i < m_batches.size(); i++) {
+			Selection s = select(i, m_batches[i]);
+			if (s != SELECT_NONE)
+				m_selection.push_back((u32)i << 2 | s);
+		}
+		return assemble();
+	}
+
+private:
+	Payload assemble();
+
+	// Encoded data of the batches while messages are being queued,
+	// in the same layout as Batch::all and Batch::no_position
+	struct PendingBatch {
+		std::string all[2];
+		std::string no_position[2];
+	};
+
+	std::vector<PendingBatch> m_pending;
+	std::vector<Batch> m_batches;
+	// Object id -> index into m_batches
+	std::unordered_map<u16, size_t> m_batch_index;
+
+	// Scratch space for build()
+	std::vector<u32> m_selection;
+	// Selection -> already assembled payload
+	std::map<std::vector<u32>, Payload> m_assembled;
+};
+
+} // namespace server
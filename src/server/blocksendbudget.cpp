@@ -0,0 +1,86 @@
+/*
+Minetest
+Copyright (C) 2024 Minetest Authors
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "blocksendbudget.h"
+#include <algorithm>
+#include "network/connection.h"
+#include "util/numeric.h"
+
+// Minimum time between two budget updates, in seconds
+#define BUDGET_UPDATE_INTERVAL 0.1f
+// Loss ratio of the block channel above which the link counts as congested
+#define BUDGET_LOSS_THRESHOLD 0.05f
+
+BlockSendBudget::BlockSendBudget(u16 initial, u16 min, u16 max) :
+	m_budget(rangelim(initial, min, max)),
+	m_min(min),
+	m_max(max)
+{
+}
+
+void BlockSendBudget::update(float dtime, const con::PeerLinkStats &stats,
+	u32 in_flight)
+{
+	m_timer += dtime;
+	m_decrease_cooldown -= dtime;
+	m_max_in_flight = std::max(m_max_in_flight, in_flight);
+
+	// Nothing measured yet, stay at the initial budget
+	if (stats.avg_rtt <= 0.0f)
+		return;
+
+	// Update about once per round trip
+	if (m_timer < std::max(BUDGET_UPDATE_INTERVAL, m_min_rtt))
+		return;
+
+	// Windowed maximum, decays so that it follows a link that got slower
+	const float rate = m_acked / m_timer;
+	m_delivery_rate = std::max(rate, m_delivery_rate * 0.9f);
+	m_acked = 0;
+	m_timer = 0.0f;
+
+	// Slowly forget the old minimum in case the route changed
+	if (m_min_rtt < 0.0f)
+		m_min_rtt = stats.avg_rtt;
+	else
+		m_min_rtt = std::min(m_min_rtt * 1.001f, stats.avg_rtt);
+
+	const float loss = stats.cur_kbps > 0.0f ?
+			stats.cur_kbps_lost / stats.cur_kbps : 0.0f;
+	const bool window_shrunk = stats.window_size < m_last_window_size;
+	m_last_window_size = stats.window_size;
+	// RTT grew well beyond the propagation delay: packets are queueing up
+	const bool queueing = stats.avg_rtt > m_min_rtt * 2.0f + 0.05f;
+
+	if (loss > BUDGET_LOSS_THRESHOLD || window_shrunk || queueing) {
+		if (m_decrease_cooldown <= 0.0f) {
+			m_budget *= 0.7f;
+			m_decrease_cooldown = stats.avg_rtt;
+		}
+	} else {
+		// Keep at least two bandwidth-delay products on the wire
+		m_budget = std::max(m_budget, 2.0f * m_delivery_rate * m_min_rtt);
+		// Probe for more bandwidth if the budget was what limited sending
+		if (m_max_in_flight + 1 >= m_budget)
+			m_budget += std::max(1.0f, m_budget / 8.0f);
+	}
+
+	m_max_in_flight = in_flight;
+	m_budget = rangelim(m_budget, (float)m_min, (float)m_max);
+}
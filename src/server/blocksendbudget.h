@@ -0,0 +1,70 @@
+/*
+Minetest
+Copyright (C) 2024 Minetest Authors
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#pragma once
+
+#include "irrlichttypes.h"
+
+namespace con {
+struct PeerLinkStats;
+}
+
+/*
+	Decides how many blocks may be in flight to a client at once.
+
+	Loosely modeled after BBR: the rate at which the client acknowledges
+	blocks and the smallest seen RTT give an estimate of the bandwidth-delay
+	product, which the budget is kept above. While the link is not congested
+	the budget is probed upwards whenever it is the limiting factor.
+	Loss, growing queueing delay or a shrinking reliable window of the
+	connection cut the budget multiplicatively, at most once per RTT.
+*/
+class BlockSendBudget
+{
+public:
+	BlockSendBudget(u16 initial, u16 min, u16 max);
+
+	// Called for every block the client confirmed with GOTBLOCKS
+	void onBlockAcked() { m_acked++; }
+
+	// in_flight: number of blocks currently on the wire
+	void update(float dtime, const con::PeerLinkStats &stats, u32 in_flight);
+
+	u16 get() const { return (u16)m_budget; }
+
+	// Estimated block delivery rate, in blocks per second
+	float getDeliveryRate() const { return m_delivery_rate; }
+
+private:
+	float m_budget;
+	const u16 m_min;
+	const u16 m_max;
+
+	float m_timer = 0.0f;
+	u32 m_acked = 0;
+	// Windowed maximum of the delivery rate
+	float m_delivery_rate = 0.0f;
+	// Slowly decaying minimum of the RTT, in seconds
+	float m_min_rtt = -1.0f;
+	// Highest in-flight count seen since the last update
+	u32 m_max_in_flight = 0;
+	u16 m_last_window_size = 0;
+	// Time until the budget may be reduced again
+	float m_decrease_cooldown = 0.0f;
+};
@@ -39,6 +39,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "threading/mutex_auto_lock.h"
 #include "filesys.h"
 #include "gameparams.h"
+#include "emerge.h"
 #include "database/database-dummy.h"
 #include "database/database-files.h"
 #include "database/database-sqlite3.h"
@@ -384,12 +385,50 @@ void ActiveBlockList::update(std::vector<PlayerSAO*> &active_players,
 			blocks_added.insert(p);
 	}
 
+	// Forget the pending blocks that are not wanted anymore
+	for (auto it = m_pending.begin(); it != m_pending.end();) {
+		if (newlist.find(it->first) == newlist.end())
+			it = m_pending.erase(it);
+		else
+			++it;
+	}
+
 	/*
 		Update m_list
 	*/
 	m_list = std::move(newlist);
 }
 
+bool ActiveBlockList::activatePending(v3s16 p)
+{
+	auto it = m_pending.find(p);
+	if (it == m_pending.end())
+		return false;
+
+	m_list.insert(p);
+	if (it->second)
+		m_abm_list.insert(p);
+	m_pending.erase(it);
+	return true;
+}
+
+void ActiveBlockList::pushEmerged(v3s16 p)
+{
+	MutexAutoLock lock(m_emerged_mutex);
+	m_emerged.push_back(p);
+}
+
+void ActiveBlockList::takeEmerged(std::vector<v3s16> &emerged)
+{
+	MutexAutoLock lock(m_emerged_mutex);
+	emerged.swap(m_emerged);
+}
+
+static void on_active_block_emerged(v3s16 blockpos, EmergeAction action, void *param)
+{
+	static_cast<ActiveBlockList *>(param)->pushEmerged(blockpos);
+}
+
 /*
 	OnMapblocksChangedReceiver
 */
@@ -417,6 +456,7 @@ ServerEnvironment::ServerEnvironment(ServerMap *map,
 	m_script(script_iface),
 	m_server(server),
 	m_path_world(path_world),
+	m_node_timer_wheel(m_cache_nodetimer_interval),
 	m_rgen(seed())
 {
 	m_step_time_counter = mb->addCounter(
@@ -506,6 +546,12 @@ void ServerEnvironment::init()
 
 ServerEnvironment::~ServerEnvironment()
 {
+	// The timers must not refer to the wheel anymore when the blocks are saved
+	for (const v3s16 &p: m_active_blocks.m_list) {
+		if (MapBlock *block = m_map ? m_map->getBlockNoCreateNoEx(p) : nullptr)
+			block->detachNodeTimers();
+	}
+
 	// Clear active block list.
 	// This makes the next one delete all active objects.
 	m_active_blocks.clear();
@@ -1043,8 +1089,9 @@ void ServerEnvironment::activateBlock(MapBlock *block, u32 additional_dtime)
 	if (block->isOrphan())
 		return;
 
-	// Run node timers
-	block->step((float)dtime_s, [&](v3s16 p, MapNode n, f32 d) -> bool {
+	// Run node timers, including those that elapsed while inactive
+	block->attachNodeTimers(&m_node_timer_wheel, dtime_s);
+	block->runNodeTimers([&](v3s16 p, MapNode n, f32 d) -> bool {
 		return !block->isOrphan() && m_script->node_on_timer(p, n, d);
 	});
 }
@@ -1332,7 +1379,8 @@ void ServerEnvironment::clearObjects(ClearObjectsMode mode)
 
 void ServerEnvironment::step(float dtime)
 {
-	ScopeProfiler sp2(g_profiler, "ServerEnv::step()", SPT_AVG);
+	static const auto sp2_id = ScopeProfiler::intern("ServerEnv::step()");
+	ScopeProfiler sp2(g_profiler, sp2_id, SPT_AVG);
 	const auto start_time = porting::getTimeUs();
 
 	/* Step time of day */
@@ -1359,7 +1407,8 @@ void ServerEnvironment::step(float dtime)
 		Handle players
 	*/
 	{
-		ScopeProfiler sp(g_profiler, "ServerEnv: move players", SPT_AVG);
+		static const auto sp_id = ScopeProfiler::intern("ServerEnv: move players");
+		ScopeProfiler sp(g_profiler, sp_id, SPT_AVG);
 		for (RemotePlayer *player : m_players) {
 			// Ignore disconnected players
 			if (player->getPeerId() == PEER_ID_INEXISTENT)
@@ -1374,7 +1423,8 @@ void ServerEnvironment::step(float dtime)
 		Manage active block list
 	*/
 	if (m_active_blocks_mgmt_interval.step(dtime, m_cache_active_block_mgmt_interval / m_fast_active_block_divider)) {
-		ScopeProfiler sp(g_profiler, "ServerEnv: update active blocks", SPT_AVG);
+		static const auto sp_id = ScopeProfiler::intern("ServerEnv: update active blocks");
+		ScopeProfiler sp(g_profiler, sp_id, SPT_AVG);
 
 		/*
 			Get player block positions
@@ -1420,6 +1470,7 @@ void ServerEnvironment::step(float dtime)
 
 			// Set current time as timestamp (and let it set ChangedFlag)
 			block->setTimestamp(m_game_time);
+			block->detachNodeTimers();
 		}
 
 		/*
@@ -1427,34 +1478,29 @@ void ServerEnvironment::step(float dtime)
 		*/
 
 		for (const v3s16 &p: blocks_added) {
-			MapBlock *block = m_map->getBlockOrEmerge(p);
-			if (!block) {
-				// TODO: The blocks removed here will only be picked up again
-				// on the next cycle. To minimize the latency of objects being
-				// activated we could remember the blocks pending activating
-				// and activate them instantly as soon as they're loaded.
-				m_active_blocks.remove(p);
+			MapBlock *block = m_map->getBlockNoCreateNoEx(p);
+			if (block) {
+				m_active_blocks.removePending(p);
+				activateBlock(block);
 				continue;
 			}
 
-			activateBlock(block);
+			// Activated as soon as it is loaded, see below
+			if (m_active_blocks.isPending(p) ||
+					m_server->getEmergeManager()->enqueueBlockEmergeEx(p,
+						PEER_ID_INEXISTENT, 0, on_active_block_emerged,
+						&m_active_blocks))
+				m_active_blocks.addPending(p);
+			else
+				m_active_blocks.remove(p);
 		}
 
 		// Some blocks may be removed again by the code above so do this here
 		m_active_block_gauge->set(m_active_blocks.size());
 
-		if (m_fast_active_block_divider > 1)
-			--m_fast_active_block_divider;
-	}
-
-	/*
-		Mess around in active blocks
-	*/
-	if (m_active_blocks_nodemetadata_interval.step(dtime, m_cache_nodetimer_interval)) {
-		ScopeProfiler sp(g_profiler, "ServerEnv: Run node timers", SPT_AVG);
-
-		float dtime = m_cache_nodetimer_interval;
-
+		/*
+			Keep the active blocks loaded and their timestamps current
+		*/
 		for (const v3s16 &p: m_active_blocks.m_list) {
 			MapBlock *block = m_map->getBlockNoCreateNoEx(p);
 			if (!block)
@@ -1471,15 +1517,63 @@ void ServerEnvironment::step(float dtime)
 				block->raiseModified(MOD_STATE_WRITE_AT_UNLOAD,
 					MOD_REASON_BLOCK_EXPIRED);
 
-			// Run node timers
-			block->step(dtime, [&](v3s16 p, MapNode n, f32 d) -> bool {
+			// The block was replaced after it became active
+			if (!block->hasAttachedNodeTimers())
+				block->attachNodeTimers(&m_node_timer_wheel, 0);
+		}
+
+		if (m_fast_active_block_divider > 1)
+			--m_fast_active_block_divider;
+	}
+
+	/*
+		Activate the pending blocks that were loaded since the last step
+	*/
+	{
+		std::vector<v3s16> emerged;
+		m_active_blocks.takeEmerged(emerged);
+		for (const v3s16 &p : emerged) {
+			MapBlock *block = m_map->getBlockNoCreateNoEx(p);
+			if (!block) {
+				// Not on disk or cancelled, retried with the next update
+				m_active_blocks.removePending(p);
+				continue;
+			}
+			if (m_active_blocks.activatePending(p))
+				activateBlock(block);
+		}
+		if (!emerged.empty())
+			m_active_block_gauge->set(m_active_blocks.size());
+	}
+
+	/*
+		Mess around in active blocks
+	*/
+	if (m_active_blocks_nodemetadata_interval.step(dtime, m_cache_nodetimer_interval)) {
+		static const auto sp_id = ScopeProfiler::intern("ServerEnv: Run node timers");
+		ScopeProfiler sp(g_profiler, sp_id, SPT_AVG);
+
+		std::vector<v3s16> due;
+		m_node_timer_wheel.step(due);
+
+		for (const v3s16 &p: due) {
+			MapBlock *block = m_map->getBlockNoCreateNoEx(p);
+			if (!block || !block->hasAttachedNodeTimers())
+				continue;
+			if (!m_active_blocks.contains(p)) {
+				block->detachNodeTimers();
+				continue;
+			}
+
+			block->runNodeTimers([&](v3s16 p, MapNode n, f32 d) -> bool {
 				return m_script->node_on_timer(p, n, d);
 			});
 		}
 	}
 
 	if (m_active_block_modifier_interval.step(dtime, m_cache_abm_interval)) {
-		ScopeProfiler sp(g_profiler, "SEnv: modify in blocks avg per interval", SPT_AVG);
+		static const auto sp_id = ScopeProfiler::intern("SEnv: modify in blocks avg per interval");
+		ScopeProfiler sp(g_profiler, sp_id, SPT_AVG);
 		TimeTaker timer("modify in active blocks per interval");
 
 		// Shuffle to prevent persistent artifacts of ordering
@@ -1543,7 +1637,8 @@ void ServerEnvironment::step(float dtime)
 		Step active objects
 	*/
 	{
-		ScopeProfiler sp(g_profiler, "ServerEnv: Run SAO::step()", SPT_AVG);
+		static const auto sp_id = ScopeProfiler::intern("ServerEnv: Run SAO::step()");
+		ScopeProfiler sp(g_profiler, sp_id, SPT_AVG);
 
 		// This helps the objects to send data at the same time
 		bool send_recommended = false;
@@ -1879,7 +1974,8 @@ u16 ServerEnvironment::addActiveObjectRaw(std::unique_ptr<ServerActiveObject> ob
 */
 void ServerEnvironment::removeRemovedObjects()
 {
-	ScopeProfiler sp(g_profiler, "ServerEnvironment::removeRemovedObjects()", SPT_AVG);
+	static const auto sp_id = ScopeProfiler::intern("ServerEnvironment::removeRemovedObjects()");
+	ScopeProfiler sp(g_profiler, sp_id, SPT_AVG);
 
 	auto clear_cb = [this](ServerActiveObject *obj, u16 id) {
 		// This shouldn't happen but check it
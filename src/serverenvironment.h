@@ -27,6 +27,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "util/numeric.h"
 #include "util/metricsbackend.h"
 #include <set>
+#include <map>
+#include <mutex>
 #include <random>
 
 class IGameDef;
@@ -180,6 +182,7 @@ class ActiveBlockList
 
 	void clear() {
 		m_list.clear();
+		m_pending.clear();
 	}
 
 	void remove(v3s16 p) {
@@ -187,10 +190,42 @@ class ActiveBlockList
 		m_abm_list.erase(p);
 	}
 
+	/*
+		Blocks that should be active but are still being loaded are kept out
+		of the lists until their emerge is done.
+	*/
+	void addPending(v3s16 p) {
+		m_pending[p] = m_abm_list.count(p) != 0;
+		remove(p);
+	}
+
+	bool isPending(v3s16 p) const {
+		return m_pending.count(p) != 0;
+	}
+
+	// Puts a pending block back into the lists, returns false if it was
+	// not pending (anymore)
+	bool activatePending(v3s16 p);
+
+	void removePending(v3s16 p) {
+		m_pending.erase(p);
+	}
+
+	// Thread-safe, called by the emerge completion callback
+	void pushEmerged(v3s16 p);
+	// Returns the pending blocks whose emerge finished since the last call
+	void takeEmerged(std::vector<v3s16> &emerged);
+
 	std::set<v3s16> m_list;
 	std::set<v3s16> m_abm_list;
 	// list of blocks that are always active, not modified by this class
 	std::set<v3s16> m_forceloaded_list;
+
+private:
+	// Pending blocks, with whether they belong to m_abm_list
+	std::map<v3s16, bool> m_pending;
+	std::mutex m_emerged_mutex;
+	std::vector<v3s16> m_emerged;
 };
 
 /*
@@ -481,6 +516,8 @@ class ServerEnvironment final : public Environment
 	IntervalLimiter m_active_blocks_mgmt_interval;
 	IntervalLimiter m_active_block_modifier_interval;
 	IntervalLimiter m_active_blocks_nodemetadata_interval;
+	// Active blocks by the time their next node timer is due
+	NodeTimerWheel m_node_timer_wheel;
 	// Whether the variables below have been read from file yet
 	bool m_meta_loaded = false;
 	// Time from the beginning of the game in seconds.
@@ -0,0 +1,217 @@
+/*
+Minetest
+Copyright (C) 2024 Minetest Authors
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "tracer.h"
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <vector>
+#include "filesys.h"
+#include "log.h"
+#include "porting.h"
+#include "profiler.h"
+#include "util/serialize.h"
+#include "util/string.h"
+
+// Number of scopes kept per thread
+#define TRACE_EVENTS_PER_THREAD 16384
+// Number of ended threads whose scopes are kept
+#define TRACE_ENDED_THREADS_MAX 8
+
+std::atomic<bool> Tracer::g_tracing_enabled(false);
+
+namespace {
+
+// Written by one thread only, may be read while it is overwritten
+struct TraceEvent {
+	std::atomic<u64> start_us{0};
+	// Duration in microseconds in the upper half, section id in the lower one
+	std::atomic<u64> duration_id{0};
+};
+
+struct ThreadTrace {
+	ThreadTrace(u32 tid, const std::string &name) : tid(tid), name(name) {}
+
+	// These three are only accessed with the registry mutex
+	u32 tid;
+	std::string name;
+	bool ended = false;
+	// Number of events ever written
+	std::atomic<u64> head{0};
+	TraceEvent events[TRACE_EVENTS_PER_THREAD];
+};
+
+struct TraceRegistry {
+	std::mutex mutex;
+	// Kept for a while after their thread ended, so their events can still
+	// be dumped, until a new thread takes them over
+	std::vector<std::unique_ptr<ThreadTrace>> threads;
+	u32 next_tid = 1;
+};
+
+TraceRegistry &getRegistry()
+{
+	static TraceRegistry registry;
+	return registry;
+}
+
+// Hands the trace of a thread back to the registry when the thread ends
+struct ThreadTraceOwner {
+	ThreadTrace *trace = nullptr;
+
+	~ThreadTraceOwner()
+	{
+		if (!trace)
+			return;
+
+		TraceRegistry &registry = getRegistry();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+		trace->ended = true;
+
+		size_t ended = 0;
+		for (const auto &it : registry.threads)
+			ended += it->ended;
+		if (ended <= TRACE_ENDED_THREADS_MAX)
+			return;
+		// Drop the one that ended first
+		for (auto it = registry.threads.begin(); it != registry.threads.end(); ++it) {
+			if ((*it)->ended) {
+				registry.threads.erase(it);
+				break;
+			}
+		}
+	}
+};
+
+ThreadTrace *getThreadTrace()
+{
+	thread_local ThreadTraceOwner owner;
+	if (owner.trace)
+		return owner.trace;
+
+	TraceRegistry &registry = getRegistry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+	for (auto &it : registry.threads) {
+		if (!it->ended)
+			continue;
+		// Reuse the buffer of an ended thread
+		owner.trace = it.get();
+		owner.trace->tid = registry.next_tid++;
+		owner.trace->name = g_logger.getThreadName();
+		owner.trace->ended = false;
+		owner.trace->head.store(0, std::memory_order_relaxed);
+		return owner.trace;
+	}
+
+	registry.threads.push_back(std::make_unique<ThreadTrace>(
+			registry.next_tid++, g_logger.getThreadName()));
+	owner.trace = registry.threads.back().get();
+	return owner.trace;
+}
+
+}
+
+void Tracer::setEnabled(bool enabled)
+{
+	g_tracing_enabled.store(enabled);
+}
+
+void Tracer::record(u32 section_id, u64 start_us, u64 end_us)
+{
+	ThreadTrace *trace = getThreadTrace();
+	const u64 head = trace->head.load(std::memory_order_relaxed);
+	TraceEvent &event = trace->events[head % TRACE_EVENTS_PER_THREAD];
+
+	const u64 duration = std::min<u64>(end_us - start_us, U32_MAX);
+	event.start_us.store(start_us, std::memory_order_relaxed);
+	event.duration_id.store(duration << 32 | section_id, std::memory_order_relaxed);
+	trace->head.store(head + 1, std::memory_order_release);
+}
+
+void Tracer::dump(std::ostream &os, u64 window_us)
+{
+	const u64 now = porting::getTimeUs();
+	const u64 min_end = window_us != 0 && now > window_us ? now - window_us : 0;
+
+	os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+	bool first = true;
+	auto separator = [&] () {
+		if (!first)
+			os << ",\n";
+		first = false;
+	};
+
+	TraceRegistry &registry = getRegistry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+	for (const auto &trace : registry.threads) {
+		separator();
+		os << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+			<< trace->tid << ",\"args\":{\"name\":"
+			<< serializeJsonString(trace->name) << "}}";
+
+		const u64 head = trace->head.load(std::memory_order_acquire);
+		const u64 begin = head > TRACE_EVENTS_PER_THREAD ?
+				head - TRACE_EVENTS_PER_THREAD : 0;
+		for (u64 i = begin; i < head; i++) {
+			const TraceEvent &event = trace->events[i % TRACE_EVENTS_PER_THREAD];
+			const u64 start = event.start_us.load(std::memory_order_relaxed);
+			const u64 duration_id = event.duration_id.load(std::memory_order_relaxed);
+
+			// The thread went on and may have overwritten this event meanwhile.
+			// It does so while head is still i + TRACE_EVENTS_PER_THREAD, and
+			// the fence keeps the event loads before the head load.
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (trace->head.load(std::memory_order_relaxed) >=
+					i + TRACE_EVENTS_PER_THREAD)
+				continue;
+
+			const u64 duration = duration_id >> 32;
+			if (start + duration < min_end)
+				continue;
+
+			// The unit added by ScopeProfiler is meaningless here
+			std::string name = Profiler::getSectionName(duration_id & U32_MAX);
+			if (str_ends_with(name, " [ms]"))
+				name.resize(name.size() - 5);
+
+			separator();
+			os << "{\"name\":" << serializeJsonString(name)
+				<< ",\"ph\":\"X\",\"pid\":1,\"tid\":" << trace->tid
+				<< ",\"ts\":" << start << ",\"dur\":" << duration << "}";
+		}
+	}
+	os << "]}\n";
+}
+
+std::string Tracer::dumpToFile(const std::string &dir, u64 window_us)
+{
+	std::ostringstream os;
+	dump(os, window_us);
+
+	if (!fs::CreateAllDirs(dir))
+		return "";
+
+	std::string path = dir + DIR_DELIM + "trace_" +
+			std::to_string(porting::getTimeMs()) + ".json";
+	if (!fs::safeWriteToFile(path, os.str())) {
+		errorstream << "Tracer: failed to write " << path << std::endl;
+		return "";
+	}
+	return path;
+}
@@ -0,0 +1,54 @@
+/*
+Minetest
+Copyright (C) 2024 Minetest Authors
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#pragma once
+
+#include "irrlichttypes.h"
+#include <atomic>
+#include <ostream>
+#include <string>
+
+/*
+	Timeline of ScopeProfiler scopes.
+
+	Every thread records its finished scopes into its own ring buffer.
+	The buffers can be written out in the Chrome trace event format, which
+	can be opened in chrome://tracing or https://ui.perfetto.dev.
+*/
+namespace Tracer
+{
+	extern std::atomic<bool> g_tracing_enabled;
+
+	void setEnabled(bool enabled);
+
+	inline bool isEnabled()
+	{
+		return g_tracing_enabled.load(std::memory_order_relaxed);
+	}
+
+	// Records a finished scope of the calling thread, times in microseconds
+	void record(u32 section_id, u64 start_us, u64 end_us);
+
+	// Writes the scopes that ended in the last `window_us` microseconds,
+	// or all recorded scopes if 0
+	void dump(std::ostream &os, u64 window_us = 0);
+
+	// Writes a trace file into `dir`. Returns its path, or "" on failure.
+	std::string dumpToFile(const std::string &dir, u64 window_us = 0);
+}
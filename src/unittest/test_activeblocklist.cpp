@@ -0,0 +1,111 @@
+/*
+Minetest
+Copyright (C) 2024 Minetest Authors
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include "serverenvironment.h"
+
+class TestActiveBlockList : public TestBase
+{
+public:
+	TestActiveBlockList() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestActiveBlockList"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testPendingActivation();
+	void testPendingForgotten();
+};
+
+static TestActiveBlockList g_test_instance;
+
+void TestActiveBlockList::runTests(IGameDef *gamedef)
+{
+	TEST(testPendingActivation);
+	TEST(testPendingForgotten);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Without players, the forceloaded blocks are the active ones
+static void update(ActiveBlockList &list, std::set<v3s16> &added)
+{
+	std::vector<PlayerSAO *> players;
+	std::set<v3s16> removed;
+	added.clear();
+	list.update(players, 2, 2, removed, added);
+}
+
+void TestActiveBlockList::testPendingActivation()
+{
+	const v3s16 loaded(0, 0, 0), loading(1, 0, 0);
+	ActiveBlockList list;
+	list.m_forceloaded_list = {loaded, loading};
+
+	std::set<v3s16> added;
+	update(list, added);
+	UASSERTEQ(size_t, added.size(), 2);
+
+	list.addPending(loading);
+	UASSERT(list.isPending(loading));
+	UASSERT(list.contains(loaded));
+	UASSERT(!list.contains(loading));
+	UASSERT(list.m_abm_list.count(loading) == 0);
+
+	// Still wanted, so it is handed out again until it is loaded
+	update(list, added);
+	UASSERT(added.count(loading) == 1);
+	UASSERT(list.isPending(loading));
+	list.addPending(loading);
+
+	list.pushEmerged(loading);
+	std::vector<v3s16> emerged;
+	list.takeEmerged(emerged);
+	UASSERTEQ(size_t, emerged.size(), 1);
+	UASSERT(emerged[0] == loading);
+	list.takeEmerged(emerged);
+	UASSERT(emerged.empty());
+
+	UASSERT(list.activatePending(loading));
+	UASSERT(!list.isPending(loading));
+	UASSERT(list.contains(loading));
+	UASSERT(list.m_abm_list.count(loading) == 1);
+	UASSERT(!list.activatePending(loading));
+
+	update(list, added);
+	UASSERT(added.empty());
+}
+
+void TestActiveBlockList::testPendingForgotten()
+{
+	const v3s16 p(0, -3, 7);
+	ActiveBlockList list;
+	list.m_forceloaded_list = {p};
+
+	std::set<v3s16> added;
+	update(list, added);
+	list.addPending(p);
+
+	// Not wanted anymore before it was loaded
+	list.m_forceloaded_list.clear();
+	update(list, added);
+	UASSERT(!list.isPending(p));
+	UASSERT(!list.activatePending(p));
+	UASSERT(!list.contains(p));
+}
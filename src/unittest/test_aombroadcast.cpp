@@ -0,0 +1,200 @@
+/*
+Minetest
+Copyright (C) 2024 Minetest Authors
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include "server/aombroadcast.h"
+#include "util/serialize.h"
+
+using server::AOMessageBroadcast;
+
+class TestAOMessageBroadcast : public TestBase
+{
+public:
+	TestAOMessageBroadcast() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestAOMessageBroadcast"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testEncode();
+	void testSelectAll();
+	void testSelectNoPosition();
+	void testSelectNone();
+	void testSharedPayload();
+};
+
+static TestAOMessageBroadcast g_test_instance;
+
+void TestAOMessageBroadcast::runTests(IGameDef *gamedef)
+{
+	TEST(testEncode);
+	TEST(testSelectAll);
+	TEST(testSelectNoPosition);
+	TEST(testSelectNone);
+	TEST(testSharedPayload);
+}
+
+// Wire format of one message in TOCLIENT_ACTIVE_OBJECT_MESSAGES
+static std::string encodeMessage(u16 id, const std::string &data)
+{
+	std::string ret(2, '\0');
+	writeU16((u8 *)&ret[0], id);
+	ret.append(serializeString16(data));
+	return ret;
+}
+
+static const std::string s_anim = std::string(1, (char)AO_CMD_SET_ANIMATION) + "anim";
+static const std::string s_hp = std::string(1, (char)AO_CMD_PUNCHED) + "hp";
+static const std::string s_pos = std::string(1, (char)AO_CMD_UPDATE_POSITION) + "pos";
+
+/*
+	Object 1 sends an animation, a position update and a punch,
+	object 2 only an animation
+*/
+static void fillBroadcast(AOMessageBroadcast &broadcast)
+{
+	broadcast.push(ActiveObjectMessage(1, true, s_anim));
+	broadcast.push(ActiveObjectMessage(2, true, s_anim));
+	broadcast.push(ActiveObjectMessage(1, false, s_pos));
+	broadcast.push(ActiveObjectMessage(1, true, s_hp));
+	broadcast.encode();
+}
+
+static std::string getData(const AOMessageBroadcast::Payload &payload, int channel)
+{
+	return payload.data[channel] ? *payload.data[channel] : "";
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void TestAOMessageBroadcast::testEncode()
+{
+	AOMessageBroadcast broadcast;
+	UASSERT(broadcast.empty());
+	fillBroadcast(broadcast);
+
+	const auto &batches = broadcast.getBatches();
+	UASSERTEQ(size_t, batches.size(), 2);
+
+	// In the order the objects first sent something
+	const auto &b1 = batches[0];
+	UASSERTEQ(u16, b1.id, 1);
+	UASSERT(b1.has_position);
+	UASSERTEQ(std::string, getData(b1.all, 0),
+		encodeMessage(1, s_anim) + encodeMessage(1, s_hp));
+	UASSERTEQ(std::string, getData(b1.all, 1), encodeMessage(1, s_pos));
+	UASSERTEQ(std::string, getData(b1.no_position, 0),
+		encodeMessage(1, s_anim) + encodeMessage(1, s_hp));
+	UASSERT(!b1.no_position.data[1]);
+
+	// Without position updates both parts are the same buffers
+	const auto &b2 = batches[1];
+	UASSERTEQ(u16, b2.id, 2);
+	UASSERT(!b2.has_position);
+	UASSERTEQ(std::string, getData(b2.all, 0), encodeMessage(2, s_anim));
+	UASSERT(!b2.all.data[1]);
+	UASSERT(b2.no_position.data[0] == b2.all.data[0]);
+}
+
+void TestAOMessageBroadcast::testSelectAll()
+{
+	AOMessageBroadcast broadcast;
+	fillBroadcast(broadcast);
+
+	auto payload = broadcast.build([] (size_t i, const AOMessageBroadcast::Batch &batch) {
+		return AOMessageBroadcast::SELECT_ALL;
+	});
+	UASSERTEQ(std::string, getData(payload, 0), encodeMessage(1, s_anim) +
+		encodeMessage(1, s_hp) + encodeMessage(2, s_anim));
+	UASSERTEQ(std::string, getData(payload, 1), encodeMessage(1, s_pos));
+
+	// A single batch is handed out without copying
+	payload = broadcast.build([] (size_t i, const AOMessageBroadcast::Batch &batch) {
+		return batch.id == 1 ? AOMessageBroadcast::SELECT_ALL :
+			AOMessageBroadcast::SELECT_NONE;
+	});
+	UASSERT(payload.data[0] == broadcast.getBatches()[0].all.data[0]);
+	UASSERT(payload.data[1] == broadcast.getBatches()[0].all.data[1]);
+}
+
+void TestAOMessageBroadcast::testSelectNoPosition()
+{
+	AOMessageBroadcast broadcast;
+	fillBroadcast(broadcast);
+
+	// Like the player's own object or an object attached to a known one
+	auto payload = broadcast.build([] (size_t i, const AOMessageBroadcast::Batch &batch) {
+		return batch.has_position ? AOMessageBroadcast::SELECT_NO_POSITION :
+			AOMessageBroadcast::SELECT_ALL;
+	});
+	UASSERTEQ(std::string, getData(payload, 0), encodeMessage(1, s_anim) +
+		encodeMessage(1, s_hp) + encodeMessage(2, s_anim));
+	UASSERT(!payload.data[1]);
+
+	// The position update is the only unreliable data
+	payload = broadcast.build([] (size_t i, const AOMessageBroadcast::Batch &batch) {
+		return batch.id == 1 ? AOMessageBroadcast::SELECT_NO_POSITION :
+			AOMessageBroadcast::SELECT_NONE;
+	});
+	UASSERTEQ(std::string, getData(payload, 0),
+		encodeMessage(1, s_anim) + encodeMessage(1, s_hp));
+	UASSERT(!payload.data[1]);
+}
+
+void TestAOMessageBroadcast::testSelectNone()
+{
+	AOMessageBroadcast broadcast;
+	fillBroadcast(broadcast);
+
+	auto payload = broadcast.build([] (size_t i, const AOMessageBroadcast::Batch &batch) {
+		return AOMessageBroadcast::SELECT_NONE;
+	});
+	UASSERT(payload.empty());
+
+	// Nothing queued
+	AOMessageBroadcast empty;
+	empty.encode();
+	UASSERT(empty.empty());
+	payload = empty.build([] (size_t i, const AOMessageBroadcast::Batch &batch) {
+		return AOMessageBroadcast::SELECT_ALL;
+	});
+	UASSERT(payload.empty());
+}
+
+void TestAOMessageBroadcast::testSharedPayload()
+{
+	AOMessageBroadcast broadcast;
+	fillBroadcast(broadcast);
+
+	const auto select_all = [] (size_t i, const AOMessageBroadcast::Batch &batch) {
+		return AOMessageBroadcast::SELECT_ALL;
+	};
+	const auto select_no_position = [] (size_t i, const AOMessageBroadcast::Batch &batch) {
+		return AOMessageBroadcast::SELECT_NO_POSITION;
+	};
+
+	// Recipients with the same selection share the assembled buffers
+	auto first = broadcast.build(select_all);
+	auto second = broadcast.build(select_all);
+	UASSERT(first.data[0] && first.data[0] == second.data[0]);
+	UASSERT(first.data[1] && first.data[1] == second.data[1]);
+
+	auto other = broadcast.build(select_no_position);
+	UASSERT(other.data[0] != first.data[0]);
+}
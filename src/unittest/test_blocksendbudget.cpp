@@ -0,0 +1,106 @@
+/*
+Minetest
+Copyright (C) 2024 Minetest Authors
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include "network/connection.h"
+#include "server/blocksendbudget.h"
+
+class TestBlockSendBudget : public TestBase
+{
+public:
+	TestBlockSendBudget() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestBlockSendBudget"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testNoMeasurements();
+	void testFastLink();
+	void testQueueing();
+	void testLoss();
+};
+
+static TestBlockSendBudget g_test_instance;
+
+void TestBlockSendBudget::runTests(IGameDef *gamedef)
+{
+	TEST(testNoMeasurements);
+	TEST(testFastLink);
+	TEST(testQueueing);
+	TEST(testLoss);
+}
+
+static con::PeerLinkStats makeStats(float rtt)
+{
+	con::PeerLinkStats stats;
+	stats.avg_rtt = rtt;
+	stats.cur_kbps = 1000.0f;
+	stats.window_size = 1024;
+	return stats;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void TestBlockSendBudget::testNoMeasurements()
+{
+	BlockSendBudget budget(40, 2, 200);
+	con::PeerLinkStats stats;
+	for (int i = 0; i < 20; i++)
+		budget.update(0.1f, stats, 40);
+	UASSERTEQ(u16, budget.get(), 40);
+}
+
+void TestBlockSendBudget::testFastLink()
+{
+	BlockSendBudget budget(40, 2, 200);
+	con::PeerLinkStats stats = makeStats(0.002f);
+	for (int i = 0; i < 50; i++) {
+		// the client keeps up with everything we send
+		for (u16 j = 0; j < budget.get(); j++)
+			budget.onBlockAcked();
+		budget.update(0.1f, stats, budget.get());
+	}
+	UASSERTEQ(u16, budget.get(), 200);
+	UASSERT(budget.getDeliveryRate() > 0.0f);
+}
+
+void TestBlockSendBudget::testQueueing()
+{
+	BlockSendBudget budget(40, 2, 200);
+	budget.update(0.1f, makeStats(0.05f), 40);
+	u16 before = budget.get();
+
+	// RTT rises far above the propagation delay
+	con::PeerLinkStats stats = makeStats(0.5f);
+	budget.update(0.1f, stats, 40);
+	UASSERT(budget.get() < before);
+
+	for (int i = 0; i < 100; i++)
+		budget.update(0.1f, stats, budget.get());
+	UASSERTEQ(u16, budget.get(), 2);
+}
+
+void TestBlockSendBudget::testLoss()
+{
+	BlockSendBudget budget(40, 2, 200);
+	con::PeerLinkStats stats = makeStats(0.05f);
+	stats.cur_kbps_lost = 200.0f;
+	budget.update(0.1f, stats, 10);
+	UASSERTEQ(u16, budget.get(), 28);
+}
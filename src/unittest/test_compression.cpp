@@ -20,6 +20,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "test.h"
 
 #include <sstream>
+#include <vector>
 
 #include "irrlichttypes_extrabloated.h"
 #include "log.h"
@@ -38,6 +39,8 @@ class TestCompression : public TestBase {
 	void testZlibCompression();
 	void testZlibLargeData();
 	void testZstdLargeData();
+	void testZstdBuffer();
+	void testZstdDictionary();
 	void testZlibLimit();
 	void _testZlibLimit(u32 size, u32 limit);
 };
@@ -50,6 +53,8 @@ void TestCompression::runTests(IGameDef *gamedef)
 	TEST(testZlibCompression);
 	TEST(testZlibLargeData);
 	TEST(testZstdLargeData);
+	TEST(testZstdBuffer);
+	TEST(testZstdDictionary);
 	TEST(testZlibLimit);
 }
 
@@ -212,6 +217,80 @@ void TestCompression::testZstdLargeData()
 	}
 }
 
+void TestCompression::testZstdBuffer()
+{
+	std::string data_in(100000, '\0');
+	PseudoRandom pseudorandom(1337);
+	for (u32 i = 0; i < data_in.size(); i++)
+		data_in[i] = pseudorandom.range(0, 3);
+
+	std::ostringstream os_compressed(std::ios::binary);
+	compressZstd(data_in, os_compressed, 0);
+	const std::string frame = os_compressed.str();
+	// Like a block sent over the network, data follows the frame
+	const std::string buffer = frame + "tail";
+
+	// Starts out both smaller and larger than needed
+	for (size_t reserved : {(size_t)0, data_in.size() * 2}) {
+		std::string out;
+		out.reserve(reserved);
+		const size_t used = decompressZstd(
+			reinterpret_cast<const u8 *>(buffer.data()), buffer.size(), out);
+		UASSERTEQ(size_t, used, frame.size());
+		UASSERT(out == data_in);
+	}
+
+	// Cut off frame
+	std::string out;
+	EXCEPTION_CHECK(SerializationError, decompressZstd(
+		reinterpret_cast<const u8 *>(frame.data()), frame.size() - 1, out));
+}
+
+void TestCompression::testZstdDictionary()
+{
+	// Small inputs with a lot in common, like MapBlocks
+	PseudoRandom pseudorandom(4711);
+	auto make_sample = [&] () {
+		std::string sample = "air default:stone default:dirt default:dirt_with_grass "
+			"default:water_source default:sand default:gravel default:tree "
+			"default:leaves default:apple default:cobble default:mossycobble "
+			"default:stone_with_coal default:stone_with_iron default:torch ";
+		for (int i = 0; i < 30; i++)
+			sample += (char)pseudorandom.range('a', 'z');
+		return sample;
+	};
+	std::vector<std::string> samples;
+	for (int i = 0; i < 1000; i++)
+		samples.push_back(make_sample());
+
+	const ZstdDictionary dict(ZstdDictionary::train(samples, 8 * 1024));
+	UASSERT(dict.getId() != 0);
+	EXCEPTION_CHECK(SerializationError, ZstdDictionary("not a dictionary"));
+
+	const std::string data_in = make_sample();
+	std::ostringstream os_plain(std::ios::binary), os_dict(std::ios::binary);
+	compressZstd(data_in, os_plain, 0);
+	compressZstd(reinterpret_cast<const u8 *>(data_in.data()), data_in.size(),
+		os_dict, dict);
+	const std::string frame = os_dict.str();
+	UASSERT(frame.size() < os_plain.str().size());
+
+	std::string out;
+	const u8 *frame_data = reinterpret_cast<const u8 *>(frame.data());
+	UASSERTEQ(size_t, decompressZstd(frame_data, frame.size(), out, &dict),
+		frame.size());
+	UASSERT(out == data_in);
+
+	// Plain frames still work with a dictionary given
+	const std::string plain = os_plain.str();
+	decompressZstd(reinterpret_cast<const u8 *>(plain.data()), plain.size(),
+		out, &dict);
+	UASSERT(out == data_in);
+
+	EXCEPTION_CHECK(SerializationError,
+		decompressZstd(frame_data, frame.size(), out));
+}
+
 void TestCompression::testZlibLimit()
 {
 	// edge cases
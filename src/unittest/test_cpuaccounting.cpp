@@ -0,0 +1,101 @@
+/*
+Minetest
+Copyright (C) 2024 Minetest Authors
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include "script/cpp_api/s_cpuaccounting.h"
+
+class TestCpuAccounting : public TestBase
+{
+public:
+	TestCpuAccounting() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestCpuAccounting"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testAttribution();
+	void testSampling();
+};
+
+static TestCpuAccounting g_test_instance;
+
+void TestCpuAccounting::runTests(IGameDef *gamedef)
+{
+	TEST(testAttribution);
+	TEST(testSampling);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void TestCpuAccounting::testAttribution()
+{
+	ScriptCpuAccounting acc;
+	acc.setMode(ScriptCpuAccounting::FULL, 1);
+	const std::string mod_a = "mod_a", mod_b = "mod_b";
+
+	{
+		ScriptCpuAccounting::Scope scope(acc);
+		acc.setCallback("environment_Step");
+		acc.switchTo(mod_a);
+		acc.switchTo(mod_b);
+		{
+			// e.g. on_construct run by an API function called from mod_b
+			ScriptCpuAccounting::Scope nested(acc);
+			acc.switchTo(mod_a, "on_construct");
+		}
+		acc.switchTo(mod_a);
+	}
+
+	// Origin changes outside of the script environment are not counted
+	acc.switchTo(mod_b);
+
+	ScriptCpuAccounting::UsageMap usage;
+	acc.getUsage(usage);
+	UASSERTEQ(size_t, usage.size(), 2);
+	UASSERTEQ(u64, usage[mod_a].total.calls, 3);
+	UASSERTEQ(u64, usage[mod_a].callbacks["environment_Step"].calls, 2);
+	UASSERTEQ(u64, usage[mod_a].callbacks["on_construct"].calls, 1);
+	UASSERTEQ(u64, usage[mod_b].total.calls, 1);
+	UASSERTEQ(u64, usage[mod_b].callbacks["environment_Step"].calls, 1);
+}
+
+void TestCpuAccounting::testSampling()
+{
+	ScriptCpuAccounting acc;
+	acc.setMode(ScriptCpuAccounting::SAMPLED, 4);
+	const std::string mod = "mod";
+
+	for (int i = 0; i < 10; i++) {
+		ScriptCpuAccounting::Scope scope(acc);
+		acc.switchTo(mod, "on_timer");
+	}
+
+	// Two of the calls were measured, each counts for four
+	ScriptCpuAccounting::UsageMap usage;
+	acc.getUsage(usage);
+	UASSERTEQ(u64, usage[mod].total.calls, 8);
+
+	acc.setMode(ScriptCpuAccounting::OFF, 1);
+	{
+		ScriptCpuAccounting::Scope scope(acc);
+		acc.switchTo(mod, "on_timer");
+	}
+	acc.getUsage(usage);
+	UASSERTEQ(u64, usage[mod].total.calls, 8);
+}
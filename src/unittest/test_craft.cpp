@@ -34,6 +34,7 @@ class TestCraft : public TestBase
 			const std::vector<std::string> &groups, IGameDef *gamedef);
 
 	void testShapeless(IGameDef *gamedef);
+	void testGroups(IGameDef *gamedef);
 };
 
 static TestCraft g_test_instance;
@@ -41,6 +42,7 @@ static TestCraft g_test_instance;
 void TestCraft::runTests(IGameDef *gamedef)
 {
 	TEST(testShapeless, gamedef);
+	TEST(testGroups, gamedef);
 }
 
 std::string TestCraft::getDumpedCraftResult(CraftInput input, IGameDef *gamedef)
@@ -273,3 +275,70 @@ void TestCraft::testShapeless(IGameDef *gamedef)
 			}), gamedef),
 			"(item=\"crafttest:i4\", time=0)");
 }
+
+void TestCraft::testGroups(IGameDef *gamedef)
+{
+	IWritableItemDefManager *idef = (IWritableItemDefManager *)gamedef->getItemDefManager();
+	IWritableCraftDefManager *cdef = (IWritableCraftDefManager *)gamedef->getCraftDefManager();
+
+	auto to_item = [&](const std::string &itemstring) -> ItemStack {
+		ItemStack item;
+		item.deSerialize(itemstring, idef);
+		return item;
+	};
+
+	cdef->clear();
+
+	for (const char *name : {"crafttest:i1", "crafttest:i2", "crafttest:i3", "crafttest:i4"})
+		registerItemWithGroups(name, {}, gamedef);
+	registerItemWithGroups("crafttest:stick", {}, gamedef);
+	registerItemWithGroups("crafttest:wood", {"crafttest_wood"}, gamedef);
+	registerItemWithGroups("crafttest:pine", {"crafttest_wood", "crafttest_resin"}, gamedef);
+
+	cdef->registerCraft(new CraftDefinitionShaped("crafttest:i1", 1,
+			{"group:crafttest_wood", "group:crafttest_wood"}, CraftReplacements{}), gamedef);
+	cdef->registerCraft(new CraftDefinitionShaped("crafttest:i2", 1,
+			{"crafttest:pine", "crafttest:pine"}, CraftReplacements{}), gamedef);
+	cdef->registerCraft(new CraftDefinitionShaped("crafttest:i3", 1,
+			{"crafttest:stick", "group:crafttest_wood"}, CraftReplacements{}), gamedef);
+	// Same priority as the first recipe, registered later
+	cdef->registerCraft(new CraftDefinitionShaped("crafttest:i4", 1,
+			{"group:crafttest_wood,crafttest_resin", "group:crafttest_wood"},
+			CraftReplacements{}), gamedef);
+	cdef->registerCraft(new CraftDefinitionCooking("crafttest:i1",
+			"group:crafttest_resin", 3.0f, CraftReplacements{}), gamedef);
+	cdef->initHashes(gamedef);
+
+	auto craft = [&](unsigned int width, const std::vector<std::string> &items) {
+		std::vector<ItemStack> stacks;
+		for (const std::string &item : items)
+			stacks.push_back(to_item(item));
+		return getDumpedCraftResult(CraftInput(CRAFT_METHOD_NORMAL, width, stacks), gamedef);
+	};
+
+	UASSERTEQ(std::string, craft(1, {"crafttest:wood", "crafttest:wood"}),
+			"(item=\"crafttest:i1\", time=0)");
+	UASSERTEQ(std::string, craft(1, {"crafttest:pine", "crafttest:wood"}),
+			"(item=\"crafttest:i4\", time=0)");
+	UASSERTEQ(std::string, craft(1, {"crafttest:wood", "crafttest:pine"}),
+			"(item=\"crafttest:i1\", time=0)");
+	UASSERTEQ(std::string, craft(1, {"crafttest:pine", "crafttest:pine"}),
+			"(item=\"crafttest:i2\", time=0)");
+	UASSERTEQ(std::string, craft(3, {"", "crafttest:stick", "", "", "crafttest:pine"}),
+			"(item=\"crafttest:i3\", time=0)");
+
+	// Wrong shape, order or number of items
+	UASSERTEQ(std::string, craft(2, {"crafttest:wood", "crafttest:wood"}),
+			"(item=\"\", time=0)");
+	UASSERTEQ(std::string, craft(1, {"crafttest:wood", "crafttest:stick"}),
+			"(item=\"\", time=0)");
+	UASSERTEQ(std::string, craft(1, {"crafttest:wood", "crafttest:wood", "crafttest:wood"}),
+			"(item=\"\", time=0)");
+
+	UASSERTEQ(std::string, getDumpedCraftResult(CraftInput(CRAFT_METHOD_COOKING, 1,
+			{to_item("crafttest:pine")}), gamedef),
+			"(item=\"crafttest:i1\", time=3)");
+	UASSERTEQ(std::string, getDumpedCraftResult(CraftInput(CRAFT_METHOD_COOKING, 1,
+			{to_item("crafttest:wood")}), gamedef),
+			"(item=\"\", time=0)");
+}
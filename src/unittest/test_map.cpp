@@ -21,8 +21,12 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <cstdio>
 #include <unordered_set>
 #include <unordered_map>
+#include <sstream>
 #include "mapblock.h"
 #include "dummymap.h"
+#include "nodemetadata.h"
+#include "serialization.h"
+#include "staticobject.h"
 
 class TestMap : public TestBase
 {
@@ -36,6 +40,9 @@ class TestMap : public TestBase
 	void testForEachNodeInArea(IGameDef *gamedef);
 	void testForEachNodeInAreaBlank(IGameDef *gamedef);
 	void testForEachNodeInAreaEmpty(IGameDef *gamedef);
+	void testUnloadLeastRecentlyUsed(IGameDef *gamedef);
+	void testCompactBlock(IGameDef *gamedef);
+	void testDeSerializeBuffer(IGameDef *gamedef);
 };
 
 static TestMap g_test_instance;
@@ -46,6 +53,9 @@ void TestMap::runTests(IGameDef *gamedef)
 	TEST(testForEachNodeInArea, gamedef);
 	TEST(testForEachNodeInAreaBlank, gamedef);
 	TEST(testForEachNodeInAreaEmpty, gamedef);
+	TEST(testUnloadLeastRecentlyUsed, gamedef);
+	TEST(testCompactBlock, gamedef);
+	TEST(testDeSerializeBuffer, gamedef);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -169,3 +179,198 @@ void TestMap::testForEachNodeInAreaEmpty(IGameDef *gamedef)
 		return true;
 	});
 }
+
+void TestMap::testUnloadLeastRecentlyUsed(IGameDef *gamedef)
+{
+	{
+		// 2 sectors of 4 blocks
+		DummyMap map(gamedef, v3s16(0, 0, 0), v3s16(1, 3, 0));
+		auto block = [&] (s16 x, s16 y) { return map.getBlockNoCreateNoEx(v3s16(x, y, 0)); };
+
+		std::vector<v3s16> unloaded;
+		map.timerUpdate(5.0f, 10.0f, -1, &unloaded);
+		UASSERT(unloaded.empty());
+
+		// Used blocks and referenced ones stay
+		block(0, 0)->resetUsageTimer();
+		block(1, 1)->refGrab();
+		map.timerUpdate(6.0f, 10.0f, -1, &unloaded);
+		UASSERTEQ(size_t, unloaded.size(), 6);
+		UASSERT(block(0, 0));
+		UASSERT(block(1, 1));
+
+		// Dropping the reference counts as a use
+		map.timerUpdate(6.0f, 10.0f, -1, &unloaded);
+		block(1, 1)->refDrop();
+		map.timerUpdate(6.0f, 10.0f, -1, &unloaded);
+		UASSERTEQ(size_t, unloaded.size(), 7);
+		UASSERT(unloaded.back() == v3s16(0, 0, 0));
+		UASSERT(block(1, 1));
+
+		// Emptied sectors are deleted
+		UASSERT(map.getSectorNoGenerate(v2s16(0, 0)) == nullptr);
+		map.unloadUnreferencedBlocks();
+		UASSERT(map.getSectorNoGenerate(v2s16(1, 0)) == nullptr);
+	}
+
+	{
+		DummyMap map(gamedef, v3s16(0, 0, 0), v3s16(0, 3, 0));
+		map.getBlockNoCreateNoEx(v3s16(0, 0, 0))->resetUsageTimer();
+
+		// Over the limit the least recently used go first, whatever their age
+		std::vector<v3s16> unloaded;
+		map.timerUpdate(1.0f, 10.0f, 2, &unloaded);
+		UASSERTEQ(size_t, unloaded.size(), 2);
+		UASSERT(unloaded[0] == v3s16(0, 1, 0));
+		UASSERT(unloaded[1] == v3s16(0, 2, 0));
+		UASSERT(map.getBlockNoCreateNoEx(v3s16(0, 0, 0)));
+	}
+}
+
+// Fills the block with 'distinct' different nodes and checks that the
+// compact form reads the same
+static void checkCompactBlock(MapBlock &block, u32 distinct, bool compact)
+{
+	MapNode *data = block.getData();
+	for (u32 i = 0; i < MapBlock::nodecount; i++) {
+		// Runs of equal nodes, like real terrain
+		u32 k = (i / 7) % distinct;
+		data[i] = MapNode(k % 100 + 1, k / 100, i % 3 == 0 ? 0 : 4);
+		if (i % 3 == 0 && k % 2)
+			data[i] = MapNode(k % 100 + 1, k / 100, 4);
+	}
+	std::vector<MapNode> expected(data, data + MapBlock::nodecount);
+
+	block.tryShrinkNodes();
+	UASSERT(block.isCompact() == compact);
+
+	v3s16 p;
+	u32 i = 0;
+	for (p.Z = 0; p.Z < MAP_BLOCKSIZE; p.Z++)
+	for (p.Y = 0; p.Y < MAP_BLOCKSIZE; p.Y++)
+	for (p.X = 0; p.X < MAP_BLOCKSIZE; p.X++, i++)
+		UASSERT(block.getNodeNoCheck(p) == expected[i]);
+
+	std::vector<MapNode> copy(MapBlock::nodecount);
+	block.copyNodes(copy.data());
+	UASSERT(copy == expected);
+}
+
+void TestMap::testCompactBlock(IGameDef *gamedef)
+{
+	MapBlock block(v3s16(1, -2, 3), gamedef);
+
+	// Uniform
+	block.tryShrinkNodes();
+	UASSERT(block.isCompact());
+	UASSERT(block.getNodeNoCheck(v3s16(15, 0, 7)).getContent() == CONTENT_IGNORE);
+	bool valid;
+	UASSERT(block.getNode(v3s16(16, 0, 0), &valid).getContent() == CONTENT_IGNORE);
+	UASSERT(!valid);
+
+	// Writing expands the block
+	block.setNode(v3s16(1, 2, 3), MapNode(CONTENT_AIR));
+	UASSERT(!block.isCompact());
+	UASSERT(block.getNodeNoCheck(v3s16(1, 2, 3)).getContent() == CONTENT_AIR);
+	UASSERT(block.getNodeNoCheck(v3s16(1, 2, 4)).getContent() == CONTENT_IGNORE);
+
+	// 4 and 8 bit indices, and too many nodes for a palette
+	checkCompactBlock(block, 2, true);
+	checkCompactBlock(block, 8, true);
+	checkCompactBlock(block, 100, true);
+	checkCompactBlock(block, 200, false);
+}
+
+static void checkSameBlock(MapBlock &a, MapBlock &b, bool disk)
+{
+	v3s16 p;
+	for (p.Z = 0; p.Z < MAP_BLOCKSIZE; p.Z++)
+	for (p.Y = 0; p.Y < MAP_BLOCKSIZE; p.Y++)
+	for (p.X = 0; p.X < MAP_BLOCKSIZE; p.X++)
+		UASSERT(a.getNodeNoCheck(p) == b.getNodeNoCheck(p));
+
+	UASSERT(a.getIsUnderground() == b.getIsUnderground());
+	UASSERTEQ(u16, a.getLightingComplete(), b.getLightingComplete());
+
+	UASSERTEQ(size_t, a.m_node_metadata.size(), b.m_node_metadata.size());
+	NodeMetadata *meta_a = a.m_node_metadata.get(v3s16(1, 2, 3));
+	NodeMetadata *meta_b = b.m_node_metadata.get(v3s16(1, 2, 3));
+	UASSERT(meta_a && meta_b);
+	UASSERTEQ(std::string, meta_a->getString("formspec"),
+		meta_b->getString("formspec"));
+
+	if (!disk)
+		return;
+
+	UASSERTEQ(u32, a.getTimestamp(), b.getTimestamp());
+
+	UASSERTEQ(size_t, a.m_static_objects.getStoredSize(), 1);
+	UASSERTEQ(size_t, b.m_static_objects.getStoredSize(), 1);
+	const StaticObject &obj_a = a.m_static_objects.getAllStored()[0];
+	const StaticObject &obj_b = b.m_static_objects.getAllStored()[0];
+	UASSERTEQ(int, obj_a.type, obj_b.type);
+	UASSERT(obj_a.pos == obj_b.pos);
+	UASSERTEQ(std::string, obj_a.data, obj_b.data);
+
+	NodeTimer timer_a = a.getNodeTimer(v3s16(4, 5, 6));
+	NodeTimer timer_b = b.getNodeTimer(v3s16(4, 5, 6));
+	UASSERTEQ(f32, timer_a.timeout, 5.0f);
+	UASSERTEQ(f32, timer_a.timeout, timer_b.timeout);
+	UASSERTEQ(f32, timer_a.elapsed, timer_b.elapsed);
+}
+
+void TestMap::testDeSerializeBuffer(IGameDef *gamedef)
+{
+	const u8 version = SER_FMT_VER_HIGHEST_WRITE;
+	MapBlock block(v3s16(2, -1, 0), gamedef);
+
+	v3s16 p;
+	for (p.Z = 0; p.Z < MAP_BLOCKSIZE; p.Z++)
+	for (p.Y = 0; p.Y < MAP_BLOCKSIZE; p.Y++)
+	for (p.X = 0; p.X < MAP_BLOCKSIZE; p.X++) {
+		content_t c = p.Y < 5 ? t_CONTENT_STONE :
+			p.Y < 7 ? t_CONTENT_WATER : CONTENT_AIR;
+		block.setNode(p, MapNode(c, p.X, p.Z));
+	}
+	block.setIsUnderground(true);
+	block.setTimestampNoChangedFlag(12345);
+
+	NodeMetadata *meta = new NodeMetadata(gamedef->idef());
+	meta->setString("formspec", "size[8,9]");
+	block.m_node_metadata.set(v3s16(1, 2, 3), meta);
+
+	StaticObject obj;
+	obj.type = 7;
+	obj.pos = v3f(1.0f, 2.0f, 3.0f);
+	obj.data = "object data";
+	block.m_static_objects.pushStored(obj);
+
+	block.setNodeTimer(NodeTimer(5.0f, 1.5f, v3s16(4, 5, 6)));
+
+	for (bool disk : {true, false}) {
+		std::ostringstream os(std::ios_base::binary);
+		block.serialize(os, version, disk, -1);
+		// Followed by more data when sent over the network
+		if (!disk)
+			block.serializeNetworkSpecific(os);
+		const std::string data = os.str();
+
+		MapBlock from_stream(block.getPos(), gamedef);
+		std::istringstream is(data, std::ios_base::binary);
+		from_stream.deSerialize(is, version, disk);
+
+		MapBlock from_buffer(block.getPos(), gamedef);
+		size_t used = from_buffer.deSerialize(
+			reinterpret_cast<const u8 *>(data.data()), data.size(), version, disk);
+
+		// Stops where the stream overload stops
+		UASSERTEQ(size_t, used, (size_t)is.tellg());
+		if (disk)
+			UASSERTEQ(size_t, used, data.size());
+		else
+			UASSERTEQ(size_t, used, data.size() - 1);
+
+		checkSameBlock(block, from_stream, disk);
+		checkSameBlock(block, from_buffer, disk);
+	}
+}
@@ -0,0 +1,278 @@
+/*
+Minetest
+Copyright (C) 2024 Minetest Authors
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "cmake_config.h"
+
+#include "test.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include "database/database-dummy.h"
+#include "database/database-regions.h"
+#include "database/database-sqlite3.h"
+#if USE_POSTGRESQL
+#include "database/database-postgresql.h"
+#endif
+#include "filesys.h"
+
+class TestMapDatabase : public TestBase
+{
+public:
+	TestMapDatabase() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestMapDatabase"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testLoadBlocks(MapDatabase *db);
+	void testRegionsReopen(const std::string &dir);
+	void testRegionsCompaction(const std::string &dir);
+	void testRegionsIncrementalCompaction(const std::string &dir);
+};
+
+static TestMapDatabase g_test_instance;
+
+void TestMapDatabase::runTests(IGameDef *gamedef)
+{
+	const std::string test_dir = getTestTempDirectory();
+
+	rawstream << "-------- Dummy database" << std::endl;
+	{
+		Database_Dummy db;
+		TEST(testLoadBlocks, &db);
+	}
+
+	rawstream << "-------- SQLite3 database" << std::endl;
+	{
+		MapDatabaseSQLite3 db(test_dir);
+		TEST(testLoadBlocks, &db);
+	}
+	fs::DeleteSingleFileOrEmptyDirectory(test_dir + DIR_DELIM + "map.sqlite");
+
+	rawstream << "-------- Regions database" << std::endl;
+	{
+		MapDatabaseRegions db(test_dir);
+		TEST(testLoadBlocks, &db);
+	}
+	TEST(testRegionsReopen, test_dir);
+	TEST(testRegionsCompaction, test_dir);
+	TEST(testRegionsIncrementalCompaction, test_dir);
+	fs::RecursiveDelete(test_dir + DIR_DELIM + "map_regions");
+
+#if USE_POSTGRESQL
+	const char *env_postgresql_connect_string = getenv("MINETEST_POSTGRESQL_CONNECT_STRING");
+	if (env_postgresql_connect_string) {
+		rawstream << "-------- PostgreSQL database" << std::endl;
+		MapDatabasePostgreSQL db(env_postgresql_connect_string);
+		TEST(testLoadBlocks, &db);
+	}
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void TestMapDatabase::testLoadBlocks(MapDatabase *db)
+{
+	// More than one batch of the SQLite3 backend, every third block exists
+	std::vector<v3s16> pos;
+	for (s16 i = 0; i < 100; i++)
+		pos.emplace_back(i % 7 - 3, i / 7 - 7, -i);
+
+	db->beginSave();
+	for (size_t i = 0; i < pos.size(); i += 3)
+		UASSERT(db->saveBlock(pos[i], "block " + std::to_string(i)));
+	db->endSave();
+
+	// Requested more than once
+	const v3s16 first = pos[0], fourth = pos[3];
+	pos.push_back(fourth);
+	pos.insert(pos.begin() + 50, first);
+
+	std::vector<std::string> blocks;
+	db->loadBlocks(pos, blocks);
+	UASSERTEQ(size_t, blocks.size(), pos.size());
+
+	for (size_t i = 0; i < pos.size(); i++) {
+		std::string block;
+		db->loadBlock(pos[i], &block);
+		UASSERT(blocks[i] == block);
+	}
+	UASSERT(blocks[0] == "block 0");
+	UASSERT(blocks[1].empty());
+	UASSERT(blocks[50] == "block 0");
+	UASSERT(blocks.back() == "block 3");
+
+	db->loadBlocks({}, blocks);
+	UASSERT(blocks.empty());
+
+	db->beginSave();
+	for (size_t i = 0; i < pos.size(); i++)
+		db->deleteBlock(pos[i]);
+	db->endSave();
+}
+
+void TestMapDatabase::testRegionsReopen(const std::string &dir)
+{
+	// Spans several regions, including negative ones
+	std::vector<v3s16> pos;
+	for (s16 i = -40; i < 40; i += 3)
+		pos.emplace_back(i, -i / 2, i * 2);
+
+	{
+		MapDatabaseRegions db(dir);
+		db.beginSave();
+		for (const v3s16 &p : pos)
+			UASSERT(db.saveBlock(p, "old"));
+		for (const v3s16 &p : pos)
+			UASSERT(db.saveBlock(p, "block " + std::to_string(p.X)));
+		UASSERT(db.deleteBlock(pos[0]));
+		db.endSave();
+	}
+
+	MapDatabaseRegions db(dir);
+	std::string block;
+	db.loadBlock(pos[0], &block);
+	UASSERT(block.empty());
+	for (size_t i = 1; i < pos.size(); i++) {
+		db.loadBlock(pos[i], &block);
+		UASSERT(block == "block " + std::to_string(pos[i].X));
+	}
+
+	std::vector<v3s16> listed;
+	db.listAllLoadableBlocks(listed);
+	UASSERTEQ(size_t, listed.size(), pos.size() - 1);
+	for (size_t i = 1; i < pos.size(); i++)
+		UASSERT(std::find(listed.begin(), listed.end(), pos[i]) != listed.end());
+
+	db.beginSave();
+	for (const v3s16 &p : pos)
+		db.deleteBlock(p);
+	db.endSave();
+}
+
+void TestMapDatabase::testRegionsCompaction(const std::string &dir)
+{
+	const v3s16 pos(17, -3, 5), other(18, -3, 5);
+	const std::string region_path = dir + DIR_DELIM "map_regions" DIR_DELIM "r.1.-1.0.mtr";
+
+	MapDatabaseRegions db(dir);
+	db.beginSave();
+	UASSERT(db.saveBlock(other, "other"));
+	std::string data(64 * 1024, 'a');
+	for (int i = 0; i < 40; i++) {
+		data[0] = 'a' + i % 26;
+		UASSERT(db.saveBlock(pos, data));
+	}
+	std::string content;
+	UASSERT(fs::ReadFile(region_path, content));
+	const size_t size_before = content.size();
+	db.endSave();
+
+	// Only the latest version of each block is left
+	UASSERT(fs::ReadFile(region_path, content));
+	UASSERT(content.size() < size_before);
+	UASSERT(content.size() < 2 * data.size());
+
+	std::string block;
+	db.loadBlock(pos, &block);
+	UASSERT(block == data);
+	db.loadBlock(other, &block);
+	UASSERT(block == "other");
+
+	// Still works after the file was replaced
+	UASSERT(db.saveBlock(other, "changed"));
+	db.loadBlock(other, &block);
+	UASSERT(block == "changed");
+
+	db.deleteBlock(pos);
+	db.deleteBlock(other);
+}
+
+void TestMapDatabase::testRegionsIncrementalCompaction(const std::string &dir)
+{
+	// More than one compaction step worth of blocks
+	std::vector<v3s16> pos;
+	for (s16 i = 0; i < 20; i++)
+		pos.emplace_back(32 + i % 16, i / 16, 0);
+	const std::string region_path = dir + DIR_DELIM "map_regions" DIR_DELIM "r.2.0.0.mtr";
+
+	MapDatabaseRegions db(dir);
+	std::string data(64 * 1024, 'a');
+	db.beginSave();
+	for (int round = 0; round < 3; round++) {
+		for (size_t i = 0; i < pos.size(); i++) {
+			data[0] = 'a' + round;
+			data[1] = 'a' + i;
+			UASSERT(db.saveBlock(pos[i], data));
+		}
+	}
+
+	// The index is only written at the end of the save
+	{
+		MapDatabaseRegions other(dir);
+		std::string block;
+		other.loadBlock(pos[0], &block);
+		UASSERT(block.empty());
+	}
+
+	std::string content;
+	UASSERT(fs::ReadFile(region_path, content));
+	const size_t size_before = content.size();
+	db.endSave();
+
+	// Not everything was copied by the first step
+	UASSERT(fs::ReadFile(region_path, content));
+	UASSERTEQ(size_t, content.size(), size_before);
+
+	// Changed before and after being copied
+	db.beginSave();
+	data[0] = 'x';
+	data[1] = 'a';
+	UASSERT(db.saveBlock(pos[0], data));
+	UASSERT(db.deleteBlock(pos[1]));
+	data[1] = 'a' + 19;
+	UASSERT(db.saveBlock(pos[19], data));
+	db.endSave();
+
+	UASSERT(fs::ReadFile(region_path, content));
+	UASSERT(content.size() < size_before);
+
+	auto check = [&] (MapDatabase &d) {
+		std::string block;
+		for (size_t i = 0; i < pos.size(); i++) {
+			d.loadBlock(pos[i], &block);
+			if (i == 1) {
+				UASSERT(block.empty());
+				continue;
+			}
+			UASSERTEQ(size_t, block.size(), data.size());
+			UASSERT(block[0] == (i == 0 || i == 19 ? 'x' : 'c'));
+			UASSERT(block[1] == (char)('a' + i));
+		}
+	};
+	check(db);
+	{
+		MapDatabaseRegions reopened(dir);
+		check(reopened);
+	}
+
+	db.beginSave();
+	for (const v3s16 &p : pos)
+		db.deleteBlock(p);
+	db.endSave();
+}
@@ -0,0 +1,163 @@
+/*
+Minetest
+Copyright (C) 2024 Minetest Authors
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include "mapgen/mapgen.h"
+#include "noise.h"
+
+class TestMapgenColumnCache : public TestBase
+{
+public:
+	TestMapgenColumnCache() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestMapgenColumnCache"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testHit();
+	void testEviction();
+	void testGroups();
+	void testDisabled();
+};
+
+static TestMapgenColumnCache g_test_instance;
+
+void TestMapgenColumnCache::runTests(IGameDef *gamedef)
+{
+	TEST(testHit);
+	TEST(testEviction);
+	TEST(testGroups);
+	TEST(testDisabled);
+}
+
+static const NoiseParams s_np;
+
+static void fillNoise(Noise &noise, float base)
+{
+	for (u32 i = 0; i < noise.sx * noise.sy; i++)
+		noise.result[i] = base + i;
+}
+
+static bool checkNoise(const Noise &noise, float base)
+{
+	for (u32 i = 0; i < noise.sx * noise.sy; i++) {
+		if (noise.result[i] != base + i)
+			return false;
+	}
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void TestMapgenColumnCache::testHit()
+{
+	MapgenColumnCache cache(4);
+	Noise a(&s_np, 1, 5, 5);
+	Noise b(&s_np, 1, 3, 3);
+
+	const v3s16 pmin(-80, -80, 80);
+	UASSERT(!cache.load(pmin, MGCOLUMN_TERRAIN, {&a, &b}));
+
+	fillNoise(a, 100.0f);
+	fillNoise(b, 200.0f);
+	cache.store(pmin, MGCOLUMN_TERRAIN, {&a, nullptr, &b});
+	fillNoise(a, 0.0f);
+	fillNoise(b, 0.0f);
+
+	// Any mapchunk of the same column hits, null noises are skipped
+	UASSERT(cache.load(v3s16(-80, 400, 80), MGCOLUMN_TERRAIN, {&a, nullptr, &b}));
+	UASSERT(checkNoise(a, 100.0f));
+	UASSERT(checkNoise(b, 200.0f));
+
+	// Other columns do not
+	UASSERT(!cache.load(v3s16(0, -80, 80), MGCOLUMN_TERRAIN, {&a, &b}));
+	UASSERT(!cache.load(v3s16(-80, -80, 0), MGCOLUMN_TERRAIN, {&a, &b}));
+
+	cache.clear();
+	UASSERT(!cache.load(pmin, MGCOLUMN_TERRAIN, {&a, &b}));
+}
+
+void TestMapgenColumnCache::testEviction()
+{
+	MapgenColumnCache cache(2);
+	Noise noise(&s_np, 1, 4, 4);
+
+	const v3s16 col1(0, 0, 0), col2(80, 0, 0), col3(0, 0, 80);
+	fillNoise(noise, 1.0f);
+	cache.store(col1, MGCOLUMN_BIOMES, {&noise});
+	fillNoise(noise, 2.0f);
+	cache.store(col2, MGCOLUMN_BIOMES, {&noise});
+
+	// Makes col2 the least recently used one
+	UASSERT(cache.load(col1, MGCOLUMN_BIOMES, {&noise}));
+	UASSERT(checkNoise(noise, 1.0f));
+
+	fillNoise(noise, 3.0f);
+	cache.store(col3, MGCOLUMN_BIOMES, {&noise});
+	UASSERT(!cache.load(col2, MGCOLUMN_BIOMES, {&noise}));
+	UASSERT(cache.load(col1, MGCOLUMN_BIOMES, {&noise}));
+	UASSERT(checkNoise(noise, 1.0f));
+	UASSERT(cache.load(col3, MGCOLUMN_BIOMES, {&noise}));
+	UASSERT(checkNoise(noise, 3.0f));
+
+	// Storing a column that is already cached keeps the first results
+	fillNoise(noise, 4.0f);
+	cache.store(col1, MGCOLUMN_BIOMES, {&noise});
+	UASSERT(cache.load(col1, MGCOLUMN_BIOMES, {&noise}));
+	UASSERT(checkNoise(noise, 1.0f));
+	UASSERT(cache.load(col3, MGCOLUMN_BIOMES, {&noise}));
+}
+
+void TestMapgenColumnCache::testGroups()
+{
+	MapgenColumnCache cache(3);
+	Noise noise(&s_np, 1, 4, 4);
+	const v3s16 pmin(-32, -32, -32);
+
+	const MapgenColumnGroup groups[] = {MGCOLUMN_TERRAIN,
+		MGCOLUMN_TERRAIN_EXTRA, MGCOLUMN_BIOMES, MGCOLUMN_FILLER_DEPTH};
+	for (int i = 0; i < 3; i++) {
+		fillNoise(noise, 10.0f * i);
+		cache.store(pmin, groups[i], {&noise});
+	}
+
+	// Each group of a column is a separate entry
+	for (int i = 0; i < 3; i++) {
+		UASSERT(cache.load(pmin, groups[i], {&noise}));
+		UASSERT(checkNoise(noise, 10.0f * i));
+	}
+	UASSERT(!cache.load(pmin, MGCOLUMN_FILLER_DEPTH, {&noise}));
+
+	// and counts towards the limit
+	fillNoise(noise, 30.0f);
+	cache.store(pmin, MGCOLUMN_FILLER_DEPTH, {&noise});
+	UASSERT(!cache.load(pmin, MGCOLUMN_TERRAIN, {&noise}));
+	UASSERT(cache.load(pmin, MGCOLUMN_FILLER_DEPTH, {&noise}));
+	UASSERT(checkNoise(noise, 30.0f));
+}
+
+void TestMapgenColumnCache::testDisabled()
+{
+	MapgenColumnCache cache(0);
+	Noise noise(&s_np, 1, 4, 4);
+
+	fillNoise(noise, 1.0f);
+	cache.store(v3s16(0, 0, 0), MGCOLUMN_TERRAIN, {&noise});
+	UASSERT(!cache.load(v3s16(0, 0, 0), MGCOLUMN_TERRAIN, {&noise}));
+}
@@ -0,0 +1,117 @@
+/*
+Minetest
+Copyright (C) 2024 Minetest Authors
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include <cmath>
+#include <sstream>
+#include "util/metricsbackend.h"
+
+class TestMetricsBackend : public TestBase
+{
+public:
+	TestMetricsBackend() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestMetricsBackend"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testBuckets();
+	void testHistogram();
+	void testTextDump();
+};
+
+static TestMetricsBackend g_test_instance;
+
+void TestMetricsBackend::runTests(IGameDef *gamedef)
+{
+	TEST(testBuckets);
+	TEST(testHistogram);
+	TEST(testTextDump);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void TestMetricsBackend::testBuckets()
+{
+	auto linear = MetricHistogram::linearBuckets(1.0, 0.5, 3);
+	UASSERTEQ(size_t, linear.size(), 3);
+	UASSERT(linear[0] == 1.0 && linear[1] == 1.5 && linear[2] == 2.0);
+
+	auto exponential = MetricHistogram::exponentialBuckets(0.001, 10.0, 4);
+	UASSERTEQ(size_t, exponential.size(), 4);
+	UASSERT(std::fabs(exponential[3] - 1.0) < 1e-9);
+}
+
+void TestMetricsBackend::testHistogram()
+{
+	MetricsBackend mb;
+	auto hist = mb.addHistogram("test_histogram", "Test",
+		MetricHistogram::linearBuckets(10.0, 10.0, 10));
+
+	UASSERTEQ(u64, hist->getCount(), 0);
+	UASSERT(hist->getQuantile(0.5) == 0.0);
+
+	// 1, 2, ..., 100
+	for (int i = 1; i <= 100; i++)
+		hist->observe(i);
+
+	UASSERTEQ(u64, hist->getCount(), 100);
+	UASSERT(hist->getSum() == 5050.0);
+	UASSERT(std::fabs(hist->getQuantile(0.5) - 50.0) < 1e-9);
+	UASSERT(std::fabs(hist->getQuantile(0.99) - 99.0) < 1e-9);
+
+	// Everything above the last bound can't be located any better
+	hist->observe(1000.0);
+	UASSERT(hist->getQuantile(1.0) == 100.0);
+}
+
+void TestMetricsBackend::testTextDump()
+{
+	TextMetricsBackend mb;
+	auto counter = mb.addCounter("test_counter", "A counter", {{"type", "a"}});
+	auto counter2 = mb.addCounter("test_counter", "A counter", {{"type", "b"}});
+	auto gauge = mb.addGauge("test_gauge", "A gauge");
+	auto hist = mb.addHistogram("test_seconds", "A histogram", {0.1, 1.0});
+
+	counter->increment(3);
+	counter2->increment();
+	gauge->set(-2.5);
+	hist->observe(0.05);
+	hist->observe(0.5);
+	hist->observe(2.0);
+
+	std::ostringstream os;
+	mb.dump(os);
+	const std::string expected =
+		"# HELP test_counter A counter\n"
+		"# TYPE test_counter counter\n"
+		"test_counter{type=\"a\"} 3\n"
+		"test_counter{type=\"b\"} 1\n"
+		"# HELP test_gauge A gauge\n"
+		"# TYPE test_gauge gauge\n"
+		"test_gauge -2.5\n"
+		"# HELP test_seconds A histogram\n"
+		"# TYPE test_seconds histogram\n"
+		"test_seconds_bucket{le=\"0.1\"} 1\n"
+		"test_seconds_bucket{le=\"1\"} 2\n"
+		"test_seconds_bucket{le=\"+Inf\"} 3\n"
+		"test_seconds_sum 2.55\n"
+		"test_seconds_count 3\n";
+	UASSERTEQ(std::string, os.str(), expected);
+}
@@ -0,0 +1,139 @@
+/*
+Minetest
+Copyright (C) 2024 Minetest Authors
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include <sstream>
+#include "exceptions.h"
+#include "nodechangebatch.h"
+#include "util/serialize.h"
+
+class TestNodeChangeBatch : public TestBase
+{
+public:
+	TestNodeChangeBatch() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestNodeChangeBatch"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testIndex();
+	void testRoundTrip();
+	void testRuns();
+	void testInvalidRun();
+};
+
+static TestNodeChangeBatch g_test_instance;
+
+void TestNodeChangeBatch::runTests(IGameDef *gamedef)
+{
+	TEST(testIndex);
+	TEST(testRoundTrip);
+	TEST(testRuns);
+	TEST(testInvalidRun);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void TestNodeChangeBatch::testIndex()
+{
+	for (s16 z = 0; z < MAP_BLOCKSIZE; z++)
+	for (s16 y = 0; y < MAP_BLOCKSIZE; y++)
+	for (s16 x = 0; x < MAP_BLOCKSIZE; x++) {
+		v3s16 p(x, y, z);
+		UASSERT(NodeChangeBatch::indexToPos(NodeChangeBatch::posToIndex(p)) == p);
+	}
+	UASSERTEQ(u16, NodeChangeBatch::posToIndex(v3s16(1, 2, 3)), 3 * 256 + 2 * 16 + 1);
+}
+
+void TestNodeChangeBatch::testRoundTrip()
+{
+	NodeChangeBatch batch(v3s16(-3, 7, 1000));
+	batch.add(v3s16(0, 0, 0), MapNode(42, 1, 2), false);
+	batch.add(v3s16(15, 15, 15), MapNode(0x7fff, 255, 255), true);
+	batch.add(v3s16(5, 6, 7), MapNode(3), false);
+	// Replaces the node of the change before, the metadata stays removed
+	batch.add(v3s16(5, 6, 7), MapNode(4), true);
+	batch.add(v3s16(15, 15, 15), MapNode(0x7fff, 255, 255), true);
+	UASSERTEQ(size_t, batch.size(), 3);
+
+	std::ostringstream os(std::ios::binary);
+	batch.serialize(os);
+
+	NodeChangeBatch batch2;
+	std::istringstream is(os.str(), std::ios::binary);
+	batch2.deSerialize(is);
+
+	UASSERT(batch2.getBlockPos() == v3s16(-3, 7, 1000));
+	UASSERTEQ(size_t, batch2.size(), 3);
+
+	const auto &changes = batch2.getChanges();
+	auto it = changes.find(NodeChangeBatch::posToIndex(v3s16(15, 15, 15)));
+	UASSERT(it != changes.end());
+	UASSERTEQ(u16, it->second.n.param0, 0x7fff);
+	UASSERTEQ(u8, it->second.n.param1, 255);
+	UASSERTEQ(u8, it->second.n.param2, 255);
+	UASSERT(it->second.keep_metadata);
+
+	it = changes.find(NodeChangeBatch::posToIndex(v3s16(5, 6, 7)));
+	UASSERT(it != changes.end());
+	UASSERTEQ(u16, it->second.n.param0, 4);
+	UASSERT(!it->second.keep_metadata);
+
+	it = changes.find(0);
+	UASSERT(it != changes.end());
+	UASSERTEQ(u16, it->second.n.param0, 42);
+	UASSERTEQ(u8, it->second.n.param1, 1);
+	UASSERTEQ(u8, it->second.n.param2, 2);
+	UASSERT(!it->second.keep_metadata);
+}
+
+void TestNodeChangeBatch::testRuns()
+{
+	// A full row of nodes is one run
+	NodeChangeBatch batch(v3s16(0, 0, 0));
+	for (s16 x = 0; x < MAP_BLOCKSIZE; x++)
+		batch.add(v3s16(x, 4, 2), MapNode(x + 1), false);
+	batch.add(v3s16(0, 0, 9), MapNode(100), false);
+
+	std::ostringstream os(std::ios::binary);
+	batch.serialize(os);
+	const std::string data = os.str();
+
+	// blockpos, run count, two run headers and the nodes
+	UASSERTEQ(size_t, data.size(), 6 + 2 + 2 * 4 + 17 * 5);
+
+	std::istringstream is(data, std::ios::binary);
+	readV3S16(is);
+	UASSERTEQ(u16, readU16(is), 2);
+	UASSERTEQ(u16, readU16(is), NodeChangeBatch::posToIndex(v3s16(0, 4, 2)));
+	UASSERTEQ(u16, readU16(is), MAP_BLOCKSIZE);
+}
+
+void TestNodeChangeBatch::testInvalidRun()
+{
+	std::ostringstream os(std::ios::binary);
+	writeV3S16(os, v3s16(0, 0, 0));
+	writeU16(os, 1);
+	writeU16(os, 4090);
+	writeU16(os, 10);
+
+	NodeChangeBatch batch;
+	std::istringstream is(os.str(), std::ios::binary);
+	EXCEPTION_CHECK(SerializationError, batch.deSerialize(is));
+}
@@ -0,0 +1,171 @@
+/*
+Minetest
+Copyright (C) 2024 Minetest Authors
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include <sstream>
+#include "gamedef.h"
+#include "inventory.h"
+#include "nodemetadata.h"
+#include "util/serialize.h"
+
+class TestNodeMetadata : public TestBase
+{
+public:
+	TestNodeMetadata() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestNodeMetadata"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testSerializeUnread(IItemDefManager *idef);
+	void testReadOnAccess(IItemDefManager *idef);
+	void testHugeValue(IItemDefManager *idef);
+};
+
+static TestNodeMetadata g_test_instance;
+
+void TestNodeMetadata::runTests(IGameDef *gamedef)
+{
+	TEST(testSerializeUnread, gamedef->idef());
+	TEST(testReadOnAccess, gamedef->idef());
+	TEST(testHugeValue, gamedef->idef());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// A chest, a sign and an empty one
+static void fillList(NodeMetadataList &list, IItemDefManager *idef)
+{
+	NodeMetadata *chest = new NodeMetadata(idef);
+	chest->setString("infotext", "Chest");
+	chest->setString("owner", "singleplayer");
+	chest->markPrivate("owner", true);
+	InventoryList *main = chest->getInventory()->addList("main", 4);
+	main->addItem(1, ItemStack("default:dirt", 5, 0, idef));
+	list.set(v3s16(3, 0, 15), chest);
+
+	NodeMetadata *sign = new NodeMetadata(idef);
+	sign->setString("text", "Line 1\nEndInventory\nLine 3");
+	list.set(v3s16(0, 7, 2), sign);
+
+	list.set(v3s16(1, 1, 1), new NodeMetadata(idef));
+}
+
+static std::string serializeList(const NodeMetadataList &list, u8 blockver, bool disk)
+{
+	std::ostringstream os(std::ios::binary);
+	list.serialize(os, blockver, disk);
+	return os.str();
+}
+
+void TestNodeMetadata::testSerializeUnread(IItemDefManager *idef)
+{
+	NodeMetadataList list;
+	fillList(list, idef);
+	const std::string disk = serializeList(list, 29, true);
+
+	NodeMetadataList loaded;
+	std::istringstream is(disk, std::ios::binary);
+	loaded.deSerialize(is, idef);
+	UASSERTEQ(size_t, loaded.size(), 2);
+
+	// Without reading the metadata, in every format
+	UASSERT(serializeList(loaded, 29, true) == disk);
+	UASSERT(serializeList(loaded, 29, false) == serializeList(list, 29, false));
+	UASSERT(serializeList(loaded, 27, true) == serializeList(list, 27, true));
+	UASSERT(serializeList(loaded, 27, false) == serializeList(list, 27, false));
+
+	// Read from the older format
+	const std::string old = serializeList(list, 27, true);
+	std::istringstream is_old(old, std::ios::binary);
+	loaded.deSerialize(is_old, idef);
+	UASSERT(serializeList(loaded, 27, true) == old);
+}
+
+void TestNodeMetadata::testReadOnAccess(IItemDefManager *idef)
+{
+	NodeMetadataList list;
+	fillList(list, idef);
+	const std::string disk = serializeList(list, 29, true);
+
+	NodeMetadataList loaded;
+	std::istringstream is(disk, std::ios::binary);
+	loaded.deSerialize(is, idef);
+
+	std::vector<v3s16> keys = loaded.getAllKeys();
+	UASSERTEQ(size_t, keys.size(), 2);
+	UASSERT(keys[0] == v3s16(0, 7, 2));
+	UASSERT(keys[1] == v3s16(3, 0, 15));
+	UASSERT(!loaded.get(v3s16(1, 1, 1)));
+
+	NodeMetadata *sign = loaded.get(v3s16(0, 7, 2));
+	UASSERT(sign);
+	UASSERT(sign->getString("text") == "Line 1\nEndInventory\nLine 3");
+
+	NodeMetadata *chest = loaded.get(v3s16(3, 0, 15));
+	UASSERT(chest);
+	UASSERT(chest->isPrivate("owner"));
+	UASSERT(chest->getString("owner") == "singleplayer");
+	InventoryList *main = chest->getInventory()->getList("main");
+	UASSERT(main);
+	UASSERTEQ(u32, main->getItem(1).count, 5);
+	UASSERT(loaded.get(v3s16(3, 0, 15)) == chest);
+
+	// Changes are kept, whether the metadata was read or not
+	chest->setString("infotext", "Locked chest");
+	loaded.remove(v3s16(0, 7, 2));
+	UASSERT(!loaded.get(v3s16(0, 7, 2)));
+	loaded.set(v3s16(15, 15, 15), new NodeMetadata(idef));
+	loaded.get(v3s16(15, 15, 15))->setString("a", "b");
+	UASSERTEQ(size_t, loaded.size(), 2);
+
+	NodeMetadataList reloaded;
+	std::istringstream is2(serializeList(loaded, 29, true), std::ios::binary);
+	reloaded.deSerialize(is2, idef);
+	UASSERTEQ(size_t, reloaded.size(), 2);
+	UASSERT(reloaded.get(v3s16(3, 0, 15))->getString("infotext") == "Locked chest");
+	UASSERT(reloaded.get(v3s16(15, 15, 15))->getString("a") == "b");
+
+	// Broken inventories are found when the block is read
+	std::string broken = disk.substr(0, disk.rfind("EndInventory"));
+	std::istringstream is3(broken, std::ios::binary);
+	EXCEPTION_CHECK(SerializationError, reloaded.deSerialize(is3, idef));
+}
+
+void TestNodeMetadata::testHugeValue(IItemDefManager *idef)
+{
+	// A list with one field whose value claims to be 'value_size' bytes long
+	auto make_list = [] (u32 value_size) {
+		std::ostringstream os(std::ios::binary);
+		writeU8(os, 2); // version
+		writeU16(os, 1); // count
+		writeU16(os, 0); // position
+		writeU32(os, 1); // num_vars
+		os << serializeString16("a");
+		writeU32(os, value_size);
+		os << "short";
+		return os.str();
+	};
+
+	NodeMetadataList list;
+	for (u32 value_size : {U32_MAX, (u32)LONG_STRING_MAX_LEN}) {
+		std::istringstream is(make_list(value_size), std::ios::binary);
+		EXCEPTION_CHECK(SerializationError, list.deSerialize(is, idef));
+	}
+}
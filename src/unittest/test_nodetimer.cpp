@@ -0,0 +1,158 @@
+/*
+Minetest
+Copyright (C) 2024 Minetest Authors
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include <cmath>
+#include <sstream>
+#include "nodetimer.h"
+
+class TestNodeTimer : public TestBase
+{
+public:
+	TestNodeTimer() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestNodeTimer"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testWheelDueTicks();
+	void testWheelReschedule();
+	void testAttachedList();
+};
+
+static TestNodeTimer g_test_instance;
+
+void TestNodeTimer::runTests(IGameDef *gamedef)
+{
+	TEST(testWheelDueTicks);
+	TEST(testWheelReschedule);
+	TEST(testAttachedList);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Steps the wheel until the block is due, returns the number of steps
+static u32 stepUntilDue(NodeTimerWheel &wheel, v3s16 blockpos, u32 max_steps)
+{
+	std::vector<v3s16> due;
+	for (u32 i = 1; i <= max_steps; i++) {
+		due.clear();
+		wheel.step(due);
+		for (const v3s16 &p : due) {
+			if (p == blockpos)
+				return i;
+		}
+	}
+	return 0;
+}
+
+void TestNodeTimer::testWheelDueTicks()
+{
+	NodeTimerWheel wheel(0.5f);
+
+	// Every level of the wheel, and slot boundaries
+	const u32 ticks[] = {1, 2, 63, 64, 65, 100, 4095, 4096, 4097, 5000, 70000};
+	std::vector<v3s16> due;
+	for (u32 i = 0; i < ARRLEN(ticks); i++)
+		wheel.schedule(v3s16(i, 0, 0), ticks[i] * 0.5);
+	UASSERTEQ(size_t, wheel.size(), ARRLEN(ticks));
+
+	for (u32 tick = 1; tick <= 70000; tick++) {
+		due.clear();
+		wheel.step(due);
+		for (const v3s16 &p : due)
+			UASSERTEQ(u32, ticks[p.X], tick);
+		UASSERTEQ(double, wheel.getTime(), tick * 0.5);
+	}
+	UASSERTEQ(size_t, wheel.size(), 0);
+
+	// Rounded up to the next tick, and never in the past
+	wheel.schedule(v3s16(1, 0, 0), wheel.getTime() + 0.7);
+	UASSERTEQ(u32, stepUntilDue(wheel, v3s16(1, 0, 0), 10), 2);
+	wheel.schedule(v3s16(1, 0, 0), 0.0);
+	UASSERTEQ(u32, stepUntilDue(wheel, v3s16(1, 0, 0), 10), 1);
+}
+
+void TestNodeTimer::testWheelReschedule()
+{
+	NodeTimerWheel wheel(1.0f);
+	const v3s16 a(1, 2, 3), b(-4, 5, -6);
+
+	// Only an earlier time moves the block
+	wheel.schedule(a, 100.0);
+	wheel.schedule(a, 10.0);
+	wheel.schedule(a, 50.0);
+	UASSERTEQ(size_t, wheel.size(), 1);
+	UASSERTEQ(u32, stepUntilDue(wheel, a, 200), 10);
+	UASSERTEQ(u32, stepUntilDue(wheel, a, 200), 0);
+
+	wheel.schedule(b, wheel.getTime() + 5.0);
+	wheel.unschedule(b);
+	UASSERTEQ(size_t, wheel.size(), 0);
+	UASSERTEQ(u32, stepUntilDue(wheel, b, 200), 0);
+}
+
+void TestNodeTimer::testAttachedList()
+{
+	NodeTimerWheel wheel(1.0f);
+	const v3s16 blockpos(3, -1, 7);
+	const v3s16 p1(1, 2, 3), p2(4, 5, 6), p3(7, 8, 9);
+
+	NodeTimerList list;
+	list.insert(NodeTimer(10.0f, 1.0f, p1));
+	list.insert(NodeTimer(20.0f, 0.0f, p2));
+	list.insert(NodeTimer(5.0f, 0.0f, p3));
+
+	// Time while inactive is caught up on
+	std::vector<v3s16> due;
+	for (int i = 0; i < 3; i++)
+		wheel.step(due);
+	list.attach(&wheel, blockpos, 6.0);
+	std::vector<NodeTimer> elapsed = list.takeElapsed();
+	UASSERTEQ(size_t, elapsed.size(), 1);
+	UASSERT(elapsed[0].position == p3);
+	UASSERT(std::fabs(elapsed[0].elapsed - 6.0f) < 0.001f);
+	UASSERT(std::fabs(list.get(p1).elapsed - 7.0f) < 0.001f);
+
+	// The block is woken up for its next timer only
+	UASSERTEQ(u32, stepUntilDue(wheel, blockpos, 100), 3);
+	elapsed = list.takeElapsed();
+	UASSERTEQ(size_t, elapsed.size(), 1);
+	UASSERT(elapsed[0].position == p1);
+
+	// Setting an earlier timer wakes it up earlier
+	list.set(NodeTimer(2.0f, 0.0f, p3));
+	UASSERTEQ(u32, stepUntilDue(wheel, blockpos, 100), 2);
+	UASSERTEQ(size_t, list.takeElapsed().size(), 1);
+
+	// The time stands still while detached, serialization is unchanged
+	list.detach();
+	UASSERTEQ(size_t, wheel.size(), 0);
+	for (int i = 0; i < 5; i++)
+		wheel.step(due);
+	UASSERT(std::fabs(list.get(p2).elapsed - 11.0f) < 0.001f);
+
+	std::ostringstream os(std::ios::binary);
+	list.serialize(os, 29);
+	NodeTimerList loaded;
+	std::istringstream is(os.str(), std::ios::binary);
+	loaded.deSerialize(is, 29);
+	UASSERT(std::fabs(loaded.get(p2).elapsed - 11.0f) < 0.001f);
+	UASSERT(loaded.get(p1).timeout == 0.0f);
+}
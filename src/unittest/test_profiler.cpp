@@ -20,6 +20,9 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "test.h"
 
 #include "profiler.h"
+#include "tracer.h"
+#include <sstream>
+#include <thread>
 
 class TestProfiler : public TestBase
 {
@@ -30,6 +33,10 @@ class TestProfiler : public TestBase
 	void runTests(IGameDef *gamedef);
 
 	void testProfilerAverage();
+	void testProfilerThreads();
+	void testProfilerClear();
+	void testTracer();
+	void testTracerEndedThreads();
 };
 
 static TestProfiler g_test_instance;
@@ -37,6 +44,10 @@ static TestProfiler g_test_instance;
 void TestProfiler::runTests(IGameDef *gamedef)
 {
 	TEST(testProfilerAverage);
+	TEST(testProfilerThreads);
+	TEST(testProfilerClear);
+	TEST(testTracer);
+	TEST(testTracerEndedThreads);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -71,3 +82,101 @@ void TestProfiler::testProfilerAverage()
 
 	UASSERT(p.getValue("Test2") == 123.57f);
 }
+
+void TestProfiler::testProfilerThreads()
+{
+	Profiler p;
+	const Profiler::SectionId sum = Profiler::intern("Sum");
+
+	std::vector<std::thread> threads;
+	for (int t = 0; t < 4; t++) {
+		threads.emplace_back([&p, sum, t] {
+			for (int i = 0; i < 1000; i++) {
+				p.add(sum, 1.f);
+				p.max("Max", t);
+				p.avg("Avg", t);
+			}
+		});
+	}
+	for (std::thread &thread : threads)
+		thread.join();
+
+	UASSERT(p.getValue("Sum") == 4000.f);
+	UASSERT(p.getValue("Max") == 3.f);
+	UASSERT(p.getValue("Avg") == 1.5f);
+	UASSERTEQ(int, p.getAvgCount("Avg"), 4000);
+}
+
+void TestProfiler::testProfilerClear()
+{
+	Profiler p;
+	p.add("Test1", 5.f);
+	p.max("Test2", -1.f);
+	UASSERT(p.getValue("Test2") == -1.f);
+
+	p.clear();
+	UASSERT(p.getValue("Test1") == 0.f);
+
+	// Sections stay listed after clear()
+	Profiler::GraphValues values;
+	p.getPage(values, 1, 1);
+	UASSERTEQ(size_t, values.size(), 2);
+
+	p.add("Test1", 2.f);
+	UASSERT(p.getValue("Test1") == 2.f);
+
+	p.remove("Test1");
+	values.clear();
+	p.getPage(values, 1, 1);
+	UASSERTEQ(size_t, values.size(), 1);
+}
+
+void TestProfiler::testTracer()
+{
+	Tracer::setEnabled(true);
+	{
+		ScopeProfiler sp(nullptr, "TestTracer scope");
+	}
+	Tracer::setEnabled(false);
+	{
+		ScopeProfiler sp(nullptr, "TestTracer untraced");
+	}
+
+	std::ostringstream os;
+	Tracer::dump(os);
+	const std::string trace = os.str();
+	UASSERT(trace.find("\"traceEvents\"") != std::string::npos);
+	UASSERT(trace.find("\"name\":\"TestTracer scope\",\"ph\":\"X\"") != std::string::npos);
+	UASSERT(trace.find("TestTracer untraced") == std::string::npos);
+}
+
+static size_t countOccurrences(const std::string &str, const std::string &what)
+{
+	size_t count = 0;
+	for (size_t pos = str.find(what); pos != std::string::npos;
+			pos = str.find(what, pos + what.size()))
+		count++;
+	return count;
+}
+
+void TestProfiler::testTracerEndedThreads()
+{
+	const Profiler::SectionId id = ScopeProfiler::intern("TestTracer thread");
+	std::ostringstream before;
+	Tracer::dump(before);
+
+	// The buffers of ended threads are reused or released
+	for (int i = 0; i < 20; i++) {
+		std::thread([id, i] {
+			Tracer::record(id, 1000 + i, 1001 + i);
+		}).join();
+	}
+
+	std::ostringstream after;
+	Tracer::dump(after);
+	const std::string trace = after.str();
+	UASSERT(countOccurrences(trace, "\"thread_name\"") <=
+		countOccurrences(before.str(), "\"thread_name\"") + 8);
+	// The last thread is still in there
+	UASSERT(trace.find("\"ts\":1019,") != std::string::npos);
+}
@@ -22,6 +22,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "mapgen/mg_schematic.h"
 #include "gamedef.h"
 #include "nodedef.h"
+#include "dummymap.h"
 
 class TestSchematic : public TestBase {
 public:
@@ -33,6 +34,7 @@ class TestSchematic : public TestBase {
 	void testMtsSerializeDeserialize(const NodeDefManager *ndef);
 	void testLuaTableSerialize(const NodeDefManager *ndef);
 	void testFileSerializeDeserialize(const NodeDefManager *ndef);
+	void testBlitRotated(IGameDef *gamedef);
 
 	static const content_t test_schem1_data[7 * 6 * 4];
 	static const content_t test_schem2_data[3 * 3 * 3];
@@ -52,6 +54,7 @@ void TestSchematic::runTests(IGameDef *gamedef)
 	TEST(testMtsSerializeDeserialize, ndef);
 	TEST(testLuaTableSerialize, ndef);
 	TEST(testFileSerializeDeserialize, ndef);
+	TEST(testBlitRotated, gamedef);
 
 	ndef->resetNodeResolveState();
 }
@@ -187,6 +190,87 @@ void TestSchematic::testFileSerializeDeserialize(const NodeDefManager *ndef)
 }
 
 
+void TestSchematic::testBlitRotated(IGameDef *gamedef)
+{
+	static const v3s16 size(4, 2, 3);
+	static const u32 volume = size.X * size.Y * size.Z;
+	const NodeDefManager *ndef = gamedef->getNodeDefManager();
+
+	// Every placement rule except random probabilities
+	const MapNode nodes[] = {
+		MapNode(t_CONTENT_BRICK, MTSCHEM_PROB_ALWAYS, 0),
+		MapNode(t_CONTENT_WATER, MTSCHEM_PROB_ALWAYS | MTSCHEM_FORCE_PLACE, 0),
+		MapNode(t_CONTENT_LAVA, MTSCHEM_PROB_NEVER, 0),
+		MapNode(CONTENT_IGNORE, MTSCHEM_PROB_ALWAYS, 0),
+		MapNode(CONTENT_AIR, MTSCHEM_PROB_ALWAYS, 0),
+	};
+
+	Schematic schem;
+	schem.size        = size;
+	schem.schemdata   = new MapNode[volume];
+	schem.slice_probs = new u8[size.Y];
+	schem.m_ndef = ndef;
+	// Node resolving happened manually.
+	schem.m_resolve_done = true;
+	for (u32 i = 0; i != volume; i++)
+		schem.schemdata[i] = nodes[(i * 7) % ARRLEN(nodes)];
+	for (s16 y = 0; y != size.Y; y++)
+		schem.slice_probs[y] = MTSCHEM_PROB_ALWAYS;
+
+	DummyMap map(gamedef, v3s16(0, 0, 0), v3s16(0, 0, 0));
+
+	// Partially outside of the voxelmanip on the X and Z axes
+	const v3s16 p(MAP_BLOCKSIZE - 2, 5, -1);
+
+	for (int r = ROTATE_0; r <= ROTATE_270; r++)
+	for (int force_place = 0; force_place != 2; force_place++) {
+		Rotation rot = (Rotation)r;
+		MMVManip vm(&map);
+		vm.initialEmerge(v3s16(0, 0, 0), v3s16(0, 0, 0), false);
+		s32 vm_volume = vm.m_area.getVolume();
+		for (s32 i = 0; i < vm_volume; i++)
+			vm.m_data[i] = MapNode((i % 3) ? CONTENT_AIR : t_CONTENT_STONE);
+		std::vector<MapNode> before(vm.m_data, vm.m_data + vm_volume);
+
+		schem.blitToVManip(&vm, p, rot, force_place);
+
+		bool swap_xz = rot == ROTATE_90 || rot == ROTATE_270;
+		s16 sx = swap_xz ? size.Z : size.X;
+		s16 sz = swap_xz ? size.X : size.Z;
+		const VoxelArea &area = vm.m_area;
+		for (s16 z = area.MinEdge.Z; z <= area.MaxEdge.Z; z++)
+		for (s16 y = area.MinEdge.Y; y <= area.MaxEdge.Y; y++)
+		for (s16 x = area.MinEdge.X; x <= area.MaxEdge.X; x++) {
+			u32 vi = area.index(x, y, z);
+			v3s16 rel = v3s16(x, y, z) - p;
+			MapNode expected = before[vi];
+			if (rel.X >= 0 && rel.X < sx && rel.Y >= 0 && rel.Y < size.Y &&
+					rel.Z >= 0 && rel.Z < sz) {
+				// Position in the unrotated schematic
+				v3s16 src = rel;
+				if (rot == ROTATE_90)
+					src = v3s16(size.X - 1 - rel.Z, rel.Y, rel.X);
+				else if (rot == ROTATE_180)
+					src = v3s16(size.X - 1 - rel.X, rel.Y, size.Z - 1 - rel.Z);
+				else if (rot == ROTATE_270)
+					src = v3s16(rel.Z, rel.Y, size.Z - 1 - rel.X);
+				const MapNode &n = schem.schemdata[
+					(src.Z * size.Y + src.Y) * size.X + src.X];
+
+				bool can_replace = force_place ||
+					(n.param1 & MTSCHEM_FORCE_PLACE) ||
+					expected.getContent() == CONTENT_AIR;
+				if (n.getContent() != CONTENT_IGNORE &&
+						(n.param1 & MTSCHEM_PROB_MASK) != MTSCHEM_PROB_NEVER &&
+						can_replace)
+					expected = MapNode(n.getContent(), 0, n.param2);
+			}
+			UASSERT(vm.m_data[vi] == expected);
+		}
+	}
+}
+
+
 // Should form a cross-shaped-thing...?
 const content_t TestSchematic::test_schem1_data[7 * 6 * 4] = {
 	3, 3, 1, 1, 1, 3, 3, // Y=0, Z=0
@@ -24,6 +24,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "util/numeric.h"
 #include "util/string.h"
 #include "util/base64.h"
+#include "util/blockposset.h"
+#include "face_position_cache.h"
 
 class TestUtilities : public TestBase {
 public:
@@ -59,6 +61,8 @@ class TestUtilities : public TestBase {
 	void testBase64();
 	void testSanitizeDirName();
 	void testIsBlockInSight();
+	void testBlocksInSight();
+	void testBlockPosSet();
 };
 
 static TestUtilities g_test_instance;
@@ -92,6 +96,8 @@ void TestUtilities::runTests(IGameDef *gamedef)
 	TEST(testBase64);
 	TEST(testSanitizeDirName);
 	TEST(testIsBlockInSight);
+	TEST(testBlocksInSight);
+	TEST(testBlockPosSet);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -704,3 +710,83 @@ void TestUtilities::testIsBlockInSight()
 		UASSERT(isBlockInSight({-1, 0, 0}, cam_pos, cam_dir, fov, range));
 	}
 }
+
+void TestUtilities::testBlocksInSight()
+{
+	// The batched variant has to agree with isBlockInSight()
+	const v3s16 center(3, -2, 5);
+	const v3f cam_pos = intToFloat(center * MAP_BLOCKSIZE, BS) + v3f(13, 42, -7);
+	const float fov = 72 * core::DEGTORAD;
+	const float range = BS * MAP_BLOCKSIZE * 6;
+	const v3f directions[] = {
+		v3f(1, 0, 0), v3f(0, 0, -1), v3f(0, -1, 0), v3f(0.6f, 0.48f, 0.64f)
+	};
+
+	for (const v3f &cam_dir : directions)
+	for (u16 d = 0; d <= 7; d++) {
+		const auto &list = FacePositionCache::getFacePositions(d);
+		const auto &offsets = FacePositionCache::getFaceOffsets(d);
+		UASSERTEQ(size_t, offsets.x.size(), list.size());
+
+		std::vector<f32> dist(list.size());
+		std::vector<u8> in_sight(list.size(), 0);
+		blocksInSight(center, offsets.x.data(), offsets.y.data(), offsets.z.data(),
+			list.size(), cam_pos, cam_dir, fov, range, dist.data(), in_sight.data());
+
+		for (size_t i = 0; i < list.size(); i++) {
+			f32 expected_dist;
+			bool expected = isBlockInSight(list[i] + center, cam_pos, cam_dir,
+				fov, range, &expected_dist);
+			UASSERTEQ(bool, !!in_sight[i], expected);
+			UASSERT(std::fabs(dist[i] - expected_dist) < 0.1f);
+		}
+	}
+}
+
+void TestUtilities::testBlockPosSet()
+{
+	BlockPosSet set(4);
+	const v3s16 near_pos(1, 2, 3), far_pos(100, -200, 300);
+
+	UASSERT(set.empty());
+	UASSERT(set.insert(near_pos));
+	UASSERT(!set.insert(near_pos));
+	UASSERT(set.insert(far_pos));
+	UASSERTEQ(size_t, set.size(), 2);
+	UASSERT(set.contains(near_pos));
+	UASSERT(set.contains(far_pos));
+
+	// Moving the window must keep the contents
+	set.setCenter(far_pos);
+	UASSERT(set.contains(near_pos));
+	UASSERT(set.contains(far_pos));
+	UASSERT(!set.contains(far_pos + v3s16(1, 0, 0)));
+	set.setCenter(v3s16(0, 0, 0));
+	UASSERTEQ(size_t, set.size(), 2);
+
+	UASSERT(set.erase(far_pos));
+	UASSERT(!set.erase(far_pos));
+	UASSERT(set.contains(near_pos));
+	UASSERTEQ(size_t, set.size(), 1);
+
+	set.clear();
+	UASSERT(set.empty());
+	UASSERT(!set.contains(near_pos));
+
+	// Overlapping windows
+	v3s16 p;
+	for (p.Z = -6; p.Z <= 6; p.Z++)
+	for (p.Y = -6; p.Y <= 6; p.Y++)
+	for (p.X = -6; p.X <= 6; p.X++)
+		set.insert(p);
+	for (s16 x : {3, 6, 9, -2}) {
+		set.setCenter(v3s16(x, 0, -x));
+		UASSERTEQ(size_t, set.size(), 13 * 13 * 13);
+		for (p.Z = -6; p.Z <= 6; p.Z++)
+		for (p.Y = -6; p.Y <= 6; p.Y++)
+		for (p.X = -6; p.X <= 6; p.X++)
+			UASSERT(set.contains(p));
+		UASSERT(!set.contains(v3s16(7, 0, 0)));
+		UASSERT(!set.contains(v3s16(-7, 0, 0)));
+	}
+}
@@ -0,0 +1,132 @@
+/*
+Minetest
+Copyright (C) 2024 Minetest Authors
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "blockposset.h"
+#include <algorithm>
+#include <cstdlib>
+#include "numeric.h"
+
+// Bigger windows cost more memory than they save
+#define BLOCKPOSSET_MAX_RADIUS 40
+
+static s16 windowSlack(s16 radius)
+{
+	return std::max(2, rangelim(radius, 0, BLOCKPOSSET_MAX_RADIUS) / 4);
+}
+
+BlockPosSet::BlockPosSet(s16 radius) :
+	m_slack(windowSlack(radius)),
+	m_edge(2 * (rangelim(radius, 0, BLOCKPOSSET_MAX_RADIUS) + m_slack) + 1)
+{
+	const s16 half = (m_edge - 1) / 2;
+	m_origin = m_center - v3s16(half, half, half);
+	m_bits.resize(((u32)m_edge * m_edge * m_edge + 63) / 64, 0);
+}
+
+bool BlockPosSet::insert(v3s16 p)
+{
+	if (inWindow(p)) {
+		u32 i = index(p);
+		u64 &word = m_bits[i >> 6];
+		const u64 mask = (u64)1 << (i & 63);
+		if (word & mask)
+			return false;
+		word |= mask;
+	} else if (!m_outside.insert(p).second) {
+		return false;
+	}
+	m_size++;
+	return true;
+}
+
+bool BlockPosSet::erase(v3s16 p)
+{
+	if (inWindow(p)) {
+		u32 i = index(p);
+		u64 &word = m_bits[i >> 6];
+		const u64 mask = (u64)1 << (i & 63);
+		if (!(word & mask))
+			return false;
+		word &= ~mask;
+	} else if (m_outside.erase(p) == 0) {
+		return false;
+	}
+	m_size--;
+	return true;
+}
+
+void BlockPosSet::clear()
+{
+	std::fill(m_bits.begin(), m_bits.end(), 0);
+	m_outside.clear();
+	m_size = 0;
+}
+
+void BlockPosSet::setCenter(v3s16 center)
+{
+	if (std::abs(center.X - m_center.X) <= m_slack &&
+			std::abs(center.Y - m_center.Y) <= m_slack &&
+			std::abs(center.Z - m_center.Z) <= m_slack)
+		return;
+
+	m_center = center;
+
+	// Shared by all sets of the thread, it swaps places with m_bits
+	thread_local std::vector<u64> moved;
+	moved.assign(m_bits.size(), 0);
+	const auto set_moved = [&] (v3s16 p) {
+		u32 i = index(p);
+		moved[i >> 6] |= (u64)1 << (i & 63);
+	};
+
+	const v3s16 old_origin = m_origin;
+	const bool window_used = m_size > m_outside.size();
+	const s16 half = (m_edge - 1) / 2;
+	m_origin = center - v3s16(half, half, half);
+
+	// Pull back what is inside of the new window...
+	for (auto it = m_outside.begin(); it != m_outside.end();) {
+		if (inWindow(*it)) {
+			set_moved(*it);
+			it = m_outside.erase(it);
+		} else {
+			++it;
+		}
+	}
+
+	// ...then move the old window over, only what leaves it gets hashed
+	if (window_used) {
+		const u32 edge = m_edge;
+		for (u32 w = 0; w < m_bits.size(); w++) {
+			u64 word = m_bits[w];
+			for (u32 b = 0; word; b++, word >>= 1) {
+				if (!(word & 1))
+					continue;
+				const u32 i = w * 64 + b;
+				const v3s16 p = old_origin + v3s16(i % edge,
+					(i / edge) % edge, i / (edge * edge));
+				if (inWindow(p))
+					set_moved(p);
+				else
+					m_outside.insert(p);
+			}
+		}
+	}
+	m_bits.swap(moved);
+}
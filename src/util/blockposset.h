@@ -0,0 +1,89 @@
+/*
+Minetest
+Copyright (C) 2024 Minetest Authors
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#pragma once
+
+#include "irr_v3d.h"
+#include <unordered_set>
+#include <vector>
+
+/*
+	Set of block positions, stored as a dense bitset inside a cubic window
+	around a movable center and as a hash set outside of it.
+
+	Lookups near the center, which is where RemoteClient::GetNextBlocks()
+	does nearly all of its work, only touch the bitset.
+*/
+class BlockPosSet
+{
+public:
+	// Positions within `radius` of the center always hit the bitset.
+	// The window takes about (2.5 * radius)^3 bits.
+	BlockPosSet(s16 radius);
+
+	// Returns true if p was not in the set before
+	bool insert(v3s16 p);
+	// Returns true if p was in the set
+	bool erase(v3s16 p);
+	bool contains(v3s16 p) const
+	{
+		if (inWindow(p)) {
+			u32 i = index(p);
+			return (m_bits[i >> 6] >> (i & 63)) & 1;
+		}
+		return m_outside.find(p) != m_outside.end();
+	}
+
+	size_t size() const { return m_size; }
+	bool empty() const { return m_size == 0; }
+	void clear();
+
+	/*
+		Moves the window if `center` got too close to its border.
+		The contents of the set are not affected. Costs a pass over the
+		window and over the positions outside of it.
+	*/
+	void setCenter(v3s16 center);
+
+private:
+	bool inWindow(v3s16 p) const
+	{
+		return (u32)(p.X - m_origin.X) < m_edge &&
+			(u32)(p.Y - m_origin.Y) < m_edge &&
+			(u32)(p.Z - m_origin.Z) < m_edge;
+	}
+
+	u32 index(v3s16 p) const
+	{
+		return ((u32)(p.Z - m_origin.Z) * m_edge +
+			(u32)(p.Y - m_origin.Y)) * m_edge + (u32)(p.X - m_origin.X);
+	}
+
+	// How far the center may move before the window follows
+	const s16 m_slack;
+	// Edge length of the window
+	const u16 m_edge;
+	v3s16 m_center;
+	// Minimum corner of the window
+	v3s16 m_origin;
+
+	std::vector<u64> m_bits;
+	std::unordered_set<v3s16> m_outside;
+	size_t m_size = 0;
+};
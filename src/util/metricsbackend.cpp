@@ -19,15 +19,72 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "metricsbackend.h"
 #include "util/thread.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <sstream>
 #if USE_PROMETHEUS
 #include <prometheus/exposer.h>
 #include <prometheus/registry.h>
 #include <prometheus/counter.h>
 #include <prometheus/gauge.h>
+#include <prometheus/histogram.h>
 #include "log.h"
 #include "settings.h"
 #endif
 
+/* Histogram helpers */
+
+MetricHistogram::Buckets MetricHistogram::linearBuckets(
+		double start, double width, size_t count)
+{
+	Buckets ret(count);
+	for (size_t i = 0; i < count; i++)
+		ret[i] = start + width * i;
+	return ret;
+}
+
+MetricHistogram::Buckets MetricHistogram::exponentialBuckets(
+		double start, double factor, size_t count)
+{
+	Buckets ret(count);
+	double bound = start;
+	for (size_t i = 0; i < count; i++) {
+		ret[i] = bound;
+		bound *= factor;
+	}
+	return ret;
+}
+
+// counts[i] is the number of observations in bucket i (not cumulative),
+// the last element counts the observations above the highest bound.
+static double bucketQuantile(const MetricHistogram::Buckets &bounds,
+		const std::vector<u64> &counts, double q)
+{
+	assert(counts.size() == bounds.size() + 1);
+
+	u64 total = 0;
+	for (u64 count : counts)
+		total += count;
+	if (total == 0 || bounds.empty())
+		return 0.0;
+
+	const double rank = std::min(std::max(q, 0.0), 1.0) * total;
+	u64 below = 0;
+	for (size_t i = 0; i < bounds.size(); i++) {
+		if (counts[i] > 0 && below + counts[i] >= rank) {
+			// Same as Prometheus: the first bucket starts at 0 unless
+			// its bound is negative
+			const double lower = i > 0 ? bounds[i - 1] : std::min(bounds[0], 0.0);
+			return lower + (bounds[i] - lower) * (rank - below) / counts[i];
+		}
+		below += counts[i];
+	}
+	// Nothing can be said about the overflow bucket
+	return bounds.back();
+}
+
 /* Plain implementation */
 
 class SimpleMetricCounter : public MetricCounter
@@ -86,6 +143,62 @@ class SimpleMetricGauge : public MetricGauge
 	double m_gauge;
 };
 
+class SimpleMetricHistogram : public MetricHistogram
+{
+public:
+	SimpleMetricHistogram(const Buckets &buckets) :
+		MetricHistogram(), m_bounds(buckets), m_counts(buckets.size() + 1, 0)
+	{
+		assert(std::is_sorted(m_bounds.begin(), m_bounds.end()));
+	}
+
+	virtual ~SimpleMetricHistogram() {}
+
+	void observe(double value) override
+	{
+		// Bucket i holds bounds[i - 1] < value <= bounds[i]
+		size_t i = std::lower_bound(m_bounds.begin(), m_bounds.end(), value)
+			- m_bounds.begin();
+		MutexAutoLock lock(m_mutex);
+		m_counts[i]++;
+		m_sum += value;
+	}
+	u64 getCount() const override
+	{
+		MutexAutoLock lock(m_mutex);
+		u64 total = 0;
+		for (u64 count : m_counts)
+			total += count;
+		return total;
+	}
+	double getSum() const override
+	{
+		MutexAutoLock lock(m_mutex);
+		return m_sum;
+	}
+	double getQuantile(double q) const override
+	{
+		MutexAutoLock lock(m_mutex);
+		return bucketQuantile(m_bounds, m_counts, q);
+	}
+
+	const Buckets &getBounds() const { return m_bounds; }
+
+	// Non-cumulative counts, see bucketQuantile()
+	void getCounts(std::vector<u64> &counts, double &sum) const
+	{
+		MutexAutoLock lock(m_mutex);
+		counts = m_counts;
+		sum = m_sum;
+	}
+
+private:
+	mutable std::mutex m_mutex;
+	const Buckets m_bounds;
+	std::vector<u64> m_counts;
+	double m_sum = 0.0;
+};
+
 MetricCounterPtr MetricsBackend::addCounter(
 		const std::string &name, const std::string &help_str, Labels labels)
 {
@@ -98,6 +211,129 @@ MetricGaugePtr MetricsBackend::addGauge(
 	return std::make_shared<SimpleMetricGauge>();
 }
 
+MetricHistogramPtr MetricsBackend::addHistogram(
+		const std::string &name, const std::string &help_str,
+		const MetricHistogram::Buckets &buckets, Labels labels)
+{
+	return std::make_shared<SimpleMetricHistogram>(buckets);
+}
+
+/* Text backend */
+
+static std::string formatLabels(const std::string &labels, const char *extra_key = nullptr,
+		const std::string &extra_value = "")
+{
+	std::string ret = labels;
+	if (extra_key) {
+		if (!ret.empty())
+			ret.append(",");
+		ret.append(extra_key).append("=\"").append(extra_value).append("\"");
+	}
+	return ret.empty() ? ret : "{" + ret + "}";
+}
+
+static std::string formatValue(double value)
+{
+	if (std::isinf(value))
+		return value > 0 ? "+Inf" : "-Inf";
+	if (std::isnan(value))
+		return "NaN";
+	std::ostringstream os;
+	os.precision(15);
+	os << value;
+	return os.str();
+}
+
+TextMetricsBackend::Entry &TextMetricsBackend::addEntry(const std::string &name,
+		const std::string &help_str, const char *type, Labels labels)
+{
+	std::string label_str;
+	for (const auto &label : labels) {
+		if (!label_str.empty())
+			label_str.append(",");
+		// Label values used in the engine never need escaping
+		label_str.append(label.first).append("=\"").append(label.second).append("\"");
+	}
+
+	auto it = std::find_if(m_families.begin(), m_families.end(),
+		[&] (const Family &f) { return f.name == name; });
+	if (it == m_families.end()) {
+		m_families.push_back(Family{name, help_str, type, {}});
+		it = m_families.end() - 1;
+	}
+	assert(strcmp(it->type, type) == 0);
+
+	it->entries.emplace_back();
+	it->entries.back().labels = std::move(label_str);
+	return it->entries.back();
+}
+
+MetricCounterPtr TextMetricsBackend::addCounter(
+		const std::string &name, const std::string &help_str, Labels labels)
+{
+	MutexAutoLock lock(m_mutex);
+	Entry &entry = addEntry(name, help_str, "counter", labels);
+	entry.counter = MetricsBackend::addCounter(name, help_str, labels);
+	return entry.counter;
+}
+
+MetricGaugePtr TextMetricsBackend::addGauge(
+		const std::string &name, const std::string &help_str, Labels labels)
+{
+	MutexAutoLock lock(m_mutex);
+	Entry &entry = addEntry(name, help_str, "gauge", labels);
+	entry.gauge = MetricsBackend::addGauge(name, help_str, labels);
+	return entry.gauge;
+}
+
+MetricHistogramPtr TextMetricsBackend::addHistogram(
+		const std::string &name, const std::string &help_str,
+		const MetricHistogram::Buckets &buckets, Labels labels)
+{
+	MutexAutoLock lock(m_mutex);
+	Entry &entry = addEntry(name, help_str, "histogram", labels);
+	entry.histogram = std::make_shared<SimpleMetricHistogram>(buckets);
+	return entry.histogram;
+}
+
+void TextMetricsBackend::dump(std::ostream &os) const
+{
+	MutexAutoLock lock(m_mutex);
+
+	std::vector<u64> counts;
+	double sum;
+	for (const Family &family : m_families) {
+		os << "# HELP " << family.name << " " << family.help << "\n";
+		os << "# TYPE " << family.name << " " << family.type << "\n";
+
+		for (const Entry &entry : family.entries) {
+			if (entry.counter) {
+				os << family.name << formatLabels(entry.labels) << " "
+					<< formatValue(entry.counter->get()) << "\n";
+			} else if (entry.gauge) {
+				os << family.name << formatLabels(entry.labels) << " "
+					<< formatValue(entry.gauge->get()) << "\n";
+			} else if (entry.histogram) {
+				entry.histogram->getCounts(counts, sum);
+				const auto &bounds = entry.histogram->getBounds();
+
+				u64 cumulative = 0;
+				for (size_t i = 0; i < counts.size(); i++) {
+					cumulative += counts[i];
+					const double bound = i < bounds.size() ? bounds[i] : INFINITY;
+					os << family.name << "_bucket"
+						<< formatLabels(entry.labels, "le", formatValue(bound))
+						<< " " << cumulative << "\n";
+				}
+				os << family.name << "_sum" << formatLabels(entry.labels)
+					<< " " << formatValue(sum) << "\n";
+				os << family.name << "_count" << formatLabels(entry.labels)
+					<< " " << cumulative << "\n";
+			}
+		}
+	}
+}
+
 /* Prometheus backend */
 
 #if USE_PROMETHEUS
@@ -158,6 +394,54 @@ class PrometheusMetricGauge : public MetricGauge
 	prometheus::Gauge &m_gauge;
 };
 
+class PrometheusMetricHistogram : public MetricHistogram
+{
+public:
+	PrometheusMetricHistogram() = delete;
+
+	PrometheusMetricHistogram(const std::string &name, const std::string &help_str,
+			const Buckets &buckets, MetricsBackend::Labels labels,
+			std::shared_ptr<prometheus::Registry> registry) :
+			MetricHistogram(),
+			m_family(prometheus::BuildHistogram()
+							.Name(name)
+							.Help(help_str)
+							.Register(*registry)),
+			m_histogram(m_family.Add(labels, buckets)),
+			m_bounds(buckets)
+	{
+	}
+
+	virtual ~PrometheusMetricHistogram() {}
+
+	virtual void observe(double value) { m_histogram.Observe(value); }
+	virtual u64 getCount() const
+	{
+		return m_histogram.Collect().histogram.sample_count;
+	}
+	virtual double getSum() const
+	{
+		return m_histogram.Collect().histogram.sample_sum;
+	}
+	virtual double getQuantile(double q) const
+	{
+		const auto data = m_histogram.Collect().histogram;
+		std::vector<u64> counts;
+		counts.reserve(data.bucket.size());
+		u64 previous = 0;
+		for (const auto &bucket : data.bucket) {
+			counts.push_back(bucket.cumulative_count - previous);
+			previous = bucket.cumulative_count;
+		}
+		return bucketQuantile(m_bounds, counts, q);
+	}
+
+private:
+	prometheus::Family<prometheus::Histogram> &m_family;
+	prometheus::Histogram &m_histogram;
+	const Buckets m_bounds;
+};
+
 class PrometheusMetricsBackend : public MetricsBackend
 {
 public:
@@ -176,6 +460,9 @@ class PrometheusMetricsBackend : public MetricsBackend
 	MetricGaugePtr addGauge(
 			const std::string &name, const std::string &help_str,
 			Labels labels = {}) override;
+	MetricHistogramPtr addHistogram(
+			const std::string &name, const std::string &help_str,
+			const MetricHistogram::Buckets &buckets, Labels labels = {}) override;
 
 private:
 	std::unique_ptr<prometheus::Exposer> m_exposer;
@@ -194,6 +481,14 @@ MetricGaugePtr PrometheusMetricsBackend::addGauge(
 	return std::make_shared<PrometheusMetricGauge>(name, help_str, labels, m_registry);
 }
 
+MetricHistogramPtr PrometheusMetricsBackend::addHistogram(
+		const std::string &name, const std::string &help_str,
+		const MetricHistogram::Buckets &buckets, Labels labels)
+{
+	return std::make_shared<PrometheusMetricHistogram>(name, help_str, buckets,
+			labels, m_registry);
+}
+
 MetricsBackend *createPrometheusMetricsBackend()
 {
 	std::string addr;
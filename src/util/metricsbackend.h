@@ -19,9 +19,13 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #pragma once
 #include <memory>
+#include <mutex>
+#include <ostream>
 #include <string>
 #include <utility>
+#include <vector>
 #include "config.h"
+#include "irrlichttypes.h"
 
 class MetricCounter
 {
@@ -50,6 +54,31 @@ class MetricGauge
 
 typedef std::shared_ptr<MetricGauge> MetricGaugePtr;
 
+class MetricHistogram
+{
+public:
+	// Upper bounds of the buckets, in ascending order.
+	// A bucket for everything above the last bound is implied.
+	typedef std::vector<double> Buckets;
+
+	MetricHistogram() = default;
+	virtual ~MetricHistogram() {}
+
+	virtual void observe(double value) = 0;
+	virtual u64 getCount() const = 0;
+	virtual double getSum() const = 0;
+	// Estimates the value below which the fraction q of all observations
+	// falls, by interpolating inside the bucket that contains it
+	virtual double getQuantile(double q) const = 0;
+
+	// start, start + width, start + 2 * width, ...
+	static Buckets linearBuckets(double start, double width, size_t count);
+	// start, start * factor, start * factor^2, ...
+	static Buckets exponentialBuckets(double start, double factor, size_t count);
+};
+
+typedef std::shared_ptr<MetricHistogram> MetricHistogramPtr;
+
 class MetricsBackend
 {
 public:
@@ -65,6 +94,55 @@ class MetricsBackend
 	virtual MetricGaugePtr addGauge(
 			const std::string &name, const std::string &help_str,
 			Labels labels = {});
+	virtual MetricHistogramPtr addHistogram(
+			const std::string &name, const std::string &help_str,
+			const MetricHistogram::Buckets &buckets, Labels labels = {});
+};
+
+class SimpleMetricHistogram;
+
+/*
+	Backend that remembers every metric it hands out so that all of them can
+	be written in the Prometheus text exposition format, e.g. to a file that
+	is picked up by the node exporter.
+	Used where the Prometheus client library is not available.
+*/
+class TextMetricsBackend : public MetricsBackend
+{
+public:
+	TextMetricsBackend() = default;
+
+	MetricCounterPtr addCounter(
+			const std::string &name, const std::string &help_str,
+			Labels labels = {}) override;
+	MetricGaugePtr addGauge(
+			const std::string &name, const std::string &help_str,
+			Labels labels = {}) override;
+	MetricHistogramPtr addHistogram(
+			const std::string &name, const std::string &help_str,
+			const MetricHistogram::Buckets &buckets, Labels labels = {}) override;
+
+	void dump(std::ostream &os) const;
+
+private:
+	struct Entry {
+		std::string labels; // already formatted, without braces
+		MetricCounterPtr counter;
+		MetricGaugePtr gauge;
+		std::shared_ptr<SimpleMetricHistogram> histogram;
+	};
+	struct Family {
+		std::string name;
+		std::string help;
+		const char *type;
+		std::vector<Entry> entries;
+	};
+
+	Entry &addEntry(const std::string &name, const std::string &help_str,
+			const char *type, Labels labels);
+
+	mutable std::mutex m_mutex;
+	std::vector<Family> m_families;
 };
 
 #if USE_PROMETHEUS
@@ -23,6 +23,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "constants.h" // BS, MAP_BLOCKSIZE
 #include "noise.h" // PseudoRandom, PcgRandom
 #include "threading/mutex_auto_lock.h"
+#include <algorithm>
 #include <cstring>
 #include <cmath>
 
@@ -170,6 +171,44 @@ bool isBlockInSight(v3s16 blockpos_b, v3f camera_pos, v3f camera_dir,
 	return true;
 }
 
+void blocksInSight(v3s16 origin_b, const f32 *off_x, const f32 *off_y,
+		const f32 *off_z, size_t count, v3f camera_pos, v3f camera_dir,
+		f32 camera_fov, f32 range, f32 *distances, u8 *in_sight)
+{
+	v3s16 origin_nodes = origin_b * MAP_BLOCKSIZE;
+
+	// Center of the origin block relative to the camera
+	const v3f base(
+			((float)origin_nodes.X + MAP_BLOCKSIZE/2) * BS - camera_pos.X,
+			((float)origin_nodes.Y + MAP_BLOCKSIZE/2) * BS - camera_pos.Y,
+			((float)origin_nodes.Z + MAP_BLOCKSIZE/2) * BS - camera_pos.Z
+	);
+
+	// See isBlockInSight()
+	const f32 adjdist = BLOCK_MAX_RADIUS / cos((M_PI - camera_fov) / 2);
+	const v3f adj_base = base + camera_dir * adjdist;
+	const f32 cos_limit = std::cos(camera_fov * 0.55f);
+
+	// Written without early exits so that it can be vectorized
+	for (size_t i = 0; i < count; i++) {
+		const f32 rx = base.X + off_x[i];
+		const f32 ry = base.Y + off_y[i];
+		const f32 rz = base.Z + off_z[i];
+		const f32 d = std::max(0.0f,
+				std::sqrt(rx * rx + ry * ry + rz * rz) - BLOCK_MAX_RADIUS);
+
+		const f32 ax = adj_base.X + off_x[i];
+		const f32 ay = adj_base.Y + off_y[i];
+		const f32 az = adj_base.Z + off_z[i];
+		const f32 dforward = ax * camera_dir.X + ay * camera_dir.Y + az * camera_dir.Z;
+		// cosangle >= cos_limit, without the division
+		const f32 adj_len = std::sqrt(ax * ax + ay * ay + az * az);
+
+		distances[i] = d;
+		in_sight[i] |= (d <= range) & ((d == 0) | (dforward >= cos_limit * adj_len));
+	}
+}
+
 inline float adjustDist(float dist, float zoom_fov)
 {
 	// 1.775 ~= 72 * PI / 180 * 1.4, the default FOV on the client.
@@ -281,6 +281,15 @@ u64 murmur_hash_64_ua(const void *key, int len, unsigned int seed);
 bool isBlockInSight(v3s16 blockpos_b, v3f camera_pos, v3f camera_dir,
 		f32 camera_fov, f32 range, f32 *distance_ptr=NULL);
 
+/*
+	Same as isBlockInSight(), for many blocks at once.
+	Block i is at origin_b + (off_x[i], off_y[i], off_z[i]) / (MAP_BLOCKSIZE * BS).
+	The result is ORed into in_sight[i] and the distance stored in distances[i].
+*/
+void blocksInSight(v3s16 origin_b, const f32 *off_x, const f32 *off_y,
+		const f32 *off_z, size_t count, v3f camera_pos, v3f camera_dir,
+		f32 camera_fov, f32 range, f32 *distances, u8 *in_sight);
+
 s16 adjustDist(s16 dist, float zoom_fov);
 
 /*
@@ -19,6 +19,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #pragma once
 
+#include <algorithm>
 #include <iostream>
 #include <string>
 #include <functional>
@@ -68,3 +69,22 @@ class DummyStreamBuffer : public std::streambuf {
 		return n;
 	}
 };
+
+// Reads from memory owned by someone else, without copying it
+class MemoryStreamBuffer : public std::streambuf {
+public:
+	MemoryStreamBuffer(const char *data, size_t size) {
+		char *begin = const_cast<char *>(data);
+		setg(begin, begin, begin + size);
+	}
+
+	// Number of bytes read so far
+	size_t tell() const {
+		return gptr() - eback();
+	}
+
+	// Skips bytes that were read directly from the memory
+	void skip(size_t count) {
+		setg(eback(), gptr() + std::min<size_t>(count, egptr() - gptr()), egptr());
+	}
+};